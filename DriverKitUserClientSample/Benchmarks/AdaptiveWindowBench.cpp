@@ -0,0 +1,253 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures throughput and latency of pipelined async requests against the in-flight window, for fixed windows and for NullDriverAdaptiveWindow.
+The device is simulated in virtual time: it works on a fixed number of requests at once, each for a fixed time, and queues the rest. Runs are
+deterministic and take no real time, and the knee where more requests in flight only add queueing is known, so the adaptive window can be checked
+against it. It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++20 -O2 AdaptiveWindowBench.cpp -o AdaptiveWindowBench && ./AdaptiveWindowBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <queue>
+#include <vector>
+
+#include "../CppUserClient/NullDriverCoroutine.h"
+#include "NullDriverCheck.h"
+
+// The device: 16 requests at a time, 200 us each, plus 20 us each way for the notification. That's 80000 requests a second at best,
+// reached with 16 in flight and a latency of 240 us. Every request beyond 16 in flight only waits.
+static const uint32_t kDeviceParallelism = 16;
+static const uint64_t kServiceNanoseconds = 200000;
+static const uint64_t kTransitNanoseconds = 20000;
+
+static const uint32_t kCoroutineCount = 512;
+static const uint32_t kRequestsPerCoroutine = 100;
+
+// The IOReturn value the simulated device returns when nothing is left to complete.
+static const int32_t kReturnTimeout = (int32_t)0xE00002D6;
+
+// MARK: Simulated Device
+class SimulatedDeviceTransport : public NullDriverCoroutineTransport
+{
+public:
+    SimulatedDeviceTransport()
+    {
+        for (uint32_t unit = 0; unit < kDeviceParallelism; ++unit)
+        {
+            unitsFreeAt.push(0);
+        }
+    }
+
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        output[0] = input[0] + 1;
+        output[1] = input[1] + 10;
+        return 0;
+    }
+
+    // Requests start in the order they arrive, on whichever unit frees up first.
+    int32_t SubmitTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t delayNanoseconds) override
+    {
+        const uint64_t arrival = now + kTransitNanoseconds;
+        const uint64_t unitFree = unitsFreeAt.top();
+        const uint64_t start = (unitFree > arrival) ? unitFree : arrival;
+        const uint64_t finish = start + kServiceNanoseconds + delayNanoseconds;
+
+        unitsFreeAt.pop();
+        unitsFreeAt.push(finish);
+
+        Scheduled scheduled = { finish + kTransitNanoseconds, tag, input[0] + 1, input[1] + 10 };
+        scheduledResults.push(scheduled);
+        return 0;
+    }
+
+    // Jumps to the next result instead of sleeping, and delivers every result due by then.
+    int32_t WaitForCompletions(NullDriverCoroutineClient* client) override
+    {
+        if (scheduledResults.empty())
+        {
+            return kReturnTimeout;
+        }
+
+        if (scheduledResults.top().due > now)
+        {
+            now = scheduledResults.top().due;
+        }
+
+        while (!scheduledResults.empty() && (scheduledResults.top().due <= now))
+        {
+            Scheduled scheduled = scheduledResults.top();
+            scheduledResults.pop();
+            client->Complete(scheduled.tag, 0, scheduled.foo, scheduled.bar);
+        }
+
+        return 0;
+    }
+
+    uint64_t NowNanoseconds(void) override
+    {
+        return now;
+    }
+
+private:
+    typedef struct
+    {
+        uint64_t due;
+        uint64_t tag;
+        uint64_t foo;
+        uint64_t bar;
+    } Scheduled;
+
+    struct LaterDue
+    {
+        bool operator()(const Scheduled& first, const Scheduled& second) const { return first.due > second.due; }
+    };
+
+    uint64_t now = 0;
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> unitsFreeAt;
+    std::priority_queue<Scheduled, std::vector<Scheduled>, LaterDue> scheduledResults;
+};
+
+typedef struct
+{
+    uint64_t completed;
+    uint64_t mismatches;
+    uint64_t errors;
+} TaskCounts;
+
+static NullDriverTask RequestLoop(NullDriverCoroutineClient* client, uint64_t id, uint32_t requestCount, TaskCounts* counts)
+{
+    for (uint32_t request = 0; request < requestCount; ++request)
+    {
+        const uint64_t foo = (id << 32) | request;
+
+        NullDriverCoroutineResult result = co_await client->AsyncRequest(foo, 70000);
+        if (result.status != 0)
+        {
+            ++counts->errors;
+            continue;
+        }
+
+        if ((result.foo != foo + 1) || (result.bar != 70010))
+        {
+            ++counts->mismatches;
+        }
+        ++counts->completed;
+    }
+}
+
+typedef struct
+{
+    double throughput;
+    uint64_t p50Nanoseconds;
+    uint64_t p99Nanoseconds;
+    size_t maxInFlight;
+} RunResult;
+
+// Always more coroutines than the largest window, so the window, not the number of callers, sets how many requests are in flight.
+static RunResult RunWithWindow(NullDriverAdaptiveWindow* window)
+{
+    SimulatedDeviceTransport transport;
+    NullDriverCoroutineClient client(&transport);
+    TaskCounts counts = {};
+    RunResult result = {};
+
+    client.SetWindow(window);
+    for (uint32_t id = 0; id < kCoroutineCount; ++id)
+    {
+        client.Spawn(RequestLoop(&client, id, kRequestsPerCoroutine, &counts));
+    }
+
+    int32_t status = client.Run();
+
+    Check(status == 0, "Run failed with 0x%08x", status);
+    Check(counts.completed == kCoroutineCount * kRequestsPerCoroutine, "%llu of %u requests completed", (unsigned long long)counts.completed, kCoroutineCount * kRequestsPerCoroutine);
+    Check((counts.mismatches == 0) && (counts.errors == 0), "%llu mismatches and %llu errors", (unsigned long long)counts.mismatches, (unsigned long long)counts.errors);
+    Check(client.MaxInFlightCount() <= window->maxLimit, "%zu requests were in flight with a window of at most %u", client.MaxInFlightCount(), window->maxLimit);
+
+    result.throughput = (double)counts.completed * 1e9 / transport.NowNanoseconds();
+    result.p50Nanoseconds = NullDriverStatsPercentile(client.LatencyStats(), 0.50);
+    result.p99Nanoseconds = NullDriverStatsPercentile(client.LatencyStats(), 0.99);
+    result.maxInFlight = client.MaxInFlightCount();
+    return result;
+}
+
+// MARK: Controller
+static void CheckController(void)
+{
+    NullDriverAdaptiveWindow window;
+
+    // Latency that doesn't depend on the window means nothing queues, so the window opens all the way.
+    NullDriverAdaptiveWindowInit(&window, 1, 1000, 25);
+    Check(window.maxLimit == kNullDriverAdaptiveWindowMax, "the window isn't capped at the dext's limit of %u", kNullDriverAdaptiveWindowMax);
+    for (uint32_t completion = 0; completion < 100000; ++completion)
+    {
+        NullDriverAdaptiveWindowRecord(&window, 1000);
+    }
+    Check(window.limit >= window.maxLimit / 2, "the window only reached %u with constant latency", window.limit);
+
+    // Latency proportional to the window beyond 8 is a device that works on 8 at a time, so the window settles near 8.
+    NullDriverAdaptiveWindowInit(&window, 1, 512, 25);
+    for (uint32_t completion = 0; completion < 100000; ++completion)
+    {
+        const uint64_t latency = (window.limit <= 8) ? 1000 : 1000 * window.limit / 8;
+        NullDriverAdaptiveWindowRecord(&window, latency);
+    }
+    Check((window.limit >= 4) && (window.limit <= 16), "the window settled at %u instead of near 8", window.limit);
+    Check(window.decreases > 0, "the window never shrank");
+
+    // A fixed window never moves.
+    NullDriverAdaptiveWindowInit(&window, 32, 32, 25);
+    for (uint32_t completion = 0; completion < 10000; ++completion)
+    {
+        NullDriverAdaptiveWindowRecord(&window, completion);
+    }
+    Check(window.limit == 32, "a fixed window moved to %u", window.limit);
+}
+
+// MARK: Sweep
+int main(int argc, const char* argv[])
+{
+    const uint32_t windows[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512 };
+    RunResult best = {};
+    RunResult unbounded = {};
+
+    CheckController();
+
+    printf("Device: %u at a time, %llu us each, %llu us each way. %u coroutines, %u requests each.\n", kDeviceParallelism, (unsigned long long)(kServiceNanoseconds / 1000), (unsigned long long)(kTransitNanoseconds / 1000), kCoroutineCount, kRequestsPerCoroutine);
+    printf("%10s %16s %12s %12s %12s\n", "window", "completions/s", "p50 us", "p99 us", "max flight");
+
+    for (uint32_t size : windows)
+    {
+        NullDriverAdaptiveWindow window;
+        NullDriverAdaptiveWindowInit(&window, size, size, 25);
+
+        RunResult result = RunWithWindow(&window);
+        printf("%10u %16.0f %12.0f %12.0f %12zu\n", size, result.throughput, result.p50Nanoseconds / 1000.0, result.p99Nanoseconds / 1000.0, result.maxInFlight);
+
+        if (result.throughput > best.throughput)
+        {
+            best = result;
+        }
+        unbounded = result;
+    }
+
+    NullDriverAdaptiveWindow adaptive;
+    NullDriverAdaptiveWindowInit(&adaptive, 1, kNullDriverAdaptiveWindowMax, 25);
+
+    RunResult result = RunWithWindow(&adaptive);
+    printf("%10s %16.0f %12.0f %12.0f %12zu\n", "adaptive", result.throughput, result.p50Nanoseconds / 1000.0, result.p99Nanoseconds / 1000.0, result.maxInFlight);
+    printf("Adaptive window ended at %u after %llu epochs, %llu increases and %llu decreases.\n", adaptive.limit, (unsigned long long)adaptive.epochs, (unsigned long long)adaptive.increases, (unsigned long long)adaptive.decreases);
+
+    Check(result.throughput >= 0.85 * best.throughput, "the adaptive window reached %.0f of the best fixed window's %.0f completions/s", result.throughput, best.throughput);
+    Check(result.p50Nanoseconds * 4 <= unbounded.p50Nanoseconds, "the adaptive window's median latency of %llu ns is close to the unbounded window's %llu ns", (unsigned long long)result.p50Nanoseconds, (unsigned long long)unbounded.p50Nanoseconds);
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,340 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks the reply buffer pool under the dext's call pattern and under multi-threaded churn, and compares its cost with malloc and free.
+It exits with a failure status if any check fails, so it can be run as a test on any platform.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread BufferPoolBench.cpp -o BufferPoolBench && ./BufferPoolBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../Shared/NullDriverBufferPool.h"
+#include "NullDriverCheck.h"
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A small xorshift generator, so runs are repeatable on every platform.
+static uint64_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Stands in for an OSData: the length it was created with, and an owner that has to be zero whenever the buffer is in the pool.
+typedef struct
+{
+    uint32_t owner;
+    uint32_t length;
+    uint8_t bytes[];
+} Buffer;
+
+static std::atomic<uint64_t> globalLiveBuffers(0);
+
+static Buffer* CreateBuffer(uint32_t length)
+{
+    Buffer* buffer = (Buffer*)malloc(sizeof(Buffer) + length);
+    buffer->owner = 0;
+    buffer->length = length;
+    globalLiveBuffers.fetch_add(1, std::memory_order_relaxed);
+    return buffer;
+}
+
+static void FreeBuffer(Buffer* buffer)
+{
+    globalLiveBuffers.fetch_sub(1, std::memory_order_relaxed);
+    free(buffer);
+}
+
+// MARK: Classes
+static void CheckClasses(void)
+{
+    Check(NullDriverBufferPoolClassForSize(1) == 0, "1 byte isn't in the smallest class");
+    Check(NullDriverBufferPoolClassForSize(16) == 0, "16 bytes aren't in the smallest class");
+    Check(NullDriverBufferPoolClassForSize(17) == 1, "17 bytes aren't in the middle class");
+    Check(NullDriverBufferPoolClassForSize(4096) == kNullDriverBufferPoolClassCount - 1, "a page isn't in the largest class");
+    Check(NullDriverBufferPoolClassForSize(4097) == kNullDriverBufferPoolClassCount, "more than a page has a class");
+}
+
+// MARK: Steady State
+// The dext's pattern: each call takes a buffer of the reply's length, and the previous call's buffer goes back first.
+// Replies of a few repeating lengths must stop allocating once each length has a buffer.
+static void CheckSteadyState(void)
+{
+    static NullDriverBufferPool pool;
+    const uint32_t lengths[] = { 16, 16, 16, 160, 16, 4096, 16 };
+    const uint32_t callCount = 1000000;
+    Buffer* lent = nullptr;
+    uint32_t lentClass = 0;
+    uint64_t allocatedAfterWarmup = 0;
+
+    memset(&pool, 0, sizeof(pool));
+
+    for (uint32_t call = 0; call < callCount; ++call)
+    {
+        const uint32_t length = lengths[call % (sizeof(lengths) / sizeof(lengths[0]))];
+        const uint32_t sizeClass = NullDriverBufferPoolClassForSize(length);
+
+        if ((lent != nullptr) && !NullDriverBufferPoolRelease(&pool, lentClass, lent))
+        {
+            FreeBuffer(lent);
+        }
+
+        Buffer* buffer = (Buffer*)NullDriverBufferPoolAcquire(&pool, sizeClass);
+        if ((buffer != nullptr) && (buffer->length != length))
+        {
+            FreeBuffer(buffer);
+            buffer = nullptr;
+            NullDriverBufferPoolCountMismatch(&pool);
+        }
+        if (buffer == nullptr)
+        {
+            buffer = CreateBuffer(length);
+            NullDriverBufferPoolCountAllocation(&pool);
+        }
+
+        memset(buffer->bytes, (int)call, length);
+        lent = buffer;
+        lentClass = sizeClass;
+
+        if (call == 1000)
+        {
+            allocatedAfterWarmup = pool.counters.allocated;
+        }
+    }
+
+    NullDriverBufferPoolCounters counters = {};
+    NullDriverBufferPoolCountersSnapshot(&pool, &counters);
+
+    Check(counters.allocated == allocatedAfterWarmup, "%llu allocations after warmup", (unsigned long long)(counters.allocated - allocatedAfterWarmup));
+    Check(counters.reused + counters.allocated == callCount, "counted %llu acquires for %u calls", (unsigned long long)(counters.reused + counters.allocated), callCount);
+    printf("Steady state: %u calls, %llu allocated, %llu reused, %llu discarded.\n", callCount, (unsigned long long)counters.allocated, (unsigned long long)counters.reused, (unsigned long long)counters.discarded);
+
+    FreeBuffer(lent);
+    for (Buffer* buffer = (Buffer*)NullDriverBufferPoolDrain(&pool); buffer != nullptr; buffer = (Buffer*)NullDriverBufferPoolDrain(&pool))
+    {
+        FreeBuffer(buffer);
+    }
+    Check(globalLiveBuffers.load() == 0, "%llu buffers leaked", (unsigned long long)globalLiveBuffers.load());
+}
+
+// MARK: Mismatched Lengths
+// Replies that keep changing length within one class, like option 10's doubling batches, miss the pool every time.
+// Every acquire still counts once, as reused or allocated, and every buffer that isn't in the pool at the end was counted as discarded.
+static void CheckMismatchedLengths(void)
+{
+    static NullDriverBufferPool pool;
+    const uint32_t lengths[] = { 32, 64, 128, 256 };
+    const uint32_t callCount = 1000;
+    Buffer* lent = nullptr;
+    uint32_t lentClass = 0;
+    uint64_t drained = 0;
+
+    memset(&pool, 0, sizeof(pool));
+
+    for (uint32_t call = 0; call < callCount; ++call)
+    {
+        const uint32_t length = lengths[call % (sizeof(lengths) / sizeof(lengths[0]))];
+        const uint32_t sizeClass = NullDriverBufferPoolClassForSize(length);
+
+        if ((lent != nullptr) && !NullDriverBufferPoolRelease(&pool, lentClass, lent))
+        {
+            FreeBuffer(lent);
+        }
+
+        Buffer* buffer = (Buffer*)NullDriverBufferPoolAcquire(&pool, sizeClass);
+        if ((buffer != nullptr) && (buffer->length != length))
+        {
+            FreeBuffer(buffer);
+            buffer = nullptr;
+            NullDriverBufferPoolCountMismatch(&pool);
+        }
+        if (buffer == nullptr)
+        {
+            buffer = CreateBuffer(length);
+            NullDriverBufferPoolCountAllocation(&pool);
+        }
+
+        lent = buffer;
+        lentClass = sizeClass;
+    }
+
+    NullDriverBufferPoolCounters counters = {};
+    NullDriverBufferPoolCountersSnapshot(&pool, &counters);
+
+    FreeBuffer(lent);
+    for (Buffer* buffer = (Buffer*)NullDriverBufferPoolDrain(&pool); buffer != nullptr; buffer = (Buffer*)NullDriverBufferPoolDrain(&pool))
+    {
+        FreeBuffer(buffer);
+        ++drained;
+    }
+
+    Check(counters.reused == 0, "%llu replies of a different length were counted as reused", (unsigned long long)counters.reused);
+    Check(counters.allocated == callCount, "%llu allocations for %u replies that all changed length", (unsigned long long)counters.allocated, callCount);
+    Check(counters.allocated - counters.discarded == drained + 1, "%llu allocated and %llu discarded, but %llu left", (unsigned long long)counters.allocated, (unsigned long long)counters.discarded, (unsigned long long)(drained + 1));
+    Check(globalLiveBuffers.load() == 0, "%llu buffers leaked", (unsigned long long)globalLiveBuffers.load());
+}
+
+// MARK: Churn
+// Threads hold several buffers of random classes at once and release them in random order.
+// A buffer handed to two threads at once shows up as a failed claim of its owner, or as another thread's bytes.
+static void CheckChurn(void)
+{
+    static NullDriverBufferPool pool;
+    const uint32_t threadCount = 4;
+    const uint32_t operationsPerThread = 500000;
+    const uint32_t heldMax = 6;
+    std::atomic<uint32_t> doubleClaims(0);
+    std::atomic<uint32_t> corruptions(0);
+    std::thread threads[threadCount];
+
+    memset(&pool, 0, sizeof(pool));
+
+    for (uint32_t thread = 0; thread < threadCount; ++thread)
+    {
+        threads[thread] = std::thread([&, thread] {
+            const uint32_t id = thread + 1;
+            Buffer* held[heldMax] = {};
+            uint32_t heldClasses[heldMax] = {};
+            uint64_t random = 0x9E3779B97F4A7C15ULL * id;
+
+            for (uint32_t operation = 0; operation < operationsPerThread; ++operation)
+            {
+                uint32_t slot = NextRandom(&random) % heldMax;
+
+                if (held[slot] != nullptr)
+                {
+                    Buffer* buffer = held[slot];
+                    for (uint32_t index = 0; index < buffer->length; ++index)
+                    {
+                        if (buffer->bytes[index] != (uint8_t)id)
+                        {
+                            corruptions.fetch_add(1, std::memory_order_relaxed);
+                            break;
+                        }
+                    }
+
+                    __atomic_store_n(&buffer->owner, 0, __ATOMIC_RELAXED);
+                    if (!NullDriverBufferPoolRelease(&pool, heldClasses[slot], buffer))
+                    {
+                        FreeBuffer(buffer);
+                    }
+                    held[slot] = nullptr;
+                    continue;
+                }
+
+                uint32_t sizeClass = NextRandom(&random) % kNullDriverBufferPoolClassCount;
+                Buffer* buffer = (Buffer*)NullDriverBufferPoolAcquire(&pool, sizeClass);
+                if (buffer == nullptr)
+                {
+                    buffer = CreateBuffer(kNullDriverBufferPoolClassSizes[sizeClass]);
+                    NullDriverBufferPoolCountAllocation(&pool);
+                }
+
+                uint32_t expected = 0;
+                if (!__atomic_compare_exchange_n(&buffer->owner, &expected, id, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                {
+                    doubleClaims.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                memset(buffer->bytes, (int)id, buffer->length);
+                held[slot] = buffer;
+                heldClasses[slot] = sizeClass;
+            }
+
+            for (uint32_t slot = 0; slot < heldMax; ++slot)
+            {
+                if (held[slot] == nullptr)
+                {
+                    continue;
+                }
+
+                __atomic_store_n(&held[slot]->owner, 0, __ATOMIC_RELAXED);
+                if (!NullDriverBufferPoolRelease(&pool, heldClasses[slot], held[slot]))
+                {
+                    FreeBuffer(held[slot]);
+                }
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    NullDriverBufferPoolCounters counters = {};
+    NullDriverBufferPoolCountersSnapshot(&pool, &counters);
+
+    uint64_t drained = 0;
+    for (Buffer* buffer = (Buffer*)NullDriverBufferPoolDrain(&pool); buffer != nullptr; buffer = (Buffer*)NullDriverBufferPoolDrain(&pool))
+    {
+        FreeBuffer(buffer);
+        ++drained;
+    }
+
+    Check(doubleClaims.load() == 0, "%u buffers were handed out twice", doubleClaims.load());
+    Check(corruptions.load() == 0, "%u buffers were written by another thread", corruptions.load());
+    Check(counters.allocated - counters.discarded == drained, "%llu allocated and %llu discarded, but %llu drained", (unsigned long long)counters.allocated, (unsigned long long)counters.discarded, (unsigned long long)drained);
+    Check(drained <= kNullDriverBufferPoolClassCount * kNullDriverBufferPoolSlotCount, "drained %llu buffers from a pool that holds %u", (unsigned long long)drained, kNullDriverBufferPoolClassCount * kNullDriverBufferPoolSlotCount);
+    Check(globalLiveBuffers.load() == 0, "%llu buffers leaked", (unsigned long long)globalLiveBuffers.load());
+    printf("Churn: %u threads, %llu allocated, %llu reused, %llu discarded.\n", threadCount, (unsigned long long)counters.allocated, (unsigned long long)counters.reused, (unsigned long long)counters.discarded);
+}
+
+// MARK: Cost
+static void MeasureCost(void)
+{
+    static NullDriverBufferPool pool;
+    const uint32_t callCount = 10000000;
+    void* volatile sink = nullptr;
+
+    memset(&pool, 0, sizeof(pool));
+    NullDriverBufferPoolRelease(&pool, 0, malloc(16));
+
+    uint64_t startTime = NowNanoseconds();
+    for (uint32_t call = 0; call < callCount; ++call)
+    {
+        void* buffer = NullDriverBufferPoolAcquire(&pool, 0);
+        sink = buffer;
+        NullDriverBufferPoolRelease(&pool, 0, buffer);
+    }
+    uint64_t pooled = NowNanoseconds() - startTime;
+
+    startTime = NowNanoseconds();
+    for (uint32_t call = 0; call < callCount; ++call)
+    {
+        void* buffer = malloc(16);
+        sink = buffer;
+        free(buffer);
+    }
+    uint64_t allocated = NowNanoseconds() - startTime;
+
+    free(NullDriverBufferPoolDrain(&pool));
+    (void)sink;
+
+    printf("16-byte buffer: pool %.1f ns, malloc and free %.1f ns.\n", (double)pooled / callCount, (double)allocated / callCount);
+}
+
+int main(int argc, const char* argv[])
+{
+    CheckClasses();
+    CheckSteadyState();
+    CheckMismatchedLengths();
+    CheckChurn();
+    MeasureCost();
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,92 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Runs CppUserClient's bench mode against an in-process stand-in of NullDriver's handlers, so the workload loop and reports can be used without DriverKit.
+"replay TRACE" plays back a trace recorded with --record, the same as "CppUserClient replay" does against the dext.
+It exits with a failure status if any call fails or returns the wrong data, or if a replayed call returns something other than what was recorded.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread ClientBenchLoopback.cpp -o ClientBenchLoopback && ./ClientBenchLoopback --workload batch --payload 4096 --threads 2
+    ./ClientBenchLoopback --workload async --record async.trace && ./ClientBenchLoopback replay async.trace --speed 2 --threads 4
+    ./ClientBenchLoopback --workload async --threads 16 --iterations 2000 --device exponential,service=1ms,channels=4
+*/
+
+#include "../CppUserClient/NullDriverReplay.h"
+#include "NullDriverLoopbackTransport.h"
+
+static int RunReplay(int argumentCount, const char* arguments[])
+{
+    NullDriverReplayOptions options = {};
+    NullDriverReplayTrace trace = {};
+    NullDriverReplayResult result = {};
+    const char* path = nullptr;
+
+    if (!NullDriverReplayParseArguments(argumentCount, arguments, &path, &options))
+    {
+        NullDriverReplayPrintUsage("ClientBenchLoopback replay");
+        return EXIT_FAILURE;
+    }
+
+    if (!NullDriverReplayRead(path, &trace))
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool connected = NullDriverReplayRun(&options, &trace, CreateLoopbackTransport, nullptr, &result);
+    NullDriverReplayReport(stdout, &options, &result);
+
+    bool passed = connected && (result.resultMismatches == 0) && (result.sizeMismatches == 0) && (result.calls == trace.records.size());
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, const char* argv[])
+{
+    NullDriverBenchOptions options = {};
+
+    if ((argc > 1) && (strcmp(argv[1], "replay") == 0))
+    {
+        return RunReplay(argc - 2, argv + 2);
+    }
+
+    if (!NullDriverBenchParseArguments(argc - 1, argv + 1, &options))
+    {
+        NullDriverBenchPrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The dext's device belongs to the service, so bench mode puts back the configuration it replaced once the run is done, and so does this.
+    NullDriverDeviceConfig previousDevice = {};
+    if (options.configureDevice && (ConfigureLoopbackDevice(&options.device, &previousDevice) != 0))
+    {
+        fprintf(stderr, "The simulated device configuration is not valid.\n");
+        return EXIT_FAILURE;
+    }
+
+    NullDriverBenchResult* result = new NullDriverBenchResult();
+    NullDriverReplayRecorder recorder;
+    NullDriverReplayRecordingContext recording = { CreateLoopbackTransport, nullptr, &recorder };
+    bool connected = false;
+
+    if (options.recordPath != nullptr)
+    {
+        connected = NullDriverBenchRun(&options, NullDriverReplayRecordingFactory, &recording, result);
+        connected = recorder.Save(options.recordPath) && connected;
+    }
+    else
+    {
+        connected = NullDriverBenchRun(&options, CreateLoopbackTransport, nullptr, result);
+    }
+    NullDriverBenchReport(stdout, &options, result);
+
+    if (options.configureDevice)
+    {
+        NullDriverDeviceConfig replacedDevice = {};
+        ConfigureLoopbackDevice(&previousDevice, &replacedDevice);
+    }
+
+    bool passed = connected && (result->errors == 0) && (result->mismatches == 0) && (result->calls == options.iterations * options.threadCount);
+    delete result;
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,279 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks CppUserClient/NullDriverCoalescer.h against a mock batch call, without DriverKit, and measures what it buys.
+The checks cover a window of 0, batches sent once full, batches sent once the window ends, failures reaching every request of a batch,
+and results reaching the thread that asked for them. Then threads and windows are swept, with the mock charging a fixed cost per call
+that stands in for the crossing into the dext, plus a small cost per DataStruct. Each row reports the throughput, the batching factor and the
+latency the coalescer added, next to calling once per request.
+Handing each result back costs a wakeup of the waiting thread, so coalescing only pays once a call costs clearly more than a wakeup.
+A cheap call and an expensive one are both swept to show where that is on the machine running it.
+It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread CoalescerBench.cpp -o CoalescerBench && ./CoalescerBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../CppUserClient/NullDriverCoalescer.h"
+#include "../Shared/NullDriverTransform.h"
+#include "NullDriverCheck.h"
+
+// The cost of each DataStruct in a call, in the sweep.
+static const uint64_t kStructNanoseconds = 10;
+
+// Requests made across all threads in each row of the sweep.
+static const uint64_t kSweepRequests = 20000;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Spin(uint64_t nanoseconds)
+{
+    const uint64_t until = NowNanoseconds() + nanoseconds;
+    while (NowNanoseconds() < until)
+    {
+    }
+}
+
+// Stands in for a connection to the dext.
+typedef struct
+{
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> structs;
+    uint64_t callNanoseconds;
+    uint64_t structNanoseconds;
+    int32_t result; // Every call fails with this, unless it's 0.
+} MockConnection;
+
+static int32_t MockBatchCall(void* context, const DataStruct* input, DataStruct* output, uint32_t count)
+{
+    MockConnection* connection = (MockConnection*)context;
+
+    connection->calls.fetch_add(1, std::memory_order_relaxed);
+    connection->structs.fetch_add(count, std::memory_order_relaxed);
+    Spin(connection->callNanoseconds + count * connection->structNanoseconds);
+
+    if (connection->result != 0)
+    {
+        return connection->result;
+    }
+
+    NullDriverTransformDataStructs(input, output, count);
+    return 0;
+}
+
+// The requests one thread made, and how many came back wrong.
+typedef struct
+{
+    uint64_t errors;
+    uint64_t mismatches;
+    uint64_t minAddedNanoseconds;
+    uint64_t maxBatchCount;
+} ThreadCounts;
+
+// Each thread sends its own number in "bar", so a result handed to the wrong thread is caught.
+// A null "coalescer" calls the mock once per request instead.
+static void RunRequests(NullDriverCoalescer* coalescer, MockConnection* connection, uint32_t thread, uint64_t requestCount, ThreadCounts* counts)
+{
+    counts->minAddedNanoseconds = UINT64_MAX;
+
+    for (uint64_t request = 0; request < requestCount; ++request)
+    {
+        const DataStruct input = { .foo = request, .bar = 1000000ULL * thread };
+        DataStruct output = { .foo = UINT64_MAX, .bar = UINT64_MAX };
+        NullDriverCoalescerOutcome outcome = {};
+        int32_t ret = 0;
+
+        if (coalescer != nullptr)
+        {
+            ret = coalescer->Submit(MockBatchCall, connection, &input, &output, &outcome);
+        }
+        else
+        {
+            ret = MockBatchCall(connection, &input, &output, 1);
+        }
+
+        if (ret != 0)
+        {
+            counts->errors += 1;
+            counts->mismatches += ((output.foo != UINT64_MAX) || (output.bar != UINT64_MAX)) ? 1 : 0;
+            continue;
+        }
+
+        counts->mismatches += ((output.foo != input.foo + 1) || (output.bar != input.bar + 10)) ? 1 : 0;
+        counts->minAddedNanoseconds = (outcome.addedNanoseconds < counts->minAddedNanoseconds) ? outcome.addedNanoseconds : counts->minAddedNanoseconds;
+        counts->maxBatchCount = (outcome.batchCount > counts->maxBatchCount) ? outcome.batchCount : counts->maxBatchCount;
+    }
+}
+
+// Runs "requestCount" requests on each of "threadCount" threads, all started together, and adds up their counts.
+static uint64_t RunThreads(NullDriverCoalescer* coalescer, MockConnection* connection, uint32_t threadCount, uint64_t requestCount, ThreadCounts* total)
+{
+    std::vector<ThreadCounts> counts(threadCount);
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> ready(0);
+
+    *total = {};
+    total->minAddedNanoseconds = UINT64_MAX;
+
+    const uint64_t startTime = NowNanoseconds();
+    for (uint32_t thread = 0; thread < threadCount; ++thread)
+    {
+        counts[thread] = {};
+        threads.emplace_back([&, thread]() {
+            ready.fetch_add(1, std::memory_order_acq_rel);
+            while (ready.load(std::memory_order_acquire) < threadCount)
+            {
+                std::this_thread::yield();
+            }
+            RunRequests(coalescer, connection, thread, requestCount, &counts[thread]);
+        });
+    }
+
+    for (uint32_t thread = 0; thread < threadCount; ++thread)
+    {
+        threads[thread].join();
+        total->errors += counts[thread].errors;
+        total->mismatches += counts[thread].mismatches;
+        total->minAddedNanoseconds = (counts[thread].minAddedNanoseconds < total->minAddedNanoseconds) ? counts[thread].minAddedNanoseconds : total->minAddedNanoseconds;
+        total->maxBatchCount = (counts[thread].maxBatchCount > total->maxBatchCount) ? counts[thread].maxBatchCount : total->maxBatchCount;
+    }
+
+    return NowNanoseconds() - startTime;
+}
+
+// MARK: Checks
+static void CheckCoalescer()
+{
+    MockConnection connection = {};
+    NullDriverCoalescerStats stats = {};
+    ThreadCounts counts = {};
+
+    // A window of 0 sends every request by itself.
+    {
+        const NullDriverCoalescerConfig config = { .windowNanoseconds = 0, .maxCount = 64 };
+        NullDriverCoalescer coalescer(&config);
+
+        RunThreads(&coalescer, &connection, 1, 1000, &counts);
+        coalescer.CopyStats(&stats);
+        Check((counts.errors == 0) && (counts.mismatches == 0), "a window of 0 returned %llu errors and %llu wrong results", (unsigned long long)counts.errors, (unsigned long long)counts.mismatches);
+        Check((stats.requests == 1000) && (stats.batches == 1000) && (stats.largestBatch == 1), "a window of 0 sent %llu batches for %llu requests", (unsigned long long)stats.batches, (unsigned long long)stats.requests);
+        Check((connection.calls.load() == 1000) && (connection.structs.load() == 1000), "a window of 0 made %llu calls", (unsigned long long)connection.calls.load());
+    }
+
+    // Four threads that each wait for their last result before the next request fill every batch of four, long before a window of a minute ends.
+    {
+        const NullDriverCoalescerConfig config = { .windowNanoseconds = 60000000000ULL, .maxCount = 4 };
+        NullDriverCoalescer coalescer(&config);
+
+        const uint64_t elapsed = RunThreads(&coalescer, &connection, 4, 500, &counts);
+        coalescer.CopyStats(&stats);
+        Check((counts.errors == 0) && (counts.mismatches == 0), "full batches returned %llu errors and %llu wrong results", (unsigned long long)counts.errors, (unsigned long long)counts.mismatches);
+        Check((stats.batches == 500) && (stats.fullBatches == 500) && (stats.largestBatch == 4), "2000 requests in batches of 4 took %llu batches, %llu of them full",
+              (unsigned long long)stats.batches, (unsigned long long)stats.fullBatches);
+        Check(elapsed < 30000000000ULL, "full batches waited for the window");
+        Check(NullDriverCoalescerStatsBatchingFactor(&stats) == 4.0, "the batching factor of full batches of 4 is %.2f", NullDriverCoalescerStatsBatchingFactor(&stats));
+    }
+
+    // One thread alone waits out the whole window every time, and that wait is reported as added latency.
+    {
+        const NullDriverCoalescerConfig config = { .windowNanoseconds = 2000000, .maxCount = 8 };
+        NullDriverCoalescer coalescer(&config);
+
+        RunThreads(&coalescer, &connection, 1, 20, &counts);
+        coalescer.CopyStats(&stats);
+        Check((stats.batches == 20) && (stats.fullBatches == 0), "a thread alone sent %llu batches, %llu of them full", (unsigned long long)stats.batches, (unsigned long long)stats.fullBatches);
+        Check(counts.minAddedNanoseconds >= 2000000, "a request was sent %llu ns after it arrived, before its 2 ms window ended", (unsigned long long)counts.minAddedNanoseconds);
+        Check(NullDriverCoalescerStatsMeanAddedNanoseconds(&stats) >= 2000000, "the mean added latency is below the window");
+    }
+
+    // A count of 0 is taken as 1, so nothing waits even with a long window.
+    {
+        const NullDriverCoalescerConfig config = { .windowNanoseconds = 60000000000ULL, .maxCount = 0 };
+        NullDriverCoalescer coalescer(&config);
+
+        const uint64_t elapsed = RunThreads(&coalescer, &connection, 2, 100, &counts);
+        Check((counts.maxBatchCount == 1) && (elapsed < 30000000000ULL), "a count of 0 batched or waited");
+    }
+
+    // A failed call fails every request in its batch, and leaves their outputs alone.
+    {
+        const NullDriverCoalescerConfig config = { .windowNanoseconds = 60000000000ULL, .maxCount = 4 };
+        NullDriverCoalescer coalescer(&config);
+
+        connection.result = (int32_t)0xe00002c2;
+        RunThreads(&coalescer, &connection, 4, 50, &counts);
+        coalescer.CopyStats(&stats);
+        Check((counts.errors == 200) && (stats.errors == 200), "a failing call reached %llu of 200 requests", (unsigned long long)counts.errors);
+        Check(counts.mismatches == 0, "%llu failed requests had their outputs changed", (unsigned long long)counts.mismatches);
+        connection.result = 0;
+    }
+
+    // Many threads with a short window: whatever the batches turn out to be, every thread gets its own results.
+    {
+        const NullDriverCoalescerConfig config = { .windowNanoseconds = 20000, .maxCount = 16 };
+        NullDriverCoalescer coalescer(&config);
+
+        RunThreads(&coalescer, &connection, 32, 200, &counts);
+        coalescer.CopyStats(&stats);
+        Check((counts.errors == 0) && (counts.mismatches == 0), "32 threads got %llu errors and %llu wrong results", (unsigned long long)counts.errors, (unsigned long long)counts.mismatches);
+        Check((stats.requests == 6400) && (stats.largestBatch <= 16), "32 threads made %llu requests, with a largest batch of %llu", (unsigned long long)stats.requests, (unsigned long long)stats.largestBatch);
+    }
+}
+
+// MARK: Sweep
+int main()
+{
+    const uint32_t threadCounts[] = { 1, 4, 16, 64 };
+    const uint64_t windows[] = { 0, 10000, 50000 };
+    const uint64_t callCosts[] = { 5000, 50000 };
+
+    CheckCoalescer();
+
+    for (uint64_t callNanoseconds : callCosts)
+    {
+        printf("Mock call cost %llu ns, plus %llu ns per DataStruct. Batches are sent once full, with a count as large as the thread count.\n",
+               (unsigned long long)callNanoseconds, (unsigned long long)kStructNanoseconds);
+        printf("%8s %12s %14s %10s %16s %16s\n", "threads", "window ns", "requests/s", "factor", "mean added ns", "max added ns");
+        for (uint32_t threadCount : threadCounts)
+        {
+            const uint64_t requestCount = kSweepRequests / threadCount;
+            MockConnection connection = {};
+            connection.callNanoseconds = callNanoseconds;
+            connection.structNanoseconds = kStructNanoseconds;
+            ThreadCounts counts = {};
+
+            // Without a coalescer, each request is its own call.
+            uint64_t elapsed = RunThreads(nullptr, &connection, threadCount, requestCount, &counts);
+            Check(counts.mismatches == 0, "%llu direct calls returned the wrong data", (unsigned long long)counts.mismatches);
+            printf("%8u %12s %14.0f %10.2f %16s %16s\n", threadCount, "direct", (double)(threadCount * requestCount) * 1000000000.0 / (double)elapsed, 1.0, "-", "-");
+
+            for (uint64_t window : windows)
+            {
+                const NullDriverCoalescerConfig config = { .windowNanoseconds = window, .maxCount = threadCount };
+                NullDriverCoalescer coalescer(&config);
+                NullDriverCoalescerStats stats = {};
+
+                elapsed = RunThreads(&coalescer, &connection, threadCount, requestCount, &counts);
+                coalescer.CopyStats(&stats);
+                Check((counts.errors == 0) && (counts.mismatches == 0), "%u threads with a %llu ns window got %llu errors and %llu wrong results", threadCount, (unsigned long long)window,
+                      (unsigned long long)counts.errors, (unsigned long long)counts.mismatches);
+
+                printf("%8u %12llu %14.0f %10.2f %16llu %16llu\n", threadCount, (unsigned long long)window, (double)stats.requests * 1000000000.0 / (double)elapsed,
+                       NullDriverCoalescerStatsBatchingFactor(&stats), (unsigned long long)NullDriverCoalescerStatsMeanAddedNanoseconds(&stats), (unsigned long long)stats.maxAddedNanoseconds);
+            }
+        }
+    }
+
+    return NullDriverCheckFinish();
+}
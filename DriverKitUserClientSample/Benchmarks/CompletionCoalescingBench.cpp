@@ -0,0 +1,240 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A loopback benchmark of coalesced async completions that runs without DriverKit.
+A producer thread stands in for SimulatedAsyncEvent and sends results to a consumer thread through a message queue, which stands in for the
+notification port and CFRunLoop. Each mode reports both notifications per second and results per second.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread CompletionCoalescingBench.cpp -o CompletionCoalescingBench && ./CompletionCoalescingBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../Shared/NullDriverCompletion.h"
+#include "../Shared/NullDriverRing.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kResultCount = 2000000;
+
+// Matches kSimulatedCompletionBatchSize in the dext: the most results collected per pass of a wakeup.
+static const uint32_t kWakeupBatchSize = 32;
+
+// Matches kNullDriverInFlightCapacity: the dext can't complete more requests than the client has outstanding.
+static const uint32_t kOutstandingLimit = 512;
+
+// The same type words the dext sends as the first argument.
+static const uint64_t kTaggedType = 3;
+static const uint64_t kCoalescedType = 4;
+static const uint64_t kAsyncCompletionRingType = 5;
+
+typedef enum
+{
+    Mode_Single = 0,
+    Mode_CoalescedArguments = 1,
+    Mode_CoalescedRing = 2,
+    NumberOfModes
+} Mode;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// One AsyncCompletion: a fixed-size argument array, as a mach notification carries.
+typedef struct
+{
+    uint64_t arguments[kNullDriverAsyncArgumentCountMax];
+    uint32_t argumentCount;
+} Notification;
+
+// Stands in for the notification port. Every notification is its own message and its own wakeup of the consumer.
+struct NotificationQueue
+{
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<Notification> messages;
+
+    void Send(const uint64_t* arguments, uint32_t argumentCount)
+    {
+        Notification notification = {};
+        memcpy(notification.arguments, arguments, argumentCount * sizeof(uint64_t));
+        notification.argumentCount = argumentCount;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            messages.push_back(notification);
+        }
+        ready.notify_one();
+    }
+
+    Notification Receive(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [this] { return !messages.empty(); });
+
+        Notification notification = messages.front();
+        messages.pop_front();
+        return notification;
+    }
+};
+
+// MARK: Producer
+// Sends results the way SimulatedAsyncEvent does in each mode, "kWakeupBatchSize" at a time.
+// It waits while "kOutstandingLimit" results are unreceived, since a real client only issues a request after an earlier one completes.
+static void Produce(Mode mode, NotificationQueue* queue, NullDriverRing* ring, const std::atomic<uint32_t>* received)
+{
+    NullDriverCompletionResult results[kWakeupBatchSize];
+    NullDriverRingEntry entries[kWakeupBatchSize];
+    uint64_t arguments[kNullDriverAsyncArgumentCountMax];
+    uint32_t head = 0;
+
+    for (uint32_t first = 0; first < kResultCount; first += kWakeupBatchSize)
+    {
+        while (first - received->load(std::memory_order_acquire) >= kOutstandingLimit)
+        {
+            std::this_thread::yield();
+        }
+
+        uint32_t count = (kResultCount - first < kWakeupBatchSize) ? kResultCount - first : kWakeupBatchSize;
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            results[index].tag = first + index;
+            results[index].foo = first + index + 1;
+            results[index].bar = 70010;
+        }
+
+        uint32_t sent = 0;
+        if (mode == Mode_Single)
+        {
+            for (; sent < count; ++sent)
+            {
+                uint64_t single[4] = { kTaggedType, results[sent].tag, results[sent].foo, results[sent].bar };
+                queue->Send(single, 4);
+            }
+        }
+
+        if ((mode == Mode_CoalescedRing) && (count > kNullDriverCoalescedResultsMax))
+        {
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                entries[index].tag = results[index].tag;
+                entries[index].status = 0;
+                entries[index].foo = results[index].foo;
+                entries[index].bar = results[index].bar;
+            }
+
+            // The client can fall behind, in which case the rest goes out in the arguments like it would from the dext.
+            sent = NullDriverRingProduce(ring, &head, entries, count);
+            if (sent != 0)
+            {
+                arguments[0] = kAsyncCompletionRingType;
+                arguments[1] = sent;
+                queue->Send(arguments, 2);
+            }
+        }
+
+        while (sent < count)
+        {
+            uint32_t chunk = (count - sent > kNullDriverCoalescedResultsMax) ? kNullDriverCoalescedResultsMax : count - sent;
+            uint32_t argumentCount = NullDriverCompletionPack(arguments, kCoalescedType, results + sent, chunk);
+            queue->Send(arguments, argumentCount);
+            sent += chunk;
+        }
+    }
+}
+
+// MARK: Consumer
+// Unpacks notifications the way AsyncCallback in CppUserClient does, until every result has arrived.
+static void Consume(NotificationQueue* queue, NullDriverRing* ring, std::atomic<uint32_t>* received, uint64_t* notificationCount, uint32_t* mismatches)
+{
+    NullDriverCompletionResult results[kNullDriverCoalescedResultsMax];
+    NullDriverRingEntry entries[64];
+    uint32_t tail = 0;
+
+    auto check = [&](uint64_t tag, uint64_t foo, uint64_t bar) {
+        if ((foo != tag + 1) || (bar != 70010))
+        {
+            ++*mismatches;
+        }
+        received->fetch_add(1, std::memory_order_release);
+    };
+
+    while (received->load(std::memory_order_relaxed) < kResultCount)
+    {
+        Notification notification = queue->Receive();
+        ++*notificationCount;
+
+        if (notification.arguments[0] == kTaggedType)
+        {
+            check(notification.arguments[1], notification.arguments[2], notification.arguments[3]);
+        }
+        else if (notification.arguments[0] == kCoalescedType)
+        {
+            uint32_t count = NullDriverCompletionUnpack(notification.arguments, notification.argumentCount, results, kNullDriverCoalescedResultsMax);
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                check(results[index].tag, results[index].foo, results[index].bar);
+            }
+        }
+        else if (notification.arguments[0] == kAsyncCompletionRingType)
+        {
+            uint32_t count = 0;
+            do
+            {
+                count = NullDriverRingConsume(ring, &tail, entries, 64);
+                for (uint32_t index = 0; index < count; ++index)
+                {
+                    check(entries[index].tag, entries[index].foo, entries[index].bar);
+                }
+            } while (count != 0);
+        }
+    }
+}
+
+static void Run(Mode mode, const char* name)
+{
+    NullDriverRing* ring = (NullDriverRing*)aligned_alloc(64, sizeof(NullDriverRing));
+    memset(ring, 0, sizeof(NullDriverRing));
+
+    NotificationQueue queue;
+    std::atomic<uint32_t> received(0);
+    uint64_t notificationCount = 0;
+    uint32_t mismatches = 0;
+
+    uint64_t startTime = NowNanoseconds();
+    std::thread consumer([&] { Consume(&queue, ring, &received, &notificationCount, &mismatches); });
+    Produce(mode, &queue, ring, &received);
+    consumer.join();
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    free(ring);
+
+    printf("%12s %16.0f %16.0f %14.2f %12u\n", name, (double)notificationCount * 1e9 / elapsed, (double)kResultCount * 1e9 / elapsed, (double)kResultCount / notificationCount, mismatches);
+    Check(mismatches == 0, "%s mode returned %u results that don't match their tags.", name, mismatches);
+    Check(received.load() == kResultCount, "%s mode delivered %u results for %u requests.", name, received.load(), kResultCount);
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* modeNames[NumberOfModes] = { "single", "arguments", "ring" };
+
+    printf("%u results, delivered up to %u per wakeup with at most %u outstanding.\n", kResultCount, kWakeupBatchSize, kOutstandingLimit);
+    printf("%12s %16s %16s %14s %12s\n", "mode", "notifications/s", "results/s", "results/notif", "mismatches");
+    for (int mode = 0; mode < NumberOfModes; ++mode)
+    {
+        Run((Mode)mode, modeNames[mode]);
+    }
+
+    return NullDriverCheckFinish();
+}
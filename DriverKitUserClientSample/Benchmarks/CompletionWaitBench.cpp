@@ -0,0 +1,248 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A loopback benchmark of how a client waits for results, which runs without DriverKit.
+A producer thread stands in for the dext: after a random pause it publishes one result to the async completion ring, stamped with the time it
+was published. The consumer waits for it either on a notification, which is a message queue standing in for the notification port and CFRunLoop,
+or through NullDriverCompletionWaiter on the shared page by parking, spinning, or spinning and then parking.
+Each mode reports the wake-up latency, from publishing to the consumer reading the result, and how much CPU the consumer used.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread CompletionWaitBench.cpp -o CompletionWaitBench && ./CompletionWaitBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../CppUserClient/NullDriverCompletionWaiter.h"
+#include "../Shared/NullDriverDoorbell.h"
+#include "../Shared/NullDriverRing.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kResultCount = 20000;
+
+// The producer pauses for a random time in this range before each result, so the consumer is usually waiting when it arrives.
+static const uint64_t kMinPauseNanoseconds = 5000;
+static const uint64_t kMaxPauseNanoseconds = 50000;
+
+// How long spin-then-park polls before it parks. This matches what CppUserClient uses in option 19.
+static const uint64_t kSpinNanoseconds = 20000;
+
+// The type word the dext sends with ring notifications.
+static const uint64_t kAsyncCompletionRingType = 5;
+
+// The first mode waits on notifications alone. The rest are NullDriverWaitMode plus one.
+typedef enum
+{
+    Mode_Notification = 0,
+    Mode_Park = 1,
+    Mode_Spin = 2,
+    Mode_SpinThenPark = 3,
+    NumberOfModes
+} Mode;
+
+static const char* modeNames[NumberOfModes] = { "notification", "park", "spin", "spin-then-park" };
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t ThreadCPUNanoseconds(void)
+{
+    struct timespec time = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+// Stands in for the notification port. Each message is a wakeup of the consumer, and carries the ring type word and count as the dext sends them.
+struct NotificationQueue
+{
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<uint64_t> messages;
+    uint64_t sent = 0;
+
+    void Send(uint64_t count)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            messages.push_back(count);
+            ++sent;
+        }
+        ready.notify_one();
+    }
+
+    // Returns false if nothing arrived within "timeout", like CFRunLoopRunInMode returning kCFRunLoopRunTimedOut.
+    bool Receive(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (!ready.wait_for(guard, timeout, [this] { return !messages.empty(); }))
+        {
+            return false;
+        }
+
+        messages.pop_front();
+        return true;
+    }
+};
+
+static bool ParkOnQueue(void* context)
+{
+    return ((NotificationQueue*)context)->Receive(std::chrono::milliseconds(5000));
+}
+
+// MARK: Producer
+// Publishes one result at a time, the way SendCoalescedCompletions does in each mode, and waits for it to be read before pausing for the next.
+// That keeps every result a separate wakeup, which is what this measures.
+static void Produce(Mode mode, NotificationQueue* queue, NullDriverRing* ring, NullDriverDoorbell* doorbell, const std::atomic<uint32_t>* received)
+{
+    std::mt19937_64 random(mode);
+    std::uniform_int_distribution<uint64_t> pauses(kMinPauseNanoseconds, kMaxPauseNanoseconds);
+    uint32_t head = 0;
+
+    for (uint32_t index = 0; index < kResultCount; ++index)
+    {
+        while (received->load(std::memory_order_acquire) < index)
+        {
+            std::this_thread::yield();
+        }
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(pauses(random)));
+
+        NullDriverRingEntry entry = {};
+        entry.tag = index;
+        entry.foo = NowNanoseconds();
+        entry.bar = 70010;
+
+        while (NullDriverRingProduce(ring, &head, &entry, 1) == 0)
+        {
+            std::this_thread::yield();
+        }
+
+        if ((mode == Mode_Notification) || NullDriverDoorbellShouldNotify(doorbell))
+        {
+            queue->Send(kAsyncCompletionRingType);
+        }
+    }
+}
+
+// MARK: Consumer
+typedef struct
+{
+    std::vector<uint64_t> latencies;
+    uint64_t cpuNanoseconds;
+    uint32_t outOfOrder;
+    uint32_t timeouts;
+} ConsumerResult;
+
+static void Consume(Mode mode, NotificationQueue* queue, NullDriverRing* ring, NullDriverDoorbell* doorbell, std::atomic<uint32_t>* received, ConsumerResult* result, NullDriverCompletionWaiter* waiter)
+{
+    NullDriverRingEntry entries[64];
+    uint32_t tail = 0;
+
+    NullDriverCompletionWaiterInit(waiter, ring, doorbell, ParkOnQueue, queue);
+    waiter->mode = (mode == Mode_Notification) ? (uint32_t)NullDriverWaitMode_Park : (uint32_t)(mode - Mode_Park);
+    waiter->spinNanoseconds = kSpinNanoseconds;
+
+    const uint64_t startCPU = ThreadCPUNanoseconds();
+
+    while (received->load(std::memory_order_relaxed) < kResultCount)
+    {
+        if (mode == Mode_Notification)
+        {
+            if (!queue->Receive(std::chrono::milliseconds(5000)))
+            {
+                ++result->timeouts;
+                break;
+            }
+        }
+        else if (NullDriverCompletionWaiterWait(waiter, tail) == 0)
+        {
+            ++result->timeouts;
+            break;
+        }
+
+        uint32_t count = NullDriverRingConsume(ring, &tail, entries, 64);
+        const uint64_t now = NowNanoseconds();
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            if (entries[index].tag != received->load(std::memory_order_relaxed))
+            {
+                ++result->outOfOrder;
+            }
+            result->latencies.push_back(now - entries[index].foo);
+            received->fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    result->cpuNanoseconds = ThreadCPUNanoseconds() - startCPU;
+}
+
+static uint64_t Percentile(std::vector<uint64_t>* sorted, double fraction)
+{
+    if (sorted->empty())
+    {
+        return 0;
+    }
+
+    size_t index = (size_t)(fraction * (double)(sorted->size() - 1));
+    return (*sorted)[index];
+}
+
+// MARK: Main
+int main(int argc, const char* argv[])
+{
+    printf("%u results, each after a pause of %llu to %llu us, on %u hardware threads.\n", kResultCount, (unsigned long long)(kMinPauseNanoseconds / 1000), (unsigned long long)(kMaxPauseNanoseconds / 1000), std::thread::hardware_concurrency());
+    printf("%16s %10s %10s %14s %14s %8s %10s\n", "mode", "p50 us", "p99 us", "cpu us/result", "notifications", "parks", "spurious");
+
+    for (uint32_t mode = 0; mode < NumberOfModes; ++mode)
+    {
+        NullDriverRing* ring = new NullDriverRing();
+        NullDriverDoorbell* doorbell = new NullDriverDoorbell();
+        NotificationQueue queue;
+        std::atomic<uint32_t> received(0);
+        ConsumerResult result = {};
+        NullDriverCompletionWaiter waiter = {};
+
+        result.latencies.reserve(kResultCount);
+
+        std::thread producer(Produce, (Mode)mode, &queue, ring, doorbell, &received);
+        Consume((Mode)mode, &queue, ring, doorbell, &received, &result, &waiter);
+        producer.join();
+
+        std::sort(result.latencies.begin(), result.latencies.end());
+        printf("%16s %10.1f %10.1f %14.2f %14llu %8llu %10llu\n", modeNames[mode], Percentile(&result.latencies, 0.50) / 1000.0, Percentile(&result.latencies, 0.99) / 1000.0, (double)result.cpuNanoseconds / kResultCount / 1000.0, (unsigned long long)queue.sent, (unsigned long long)waiter.parks, (unsigned long long)waiter.spuriousWakeups);
+
+        Check(result.latencies.size() == kResultCount, "%s received %zu of %u results.", modeNames[mode], result.latencies.size(), kResultCount);
+        Check(result.outOfOrder == 0, "%s received %u results out of order.", modeNames[mode], result.outOfOrder);
+        Check(result.timeouts == 0, "%s timed out waiting for a result.", modeNames[mode]);
+        if (mode == Mode_Spin)
+        {
+            Check(queue.sent == 0, "spin mode was sent %llu notifications.", (unsigned long long)queue.sent);
+        }
+        if (mode != Mode_Notification)
+        {
+            // Every notification wakes a parked consumer, so there can't be more of them than parks.
+            Check(queue.sent <= waiter.parks, "%s was sent %llu notifications for %llu parks.", modeNames[mode], (unsigned long long)queue.sent, (unsigned long long)waiter.parks);
+        }
+
+        delete ring;
+        delete doorbell;
+    }
+
+    return NullDriverCheckFinish();
+}
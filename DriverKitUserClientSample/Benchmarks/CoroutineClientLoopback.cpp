@@ -0,0 +1,300 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Runs the coroutine client from CppUserClient against a simulated completion source, checks that every result reaches the coroutine that
+sent its request, and measures throughput against the number of coroutines sharing one connection.
+The simulated source completes each request after a fixed latency plus random jitter, so results arrive out of order, the way the dext's timer
+delivers them. It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++20 -O2 CoroutineClientLoopback.cpp -o CoroutineClientLoopback && ./CoroutineClientLoopback
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "../CppUserClient/NullDriverCoroutine.h"
+#include "NullDriverCheck.h"
+
+// The IOReturn values the simulated source uses.
+static const int32_t kReturnTimeout = (int32_t)0xE00002D6;
+static const int32_t kReturnNoResources = (int32_t)0xE00002BE;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A small xorshift generator, so runs are repeatable on every platform.
+static uint64_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// MARK: Simulated Completion Source
+// Stands in for the dext and the notification port. Results are transformed the way the dext does, and held until they're due.
+// Every result due by the time WaitForCompletions wakes up is delivered in that one call, like several notifications handled in one run loop pass.
+class SimulatedTransport : public NullDriverCoroutineTransport
+{
+public:
+    SimulatedTransport(uint64_t latency, uint64_t jitter) : latencyNanoseconds(latency), jitterNanoseconds(jitter) {}
+
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        output[0] = input[0] + 1;
+        output[1] = input[1] + 10;
+        return 0;
+    }
+
+    int32_t SubmitTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t delayNanoseconds) override
+    {
+        ++submitted;
+        if ((rejectEvery != 0) && (submitted % rejectEvery == 0))
+        {
+            return kReturnNoResources;
+        }
+
+        // A dropped request is accepted but never answered, like a completion lost when the dext stops.
+        if ((dropEvery != 0) && (submitted % dropEvery == 0))
+        {
+            return 0;
+        }
+
+        const uint64_t jitter = (jitterNanoseconds == 0) ? 0 : NextRandom(&random) % jitterNanoseconds;
+        Scheduled scheduled = { NowNanoseconds() + latencyNanoseconds + delayNanoseconds + jitter, tag, input[0] + 1, input[1] + 10 };
+        scheduledResults.push(scheduled);
+        return 0;
+    }
+
+    int32_t WaitForCompletions(NullDriverCoroutineClient* client) override
+    {
+        if (scheduledResults.empty())
+        {
+            return kReturnTimeout;
+        }
+
+        uint64_t now = NowNanoseconds();
+        if (scheduledResults.top().due > now)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(scheduledResults.top().due - now));
+            now = NowNanoseconds();
+        }
+
+        ++wakeups;
+        while (!scheduledResults.empty() && (scheduledResults.top().due <= now))
+        {
+            Scheduled scheduled = scheduledResults.top();
+            scheduledResults.pop();
+            client->Complete(scheduled.tag, 0, scheduled.foo, scheduled.bar);
+        }
+
+        return 0;
+    }
+
+    uint32_t rejectEvery = 0;
+    uint32_t dropEvery = 0;
+    uint64_t wakeups = 0;
+
+private:
+    typedef struct
+    {
+        uint64_t due;
+        uint64_t tag;
+        uint64_t foo;
+        uint64_t bar;
+    } Scheduled;
+
+    struct LaterDue
+    {
+        bool operator()(const Scheduled& first, const Scheduled& second) const { return first.due > second.due; }
+    };
+
+    uint64_t latencyNanoseconds;
+    uint64_t jitterNanoseconds;
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    uint64_t submitted = 0;
+    std::priority_queue<Scheduled, std::vector<Scheduled>, LaterDue> scheduledResults;
+};
+
+typedef struct
+{
+    uint64_t completed;
+    uint64_t mismatches;
+    uint64_t errors;
+} TaskCounts;
+
+// Each coroutine sends its own sequence of values, so a result handed to the wrong coroutine shows up as a mismatch.
+static NullDriverTask RequestLoop(NullDriverCoroutineClient* client, uint64_t id, uint32_t requestCount, TaskCounts* counts)
+{
+    for (uint32_t request = 0; request < requestCount; ++request)
+    {
+        const uint64_t foo = (id << 32) | request;
+
+        NullDriverCoroutineResult result = co_await client->AsyncRequest(foo, 70000);
+        if (result.status != 0)
+        {
+            ++counts->errors;
+            continue;
+        }
+
+        if ((result.foo != foo + 1) || (result.bar != 70010))
+        {
+            ++counts->mismatches;
+        }
+        ++counts->completed;
+    }
+}
+
+// MARK: Checks
+static void CheckMatching(void)
+{
+    const uint32_t coroutineCount = 64;
+    const uint32_t requestCount = 200;
+    SimulatedTransport transport(0, 200000);
+    NullDriverCoroutineClient client(&transport);
+    TaskCounts counts = {};
+
+    for (uint32_t id = 0; id < coroutineCount; ++id)
+    {
+        client.Spawn(RequestLoop(&client, id, requestCount, &counts));
+    }
+
+    int32_t status = client.Run();
+
+    Check(status == 0, "Run failed with 0x%08x", status);
+    Check(counts.completed == coroutineCount * requestCount, "%llu of %u requests completed", (unsigned long long)counts.completed, coroutineCount * requestCount);
+    Check(counts.mismatches == 0, "%llu results reached the wrong coroutine", (unsigned long long)counts.mismatches);
+    Check(counts.errors == 0, "%llu requests failed", (unsigned long long)counts.errors);
+    Check(client.MaxInFlightCount() == coroutineCount, "at most %zu requests were in flight with %u coroutines", client.MaxInFlightCount(), coroutineCount);
+    Check(client.InFlightCount() == 0, "%zu requests are still in flight", client.InFlightCount());
+    printf("Matching: %u coroutines, %llu results in %llu wakeups.\n", coroutineCount, (unsigned long long)counts.completed, (unsigned long long)transport.wakeups);
+}
+
+static NullDriverTask CheckedStructTask(NullDriverCoroutineClient* client, NullDriverCoroutineResult* result)
+{
+    *result = co_await client->CheckedStruct(300, 70000);
+}
+
+static void CheckSynchronousCall(void)
+{
+    SimulatedTransport transport(0, 0);
+    NullDriverCoroutineClient client(&transport);
+    NullDriverCoroutineResult result = { -1, 0, 0, 0 };
+
+    client.Spawn(CheckedStructTask(&client, &result));
+    client.Run();
+
+    Check((result.status == 0) && (result.foo == 301) && (result.bar == 70010), "CheckedStruct returned 0x%08x, %llu, %llu", result.status, (unsigned long long)result.foo, (unsigned long long)result.bar);
+}
+
+// A request the transport refuses resumes at once with the error, and doesn't hold up the others.
+static void CheckRejectedRequests(void)
+{
+    SimulatedTransport transport(10000, 0);
+    NullDriverCoroutineClient client(&transport);
+    TaskCounts counts = {};
+
+    transport.rejectEvery = 10;
+    for (uint32_t id = 0; id < 8; ++id)
+    {
+        client.Spawn(RequestLoop(&client, id, 100, &counts));
+    }
+
+    int32_t status = client.Run();
+
+    Check(status == 0, "Run failed with 0x%08x", status);
+    Check(counts.errors == 80, "%llu of 80 refused requests failed", (unsigned long long)counts.errors);
+    Check(counts.completed == 720, "%llu of 720 accepted requests completed", (unsigned long long)counts.completed);
+    Check(counts.mismatches == 0, "%llu results reached the wrong coroutine", (unsigned long long)counts.mismatches);
+}
+
+// Requests that are never answered fail with the transport's timeout, so every task still finishes.
+static void CheckLostCompletions(void)
+{
+    SimulatedTransport transport(10000, 0);
+    NullDriverCoroutineClient client(&transport);
+    TaskCounts counts = {};
+
+    transport.dropEvery = 50;
+    for (uint32_t id = 0; id < 4; ++id)
+    {
+        client.Spawn(RequestLoop(&client, id, 100, &counts));
+    }
+
+    int32_t status = client.Run();
+
+    Check(status == kReturnTimeout, "Run returned 0x%08x instead of a timeout", status);
+    Check(counts.errors > 0, "no request failed when completions were lost");
+    Check(counts.completed + counts.errors == 400, "%llu of 400 requests finished", (unsigned long long)(counts.completed + counts.errors));
+    Check(client.InFlightCount() == 0, "%zu requests are still in flight", client.InFlightCount());
+}
+
+static void CheckStrayCompletions(void)
+{
+    SimulatedTransport transport(0, 0);
+    NullDriverCoroutineClient client(&transport);
+
+    client.Complete(12345, 0, 1, 2);
+    Check(client.StrayCompletionCount() == 1, "a result for an unknown tag wasn't counted");
+    Check(client.Run() == 0, "Run with no tasks failed");
+}
+
+// MARK: Throughput
+// With one coroutine, every request waits out the whole latency before the next is sent, which is what blocking in CFRunLoopRun per request does.
+static void MeasureThroughput(void)
+{
+    const uint32_t coroutineCounts[] = { 1, 4, 16, 64, 256 };
+    const uint32_t totalRequests = 20000;
+    const uint64_t latencyNanoseconds = 100000;
+    double baseline = 0;
+
+    printf("%10s %12s %16s %10s %16s\n", "coroutines", "requests", "completions/s", "speedup", "results/wakeup");
+    for (uint32_t coroutineCount : coroutineCounts)
+    {
+        // A single coroutine gets fewer requests, so the run doesn't take seconds.
+        const uint32_t requestsPerCoroutine = (coroutineCount == 1) ? 2000 : totalRequests / coroutineCount;
+        SimulatedTransport transport(latencyNanoseconds, latencyNanoseconds / 10);
+        NullDriverCoroutineClient client(&transport);
+        TaskCounts counts = {};
+
+        for (uint32_t id = 0; id < coroutineCount; ++id)
+        {
+            client.Spawn(RequestLoop(&client, id, requestsPerCoroutine, &counts));
+        }
+
+        uint64_t startTime = NowNanoseconds();
+        client.Run();
+        uint64_t elapsed = NowNanoseconds() - startTime;
+
+        double throughput = (double)counts.completed * 1e9 / elapsed;
+        if (baseline == 0)
+        {
+            baseline = throughput;
+        }
+
+        Check((counts.mismatches == 0) && (counts.errors == 0), "%llu mismatches and %llu errors with %u coroutines", (unsigned long long)counts.mismatches, (unsigned long long)counts.errors, coroutineCount);
+        printf("%10u %12llu %16.0f %9.1fx %16.1f\n", coroutineCount, (unsigned long long)counts.completed, throughput, throughput / baseline, (double)counts.completed / transport.wakeups);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    CheckSynchronousCall();
+    CheckMatching();
+    CheckRejectedRequests();
+    CheckLostCompletions();
+    CheckStrayCompletions();
+    MeasureThroughput();
+
+    return NullDriverCheckFinish();
+}
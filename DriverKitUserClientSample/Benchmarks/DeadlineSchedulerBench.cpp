@@ -0,0 +1,199 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A stress test of the deadline heap that schedules simulated completions, with up to millions of pending timers.
+It checks that every timer fires once, no earlier than its deadline, in deadline order, and compares the dext's table with the linear scan it used before.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 DeadlineSchedulerBench.cpp -o DeadlineSchedulerBench && ./DeadlineSchedulerBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "../Shared/NullDriverDeadlineHeap.h"
+#include "../Shared/NullDriverInFlightTable.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kExpireBatchSize = 32;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A small xorshift generator, so runs are repeatable on every platform.
+static uint64_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// MARK: Heap Stress
+// Keeps "pendingCount" timers outstanding while a simulated clock advances, re-arming each timer that fires, like a busy client would.
+// Returns the number of timers fired per second, or a negative number if any timer fired out of order, early, or twice.
+static double StressHeap(uint32_t pendingCount, uint32_t firedCount)
+{
+    NullDriverDeadline* heap = (NullDriverDeadline*)malloc(pendingCount * sizeof(NullDriverDeadline));
+    uint8_t* firedFlags = (uint8_t*)calloc(pendingCount + (size_t)firedCount, 1);
+    NullDriverDeadline expired[kExpireBatchSize];
+    uint32_t count = 0;
+    uint64_t nextTag = 0;
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    uint64_t now = 0;
+    uint32_t fired = 0;
+    bool failed = false;
+
+    // Delays span about one second of simulated time, with some ties and some that are already due.
+    for (uint32_t index = 0; index < pendingCount; ++index)
+    {
+        NullDriverDeadlineHeapPush(heap, &count, NextRandom(&random) % 1000000000, nextTag++);
+    }
+
+    uint64_t startTime = NowNanoseconds();
+    while ((fired < firedCount) && !failed)
+    {
+        // Jump straight to the next deadline, as the dext's timer would, plus some leeway.
+        now = heap[0].deadline + NextRandom(&random) % 100000;
+
+        uint32_t popped = NullDriverDeadlineHeapPopExpired(heap, &count, now, expired, kExpireBatchSize);
+        for (uint32_t index = 0; index < popped; ++index)
+        {
+            if ((expired[index].deadline > now) || ((index != 0) && NullDriverDeadlineIsEarlier(&expired[index], &expired[index - 1])) || (firedFlags[expired[index].tag] != 0))
+            {
+                failed = true;
+            }
+            firedFlags[expired[index].tag] = 1;
+
+            if (nextTag < pendingCount + (uint64_t)firedCount)
+            {
+                NullDriverDeadlineHeapPush(heap, &count, now + NextRandom(&random) % 1000000000, nextTag++);
+            }
+        }
+        fired += popped;
+
+        // Nothing left may be due after a partial batch.
+        if ((popped < kExpireBatchSize) && (count != 0) && (heap[0].deadline <= now))
+        {
+            failed = true;
+        }
+    }
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    free(heap);
+    free(firedFlags);
+
+    return failed ? -1.0 : (double)fired * 1e9 / (double)elapsed;
+}
+
+// MARK: In-Flight Table
+// What the table did before the heap: visit every slot to collect the expired entries, then every slot again for the next deadline.
+static uint32_t TakeExpiredByScan(NullDriverInFlightTable* table, uint64_t now, NullDriverInFlightEntry* expired, uint32_t maxCount)
+{
+    uint32_t count = 0;
+    uint32_t slot = 0;
+
+    while ((slot < kNullDriverInFlightSlotCount) && (count < maxCount) && (table->count != 0))
+    {
+        NullDriverInFlightEntry* entry = &table->slots[slot];
+        if ((entry->occupied != 0) && (entry->deadline <= now))
+        {
+            expired[count++] = *entry;
+            NullDriverInFlightTableRemoveSlot(table, slot);
+            continue;
+        }
+
+        ++slot;
+    }
+
+    return count;
+}
+
+static uint64_t EarliestDeadlineByScan(const NullDriverInFlightTable* table)
+{
+    uint64_t earliest = kNullDriverInFlightNoDeadline;
+
+    for (uint32_t slot = 0; (slot < kNullDriverInFlightSlotCount) && (table->count != 0); ++slot)
+    {
+        if ((table->slots[slot].occupied != 0) && (table->slots[slot].deadline < earliest))
+        {
+            earliest = table->slots[slot].deadline;
+        }
+    }
+
+    return earliest;
+}
+
+// Measures one SimulatedAsyncEvent wakeup against a full table where "dueCount" requests are due: take them out and find the next deadline.
+static void CompareWakeups(uint32_t dueCount)
+{
+    static NullDriverInFlightTable table;
+    static NullDriverInFlightTable working;
+    NullDriverInFlightEntry expired[kNullDriverInFlightCapacity];
+    const uint32_t iterations = 20000;
+    uint64_t random = 12345;
+
+    memset(&table, 0, sizeof(table));
+    for (uint32_t index = 0; index < kNullDriverInFlightCapacity; ++index)
+    {
+        NullDriverInFlightEntry entry = {};
+        entry.tag = NextRandom(&random);
+        entry.deadline = (index < dueCount) ? index : 1000000 + (NextRandom(&random) % 1000000);
+        NullDriverInFlightTableInsert(&table, &entry);
+    }
+
+    // Taking entries empties the table, so each wakeup starts from a fresh copy. The copy isn't timed.
+    uint64_t scanElapsed = 0;
+    uint64_t heapElapsed = 0;
+    uint64_t scanChecksum = 0;
+    uint64_t heapChecksum = 0;
+    for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        memcpy(&working, &table, sizeof(table));
+        uint64_t startTime = NowNanoseconds();
+        scanChecksum += TakeExpiredByScan(&working, dueCount, expired, kNullDriverInFlightCapacity) + EarliestDeadlineByScan(&working);
+        scanElapsed += NowNanoseconds() - startTime;
+
+        memcpy(&working, &table, sizeof(table));
+        startTime = NowNanoseconds();
+        heapChecksum += NullDriverInFlightTableTakeExpired(&working, dueCount, expired, kNullDriverInFlightCapacity) + NullDriverInFlightTableEarliestDeadline(&working);
+        heapElapsed += NowNanoseconds() - startTime;
+    }
+
+    printf("%10u %14.0f %14.0f\n", dueCount, (double)scanElapsed / iterations, (double)heapElapsed / iterations);
+    Check(scanChecksum == heapChecksum, "With %u due, the heap took different requests or found a different next deadline than the scan.", dueCount);
+}
+
+int main(int argc, const char* argv[])
+{
+    const uint32_t pendingCounts[] = { 1000, 100000, 1000000, 4000000 };
+    const uint32_t firedCount = 4000000;
+
+    printf("Heap stress: %u timers fired, each re-armed after it fires.\n", firedCount);
+    printf("%10s %16s\n", "pending", "fired/sec");
+    for (uint32_t pendingCount : pendingCounts)
+    {
+        double rate = StressHeap(pendingCount, firedCount);
+        Check(rate >= 0, "With %u pending, the heap fired a timer early, out of order or twice, or left one due.", pendingCount);
+        if (rate >= 0)
+        {
+            printf("%10u %16.0f\n", pendingCount, rate);
+        }
+    }
+
+    printf("\nOne wakeup over a full in-flight table of %u requests, in ns.\n", kNullDriverInFlightCapacity);
+    printf("%10s %14s %14s\n", "due", "scan", "heap");
+    const uint32_t dueCounts[] = { 1, 8, 32, 512 };
+    for (uint32_t dueCount : dueCounts)
+    {
+        CompareWakeups(dueCount);
+    }
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,273 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Runs the simulated device of Shared/NullDriverDevice.h in simulated time, for capacity planning without DriverKit.
+Requests arrive at random at a chosen share of the device's capacity, and each one's latency is the time from arriving to completing.
+The results are checked against queueing theory: M/D/1 and M/M/1 waits, Erlang C for several channels, and M/M/1/K for the share of
+requests a full queue turns away. Then each model is swept across loads and channel counts, with its latency percentiles reported in
+multiples of the mean service time. It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 DeviceModelBench.cpp -o DeviceModelBench && ./DeviceModelBench
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../Shared/NullDriverDevice.h"
+#include "NullDriverCheck.h"
+
+// Requests per simulated run. Heavy loads take many requests for the mean wait to settle.
+static const uint32_t kArrivalCount = 1000000;
+
+// The mean service time of every model in the sweep.
+static const uint64_t kServiceNanoseconds = 100000;
+
+typedef struct
+{
+    uint64_t admitted;
+    uint64_t rejected;
+    double meanLatency; // In nanoseconds, over admitted requests.
+    double meanWait; // Latency less service time.
+    double meanService;
+    double utilization; // Busy share of the channels, over the time requests were arriving.
+    uint64_t p50Latency;
+    uint64_t p99Latency;
+    uint64_t p999Latency;
+    uint32_t maxHeld; // The most requests the device held at once, seen from the arrivals.
+} SimulationResult;
+
+static uint64_t Percentile(const std::vector<uint64_t>& sorted, double fraction)
+{
+    return sorted.empty() ? 0 : sorted[(size_t)(fraction * (double)(sorted.size() - 1))];
+}
+
+// Sends "arrivalCount" requests at random, "arrivalsPerSecond" on average, each asking for "requestedNanoseconds".
+static void Simulate(const NullDriverDeviceConfig* config, double arrivalsPerSecond, uint64_t requestedNanoseconds, uint32_t arrivalCount, SimulationResult* result)
+{
+    NullDriverDevice* device = new NullDriverDevice();
+    std::mt19937_64 random(config->model * 1000 + config->channelCount);
+    std::exponential_distribution<double> gaps(arrivalsPerSecond / 1e9);
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> held; // A min-heap of completion times, kept independently of the device's own.
+    double now = 1e9;
+
+    *result = {};
+    latencies.reserve(arrivalCount);
+    NullDriverDeviceConfigure(device, config);
+
+    for (uint32_t index = 0; index < arrivalCount; ++index)
+    {
+        const uint64_t arrival = (uint64_t)now;
+        uint64_t completion = 0;
+
+        now += gaps(random);
+
+        while (!held.empty() && (held.front() <= arrival))
+        {
+            std::pop_heap(held.begin(), held.end(), std::greater<uint64_t>());
+            held.pop_back();
+        }
+
+        if (!NullDriverDeviceAdmit(device, arrival, requestedNanoseconds, &completion))
+        {
+            continue;
+        }
+
+        latencies.push_back(completion - arrival);
+        held.push_back(completion);
+        std::push_heap(held.begin(), held.end(), std::greater<uint64_t>());
+        result->maxHeld = std::max(result->maxHeld, (uint32_t)held.size());
+    }
+
+    double totalLatency = 0.0;
+    for (uint64_t latency : latencies)
+    {
+        totalLatency += (double)latency;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    result->admitted = device->admitted;
+    result->rejected = device->rejected;
+    result->meanLatency = latencies.empty() ? 0.0 : totalLatency / latencies.size();
+    result->meanService = (device->admitted == 0) ? 0.0 : (double)device->serviceNanoseconds / device->admitted;
+    result->meanWait = (device->admitted == 0) ? 0.0 : (double)device->waitNanoseconds / device->admitted;
+    result->utilization = (config->channelCount == 0) ? 0.0 : (double)device->serviceNanoseconds / (config->channelCount * (now - 1e9));
+    result->p50Latency = Percentile(latencies, 0.50);
+    result->p99Latency = Percentile(latencies, 0.99);
+    result->p999Latency = Percentile(latencies, 0.999);
+
+    delete device;
+}
+
+// The chance an arrival waits for a channel in an M/M/c queue with "load" Erlangs offered.
+static double ErlangC(uint32_t channels, double load)
+{
+    double term = 1.0;
+    double sum = 0.0;
+
+    for (uint32_t k = 0; k < channels; ++k)
+    {
+        sum += term;
+        term *= load / (k + 1);
+    }
+
+    const double waiting = term / (1.0 - load / channels);
+    return waiting / (sum + waiting);
+}
+
+static bool Near(double value, double expected, double tolerance)
+{
+    return fabs(value - expected) <= tolerance * fabs(expected);
+}
+
+// MARK: Checks
+static void CheckLog(void)
+{
+    double worst = 0.0;
+
+    for (double x = 1e-16; x <= 1.0; x *= 1.0137)
+    {
+        worst = std::max(worst, fabs(NullDriverDeviceLog(x) - log(x)) / std::max(1.0, fabs(log(x))));
+    }
+    worst = std::max(worst, fabs(NullDriverDeviceLog(1.0)));
+
+    Check(worst < 1e-12, "NullDriverDeviceLog is off by up to %g.", worst);
+}
+
+static void CheckModels(void)
+{
+    NullDriverDeviceConfig config = {};
+    SimulationResult result = {};
+
+    // An all-zero device completes every request after exactly the delay it asked for, and turns nothing away.
+    Simulate(&config, 1e6, 12345, 10000, &result);
+    Check((result.p50Latency == 12345) && (result.p999Latency == 12345) && (result.rejected == 0), "the default device didn't keep to the requested delay.");
+
+    // Without channels nothing waits, so each latency is a service time drawn from the model.
+    config.model = NullDriverDeviceModel_Exponential;
+    config.serviceNanoseconds = kServiceNanoseconds;
+    Simulate(&config, 1e6, 0, kArrivalCount, &result);
+    Check(Near(result.meanLatency, kServiceNanoseconds, 0.01), "exponential service times have a mean of %.0f ns instead of %llu.", result.meanLatency, (unsigned long long)kServiceNanoseconds);
+    Check(Near((double)result.p50Latency, kServiceNanoseconds * 0.6931, 0.02), "exponential service times have a median of %llu ns.", (unsigned long long)result.p50Latency);
+
+    config.model = NullDriverDeviceModel_Bimodal;
+    config.slowNanoseconds = kServiceNanoseconds * 20;
+    config.slowPartsPerMillion = 10000;
+    Simulate(&config, 1e6, 0, kArrivalCount, &result);
+    Check(Near(result.meanLatency, kServiceNanoseconds * (0.99 + 0.01 * 20), 0.02), "bimodal service times have a mean of %.0f ns.", result.meanLatency);
+    Check((result.p50Latency == kServiceNanoseconds) && (result.p999Latency == config.slowNanoseconds), "bimodal service times have the wrong percentiles.");
+
+    // A trace plays back in order and starts over at the end.
+    config = {};
+    config.model = NullDriverDeviceModel_Trace;
+    config.traceCount = 3;
+    config.trace[0] = 1000;
+    config.trace[1] = 2000;
+    config.trace[2] = 6000;
+    Simulate(&config, 1e6, 0, 300000, &result);
+    Check((result.meanLatency == 3000.0) && (result.p50Latency == 2000), "the trace model didn't replay its service times in order.");
+
+    // The configuration checks reject what the dext would.
+    config.traceCount = 0;
+    Check(!NullDriverDeviceConfigIsValid(&config), "a trace model without a trace was accepted.");
+    config = {};
+    config.channelCount = kNullDriverDeviceMaxChannels + 1;
+    Check(!NullDriverDeviceConfigIsValid(&config), "too many channels were accepted.");
+    config = {};
+    config.model = NullDriverDeviceModel_Bimodal;
+    config.slowPartsPerMillion = kNullDriverDevicePartsPerMillion + 1;
+    Check(!NullDriverDeviceConfigIsValid(&config), "a bimodal model slower than always was accepted.");
+}
+
+static void CheckQueueing(void)
+{
+    NullDriverDeviceConfig config = {};
+    SimulationResult result = {};
+    const double load = 0.8;
+
+    config.serviceNanoseconds = kServiceNanoseconds;
+    config.channelCount = 1;
+
+    // M/D/1: the mean wait is load / (2 * (1 - load)) service times.
+    config.model = NullDriverDeviceModel_Fixed;
+    Simulate(&config, load * 1e9 / kServiceNanoseconds, 0, kArrivalCount, &result);
+    Check(Near(result.meanWait, kServiceNanoseconds * load / (2.0 * (1.0 - load)), 0.05), "M/D/1 at %.0f%% load waited %.0f ns.", load * 100, result.meanWait);
+    Check(Near(result.utilization, load, 0.02), "M/D/1 at %.0f%% load was busy %.1f%% of the time.", load * 100, result.utilization * 100);
+    Check(Near(result.meanLatency, result.meanWait + result.meanService, 1e-9), "latency isn't wait plus service.");
+
+    // M/M/1: the mean wait is load / (1 - load) service times.
+    config.model = NullDriverDeviceModel_Exponential;
+    Simulate(&config, load * 1e9 / kServiceNanoseconds, 0, kArrivalCount, &result);
+    Check(Near(result.meanWait, kServiceNanoseconds * load / (1.0 - load), 0.08), "M/M/1 at %.0f%% load waited %.0f ns.", load * 100, result.meanWait);
+
+    // M/M/c: Erlang C gives the chance of waiting, and a request that waits does so for 1 / (c - offered load) service times on average.
+    config.channelCount = 4;
+    Simulate(&config, config.channelCount * load * 1e9 / kServiceNanoseconds, 0, kArrivalCount, &result);
+    const double expectedWait = ErlangC(config.channelCount, config.channelCount * load) * kServiceNanoseconds / (config.channelCount * (1.0 - load));
+    Check(Near(result.meanWait, expectedWait, 0.08), "M/M/4 at %.0f%% load waited %.0f ns instead of %.0f.", load * 100, result.meanWait, expectedWait);
+
+    // M/M/1/K: with room for K requests, an arrival is turned away with probability (1 - r) r^K / (1 - r^(K + 1)) at load r.
+    const uint32_t depth = 8;
+    const double overload = 1.2;
+    config.channelCount = 1;
+    config.queueDepth = depth;
+    Simulate(&config, overload * 1e9 / kServiceNanoseconds, 0, kArrivalCount, &result);
+    const double expectedBlocking = (1.0 - overload) * pow(overload, depth) / (1.0 - pow(overload, depth + 1));
+    const double blocking = (double)result.rejected / (result.admitted + result.rejected);
+    Check(Near(blocking, expectedBlocking, 0.05), "M/M/1/%u at %.0f%% load turned away %.2f%% instead of %.2f%%.", depth, overload * 100, blocking * 100, expectedBlocking * 100);
+    Check(result.maxHeld <= depth, "a device with depth %u held %u requests.", depth, result.maxHeld);
+}
+
+// MARK: Sweep
+static void Sweep(void)
+{
+    const uint32_t channelCounts[] = { 1, 4, 16 };
+    const double loads[] = { 0.5, 0.7, 0.8, 0.9, 0.95 };
+
+    printf("\nLatency in multiples of the mean service time, with requests arriving at random:\n");
+    printf("%12s %9s %6s %10s %8s %8s %8s %8s\n", "model", "channels", "load", "busy %", "mean", "p50", "p99", "p999");
+
+    for (uint32_t model = NullDriverDeviceModel_Fixed; model <= NullDriverDeviceModel_Bimodal; ++model)
+    {
+        NullDriverDeviceConfig config = {};
+        config.model = model;
+        config.serviceNanoseconds = kServiceNanoseconds;
+
+        // One request in a hundred takes 20 times as long, with the fast ones shortened so the mean stays the same.
+        if (model == NullDriverDeviceModel_Bimodal)
+        {
+            config.slowNanoseconds = kServiceNanoseconds * 20;
+            config.slowPartsPerMillion = 10000;
+            config.serviceNanoseconds = (kServiceNanoseconds * 100 - config.slowNanoseconds) / 99;
+        }
+
+        for (uint32_t channels : channelCounts)
+        {
+            config.channelCount = channels;
+            for (double load : loads)
+            {
+                SimulationResult result = {};
+                Simulate(&config, channels * load * 1e9 / kServiceNanoseconds, 0, kArrivalCount, &result);
+                printf("%12s %9u %6.2f %10.1f %8.2f %8.2f %8.2f %8.2f\n", kNullDriverDeviceModelNames[model], channels, load, result.utilization * 100, result.meanLatency / kServiceNanoseconds,
+                       (double)result.p50Latency / kServiceNanoseconds, (double)result.p99Latency / kServiceNanoseconds, (double)result.p999Latency / kServiceNanoseconds);
+            }
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    CheckLog();
+    CheckModels();
+    CheckQueueing();
+    Sweep();
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,138 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A benchmark of the per-call cost of the dext's logging choices, using a 16-scalar call like HandleExternalCheckedScalar.
+os_log isn't available off Apple platforms, so formatted lines written to a buffered /dev/null stand in for it.
+That skips os_log's own buffer management, so the "per element" and "per call" rows are a lower bound on the real cost.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 LoggingBench.cpp -o LoggingBench && ./LoggingBench
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "../Shared/NullDriverTrace.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kCallCount = 1000000;
+static const uint32_t kScalarCount = 16;
+static const uint32_t kCheckedScalarSelector = 2;
+
+static FILE* globalLogFile = nullptr;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stands in for os_log: format the line and hand it to a buffered sink.
+__attribute__((format(printf, 1, 2)))
+static void StandInLog(const char* format, ...)
+{
+    char line[256];
+    va_list arguments;
+
+    va_start(arguments, format);
+    int length = vsnprintf(line, sizeof(line), format, arguments);
+    va_end(arguments);
+
+    fwrite(line, 1, (length < (int)sizeof(line)) ? length : sizeof(line) - 1, globalLogFile);
+}
+
+typedef enum
+{
+    Mode_PerElementLog = 0, // What the dext did before: one line per call, and one per scalar.
+    Mode_PerCallLog = 1, // NULLDRIVER_LOG_LEVEL_DEBUG: only the "Got action type" line.
+    Mode_Off = 2, // NULLDRIVER_LOG_LEVEL_INFO, the release default: no logging on this path.
+    Mode_BinaryTrace = 3, // Logging off, with NULLDRIVER_TRACE recording one record per call.
+    NumberOfModes
+} Mode;
+
+// The body of HandleExternalCheckedScalar, with each kind of logging compiled in or out.
+template <Mode mode>
+__attribute__((noinline)) static int32_t HandleCheckedScalar(const uint64_t* input, uint64_t* output, NullDriverTraceRing* trace)
+{
+    if (mode <= Mode_PerCallLog)
+    {
+        StandInLog("NullDriver - Got action type checked scalar\n");
+    }
+
+    for (uint32_t index = 0; index < kScalarCount; ++index)
+    {
+        output[index] = input[index] + 1;
+        if (mode == Mode_PerElementLog)
+        {
+            StandInLog("NullDriver - %llu %llu\n", (unsigned long long)input[index], (unsigned long long)output[index]);
+        }
+    }
+
+    if (mode == Mode_BinaryTrace)
+    {
+        NullDriverTraceRecordCall(trace, NowNanoseconds(), kCheckedScalarSelector, 0, 0);
+    }
+
+    return 0;
+}
+
+template <Mode mode>
+static double Measure(NullDriverTraceRing* trace)
+{
+    uint64_t input[kScalarCount] = {};
+    uint64_t output[kScalarCount] = {};
+
+    uint64_t startTime = NowNanoseconds();
+    for (uint32_t call = 0; call < kCallCount; ++call)
+    {
+        input[0] = call;
+        HandleCheckedScalar<mode>(input, output, trace);
+    }
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    return (double)elapsed / kCallCount;
+}
+
+int main(int argc, const char* argv[])
+{
+    globalLogFile = fopen("/dev/null", "w");
+    if (globalLogFile == nullptr)
+    {
+        printf("Failed to open /dev/null.\n");
+        return EXIT_FAILURE;
+    }
+
+    NullDriverTraceRing* trace = (NullDriverTraceRing*)aligned_alloc(64, sizeof(NullDriverTraceRing));
+    memset(trace, 0, sizeof(NullDriverTraceRing));
+
+    const double baseline = Measure<Mode_PerElementLog>(trace);
+    const double results[NumberOfModes] = { baseline, Measure<Mode_PerCallLog>(trace), Measure<Mode_Off>(trace), Measure<Mode_BinaryTrace>(trace) };
+    const char* names[NumberOfModes] = { "log per element", "log per call", "logging off", "binary trace" };
+
+    printf("%u calls of %u scalars each.\n", kCallCount, kScalarCount);
+    printf("%18s %12s %10s\n", "mode", "ns/call", "speedup");
+    for (int mode = 0; mode < NumberOfModes; ++mode)
+    {
+        printf("%18s %12.1f %9.1fx\n", names[mode], results[mode], baseline / results[mode]);
+    }
+
+    // Check the trace kept the most recent calls intact.
+    NullDriverTraceRecord records[kNullDriverTraceRecordCount];
+    uint32_t count = NullDriverTraceSnapshot(trace, records, kNullDriverTraceRecordCount);
+    bool ordered = (count == kNullDriverTraceRecordCount);
+    for (uint32_t index = 1; index < count; ++index)
+    {
+        ordered = ordered && (records[index].sequence == records[index - 1].sequence + 1) && (records[index].timestamp >= records[index - 1].timestamp);
+    }
+    printf("Trace holds the last %u of %llu calls.\n", count, (unsigned long long)trace->next);
+    Check(ordered, "The trace doesn't hold the last %u calls in order.", kNullDriverTraceRecordCount);
+
+    free(trace);
+    fclose(globalLogFile);
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,42 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The checks shared by the programs in this folder that double as tests. Each failed Check prints what went wrong and carries on,
+so one run reports every failure, and NullDriverCheckFinish turns the count into the program's exit status.
+*/
+
+#ifndef NullDriverCheck_h
+#define NullDriverCheck_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint32_t globalFailures = 0;
+
+#define Check(condition, ...) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("FAILED: " __VA_ARGS__); \
+            printf("\n"); \
+            ++globalFailures; \
+        } \
+    } while (0)
+
+// Prints the summary line, and returns the status for main to exit with.
+static inline int NullDriverCheckFinish(void)
+{
+    if (globalFailures != 0)
+    {
+        printf("%u checks FAILED.\n", globalFailures);
+        return EXIT_FAILURE;
+    }
+
+    printf("All checks passed.\n");
+    return EXIT_SUCCESS;
+}
+
+#endif /* NullDriverCheck_h */
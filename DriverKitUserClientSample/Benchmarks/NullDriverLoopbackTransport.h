@@ -0,0 +1,199 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+An in-process stand-in of NullDriver's handlers behind NullDriverBenchTransport, shared by the loopback programs in this folder.
+Synchronous calls run the handler bodies directly. Async requests are handed to a thread that stands in for the dext's dispatch queue, and the
+result is handed back the way a notification would be, once the simulated device that every connection shares has finished with it.
+*/
+
+#ifndef NullDriverLoopbackTransport_h
+#define NullDriverLoopbackTransport_h
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../CppUserClient/NullDriverBench.h"
+#include "../Shared/NullDriverDevice.h"
+#include "../Shared/NullDriverTransform.h"
+
+// The error codes the dext returns, from IOReturn.h.
+static const int32_t kIOReturnBadArgument = (int32_t)0xe00002c2;
+static const int32_t kIOReturnBusy = (int32_t)0xe00002d5;
+static const int32_t kIOReturnNoSpace = (int32_t)0xe00002c3;
+
+// Stands in for the service's simulated device, which every connection shares. It starts out all zero, so requests complete right away.
+typedef struct
+{
+    std::mutex lock;
+    NullDriverDevice device;
+} LoopbackDevice;
+
+static inline LoopbackDevice* GetLoopbackDevice(void)
+{
+    static LoopbackDevice* device = new LoopbackDevice();
+    return device;
+}
+
+// The body of HandleConfigureDevice. The configuration "config" replaced is copied to "previous".
+static inline int32_t ConfigureLoopbackDevice(const NullDriverDeviceConfig* config, NullDriverDeviceConfig* previous)
+{
+    LoopbackDevice* device = GetLoopbackDevice();
+
+    if (!NullDriverDeviceConfigIsValid(config))
+    {
+        return kIOReturnBadArgument;
+    }
+
+    std::lock_guard<std::mutex> guard(device->lock);
+    *previous = device->device.config;
+    NullDriverDeviceConfigure(&device->device, config);
+    return 0;
+}
+
+class LoopbackTransport : public NullDriverBenchTransport
+{
+public:
+    LoopbackTransport()
+    {
+        queueThread = std::thread([this] { RunQueue(); });
+    }
+
+    ~LoopbackTransport() override
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        requestReady.notify_one();
+        queueThread.join();
+    }
+
+    // The body of HandleExternalScalar.
+    int32_t CallScalar(const uint64_t* input, uint32_t inputCount, uint64_t* output, uint32_t* outputCount) override
+    {
+        uint32_t count = (inputCount < *outputCount) ? inputCount : *outputCount;
+        count = (count > kNullDriverBenchMaxScalarCount) ? kNullDriverBenchMaxScalarCount : count;
+
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            output[index] = input[index] + 1;
+        }
+        *outputCount = count;
+
+        return 0;
+    }
+
+    // The body of HandleExternalCheckedStruct.
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        NullDriverTransformDataStructs(input, output, 1);
+        return 0;
+    }
+
+    // The checks and transform of HandleExternalCheckedStructBatch.
+    int32_t CallCheckedStructBatch(const uint64_t* input, size_t inputSize, uint64_t* output, size_t* outputSize) override
+    {
+        if ((inputSize == 0) || ((inputSize % 16) != 0) || (inputSize > kNullDriverBenchMaxBatchSize))
+        {
+            return kIOReturnBadArgument;
+        }
+
+        if (*outputSize < inputSize)
+        {
+            return kIOReturnNoSpace;
+        }
+
+        NullDriverTransformDataStructs(input, output, inputSize / 16);
+        *outputSize = inputSize;
+
+        return 0;
+    }
+
+    // HandleTaggedAsyncRequest with no delay: the request crosses to the queue thread, and the result crosses back once the device is done with it.
+    int32_t CallTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t* output) override
+    {
+        LoopbackDevice* device = GetLoopbackDevice();
+        uint64_t completion = 0;
+        bool admitted = false;
+
+        {
+            std::lock_guard<std::mutex> deviceGuard(device->lock);
+            admitted = NullDriverDeviceAdmit(&device->device, NullDriverBenchNowNanoseconds(), 0, &completion);
+        }
+        if (!admitted)
+        {
+            return kIOReturnBusy;
+        }
+
+        std::unique_lock<std::mutex> guard(lock);
+
+        requestTag = tag;
+        requestDeadline = completion;
+        requestData[0] = input[0];
+        requestData[1] = input[1];
+        requestPending = true;
+        requestReady.notify_one();
+
+        completionReady.wait(guard, [this] { return !requestPending; });
+        if (completionTag != tag)
+        {
+            return kIOReturnBadArgument;
+        }
+
+        output[0] = completionData[0];
+        output[1] = completionData[1];
+
+        return 0;
+    }
+
+private:
+    void RunQueue(void)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+
+        while (true)
+        {
+            requestReady.wait(guard, [this] { return requestPending || stopping; });
+            if (stopping)
+            {
+                return;
+            }
+
+            // The dext's timer fires at the deadline, and so does this.
+            if (requestDeadline > NullDriverBenchNowNanoseconds())
+            {
+                const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(requestDeadline));
+                guard.unlock();
+                std::this_thread::sleep_until(deadline);
+                guard.lock();
+            }
+
+            NullDriverTransformDataStructs(requestData, completionData, 1);
+            completionTag = requestTag;
+            requestPending = false;
+            completionReady.notify_one();
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable requestReady;
+    std::condition_variable completionReady;
+    std::thread queueThread;
+    bool stopping = false;
+    bool requestPending = false;
+    uint64_t requestTag = 0;
+    uint64_t requestDeadline = 0;
+    uint64_t requestData[2] = {};
+    uint64_t completionTag = 0;
+    uint64_t completionData[2] = {};
+};
+
+// Every loopback transport is its own stand-in of the dext, so the factory has no context to use.
+static inline NullDriverBenchTransport* CreateLoopbackTransport(void* /* context */)
+{
+    return new LoopbackTransport();
+}
+
+#endif /* NullDriverLoopbackTransport_h */
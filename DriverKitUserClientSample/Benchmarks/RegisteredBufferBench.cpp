@@ -0,0 +1,179 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks the bounds checks on registered buffer requests, and compares mapping a client's memory on every call with mapping it once and
+referring to it by index and offset, across payload sizes.
+mmap and munmap of a shared file stand in for CreateMapping and the release of the IOMemoryMap, so the absolute costs differ from the dext's,
+but both include setting up and tearing down page tables for every page touched.
+It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 RegisteredBufferBench.cpp -o RegisteredBufferBench && ./RegisteredBufferBench
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "../Shared/NullDriverRegisteredBuffer.h"
+#include "../Shared/NullDriverTransform.h"
+#include "NullDriverCheck.h"
+
+static const uint64_t kBufferSize = 1024 * 1024;
+static const uint64_t kBytesPerSize = 1024ULL * 1024 * 1024;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MARK: Bounds
+// Every value in a request comes from the client, so regions that reach past a buffer, or wrap around, have to be refused.
+static void CheckResolve(void)
+{
+    static uint8_t memory[4096];
+    NullDriverRegisteredBufferTable table = {};
+
+    Check(NullDriverRegisteredBufferFindFree(&table) == 0, "an empty table has no free slot");
+    table.addresses[0] = (uint64_t)(uintptr_t)memory;
+    table.lengths[0] = sizeof(memory);
+    Check(NullDriverRegisteredBufferFindFree(&table) == 1, "slot 0 is still free");
+
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 0, 4096) == memory, "the whole buffer is refused");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 4080, 16) == memory + 4080, "the last DataStruct is refused");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 4080, 32) == nullptr, "a region past the end is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 4096, 16) == nullptr, "a region starting at the end is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 0, 0) == nullptr, "an empty region is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 8, 16) == nullptr, "a misaligned offset is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 0, 24) == nullptr, "a partial DataStruct is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, 16, UINT64_MAX - 15) == nullptr, "a length that wraps is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 0, UINT64_MAX - 15, 32) == nullptr, "an offset that wraps is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, 1, 0, 16) == nullptr, "an unregistered buffer is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, kNullDriverRegisteredBufferCount, 0, 16) == nullptr, "an index past the table is allowed");
+    Check(NullDriverRegisteredBufferResolve(&table, UINT64_MAX, 0, 16) == nullptr, "a huge index is allowed");
+
+    Check(NullDriverRegisteredBufferOverlaps(memory, memory + 16, 32), "overlapping regions aren't detected");
+    Check(!NullDriverRegisteredBufferOverlaps(memory, memory + 32, 32), "adjacent regions are reported as overlapping");
+}
+
+// MARK: Cost
+// The client's memory: one shared file holding the input buffer followed by the output buffer.
+static int CreateClientMemory(void)
+{
+    char path[] = "/tmp/RegisteredBufferBench.XXXXXX";
+    int file = mkstemp(path);
+
+    if (file < 0)
+    {
+        return -1;
+    }
+
+    unlink(path);
+    if (ftruncate(file, 2 * kBufferSize) != 0)
+    {
+        close(file);
+        return -1;
+    }
+
+    return file;
+}
+
+// What the dext did before: map the input and output descriptors, transform, and release both mappings, on every call.
+static uint64_t MeasureMappedPerCall(int file, uint64_t payloadSize, uint64_t callCount)
+{
+    uint64_t startTime = NowNanoseconds();
+
+    for (uint64_t call = 0; call < callCount; ++call)
+    {
+        void* input = mmap(nullptr, payloadSize, PROT_READ, MAP_SHARED, file, 0);
+        void* output = mmap(nullptr, payloadSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, kBufferSize);
+        if ((input == MAP_FAILED) || (output == MAP_FAILED))
+        {
+            Check(false, "mmap failed");
+            return 0;
+        }
+
+        NullDriverTransformDataStructs(input, output, payloadSize / 16);
+
+        munmap(input, payloadSize);
+        munmap(output, payloadSize);
+    }
+
+    return NowNanoseconds() - startTime;
+}
+
+// What ExternalMethodType_RegisteredStructBatch does: look up regions of buffers that stay mapped, and transform.
+static uint64_t MeasureRegistered(const NullDriverRegisteredBufferTable* table, uint64_t payloadSize, uint64_t callCount)
+{
+    uint64_t startTime = NowNanoseconds();
+
+    for (uint64_t call = 0; call < callCount; ++call)
+    {
+        const void* input = NullDriverRegisteredBufferResolve(table, 0, 0, payloadSize);
+        void* output = NullDriverRegisteredBufferResolve(table, 1, 0, payloadSize);
+
+        NullDriverTransformDataStructs(input, output, payloadSize / 16);
+    }
+
+    return NowNanoseconds() - startTime;
+}
+
+int main(int argc, const char* argv[])
+{
+    const uint64_t payloadSizes[] = { 4096, 16384, 65536, 262144, 1048576 };
+    NullDriverRegisteredBufferTable table = {};
+
+    CheckResolve();
+
+    int file = CreateClientMemory();
+    if (file < 0)
+    {
+        printf("Failed to create the client memory file.\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t* input = (uint64_t*)mmap(nullptr, kBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    uint64_t* output = (uint64_t*)mmap(nullptr, kBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, kBufferSize);
+    if ((input == MAP_FAILED) || (output == MAP_FAILED))
+    {
+        printf("Failed to map the client memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    for (uint64_t index = 0; index < kBufferSize / 16; ++index)
+    {
+        input[index * 2] = index;
+        input[index * 2 + 1] = 70000;
+    }
+
+    // Registering maps each buffer once.
+    table.addresses[0] = (uint64_t)(uintptr_t)input;
+    table.lengths[0] = kBufferSize;
+    table.addresses[1] = (uint64_t)(uintptr_t)output;
+    table.lengths[1] = kBufferSize;
+
+    printf("%10s %12s %18s %18s %10s\n", "bytes", "calls", "mapped ns/call", "registered ns/call", "speedup");
+    for (uint64_t payloadSize : payloadSizes)
+    {
+        const uint64_t callCount = kBytesPerSize / payloadSize;
+        uint64_t mapped = MeasureMappedPerCall(file, payloadSize, callCount);
+        uint64_t registered = MeasureRegistered(&table, payloadSize, callCount);
+
+        printf("%10llu %12llu %18.0f %18.0f %9.2fx\n", (unsigned long long)payloadSize, (unsigned long long)callCount, (double)mapped / callCount, (double)registered / callCount, (double)mapped / registered);
+
+        const uint64_t last = payloadSize / 16 - 1;
+        Check((output[last * 2] == last + 1) && (output[last * 2 + 1] == 70010), "the last DataStruct of a %llu byte payload is wrong", (unsigned long long)payloadSize);
+    }
+
+    munmap(input, kBufferSize);
+    munmap(output, kBufferSize);
+    close(file);
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,202 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks the trace format and replay scheduler of CppUserClient/NullDriverReplay.h against the in-process stand-in of the dext's handlers.
+A bench run is recorded through the recording transport, written out and read back, and then replayed at its recorded pace, faster, and flat out
+on several threads. A trace with known gaps between calls checks that replay keeps to its schedule. It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread ReplayLoopback.cpp -o ReplayLoopback && ./ReplayLoopback
+*/
+
+#include "../CppUserClient/NullDriverReplay.h"
+#include "NullDriverLoopbackTransport.h"
+#include "NullDriverCheck.h"
+
+static const char* const kTracePath = "ReplayLoopback.trace";
+
+// The paced trace has this many calls on each of its streams, this far apart.
+static const uint32_t kPacedStreamCount = 4;
+static const uint32_t kPacedCallsPerStream = 100;
+static const uint64_t kPacedGapNanoseconds = 1000000;
+
+// MARK: Recording
+// Records one short bench run of every workload, plus a batch call the dext rejects, so the trace has every selector and a failed result.
+static void RecordBench(NullDriverReplayRecorder* recorder)
+{
+    const NullDriverBenchWorkload workloads[] = { NullDriverBenchWorkload_Scalar, NullDriverBenchWorkload_Struct, NullDriverBenchWorkload_StructBatch, NullDriverBenchWorkload_Async };
+    const uint32_t payloadSizes[] = { 64, 16, 4096, 16 };
+    NullDriverReplayRecordingContext recording = { CreateLoopbackTransport, nullptr, recorder };
+    NullDriverBenchResult* result = new NullDriverBenchResult();
+
+    for (uint32_t index = 0; index < sizeof(workloads) / sizeof(workloads[0]); ++index)
+    {
+        NullDriverBenchOptions options = {};
+        options.workload = workloads[index];
+        options.iterations = 2000;
+        options.payloadSize = payloadSizes[index];
+        options.threadCount = 2;
+        options.warmupMilliseconds = 0;
+
+        bool connected = NullDriverBenchRun(&options, NullDriverReplayRecordingFactory, &recording, result);
+        Check(connected && (result->errors == 0) && (result->mismatches == 0), "recording the %s workload failed.", kNullDriverBenchWorkloadNames[workloads[index]]);
+    }
+
+    NullDriverBenchTransport* transport = NullDriverReplayRecordingFactory(&recording);
+    uint64_t input[2] = { 1, 70000 };
+    uint64_t output[2] = {};
+    size_t outputSize = sizeof(output);
+    Check(transport->CallCheckedStructBatch(input, 8, output, &outputSize) == kIOReturnBadArgument, "a short batch wasn't rejected.");
+    delete transport;
+
+    delete result;
+}
+
+// Calls on "kPacedStreamCount" streams, each "kPacedGapNanoseconds" after the last one on its stream.
+static void MakePacedTrace(NullDriverReplayTrace* trace)
+{
+    *trace = {};
+    for (uint32_t call = 0; call < kPacedCallsPerStream; ++call)
+    {
+        for (uint32_t stream = 0; stream < kPacedStreamCount; ++stream)
+        {
+            NullDriverReplayRecord record = {};
+            const uint64_t input[2] = { call, 70000 };
+
+            record.timestamp = call * kPacedGapNanoseconds;
+            record.selector = NullDriverReplaySelector_CheckedStruct;
+            record.stream = (uint16_t)stream;
+            record.inputSize = 16;
+            record.outputSize = 16;
+            NullDriverReplayTraceAdd(trace, &record, input);
+        }
+    }
+}
+
+// MARK: File Format
+static void CheckRoundTrip(NullDriverReplayRecorder* recorder, NullDriverReplayTrace* trace)
+{
+    const size_t recordCount = recorder->RecordCount();
+
+    Check(recorder->Save(kTracePath), "couldn't save the trace.");
+    Check(NullDriverReplayRead(kTracePath, trace), "couldn't read the trace back.");
+    Check(trace->records.size() == recordCount, "read %zu records of the %zu recorded.", trace->records.size(), recordCount);
+
+    uint32_t selectorCounts[16] = {};
+    uint32_t failed = 0;
+    uint64_t payloadWords = 0;
+    for (size_t index = 0; index < trace->records.size(); ++index)
+    {
+        const NullDriverReplayRecord* record = &trace->records[index];
+
+        Check((index == 0) || (record->timestamp >= trace->records[index - 1].timestamp), "record %zu is out of timestamp order.", index);
+        selectorCounts[record->selector & 15] += 1;
+        failed += (record->result != 0) ? 1 : 0;
+        payloadWords += record->inputSize / 8;
+    }
+
+    // 2 threads make 2000 calls each for every workload, with no warmup.
+    Check(selectorCounts[NullDriverReplaySelector_Scalar] == 4000, "recorded %u scalar calls instead of 4000.", selectorCounts[NullDriverReplaySelector_Scalar]);
+    Check(selectorCounts[NullDriverReplaySelector_CheckedStruct] == 4000, "recorded %u struct calls instead of 4000.", selectorCounts[NullDriverReplaySelector_CheckedStruct]);
+    Check(selectorCounts[NullDriverReplaySelector_CheckedStructBatch] == 4001, "recorded %u batch calls instead of 4001.", selectorCounts[NullDriverReplaySelector_CheckedStructBatch]);
+    Check(selectorCounts[NullDriverReplaySelector_TaggedAsyncRequest] == 4000, "recorded %u async calls instead of 4000.", selectorCounts[NullDriverReplaySelector_TaggedAsyncRequest]);
+    Check(failed == 1, "recorded %u failed calls instead of 1.", failed);
+    Check(payloadWords == trace->payload.size(), "the payload has %zu words, but the records add up to %llu.", trace->payload.size(), (unsigned long long)payloadWords);
+
+    // A file cut short is rejected, and so is one with the wrong magic.
+    std::vector<uint8_t> bytes;
+    FILE* file = fopen(kTracePath, "rb");
+    if (file != nullptr)
+    {
+        uint8_t buffer[4096];
+        size_t count = 0;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) != 0)
+        {
+            bytes.insert(bytes.end(), buffer, buffer + count);
+        }
+        fclose(file);
+    }
+
+    if (bytes.size() <= sizeof(NullDriverReplayFileHeader) + sizeof(NullDriverReplayRecord))
+    {
+        Check(false, "the saved trace is only %zu bytes.", bytes.size());
+        return;
+    }
+
+    const size_t truncatedSizes[] = { bytes.size() - 7, sizeof(NullDriverReplayFileHeader) + sizeof(NullDriverReplayRecord) / 2 };
+    for (size_t truncatedSize : truncatedSizes)
+    {
+        NullDriverReplayTrace rejected = {};
+
+        file = fopen(kTracePath, "wb");
+        fwrite(bytes.data(), 1, truncatedSize, file);
+        fclose(file);
+        Check(!NullDriverReplayRead(kTracePath, &rejected) && rejected.records.empty(), "a trace cut to %zu bytes was accepted.", truncatedSize);
+    }
+
+    NullDriverReplayTrace rejected = {};
+    bytes[0] ^= 0xff;
+    file = fopen(kTracePath, "wb");
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+    Check(!NullDriverReplayRead(kTracePath, &rejected), "a trace with the wrong magic was accepted.");
+
+    remove(kTracePath);
+}
+
+// MARK: Replay
+static void Replay(const char* name, const NullDriverReplayTrace* trace, double speed, uint32_t threadCount, NullDriverReplayResult* result)
+{
+    NullDriverReplayOptions options = { speed, threadCount, NullDriverBenchFormat_CSV };
+
+    bool connected = NullDriverReplayRun(&options, trace, CreateLoopbackTransport, nullptr, result);
+    printf("%-24s %6.1f %8u %10llu %12.1f %12.1f %10.1f %10.1f %10.1f\n", name, speed, threadCount, (unsigned long long)result->calls, result->elapsedNanoseconds / 1000000.0,
+           result->scheduledNanoseconds / 1000000.0, result->p50Nanoseconds / 1000.0, result->p50LateNanoseconds / 1000.0, result->p99LateNanoseconds / 1000.0);
+
+    Check(connected, "%s couldn't connect.", name);
+    Check(result->calls == trace->records.size(), "%s made %llu of %zu calls.", name, (unsigned long long)result->calls, trace->records.size());
+    Check((result->resultMismatches == 0) && (result->sizeMismatches == 0), "%s had %llu result and %llu size mismatches.", name, (unsigned long long)result->resultMismatches,
+          (unsigned long long)result->sizeMismatches);
+}
+
+int main(int argc, const char* argv[])
+{
+    NullDriverReplayRecorder* recorder = new NullDriverReplayRecorder();
+    NullDriverReplayTrace trace = {};
+    NullDriverReplayTrace paced = {};
+    NullDriverReplayResult result = {};
+
+    RecordBench(recorder);
+    CheckRoundTrip(recorder, &trace);
+    delete recorder;
+
+    printf("%-24s %6s %8s %10s %12s %12s %10s %10s %10s\n", "trace", "speed", "threads", "calls", "elapsed ms", "scheduled ms", "p50 us", "p50 late", "p99 late");
+
+    // The recorded bench ran flat out, so it can't replay faster than it was recorded. It has to reproduce every result, on any number of threads.
+    Replay("recorded bench", &trace, 1.0, 2, &result);
+    Replay("recorded bench", &trace, 0.0, 1, &result);
+    Replay("recorded bench", &trace, 0.0, 4, &result);
+
+    // The paced trace is mostly gaps, so replay takes as long as its schedule says, and calls go out close to on time.
+    MakePacedTrace(&paced);
+    const double speeds[] = { 1.0, 4.0, 0.0 };
+    for (double speed : speeds)
+    {
+        Replay("paced", &paced, speed, kPacedStreamCount, &result);
+        if (speed > 0.0)
+        {
+            Check(result.elapsedNanoseconds >= result.scheduledNanoseconds, "at %.0fx the paced trace finished early, in %llu ns of %llu.", speed, (unsigned long long)result.elapsedNanoseconds,
+                  (unsigned long long)result.scheduledNanoseconds);
+            Check(result.elapsedNanoseconds < result.scheduledNanoseconds * 2, "at %.0fx the paced trace took %llu ns of %llu.", speed, (unsigned long long)result.elapsedNanoseconds,
+                  (unsigned long long)result.scheduledNanoseconds);
+            Check(result.p50LateNanoseconds < kPacedGapNanoseconds / 4, "at %.0fx half the calls were more than %llu ns late.", speed, (unsigned long long)(kPacedGapNanoseconds / 4));
+        }
+        else
+        {
+            Check(result.elapsedNanoseconds < (kPacedCallsPerStream - 1) * kPacedGapNanoseconds / 4, "flat out, the paced trace took %llu ns.", (unsigned long long)result.elapsedNanoseconds);
+        }
+    }
+
+    return NullDriverCheckFinish();
+}
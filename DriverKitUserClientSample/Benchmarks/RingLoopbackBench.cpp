@@ -0,0 +1,270 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A loopback benchmark of the shared ring transport that runs without DriverKit.
+A second thread stands in for the dext, and is compared with a round trip per request that allocates its reply, like Checked Struct does.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread RingLoopbackBench.cpp -o RingLoopbackBench && ./RingLoopbackBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../Shared/NullDriverProtocol.h"
+#include "../Shared/NullDriverRing.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kRequestCount = 2000000;
+static const uint32_t kBatchSize = 256;
+static const uint32_t kDrainBatchSize = 64;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MARK: Shared Ring
+// Stands in for the dext's dispatch queue. A doorbell wakes it, and it drains the ring the same way NullDriver::DrainSubmissionRing does.
+struct RingServer
+{
+    NullDriverRing* submissionRing = nullptr;
+    NullDriverRing* completionRing = nullptr;
+    uint32_t submissionTail = 0;
+    uint32_t completionHead = 0;
+
+    std::mutex lock;
+    std::condition_variable doorbell;
+    bool drainScheduled = false;
+    bool stop = false;
+
+    void Ring(void)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (drainScheduled)
+            {
+                return;
+            }
+            drainScheduled = true;
+        }
+        doorbell.notify_one();
+    }
+
+    void Run(void)
+    {
+        NullDriverRingEntry entries[kDrainBatchSize];
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                doorbell.wait(guard, [this] { return drainScheduled || stop; });
+                if (stop)
+                {
+                    return;
+                }
+                drainScheduled = false;
+            }
+
+            uint32_t count = 0;
+            do
+            {
+                uint32_t budget = NullDriverRingFreeCount(completionRing, completionHead);
+                if (budget > kDrainBatchSize)
+                {
+                    budget = kDrainBatchSize;
+                }
+
+                count = NullDriverRingConsume(submissionRing, &submissionTail, entries, budget);
+                for (uint32_t index = 0; index < count; ++index)
+                {
+                    entries[index].foo = entries[index].foo + 1;
+                    entries[index].bar = entries[index].bar + 10;
+                    entries[index].status = 0;
+                }
+
+                NullDriverRingProduce(completionRing, &completionHead, entries, count);
+            } while (count != 0);
+        }
+    }
+};
+
+static double RunRing(void)
+{
+    NullDriverRing* submissionRing = (NullDriverRing*)aligned_alloc(64, sizeof(NullDriverRing));
+    NullDriverRing* completionRing = (NullDriverRing*)aligned_alloc(64, sizeof(NullDriverRing));
+    memset(submissionRing, 0, sizeof(NullDriverRing));
+    memset(completionRing, 0, sizeof(NullDriverRing));
+
+    RingServer server;
+    server.submissionRing = submissionRing;
+    server.completionRing = completionRing;
+    std::thread serverThread([&server] { server.Run(); });
+
+    NullDriverRingEntry batch[kBatchSize] = {};
+    uint32_t submissionHead = 0;
+    uint32_t completionTail = 0;
+    uint32_t submitted = 0;
+    uint32_t completed = 0;
+    uint32_t mismatches = 0;
+    uint32_t misordered = 0;
+    uint64_t doorbells = 0;
+
+    uint64_t startTime = NowNanoseconds();
+    while (completed < kRequestCount)
+    {
+        uint32_t reaped = NullDriverRingConsume(completionRing, &completionTail, batch, kBatchSize);
+        for (uint32_t index = 0; index < reaped; ++index)
+        {
+            if ((batch[index].foo != batch[index].tag + 1) || (batch[index].bar != 70010))
+            {
+                ++mismatches;
+            }
+
+            // The rings are FIFO, so a result that isn't the next tag means one was lost or repeated.
+            if (batch[index].tag != completed + index)
+            {
+                ++misordered;
+            }
+        }
+        completed += reaped;
+
+        uint32_t count = kRequestCount - submitted;
+        if (count > kBatchSize)
+        {
+            count = kBatchSize;
+        }
+
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            batch[index].tag = submitted + index;
+            batch[index].foo = submitted + index;
+            batch[index].bar = 70000;
+        }
+
+        count = NullDriverRingProduce(submissionRing, &submissionHead, batch, count);
+        submitted += count;
+
+        if ((count != 0) || (reaped != 0))
+        {
+            server.Ring();
+            ++doorbells;
+        }
+    }
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        server.stop = true;
+    }
+    server.doorbell.notify_one();
+    serverThread.join();
+
+    free(submissionRing);
+    free(completionRing);
+
+    printf("Shared ring:    %u results, %u mismatched, %llu doorbells.\n", completed, mismatches, (unsigned long long)doorbells);
+    Check(completed == kRequestCount, "The shared ring returned %u results for %u requests.", completed, kRequestCount);
+    Check(mismatches == 0, "The shared ring returned %u wrong results.", mismatches);
+    Check(misordered == 0, "The shared ring returned %u results out of order.", misordered);
+    return (double)kRequestCount * 1e9 / (double)elapsed;
+}
+
+// MARK: Call Per Request
+// Stands in for ExternalMethod with Checked Struct: one blocking round trip to the other thread per request, and a fresh reply allocation each time.
+struct CallServer
+{
+    std::mutex lock;
+    std::condition_variable requestReady;
+    std::condition_variable replyReady;
+    DataStruct request = {};
+    DataStruct* reply = nullptr;
+    bool hasRequest = false;
+    bool stop = false;
+
+    void Run(void)
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            requestReady.wait(guard, [this] { return hasRequest || stop; });
+            if (stop)
+            {
+                return;
+            }
+
+            DataStruct* output = (DataStruct*)malloc(sizeof(DataStruct));
+            output->foo = request.foo + 1;
+            output->bar = request.bar + 10;
+            reply = output;
+            hasRequest = false;
+            replyReady.notify_one();
+        }
+    }
+
+    DataStruct Call(const DataStruct& input)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        request = input;
+        hasRequest = true;
+        requestReady.notify_one();
+        replyReady.wait(guard, [this] { return reply != nullptr; });
+
+        DataStruct output = *reply;
+        free(reply);
+        reply = nullptr;
+        return output;
+    }
+};
+
+static double RunCallPerRequest(void)
+{
+    const uint32_t requestCount = kRequestCount / 10;
+
+    CallServer server;
+    std::thread serverThread([&server] { server.Run(); });
+
+    uint32_t mismatches = 0;
+    uint64_t startTime = NowNanoseconds();
+    for (uint32_t index = 0; index < requestCount; ++index)
+    {
+        const DataStruct input = { .foo = index, .bar = 70000 };
+        DataStruct output = server.Call(input);
+        if ((output.foo != input.foo + 1) || (output.bar != 70010))
+        {
+            ++mismatches;
+        }
+    }
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    {
+        std::lock_guard<std::mutex> guard(server.lock);
+        server.stop = true;
+    }
+    server.requestReady.notify_one();
+    serverThread.join();
+
+    printf("Call per request: %u results, %u mismatched.\n", requestCount, mismatches);
+    Check(mismatches == 0, "Call per request returned %u wrong results.", mismatches);
+    return (double)requestCount * 1e9 / (double)elapsed;
+}
+
+int main(int argc, const char* argv[])
+{
+    double ringRate = RunRing();
+    double callRate = RunCallPerRequest();
+
+    printf("Shared ring:      %12.0f ops/sec\n", ringRate);
+    printf("Call per request: %12.0f ops/sec\n", callRate);
+    printf("Speedup:          %12.1fx\n", ringRate / callRate);
+
+    return NullDriverCheckFinish();
+}
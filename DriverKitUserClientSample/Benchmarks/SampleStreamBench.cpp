@@ -0,0 +1,244 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Runs the sample stream of Shared/NullDriverSampleRing.h between two threads, without DriverKit.
+A producer thread stands in for SimulatedAsyncEvent: it wakes every tick, writes the samples that are due, and signals the consumer
+when the ring falls to its low-water mark. The consumer sleeps until then, reads the samples in place, and spends a chosen time on each one.
+The producer is first checked in simulated time: the due count at high rates, dropping once the ring is full, one notification per
+low-water crossing, and reads across the wrap. Then rates and consumer costs are swept, with the sustained rate, the share of samples
+dropped and the notifications per second reported. Every run checks that the sequence gaps the consumer saw add up to what the producer dropped.
+It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread SampleStreamBench.cpp -o SampleStreamBench && ./SampleStreamBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../Shared/NullDriverSampleRing.h"
+#include "NullDriverCheck.h"
+
+// How long each threaded run streams for.
+static const uint64_t kRunNanoseconds = 500000000ULL;
+
+static uint64_t Now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// What the consumer saw. "skipped" counts the sequence numbers that never reached it.
+typedef struct
+{
+    uint64_t read;
+    uint64_t skipped;
+    uint64_t mismatches;
+    uint64_t nextSequence;
+} ConsumerCounts;
+
+static void ReadSamples(NullDriverSampleRing* ring, uint32_t* tail, ConsumerCounts* counts, uint64_t costNanoseconds)
+{
+    const NullDriverSample* samples = nullptr;
+    uint32_t count = 0;
+
+    while ((count = NullDriverSampleRingPeek(ring, *tail, &samples)) != 0)
+    {
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            if (samples[index].sequence > counts->nextSequence)
+            {
+                counts->skipped += samples[index].sequence - counts->nextSequence;
+            }
+            if ((samples[index].foo != samples[index].sequence + 1) || (samples[index].bar != kNullDriverSampleBar + 10))
+            {
+                ++counts->mismatches;
+            }
+            counts->nextSequence = samples[index].sequence + 1;
+
+            // Stands in for whatever the client does with each sample.
+            if (costNanoseconds != 0)
+            {
+                const uint64_t until = Now() + costNanoseconds;
+                while (Now() < until)
+                {
+                }
+            }
+        }
+
+        counts->read += count;
+        NullDriverSampleRingRelease(ring, tail, count);
+    }
+}
+
+// MARK: Simulated Time
+static void CheckProducer()
+{
+    NullDriverSampleRing* ring = new NullDriverSampleRing();
+    NullDriverSampleProducer producer = {};
+    ConsumerCounts counts = {};
+    uint32_t tail = 0;
+    const uint64_t start = 1000000000ULL;
+    const uint32_t lowWaterMark = kNullDriverSampleRingEntryCount / 4;
+
+    // A day at the highest rate is far past where a plain product would overflow.
+    NullDriverSampleProducerStart(&producer, ring, kNullDriverSampleMaxRate, lowWaterMark, start);
+    Check(NullDriverSampleProducerDueBy(&producer, start + 86400ULL * 1000000000ULL) == 86400ULL * kNullDriverSampleMaxRate, "due count at the highest rate after a day is wrong");
+    Check(NullDriverSampleProducerDueBy(&producer, start - 1) == 0, "samples were due before the stream started");
+
+    // 1000 samples per second: sample N is due at N ms, and the producer wakes a tick later at the soonest.
+    NullDriverSampleProducerStart(&producer, ring, 1000, lowWaterMark, start);
+    Check(NullDriverSampleProducerDueBy(&producer, start + 2999999) == 2, "due count at 1000 per second is %llu, not 2", (unsigned long long)NullDriverSampleProducerDueBy(&producer, start + 2999999));
+    Check(NullDriverSampleProducerNextDeadline(&producer, start) == start + 1000000, "first deadline at 1000 per second is wrong");
+
+    // 1 sample per second: the next wakeup is the next sample, not the next tick.
+    NullDriverSampleProducerStart(&producer, ring, 1, lowWaterMark, start);
+    Check(NullDriverSampleProducerNextDeadline(&producer, start) == start + 1000000000ULL, "first deadline at 1 per second is wrong");
+
+    // Nothing is read while 10000 samples come due, so everything past the ring is dropped, and the client is notified once.
+    NullDriverSampleProducerStart(&producer, ring, 1000000, lowWaterMark, start);
+    uint32_t notifications = 0;
+    for (uint64_t now = start; now <= start + 10000000; now += kNullDriverSampleTickNanoseconds / 10)
+    {
+        notifications += NullDriverSampleProducerRun(&producer, ring, now) ? 1 : 0;
+    }
+    Check(producer.generated == 10000, "generated %llu samples, not 10000", (unsigned long long)producer.generated);
+    Check(producer.dropped == 10000 - kNullDriverSampleRingEntryCount, "dropped %llu samples with nothing read", (unsigned long long)producer.dropped);
+    Check(notifications == 1, "a full ring sent %u notifications, not 1", notifications);
+    Check(ring->produced == producer.generated && ring->dropped == producer.dropped, "the ring's counts don't match the producer's");
+
+    // Reading less than the mark doesn't re-arm the notification. Reading past it does.
+    const NullDriverSample* samples = nullptr;
+    uint32_t count = NullDriverSampleRingPeek(ring, tail, &samples);
+    Check(count == kNullDriverSampleRingEntryCount, "a full ring offered %u samples before the wrap", count);
+    NullDriverSampleRingRelease(ring, &tail, lowWaterMark / 2);
+    counts.read = lowWaterMark / 2;
+    counts.nextSequence = lowWaterMark / 2;
+    Check(!NullDriverSampleProducerRun(&producer, ring, start + 10500000), "notified again without the ring leaving the low-water mark");
+
+    ReadSamples(ring, &tail, &counts, 0);
+    uint64_t now = start + 20000000;
+    Check(NullDriverSampleProducerRun(&producer, ring, now), "not notified when the ring filled up a second time");
+
+    // Reading the rest crosses the wrap, and the gaps account for every dropped sample.
+    ReadSamples(ring, &tail, &counts, 0);
+    Check(counts.mismatches == 0, "%llu samples had the wrong contents", (unsigned long long)counts.mismatches);
+    Check(counts.skipped + (producer.generated - counts.nextSequence) == producer.dropped, "gaps of %llu don't match %llu dropped", (unsigned long long)counts.skipped, (unsigned long long)producer.dropped);
+    Check(counts.read + producer.dropped == producer.generated, "read and dropped don't add up to generated");
+
+    // Stopping keeps the counts, and writes nothing more.
+    const uint64_t generated = producer.generated;
+    NullDriverSampleProducerStart(&producer, ring, 0, lowWaterMark, now);
+    Check(!NullDriverSampleProducerRun(&producer, ring, now + 1000000000ULL) && (ring->produced == generated), "a stopped producer changed the ring");
+    Check(NullDriverSampleProducerNextDeadline(&producer, now) == 0, "a stopped producer asked for a wakeup");
+
+    // A tail past the head from the client leaves the producer no room, rather than a huge amount.
+    __atomic_store_n(&ring->tail, ring->head + 1, __ATOMIC_RELEASE);
+    Check(NullDriverSampleRingFreeCount(ring, ring->head) == 0, "a bad tail from the client gave the producer free space");
+
+    delete ring;
+}
+
+// MARK: Threaded Runs
+typedef struct
+{
+    double samplesPerSecond; // Read by the consumer.
+    double dropPercent;
+    double notificationsPerSecond;
+} RunResult;
+
+static RunResult RunStream(uint64_t samplesPerSecond, uint64_t costNanoseconds)
+{
+    NullDriverSampleRing* ring = new NullDriverSampleRing();
+    NullDriverSampleProducer producer = {};
+    ConsumerCounts counts = {};
+    uint32_t tail = 0;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    uint64_t notifications = 0;
+    bool stopped = false;
+    RunResult result = {};
+
+    const uint64_t start = Now();
+    NullDriverSampleProducerStart(&producer, ring, samplesPerSecond, kNullDriverSampleRingEntryCount / 2, start);
+
+    std::thread producerThread([&]() {
+        uint64_t now = start;
+        while (now < start + kRunNanoseconds)
+        {
+            if (NullDriverSampleProducerRun(&producer, ring, now))
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++notifications;
+                wakeup.notify_one();
+            }
+
+            const uint64_t deadline = NullDriverSampleProducerNextDeadline(&producer, now);
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline)));
+            now = Now();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        wakeup.notify_one();
+    });
+
+    uint64_t seen = 0;
+    while (true)
+    {
+        bool done = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [&]() { return stopped || (notifications != seen); });
+            seen = notifications;
+            done = stopped;
+        }
+
+        ReadSamples(ring, &tail, &counts, costNanoseconds);
+        if (done)
+        {
+            break;
+        }
+    }
+
+    producerThread.join();
+    const uint64_t elapsed = Now() - start;
+
+    Check(counts.mismatches == 0, "%llu samples had the wrong contents at %llu per second", (unsigned long long)counts.mismatches, (unsigned long long)samplesPerSecond);
+    Check(counts.skipped + (producer.generated - counts.nextSequence) == producer.dropped, "gaps of %llu don't match %llu dropped at %llu per second", (unsigned long long)counts.skipped, (unsigned long long)producer.dropped, (unsigned long long)samplesPerSecond);
+    Check(counts.read + producer.dropped == producer.generated, "read %llu and dropped %llu of %llu generated at %llu per second", (unsigned long long)counts.read, (unsigned long long)producer.dropped, (unsigned long long)producer.generated, (unsigned long long)samplesPerSecond);
+
+    result.samplesPerSecond = (double)counts.read * 1000000000.0 / (double)elapsed;
+    result.dropPercent = (producer.generated != 0) ? 100.0 * (double)producer.dropped / (double)producer.generated : 0.0;
+    result.notificationsPerSecond = (double)notifications * 1000000000.0 / (double)elapsed;
+
+    delete ring;
+    return result;
+}
+
+int main()
+{
+    const uint64_t rates[] = { 10000, 100000, 1000000, 10000000 };
+    const uint64_t costs[] = { 0, 100, 1000 };
+
+    CheckProducer();
+
+    printf("Ring of %u samples, notified at half full, producer tick %llu us.\n", kNullDriverSampleRingEntryCount, kNullDriverSampleTickNanoseconds / 1000);
+    printf("%12s %10s %14s %10s %16s\n", "rate", "cost ns", "samples/s", "drop %", "notifications/s");
+    for (uint64_t rate : rates)
+    {
+        for (uint64_t cost : costs)
+        {
+            const RunResult result = RunStream(rate, cost);
+            printf("%12llu %10llu %14.0f %10.2f %16.1f\n", (unsigned long long)rate, (unsigned long long)cost, result.samplesPerSecond, result.dropPercent, result.notificationsPerSecond);
+        }
+    }
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,264 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks how Shared/NullDriverScatterGather.h parses and resolves segment lists, and compares transforming data spread over a registered buffer
+in place with gathering it into one array first, transforming that, and scattering the results back, across segment sizes.
+Both paths make the same number of calls, so the difference is the copying the scatter-gather list saves. The dext's cost of receiving the
+staged array with the call, or mapping it when it's too large to pass inline, comes on top of that, so the real difference is larger.
+It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 ScatterGatherBench.cpp -o ScatterGatherBench && ./ScatterGatherBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "../Shared/NullDriverProtocol.h"
+#include "../Shared/NullDriverScatterGather.h"
+#include "../Shared/NullDriverTransform.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kSegmentCount = 64;
+static const uint64_t kBytesPerSize = 1024ULL * 1024 * 1024;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MARK: Parsing
+// The header comes from the client, so every way the count and the size can disagree has to be refused.
+static void CheckSegmentCount(void)
+{
+    NullDriverScatterGatherHeader header = {};
+
+    header.segmentCount = 3;
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(3)) == 3, "a well-formed list of 3 is refused");
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(2)) == 0, "a list shorter than its count is allowed");
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(4)) == 0, "a list longer than its count is allowed");
+    Check(NullDriverScatterGatherSegmentCount(&header, sizeof(header) - 1) == 0, "a request shorter than the header is allowed");
+
+    header.reserved = 1;
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(3)) == 0, "a nonzero reserved field is allowed");
+
+    header.reserved = 0;
+    header.segmentCount = 0;
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(0)) == 0, "an empty list is allowed");
+
+    header.segmentCount = kNullDriverScatterGatherMaxSegments;
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(kNullDriverScatterGatherMaxSegments)) == kNullDriverScatterGatherMaxSegments, "the longest list is refused");
+
+    header.segmentCount = kNullDriverScatterGatherMaxSegments + 1;
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(kNullDriverScatterGatherMaxSegments + 1)) == 0, "a list past the limit is allowed");
+
+    // A count that would overflow a 32-bit size still has to be refused by the limit, not wrap into a match.
+    header.segmentCount = UINT32_MAX;
+    Check(NullDriverScatterGatherSegmentCount(&header, NullDriverScatterGatherRequestSize(UINT32_MAX)) == 0, "a huge count is allowed");
+
+    Check(NullDriverScatterGatherRequestSize(kNullDriverScatterGatherMaxSegments) < kNullDriverInlineStructureSize, "the longest list isn't passed inline");
+}
+
+// MARK: Resolving
+// Each segment gets its own status, and a bad one doesn't stop the rest of the list.
+static void CheckResolve(void)
+{
+    static uint8_t first[4096];
+    static uint8_t second[1024];
+    NullDriverRegisteredBufferTable table = {};
+    void* regions[8] = {};
+    uint32_t statuses[8] = {};
+
+    table.addresses[0] = (uint64_t)(uintptr_t)first;
+    table.lengths[0] = sizeof(first);
+    table.addresses[2] = (uint64_t)(uintptr_t)second;
+    table.lengths[2] = sizeof(second);
+
+    const NullDriverSegment segments[] = {
+        { .buffer = 0, .offset = 0, .length = 64 }, // Done.
+        { .buffer = 2, .offset = 1008, .length = 16 }, // Done, the last DataStruct of the second buffer.
+        { .buffer = 2, .offset = 1008, .length = 32 }, // Past the end.
+        { .buffer = 1, .offset = 0, .length = 16 }, // Not registered.
+        { .buffer = 0, .offset = 48, .length = 32 }, // Shares 16 bytes with the first segment.
+        { .buffer = 0, .offset = 64, .length = 64 }, // Right after the first segment, which is fine.
+        { .buffer = 2, .offset = 992, .length = 64 }, // Past the end, so it doesn't count against the next one.
+        { .buffer = 2, .offset = 992, .length = 16 }, // Done, next to the second segment.
+    };
+    const uint32_t expected[] = {
+        NullDriverSegmentStatus_Done, NullDriverSegmentStatus_Done, NullDriverSegmentStatus_OutOfBounds, NullDriverSegmentStatus_OutOfBounds,
+        NullDriverSegmentStatus_Overlaps, NullDriverSegmentStatus_Done, NullDriverSegmentStatus_OutOfBounds, NullDriverSegmentStatus_Done,
+    };
+
+    const uint64_t total = NullDriverScatterGatherResolve(&table, segments, 8, regions, statuses);
+    for (uint32_t index = 0; index < 8; ++index)
+    {
+        Check(statuses[index] == expected[index], "segment %u has status %u, not %u", index, statuses[index], expected[index]);
+        Check((regions[index] != nullptr) == (expected[index] == NullDriverSegmentStatus_Done), "segment %u resolved to the wrong region", index);
+    }
+    Check(total == 64 + 16 + 64 + 16, "resolved %llu bytes, not 160", (unsigned long long)total);
+    Check(regions[1] == second + 1008, "the second segment points at the wrong place");
+
+    // The same region twice would be transformed twice.
+    const NullDriverSegment repeated[] = { { .buffer = 0, .offset = 128, .length = 32 }, { .buffer = 0, .offset = 128, .length = 32 } };
+    NullDriverScatterGatherResolve(&table, repeated, 2, regions, statuses);
+    Check((statuses[0] == NullDriverSegmentStatus_Done) && (statuses[1] == NullDriverSegmentStatus_Overlaps), "a repeated segment isn't refused");
+
+    // Once a segment is out of order, overlaps with any earlier segment are still found, not just with the one before it.
+    const NullDriverSegment unordered[] = {
+        { .buffer = 0, .offset = 256, .length = 64 },
+        { .buffer = 0, .offset = 0, .length = 64 },
+        { .buffer = 0, .offset = 512, .length = 64 },
+        { .buffer = 0, .offset = 288, .length = 16 }, // Inside the first segment.
+        { .buffer = 0, .offset = 128, .length = 64 }, // Between the others, which is fine.
+    };
+    NullDriverScatterGatherResolve(&table, unordered, 5, regions, statuses);
+    Check((statuses[0] == NullDriverSegmentStatus_Done) && (statuses[1] == NullDriverSegmentStatus_Done) && (statuses[2] == NullDriverSegmentStatus_Done) &&
+          (statuses[3] == NullDriverSegmentStatus_Overlaps) && (statuses[4] == NullDriverSegmentStatus_Done), "segments out of order are resolved wrong");
+
+    // Transforming what resolved touches only those segments.
+    DataStruct* data = (DataStruct*)first;
+    for (uint32_t index = 0; index < sizeof(first) / sizeof(DataStruct); ++index)
+    {
+        data[index] = { .foo = index, .bar = 70000 };
+    }
+    NullDriverScatterGatherResolve(&table, segments, 8, regions, statuses);
+    for (uint32_t index = 0; index < 8; ++index)
+    {
+        if (regions[index] != nullptr)
+        {
+            NullDriverTransformDataStructs(regions[index], regions[index], segments[index].length / sizeof(DataStruct));
+        }
+    }
+    for (uint32_t index = 0; index < 16; ++index)
+    {
+        const bool transformed = (index < 8);
+        Check((data[index].foo == index + (transformed ? 1 : 0)) && (data[index].bar == (transformed ? 70010U : 70000U)), "DataStruct %u of the first buffer is wrong", index);
+    }
+}
+
+// MARK: Cost
+// The segments sit in one buffer with a gap the size of a segment after each, like fields scattered through an application's data.
+static void FillSegments(NullDriverSegment* segments, uint64_t segmentSize)
+{
+    for (uint32_t index = 0; index < kSegmentCount; ++index)
+    {
+        segments[index] = { .buffer = 0, .offset = 2 * index * segmentSize, .length = segmentSize };
+    }
+}
+
+// Gather the segments into one array, transform it into a second array as a batch call would, and scatter the results back.
+static uint64_t MeasureStaged(const NullDriverRegisteredBufferTable* table, const NullDriverSegment* segments, uint8_t* staging, uint8_t* results, uint64_t callCount)
+{
+    uint8_t* base = (uint8_t*)(uintptr_t)table->addresses[0];
+    const uint64_t segmentSize = segments[0].length;
+    uint64_t startTime = NowNanoseconds();
+
+    for (uint64_t call = 0; call < callCount; ++call)
+    {
+        for (uint32_t index = 0; index < kSegmentCount; ++index)
+        {
+            memcpy(staging + index * segmentSize, base + segments[index].offset, segmentSize);
+        }
+
+        NullDriverTransformDataStructs(staging, results, kSegmentCount * segmentSize / sizeof(DataStruct));
+
+        for (uint32_t index = 0; index < kSegmentCount; ++index)
+        {
+            memcpy(base + segments[index].offset, results + index * segmentSize, segmentSize);
+        }
+    }
+
+    return NowNanoseconds() - startTime;
+}
+
+// What ExternalMethodType_ScatterGather does: resolve the list, and transform every segment where it is.
+static uint64_t MeasureScatterGather(const NullDriverRegisteredBufferTable* table, const NullDriverSegment* segments, uint64_t callCount)
+{
+    void* regions[kSegmentCount];
+    uint32_t statuses[kSegmentCount];
+    uint64_t startTime = NowNanoseconds();
+
+    for (uint64_t call = 0; call < callCount; ++call)
+    {
+        NullDriverScatterGatherResolve(table, segments, kSegmentCount, regions, statuses);
+        for (uint32_t index = 0; index < kSegmentCount; ++index)
+        {
+            if (regions[index] != nullptr)
+            {
+                NullDriverTransformDataStructs(regions[index], regions[index], segments[index].length / sizeof(DataStruct));
+            }
+        }
+    }
+
+    return NowNanoseconds() - startTime;
+}
+
+// Every DataStruct in a segment started at (its index, 70000) and was transformed "callCount" times. The gaps weren't touched.
+static bool CheckBuffer(const DataStruct* data, uint64_t segmentSize, uint64_t callCount)
+{
+    const uint64_t perSegment = segmentSize / sizeof(DataStruct);
+
+    for (uint64_t index = 0; index < kSegmentCount * 2 * perSegment; ++index)
+    {
+        const uint64_t steps = ((index / perSegment) % 2 == 0) ? callCount : 0;
+        if ((data[index].foo != index + steps) || (data[index].bar != 70000 + 10 * steps))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void ResetBuffer(DataStruct* data, uint64_t count)
+{
+    for (uint64_t index = 0; index < count; ++index)
+    {
+        data[index] = { .foo = index, .bar = 70000 };
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    const uint64_t segmentSizes[] = { 64, 256, 1024, 4096 };
+    const uint64_t bufferSize = 2 * kSegmentCount * 4096;
+    NullDriverRegisteredBufferTable table = {};
+    NullDriverSegment segments[kSegmentCount];
+
+    CheckSegmentCount();
+    CheckResolve();
+
+    DataStruct* buffer = new DataStruct[bufferSize / sizeof(DataStruct)];
+    uint8_t* staging = new uint8_t[bufferSize / 2];
+    uint8_t* results = new uint8_t[bufferSize / 2];
+
+    table.addresses[0] = (uint64_t)(uintptr_t)buffer;
+    table.lengths[0] = bufferSize;
+
+    printf("%10s %10s %12s %16s %16s %10s\n", "seg bytes", "segments", "calls", "staged ns/call", "sg ns/call", "speedup");
+    for (uint64_t segmentSize : segmentSizes)
+    {
+        const uint64_t callCount = kBytesPerSize / (kSegmentCount * segmentSize);
+        FillSegments(segments, segmentSize);
+
+        ResetBuffer(buffer, bufferSize / sizeof(DataStruct));
+        uint64_t staged = MeasureStaged(&table, segments, staging, results, callCount);
+        Check(CheckBuffer(buffer, segmentSize, callCount), "staging %llu byte segments gave the wrong results", (unsigned long long)segmentSize);
+
+        ResetBuffer(buffer, bufferSize / sizeof(DataStruct));
+        uint64_t scatterGather = MeasureScatterGather(&table, segments, callCount);
+        Check(CheckBuffer(buffer, segmentSize, callCount), "scatter-gather of %llu byte segments gave the wrong results", (unsigned long long)segmentSize);
+
+        printf("%10llu %10u %12llu %16.0f %16.0f %9.2fx\n", (unsigned long long)segmentSize, kSegmentCount, (unsigned long long)callCount, (double)staged / callCount, (double)scatterGather / callCount, (double)staged / scatterGather);
+    }
+
+    delete[] buffer;
+    delete[] staging;
+    delete[] results;
+
+    return NullDriverCheckFinish();
+}
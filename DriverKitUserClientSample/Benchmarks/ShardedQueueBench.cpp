@@ -0,0 +1,251 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Measures completion throughput against the number of worker queues the dext spreads shared clients across, and checks that every client's
+completions still run in the order they were scheduled.
+Each queue is a thread draining a FIFO, which stands in for a serial IODispatchQueue. Work items either spin, like the transform, or block,
+like waiting on a device, so the run shows both the CPU-bound limit and the latency hiding more queues give.
+It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread ShardedQueueBench.cpp -o ShardedQueueBench && ./ShardedQueueBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../Shared/NullDriverShard.h"
+#include "NullDriverCheck.h"
+
+static const uint32_t kClientCount = 16;
+static const uint32_t kRequestsPerClient = 400;
+static const uint64_t kSpinNanoseconds = 20000;
+static const uint64_t kBlockNanoseconds = 200000;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MARK: Serial Queue
+// Runs blocks one at a time, in the order they were dispatched, on a thread of its own.
+class SerialQueue
+{
+public:
+    SerialQueue() : worker([this] { Run(); }) {}
+
+    ~SerialQueue()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            cancelled = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    void DispatchAsync(std::function<void()> block)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            blocks.push_back(std::move(block));
+        }
+        wake.notify_one();
+    }
+
+private:
+    void Run()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+
+        for (;;)
+        {
+            wake.wait(guard, [this] { return cancelled || !blocks.empty(); });
+            if (blocks.empty())
+            {
+                return;
+            }
+
+            std::function<void()> block = std::move(blocks.front());
+            blocks.pop_front();
+
+            guard.unlock();
+            block();
+            guard.lock();
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> blocks;
+    bool cancelled = false;
+    std::thread worker;
+};
+
+// MARK: Shard Selection
+static void CheckShardSelection(void)
+{
+    Check(NullDriverShardCountFromProperty(0) == 1, "a missing count doesn't mean one queue");
+    Check(NullDriverShardCountFromProperty(4) == 4, "a count of 4 isn't kept");
+    Check(NullDriverShardCountFromProperty(1000) == kNullDriverMaxShardCount, "a huge count isn't clamped");
+
+    for (uint32_t shardCount = 1; shardCount <= kNullDriverMaxShardCount; ++shardCount)
+    {
+        uint32_t clients[kNullDriverMaxShardCount] = {};
+
+        // Client IDs start at 1.
+        for (uint64_t clientID = 1; clientID <= 4 * shardCount; ++clientID)
+        {
+            uint32_t shard = NullDriverShardForClient(clientID, shardCount);
+            Check(shard < shardCount, "client %llu is on queue %u of %u", (unsigned long long)clientID, shard, shardCount);
+            Check(NullDriverShardForClient(clientID, shardCount) == shard, "client %llu moved queues", (unsigned long long)clientID);
+            ++clients[shard % kNullDriverMaxShardCount];
+        }
+
+        for (uint32_t shard = 0; shard < shardCount; ++shard)
+        {
+            Check(clients[shard] == 4, "queue %u of %u has %u of %u clients", shard, shardCount, clients[shard], 4 * shardCount);
+        }
+    }
+}
+
+// MARK: Throughput
+typedef enum
+{
+    ShardBy_Client,
+    ShardBy_Tag,
+} ShardBy;
+
+typedef struct
+{
+    uint64_t nanoseconds;
+    uint32_t reordered;
+} RunResult;
+
+static void SpinFor(uint64_t nanoseconds)
+{
+    const uint64_t endTime = NowNanoseconds() + nanoseconds;
+
+    while (NowNanoseconds() < endTime)
+    {
+    }
+}
+
+// Every client schedules its requests in order, interleaved with the other clients, the way the dext's default queue hands them out.
+// Each completion checks that it follows the previous completion of the same client.
+static RunResult RunWorkload(uint32_t shardCount, bool blocking, ShardBy shardBy)
+{
+    std::vector<SerialQueue*> queues;
+    std::atomic<uint32_t> remaining(kClientCount * kRequestsPerClient);
+    std::atomic<uint32_t> reordered(0);
+    std::atomic<uint32_t> lastCompleted[kClientCount];
+    std::mutex doneLock;
+    std::condition_variable done;
+    RunResult result = {};
+
+    for (uint32_t shard = 0; shard < shardCount; ++shard)
+    {
+        queues.push_back(new SerialQueue());
+    }
+    for (std::atomic<uint32_t>& last : lastCompleted)
+    {
+        last.store(0);
+    }
+
+    uint64_t startTime = NowNanoseconds();
+
+    for (uint32_t request = 1; request <= kRequestsPerClient; ++request)
+    {
+        for (uint32_t client = 0; client < kClientCount; ++client)
+        {
+            const uint64_t clientID = client + 1;
+            // Clients number their own tags, so a tag only identifies a request together with its client.
+            const uint64_t tag = request;
+            const uint32_t shard = (shardBy == ShardBy_Client) ? NullDriverShardForClient(clientID, shardCount) : (uint32_t)(tag % shardCount);
+
+            queues[shard]->DispatchAsync([&, client, request] {
+                if (blocking)
+                {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(kBlockNanoseconds));
+                }
+                else
+                {
+                    SpinFor(kSpinNanoseconds);
+                }
+
+                if (lastCompleted[client].exchange(request, std::memory_order_relaxed) != request - 1)
+                {
+                    reordered.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    std::lock_guard<std::mutex> guard(doneLock);
+                    done.notify_one();
+                }
+            });
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(doneLock);
+        done.wait(guard, [&] { return remaining.load(std::memory_order_acquire) == 0; });
+    }
+
+    result.nanoseconds = NowNanoseconds() - startTime;
+    result.reordered = reordered.load();
+
+    for (SerialQueue* queue : queues)
+    {
+        delete queue;
+    }
+
+    return result;
+}
+
+static void MeasureScaling(bool blocking)
+{
+    const uint32_t shardCounts[] = { 1, 2, 4, 8, 16 };
+    const uint32_t requestCount = kClientCount * kRequestsPerClient;
+    double baseline = 0;
+
+    printf("%s work, %u clients, %u requests each:\n", blocking ? "Blocking" : "CPU-bound", kClientCount, kRequestsPerClient);
+    printf("%8s %16s %10s %18s\n", "queues", "completions/s", "speedup", "reordered by tag");
+
+    for (uint32_t shardCount : shardCounts)
+    {
+        RunResult byClient = RunWorkload(shardCount, blocking, ShardBy_Client);
+        RunResult byTag = RunWorkload(shardCount, blocking, ShardBy_Tag);
+        double throughput = (double)requestCount * 1e9 / byClient.nanoseconds;
+
+        if (baseline == 0)
+        {
+            baseline = throughput;
+        }
+
+        Check(byClient.reordered == 0, "%u completions ran out of order with %u queues sharded by client", byClient.reordered, shardCount);
+        printf("%8u %16.0f %9.2fx %18u\n", shardCount, throughput, throughput / baseline, byTag.reordered);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    CheckShardSelection();
+
+    printf("%u hardware threads.\n", std::thread::hardware_concurrency());
+    MeasureScaling(false);
+    MeasureScaling(true);
+
+    return NullDriverCheckFinish();
+}
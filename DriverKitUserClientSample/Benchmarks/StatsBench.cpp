@@ -0,0 +1,172 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks the per-selector counters and latency histograms against exact values, and measures the cost of recording one call.
+It exits with a failure status if any check fails, so it can be run as a test on any platform.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread StatsBench.cpp -o StatsBench && ./StatsBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../Shared/NullDriverStats.h"
+#include "NullDriverCheck.h"
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A small xorshift generator, so runs are repeatable on every platform.
+static uint64_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// MARK: Buckets
+// Every value lands in a bucket whose bounds contain it, the buckets tile the range without gaps, and no bucket is wider than a quarter of its lower bound.
+static void CheckBuckets(void)
+{
+    for (uint32_t bucket = 0; bucket + 1 < kNullDriverStatsBucketCount; ++bucket)
+    {
+        uint64_t lower = NullDriverStatsBucketLowerBound(bucket);
+        uint64_t upper = NullDriverStatsBucketUpperBound(bucket);
+
+        Check(NullDriverStatsBucketForNanoseconds(lower) == bucket, "lower bound %llu of bucket %u maps to bucket %u", (unsigned long long)lower, bucket, NullDriverStatsBucketForNanoseconds(lower));
+        Check(NullDriverStatsBucketForNanoseconds(upper) == bucket, "upper bound %llu of bucket %u maps to bucket %u", (unsigned long long)upper, bucket, NullDriverStatsBucketForNanoseconds(upper));
+        Check(upper + 1 == NullDriverStatsBucketLowerBound(bucket + 1), "gap after bucket %u", bucket);
+        Check((lower < kNullDriverStatsSubBucketCount) || ((upper - lower + 1) * kNullDriverStatsSubBucketCount <= lower), "bucket %u is too wide", bucket);
+    }
+
+    Check(NullDriverStatsBucketForNanoseconds(UINT64_MAX) == kNullDriverStatsBucketCount - 1, "UINT64_MAX isn't in the last bucket");
+}
+
+// MARK: Percentiles
+// Each percentile must come from the same bucket as the exact percentile of the recorded values, and never be below it.
+static void CheckPercentiles(void)
+{
+    static NullDriverStats stats;
+    const double fractions[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+    std::vector<uint64_t> values;
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+
+    memset(&stats, 0, sizeof(stats));
+
+    // Mostly fast calls with a long tail, like a handler that sometimes blocks.
+    for (uint32_t index = 0; index < 100000; ++index)
+    {
+        uint64_t value = 200 + NextRandom(&random) % 800;
+        if (index % 100 == 0)
+        {
+            value = 10000 + NextRandom(&random) % 90000;
+        }
+        if (index % 10000 == 0)
+        {
+            value = 5000000 + NextRandom(&random) % 5000000;
+        }
+
+        values.push_back(value);
+        NullDriverStatsRecord(&stats, 3, (index % 1000) == 0, 16, 16, value);
+    }
+    std::sort(values.begin(), values.end());
+
+    const NullDriverSelectorStats* selectorStats = &stats.selectors[3];
+    Check(selectorStats->calls == values.size(), "counted %llu calls", (unsigned long long)selectorStats->calls);
+    Check(selectorStats->errors == 100, "counted %llu errors", (unsigned long long)selectorStats->errors);
+    Check(selectorStats->bytesIn == values.size() * 16, "counted %llu bytes in", (unsigned long long)selectorStats->bytesIn);
+    Check(selectorStats->maxNanoseconds == values.back(), "maximum is %llu", (unsigned long long)selectorStats->maxNanoseconds);
+
+    for (double fraction : fractions)
+    {
+        size_t rank = (size_t)(fraction * values.size() + 0.999999);
+        uint64_t exact = values[(rank == 0) ? 0 : rank - 1];
+        uint64_t reported = NullDriverStatsPercentile(selectorStats, fraction);
+
+        Check((reported >= exact) && (NullDriverStatsBucketForNanoseconds(reported) == NullDriverStatsBucketForNanoseconds(exact)), "p%g is %llu, exact is %llu", fraction * 100, (unsigned long long)reported, (unsigned long long)exact);
+        printf("p%-6g exact %10llu  reported %10llu\n", fraction * 100, (unsigned long long)exact, (unsigned long long)reported);
+    }
+
+    NullDriverSelectorStats empty = {};
+    Check(NullDriverStatsPercentile(&empty, 0.5) == 0, "percentile of nothing isn't 0");
+}
+
+// MARK: Concurrency
+// Several threads record into the same selector, as calls from different threads of one client would. No update may be lost.
+static void CheckConcurrentRecording(void)
+{
+    static NullDriverStats stats;
+    static NullDriverStats snapshot;
+    const uint32_t threadCount = 4;
+    const uint32_t callsPerThread = 250000;
+    std::thread threads[threadCount];
+
+    memset(&stats, 0, sizeof(stats));
+    for (uint32_t thread = 0; thread < threadCount; ++thread)
+    {
+        threads[thread] = std::thread([thread] {
+            for (uint32_t call = 0; call < callsPerThread; ++call)
+            {
+                NullDriverStatsRecord(&stats, 7, false, 1, 2, thread * 1000 + call % 1000);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    NullDriverStatsSnapshot(&stats, 42, &snapshot);
+
+    uint64_t bucketTotal = 0;
+    for (uint32_t bucket = 0; bucket < kNullDriverStatsBucketCount; ++bucket)
+    {
+        bucketTotal += snapshot.selectors[7].buckets[bucket];
+    }
+
+    Check((snapshot.version == kNullDriverStatsVersion) && (snapshot.clientID == 42), "snapshot header is wrong");
+    Check(snapshot.selectors[7].calls == threadCount * callsPerThread, "counted %llu calls", (unsigned long long)snapshot.selectors[7].calls);
+    Check(bucketTotal == threadCount * callsPerThread, "histogram holds %llu calls", (unsigned long long)bucketTotal);
+    Check(snapshot.selectors[7].bytesOut == 2ULL * threadCount * callsPerThread, "counted %llu bytes out", (unsigned long long)snapshot.selectors[7].bytesOut);
+    Check(snapshot.selectors[7].maxNanoseconds == (threadCount - 1) * 1000 + 999, "maximum is %llu", (unsigned long long)snapshot.selectors[7].maxNanoseconds);
+    Check(NullDriverStatsPercentile(&snapshot.selectors[6], 0.5) == 0, "an unused selector has calls");
+}
+
+// MARK: Cost
+static void MeasureRecordCost(void)
+{
+    static NullDriverStats stats;
+    const uint32_t callCount = 10000000;
+
+    memset(&stats, 0, sizeof(stats));
+
+    uint64_t startTime = NowNanoseconds();
+    for (uint32_t call = 0; call < callCount; ++call)
+    {
+        NullDriverStatsRecord(&stats, call & 7, false, 16, 16, 100 + (call & 1023));
+    }
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    printf("Recording one call costs %.1f ns.\n", (double)elapsed / callCount);
+}
+
+int main(int argc, const char* argv[])
+{
+    CheckBuckets();
+    CheckPercentiles();
+    CheckConcurrentRecording();
+    MeasureRecordCost();
+
+    return NullDriverCheckFinish();
+}
@@ -0,0 +1,407 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Checks the chunked stream state, and compares moving a large payload through the single-shot descriptor path with streaming it through the
+double-buffered region. The dext is a thread that processes submitted chunks in place and reports progress. The client copies each chunk into
+the region and each result out, so both sides run at once.
+For the single-shot path, mmap and munmap of a shared file stand in for the mapping of structureInputDescriptor and structureOutputDescriptor on
+every call, as in RegisteredBufferBench. Absolute numbers differ from the dext's, but the work each path does is the same.
+It exits with a failure status if any check fails.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 -pthread StreamBench.cpp -o StreamBench && ./StreamBench
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "../Shared/NullDriverStream.h"
+#include "../Shared/NullDriverTransform.h"
+#include "NullDriverCheck.h"
+
+static const uint64_t kPayloadSize = 64ULL * 1024 * 1024;
+
+// The largest Checked Struct Batch call, 4096 DataStructs.
+static const uint64_t kBatchSize = 65536;
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MARK: State
+static void CheckState(void)
+{
+    NullDriverStreamState state = {};
+    uint32_t slot = 0;
+
+    Check(NullDriverStreamSubmit(&state, 0, 4096, &slot) == NullDriverStreamResult_OutOfOrder, "a chunk was accepted before the stream began");
+
+    Check(NullDriverStreamBegin(&state, 65536, 4000) == NullDriverStreamResult_BadArgument, "a chunk size that isn't whole pages was accepted");
+    Check(NullDriverStreamBegin(&state, 65536, 0) == NullDriverStreamResult_BadArgument, "a chunk size of 0 was accepted");
+    Check(NullDriverStreamBegin(&state, 65536, 2 * kNullDriverStreamMaxChunkSize) == NullDriverStreamResult_BadArgument, "a chunk size over the maximum was accepted");
+    Check(NullDriverStreamBegin(&state, 0, 4096) == NullDriverStreamResult_BadArgument, "an empty stream was accepted");
+    Check(NullDriverStreamBegin(&state, 65544, 4096) == NullDriverStreamResult_BadArgument, "a partial DataStruct was accepted");
+    Check(NullDriverStreamBegin(&state, kNullDriverStreamMaxLength + 16, 4096) == NullDriverStreamResult_BadArgument, "a stream over the maximum was accepted");
+    Check(NullDriverStreamBegin(&state, UINT64_MAX - 15, 4096) == NullDriverStreamResult_BadArgument, "a length near UINT64_MAX was accepted");
+
+    // 10000 bytes in 4096-byte chunks is two full chunks and one of 1808.
+    Check(NullDriverStreamBegin(&state, 10000, 4096) == NullDriverStreamResult_Success, "a valid stream was refused");
+    Check(NullDriverStreamChunkCount(&state) == 3, "the stream has %llu chunks instead of 3", (unsigned long long)NullDriverStreamChunkCount(&state));
+    Check(NullDriverStreamChunkLength(&state, 2) == 1808, "the last chunk is %llu bytes", (unsigned long long)NullDriverStreamChunkLength(&state, 2));
+    Check(NullDriverStreamChunkLength(&state, 3) == 0, "a chunk past the end has a length");
+
+    Check(NullDriverStreamSubmit(&state, 1, 4096, &slot) == NullDriverStreamResult_OutOfOrder, "a chunk was accepted out of order");
+    Check(NullDriverStreamSubmit(&state, 0, 1808, &slot) == NullDriverStreamResult_BadArgument, "a chunk of the wrong length was accepted");
+    Check((NullDriverStreamSubmit(&state, 0, 4096, &slot) == NullDriverStreamResult_Success) && (slot == 0), "chunk 0 wasn't accepted into slot 0");
+    Check((NullDriverStreamSubmit(&state, 1, 4096, &slot) == NullDriverStreamResult_Success) && (slot == 1), "chunk 1 wasn't accepted into slot 1");
+    Check(!NullDriverStreamIsIdle(&state), "a stream with chunks in flight is idle");
+    Check(NullDriverStreamSubmit(&state, 2, 1808, &slot) == NullDriverStreamResult_Busy, "chunk 2 was accepted while slot 0 was busy");
+
+    Check(NullDriverStreamComplete(&state, 0, 4096) == 4096, "the progress after chunk 0 is wrong");
+    Check((NullDriverStreamSubmit(&state, 2, 1808, &slot) == NullDriverStreamResult_Success) && (slot == 0), "chunk 2 wasn't accepted once slot 0 was free");
+    Check(NullDriverStreamSubmit(&state, 3, 0, &slot) == NullDriverStreamResult_OutOfOrder, "a chunk past the end was accepted");
+    Check(NullDriverStreamComplete(&state, 1, 4096) == 8192, "the progress after chunk 1 is wrong");
+    Check(NullDriverStreamComplete(&state, 0, 1808) == 10000, "the progress after the last chunk is wrong");
+    Check(NullDriverStreamIsIdle(&state), "a finished stream isn't idle");
+    Check(NullDriverStreamSlotOffset(&state, 1) == 4096, "slot 1 doesn't follow slot 0");
+    Check(NullDriverStreamRegionSize(4096) == 8192, "the region doesn't hold both slots");
+}
+
+// MARK: Simulated Dext
+// Chunks are processed one at a time on one thread, like the dext's dispatch queue, and progress is reported in order.
+class SimulatedStreamDext
+{
+public:
+    SimulatedStreamDext() : worker([this] { Run(); }) {}
+
+    ~SimulatedStreamDext()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        submitted.notify_one();
+        worker.join();
+    }
+
+    // What ExternalMethodType_StreamBegin does, apart from creating the region.
+    bool Begin(uint8_t* newRegion, uint64_t totalLength, uint32_t chunkSize)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!NullDriverStreamIsIdle(&state) || (NullDriverStreamBegin(&state, totalLength, chunkSize) != NullDriverStreamResult_Success))
+        {
+            return false;
+        }
+
+        region = newRegion;
+        completedChunks = 0;
+        completedBytes = 0;
+        return true;
+    }
+
+    // What ExternalMethodType_StreamChunk does: check the chunk and hand it to the queue.
+    NullDriverStreamResult SubmitChunk(uint64_t sequence, uint64_t length)
+    {
+        uint32_t slot = 0;
+        NullDriverStreamResult result = NullDriverStreamSubmit(&state, sequence, length, &slot);
+
+        if (result == NullDriverStreamResult_Success)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.push_back({ sequence, slot, length });
+            }
+            submitted.notify_one();
+        }
+
+        return result;
+    }
+
+    // Blocks until the progress for chunk "sequence" has arrived, like the client's run loop waiting for the AsyncCompletion.
+    void WaitForChunk(uint64_t sequence)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        progressed.wait(lock, [&] { return completedChunks > sequence; });
+    }
+
+    uint64_t CompletedBytes(void)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return completedBytes;
+    }
+
+private:
+    typedef struct
+    {
+        uint64_t sequence;
+        uint32_t slot;
+        uint64_t length;
+    } Chunk;
+
+    void Run(void)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;)
+        {
+            submitted.wait(lock, [&] { return stopping || !pending.empty(); });
+            if (pending.empty())
+            {
+                return;
+            }
+
+            Chunk chunk = pending.front();
+            pending.pop_front();
+            lock.unlock();
+
+            // What ProcessStreamChunk does.
+            uint64_t* data = (uint64_t*)(region + NullDriverStreamSlotOffset(&state, chunk.slot));
+            NullDriverTransformDataStructs(data, data, chunk.length / 16);
+            uint64_t progress = NullDriverStreamComplete(&state, chunk.slot, chunk.length);
+
+            lock.lock();
+            completedChunks = chunk.sequence + 1;
+            completedBytes = progress;
+            progressed.notify_one();
+        }
+    }
+
+    NullDriverStreamState state = {};
+    uint8_t* region = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable submitted;
+    std::condition_variable progressed;
+    std::deque<Chunk> pending;
+    uint64_t completedChunks = 0;
+    uint64_t completedBytes = 0;
+    bool stopping = false;
+
+    std::thread worker;
+};
+
+// The same loop as StreamPayload in the client. With "overlap" off, each chunk is collected before the next is copied in, as if there were one slot.
+static bool StreamPayload(SimulatedStreamDext* dext, uint8_t* region, const uint8_t* source, uint8_t* destination, uint64_t length, uint32_t chunkSize, bool overlap)
+{
+    NullDriverStreamState stream = {};
+    const uint64_t lag = overlap ? kNullDriverStreamSlotCount : 1;
+
+    if (!dext->Begin(region, length, chunkSize))
+    {
+        Check(false, "a stream of %llu bytes in chunks of %u wasn't begun", (unsigned long long)length, chunkSize);
+        return false;
+    }
+
+    NullDriverStreamBegin(&stream, length, chunkSize);
+    const uint64_t chunkCount = NullDriverStreamChunkCount(&stream);
+
+    auto collect = [&](uint64_t sequence)
+    {
+        dext->WaitForChunk(sequence);
+        memcpy(destination + sequence * chunkSize, region + NullDriverStreamSlotOffset(&stream, NullDriverStreamSlotForSequence(sequence)), NullDriverStreamChunkLength(&stream, sequence));
+    };
+
+    for (uint64_t sequence = 0; sequence < chunkCount; ++sequence)
+    {
+        const uint64_t chunkLength = NullDriverStreamChunkLength(&stream, sequence);
+
+        if (sequence >= lag)
+        {
+            collect(sequence - lag);
+        }
+
+        memcpy(region + NullDriverStreamSlotOffset(&stream, NullDriverStreamSlotForSequence(sequence)), source + sequence * chunkSize, chunkLength);
+        if (dext->SubmitChunk(sequence, chunkLength) != NullDriverStreamResult_Success)
+        {
+            Check(false, "chunk %llu was refused", (unsigned long long)sequence);
+            return false;
+        }
+    }
+
+    for (uint64_t sequence = (chunkCount > lag) ? chunkCount - lag : 0; sequence < chunkCount; ++sequence)
+    {
+        collect(sequence);
+    }
+
+    Check(dext->CompletedBytes() == length, "progress ended at %llu of %llu bytes", (unsigned long long)dext->CompletedBytes(), (unsigned long long)length);
+    return true;
+}
+
+// A chunk submitted into a slot the dext hasn't finished with is refused, however the client times it.
+static void CheckBusySlot(SimulatedStreamDext* dext, uint8_t* region)
+{
+    Check(dext->Begin(region, 3 * 4096, 4096), "a small stream wasn't begun");
+
+    NullDriverStreamResult first = dext->SubmitChunk(0, 4096);
+    NullDriverStreamResult second = dext->SubmitChunk(1, 4096);
+    NullDriverStreamResult third = dext->SubmitChunk(2, 4096);
+
+    Check((first == NullDriverStreamResult_Success) && (second == NullDriverStreamResult_Success), "the first two chunks were refused");
+    if (third != NullDriverStreamResult_Success)
+    {
+        Check(third == NullDriverStreamResult_Busy, "chunk 2 was refused with %u instead of Busy", third);
+        dext->WaitForChunk(0);
+        Check(dext->SubmitChunk(2, 4096) == NullDriverStreamResult_Success, "chunk 2 was refused after slot 0 was free");
+    }
+    dext->WaitForChunk(2);
+}
+
+// MARK: Single-Shot
+static int CreateClientMemory(void)
+{
+    char path[] = "/tmp/StreamBench.XXXXXX";
+    int file = mkstemp(path);
+
+    if (file < 0)
+    {
+        return -1;
+    }
+
+    unlink(path);
+    if (ftruncate(file, 2 * kPayloadSize) != 0)
+    {
+        close(file);
+        return -1;
+    }
+
+    return file;
+}
+
+// What Checked Struct Batch does with a payload larger than a page: map both descriptors, transform, and release both mappings, on every call.
+static bool SingleShotPayload(int file, uint64_t length)
+{
+    for (uint64_t offset = 0; offset < length; offset += kBatchSize)
+    {
+        void* input = mmap(nullptr, kBatchSize, PROT_READ, MAP_SHARED, file, offset);
+        void* output = mmap(nullptr, kBatchSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, kPayloadSize + offset);
+        if ((input == MAP_FAILED) || (output == MAP_FAILED))
+        {
+            Check(false, "mmap failed");
+            return false;
+        }
+
+        NullDriverTransformDataStructs(input, output, kBatchSize / 16);
+
+        munmap(input, kBatchSize);
+        munmap(output, kBatchSize);
+    }
+
+    return true;
+}
+
+static uint64_t CountMismatches(const uint64_t* destination, uint64_t length)
+{
+    uint64_t mismatches = 0;
+
+    for (uint64_t index = 0; index < length / 16; ++index)
+    {
+        if ((destination[index * 2] != index + 1) || (destination[index * 2 + 1] != 70010))
+        {
+            ++mismatches;
+        }
+    }
+
+    return mismatches;
+}
+
+// MARK: Throughput
+int main(int argc, const char* argv[])
+{
+    const uint32_t chunkSizes[] = { 65536, 262144, 1048576, 4194304 };
+    const uint32_t rounds = 3;
+
+    CheckState();
+
+    int file = CreateClientMemory();
+    if (file < 0)
+    {
+        printf("Failed to create the client memory file.\n");
+        return EXIT_FAILURE;
+    }
+
+    // The single-shot path reads the client's memory in place. The stream copies the same source into the region and the results back out.
+    uint64_t* source = (uint64_t*)mmap(nullptr, kPayloadSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    uint64_t* destination = (uint64_t*)mmap(nullptr, kPayloadSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, kPayloadSize);
+    uint8_t* region = (uint8_t*)malloc(NullDriverStreamRegionSize(kNullDriverStreamMaxChunkSize));
+    if ((source == MAP_FAILED) || (destination == MAP_FAILED) || (region == nullptr))
+    {
+        printf("Failed to map the client memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    for (uint64_t index = 0; index < kPayloadSize / 16; ++index)
+    {
+        source[index * 2] = index;
+        source[index * 2 + 1] = 70000;
+    }
+
+    SimulatedStreamDext dext;
+    CheckBusySlot(&dext, region);
+
+    printf("%llu MB payload, best of %u rounds.\n", (unsigned long long)(kPayloadSize >> 20), rounds);
+    printf("%24s %10s %10s\n", "path", "calls", "GB/s");
+
+    // -1 is the single-shot path. Every chunk size runs without overlap and with it.
+    for (int32_t chunkIndex = -1; chunkIndex < (int32_t)(sizeof(chunkSizes) / sizeof(chunkSizes[0])); ++chunkIndex)
+    {
+        for (uint32_t overlap = 0; overlap < ((chunkIndex < 0) ? 1U : 2U); ++overlap)
+        {
+            char pathName[32] = {};
+            uint64_t best = UINT64_MAX;
+            uint64_t callCount = 0;
+
+            for (uint32_t round = 0; round < rounds; ++round)
+            {
+                memset(destination, 0, kPayloadSize);
+
+                uint64_t startTime = NowNanoseconds();
+                if (chunkIndex < 0)
+                {
+                    SingleShotPayload(file, kPayloadSize);
+                }
+                else
+                {
+                    StreamPayload(&dext, region, (const uint8_t*)source, (uint8_t*)destination, kPayloadSize, chunkSizes[chunkIndex], overlap != 0);
+                }
+                uint64_t elapsed = NowNanoseconds() - startTime;
+
+                best = (elapsed < best) ? elapsed : best;
+                Check(CountMismatches(destination, kPayloadSize) == 0, "the destination has wrong DataStructs");
+            }
+
+            if (chunkIndex < 0)
+            {
+                snprintf(pathName, sizeof(pathName), "single-shot %llu KB", (unsigned long long)(kBatchSize / 1024));
+                callCount = kPayloadSize / kBatchSize;
+            }
+            else
+            {
+                snprintf(pathName, sizeof(pathName), "stream %u KB%s", chunkSizes[chunkIndex] / 1024, overlap ? "" : " serial");
+                callCount = 1 + kPayloadSize / chunkSizes[chunkIndex];
+            }
+
+            // Bytes per nanosecond is GB/s.
+            printf("%24s %10llu %10.2f\n", pathName, (unsigned long long)callCount, (double)kPayloadSize / best);
+        }
+    }
+
+    free(region);
+    munmap(source, kPayloadSize);
+    munmap(destination, kPayloadSize);
+    close(file);
+
+    return NullDriverCheckFinish();
+}
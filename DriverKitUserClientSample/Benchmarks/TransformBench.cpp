@@ -0,0 +1,189 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A microbenchmark of the DataStruct transform kernel against the per-struct code the handlers used before it.
+Every variant's output is checked against the per-struct code, both for plain DataStruct arrays and for pairs embedded in larger records.
+
+Build and run on Linux or macOS with:
+    c++ -std=c++17 -O2 TransformBench.cpp -o TransformBench && ./TransformBench
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "../Shared/NullDriverProtocol.h"
+#include "../Shared/NullDriverTransform.h"
+#include "NullDriverCheck.h"
+
+static uint64_t NowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// This is what each handler did for one struct: build the result in a local, then copy it out.
+// It's kept out of line, since each handler call transformed exactly one struct.
+__attribute__((noinline)) static void TransformOnePerStruct(const DataStruct* input, DataStruct* output)
+{
+    DataStruct result = {};
+    result.foo = input->foo + 1;
+    result.bar = input->bar + 10;
+    memcpy(output, &result, sizeof(DataStruct));
+}
+
+static void TransformPerStruct(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    for (size_t index = 0; index < count; ++index)
+    {
+        TransformOnePerStruct((const DataStruct*)(input + index * stride), (DataStruct*)(output + index * stride));
+    }
+}
+
+// This is what the handlers call now: inline scalar code for a few structs, the selected vector variant for more.
+static void TransformSelected(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    NullDriverTransformStrided(input, output, count, stride);
+}
+
+static bool Verify(const DataStruct* input, const DataStruct* output, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+    {
+        if ((output[index].foo != input[index].foo + 1) || (output[index].bar != input[index].bar + 10))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Runs "function" over records of "stride" words with the pair at word "offset", for every count up to a few vector widths past the threshold,
+// both in place and into a separate array. The other words of each record must come through untouched.
+static void CheckStrided(NullDriverTransformFunction function, const char* name, size_t stride, size_t offset)
+{
+    const size_t maxCount = kNullDriverTransformVectorThreshold + 9;
+    uint64_t input[maxCount * 8];
+    uint64_t expected[maxCount * 8];
+    uint64_t output[maxCount * 8];
+
+    for (size_t count = 0; count <= maxCount; ++count)
+    {
+        for (size_t word = 0; word < maxCount * stride; ++word)
+        {
+            input[word] = 0x1000 * word + 7;
+        }
+
+        memcpy(expected, input, sizeof(input));
+        TransformPerStruct(input + offset, expected + offset, count, stride);
+
+        memcpy(output, input, sizeof(input));
+        function(input + offset, output + offset, count, stride);
+        Check(memcmp(output, expected, maxCount * stride * sizeof(uint64_t)) == 0, "%s with stride %zu and %zu pairs differs from the per-struct code.", name, stride, count);
+
+        memcpy(output, input, sizeof(input));
+        function(output + offset, output + offset, count, stride);
+        Check(memcmp(output, expected, maxCount * stride * sizeof(uint64_t)) == 0, "%s in place with stride %zu and %zu pairs differs from the per-struct code.", name, stride, count);
+    }
+}
+
+// Runs "function" over "count" structs enough times to move about 2 GB, and returns the rate in GB/s.
+static double Measure(NullDriverTransformFunction function, const DataStruct* input, DataStruct* output, size_t count)
+{
+    const size_t bytes = count * sizeof(DataStruct);
+    const size_t iterations = (size_t)2e9 / bytes;
+
+    // Warm the caches and the branch predictors before timing.
+    for (size_t iteration = 0; iteration < iterations / 10 + 1; ++iteration)
+    {
+        function((const uint64_t*)input, (uint64_t*)output, count, 2);
+    }
+
+    uint64_t startTime = NowNanoseconds();
+    for (size_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        function((const uint64_t*)input, (uint64_t*)output, count, 2);
+        __asm__ volatile("" : : "r"(output) : "memory");
+    }
+    uint64_t elapsed = NowNanoseconds() - startTime;
+
+    return (double)(bytes * iterations) / (double)elapsed;
+}
+
+int main(int argc, const char* argv[])
+{
+    const size_t payloadSizes[] = { 16, 4096, 1 << 20 };
+    const size_t maxCount = (1 << 20) / sizeof(DataStruct);
+
+    DataStruct* input = (DataStruct*)aligned_alloc(64, maxCount * sizeof(DataStruct));
+    DataStruct* output = (DataStruct*)aligned_alloc(64, maxCount * sizeof(DataStruct));
+    for (size_t index = 0; index < maxCount; ++index)
+    {
+        input[index].foo = index;
+        input[index].bar = 70000 + index;
+    }
+
+    printf("Selected variant: ");
+    for (int variant = 0; variant < NumberOfNullDriverTransformVariants; ++variant)
+    {
+        if (NullDriverTransformGetVariant((NullDriverTransformVariant)variant) == NullDriverTransformBest())
+        {
+            printf("%s\n", NullDriverTransformVariantName((NullDriverTransformVariant)variant));
+        }
+    }
+
+    // The ring drain transforms NullDriverRingEntry records, with foo and bar at words 2 and 3 of 4.
+    // The completion path transforms NullDriverInFlightEntry records, with foo and bar at words 2 and 3 of 6.
+    const size_t strides[][2] = { { 2, 0 }, { 4, 2 }, { 6, 2 }, { 8, 5 } };
+    for (const size_t* stride : strides)
+    {
+        CheckStrided(TransformPerStruct, "per-struct", stride[0], stride[1]);
+        CheckStrided(NullDriverTransformStrided, "NullDriverTransformStrided", stride[0], stride[1]);
+        for (int variant = 0; variant < NumberOfNullDriverTransformVariants; ++variant)
+        {
+            NullDriverTransformFunction function = NullDriverTransformGetVariant((NullDriverTransformVariant)variant);
+            if (function != nullptr)
+            {
+                CheckStrided(function, NullDriverTransformVariantName((NullDriverTransformVariant)variant), stride[0], stride[1]);
+            }
+        }
+    }
+
+    printf("%10s %12s %10s %10s\n", "payload", "variant", "GB/s", "speedup");
+    for (size_t payloadSize : payloadSizes)
+    {
+        const size_t count = payloadSize / sizeof(DataStruct);
+
+        memset(output, 0, payloadSize);
+        double baseline = Measure(TransformPerStruct, input, output, count);
+        printf("%10zu %12s %10.2f %10s\n", payloadSize, "per-struct", baseline, "1.00x");
+        Check(Verify(input, output, count), "per-struct output of %zu bytes is wrong.", payloadSize);
+
+        memset(output, 0, payloadSize);
+        double selected = Measure(TransformSelected, input, output, count);
+        printf("%10zu %12s %10.2f %9.2fx\n", payloadSize, "selected", selected, selected / baseline);
+        Check(Verify(input, output, count), "selected output of %zu bytes is wrong.", payloadSize);
+
+        for (int variant = 0; variant < NumberOfNullDriverTransformVariants; ++variant)
+        {
+            NullDriverTransformFunction function = NullDriverTransformGetVariant((NullDriverTransformVariant)variant);
+            if (function == nullptr)
+            {
+                continue;
+            }
+
+            memset(output, 0, payloadSize);
+            double rate = Measure(function, input, output, count);
+            printf("%10zu %12s %10.2f %9.2fx\n", payloadSize, NullDriverTransformVariantName((NullDriverTransformVariant)variant), rate, rate / baseline);
+            Check(Verify(input, output, count), "%s output of %zu bytes is wrong.", NullDriverTransformVariantName((NullDriverTransformVariant)variant), payloadSize);
+        }
+    }
+
+    free(input);
+    free(output);
+
+    return NullDriverCheckFinish();
+}
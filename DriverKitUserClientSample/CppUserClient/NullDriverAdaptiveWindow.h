@@ -0,0 +1,130 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Decides how many async requests a client keeps in flight, from the latency of the ones that complete.
+While latency stays near the lowest seen, the device isn't queueing yet, so the window grows. Once latency rises well above it, requests are only
+waiting behind each other, so the window shrinks. This keeps the dext busy without building an unbounded queue in front of it.
+*/
+
+#ifndef NullDriverAdaptiveWindow_h
+#define NullDriverAdaptiveWindow_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../Shared/NullDriverInFlightTable.h"
+
+// The dext refuses tagged requests beyond this many per client, so no window is larger.
+#define kNullDriverAdaptiveWindowMax kNullDriverInFlightCapacity
+
+// Every this many epochs the window is halved and the base latency measured again, so a device that got slower for good isn't treated as queueing forever.
+#define kNullDriverAdaptiveWindowRefreshEpochs 64U
+
+// An epoch ends once as many requests have completed as the window allows, which is about one round trip.
+// Call NullDriverAdaptiveWindowInit before use.
+typedef struct
+{
+    uint32_t limit; // Requests allowed in flight now.
+    uint32_t minLimit;
+    uint32_t maxLimit;
+    uint32_t tolerancePercent; // How far the average latency may rise above the base before the window stops growing.
+    bool slowStart; // Doubles the window each epoch until latency first rises, then grows by one.
+
+    uint64_t baseLatency; // The lowest latency seen since the last refresh, in nanoseconds.
+    uint64_t epochLatencySum;
+    uint64_t epochMinLatency;
+    uint32_t epochCompletions;
+    uint32_t epochsSinceRefresh;
+
+    uint64_t epochs;
+    uint64_t increases;
+    uint64_t decreases;
+} NullDriverAdaptiveWindow;
+
+static inline void NullDriverAdaptiveWindowInit(NullDriverAdaptiveWindow* window, uint32_t minLimit, uint32_t maxLimit, uint32_t tolerancePercent)
+{
+    if (minLimit == 0)
+    {
+        minLimit = 1;
+    }
+    if (maxLimit > kNullDriverAdaptiveWindowMax)
+    {
+        maxLimit = kNullDriverAdaptiveWindowMax;
+    }
+    if (maxLimit < minLimit)
+    {
+        maxLimit = minLimit;
+    }
+
+    *window = {};
+    window->limit = minLimit;
+    window->minLimit = minLimit;
+    window->maxLimit = maxLimit;
+    window->tolerancePercent = tolerancePercent;
+    window->slowStart = true;
+    window->baseLatency = UINT64_MAX;
+    window->epochMinLatency = UINT64_MAX;
+}
+
+// Records one completed request, and at the end of each epoch moves the limit.
+static inline void NullDriverAdaptiveWindowRecord(NullDriverAdaptiveWindow* window, uint64_t latencyNanoseconds)
+{
+    window->epochLatencySum += latencyNanoseconds;
+    window->epochCompletions += 1;
+    if (latencyNanoseconds < window->epochMinLatency)
+    {
+        window->epochMinLatency = latencyNanoseconds;
+    }
+
+    if (window->epochCompletions < window->limit)
+    {
+        return;
+    }
+
+    const uint64_t average = window->epochLatencySum / window->epochCompletions;
+
+    if (window->epochMinLatency < window->baseLatency)
+    {
+        window->baseLatency = window->epochMinLatency;
+    }
+
+    // Written as divisions of the base, so a base near UINT64_MAX can't overflow.
+    const uint64_t growBelow = window->baseLatency + window->baseLatency / 100 * window->tolerancePercent;
+    const uint64_t shrinkAbove = window->baseLatency + window->baseLatency / 100 * (2 * window->tolerancePercent);
+
+    ++window->epochs;
+    ++window->epochsSinceRefresh;
+
+    if (window->epochsSinceRefresh >= kNullDriverAdaptiveWindowRefreshEpochs)
+    {
+        // With half the requests in flight, the next epoch's latencies show what the device takes now without most of the queueing.
+        window->limit = (window->limit / 2 > window->minLimit) ? window->limit / 2 : window->minLimit;
+        window->baseLatency = UINT64_MAX;
+        window->epochsSinceRefresh = 0;
+        ++window->decreases;
+    }
+    else if (average <= growBelow)
+    {
+        uint32_t grown = window->slowStart ? window->limit * 2 : window->limit + 1;
+        window->limit = (grown < window->maxLimit) ? grown : window->maxLimit;
+        ++window->increases;
+    }
+    else if (average > shrinkAbove)
+    {
+        uint32_t shrunk = window->limit - window->limit / 4;
+        window->limit = (shrunk > window->minLimit) ? shrunk : window->minLimit;
+        window->slowStart = false;
+        ++window->decreases;
+    }
+    else
+    {
+        window->slowStart = false;
+    }
+
+    window->epochLatencySum = 0;
+    window->epochMinLatency = UINT64_MAX;
+    window->epochCompletions = 0;
+}
+
+#endif /* NullDriverAdaptiveWindow_h */
@@ -0,0 +1,1162 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The workload loop, latency statistics and report formats behind CppUserClient's non-interactive bench mode.
+Each thread has its own connection, and can make one kind of call or a weighted mix of them, so the bench doubles as a load generator.
+Calls go through NullDriverBenchTransport, so the same bench runs against the dext through IOKit, or against an in-process stand-in of its
+handlers on any platform.
+*/
+
+#ifndef NullDriverBench_h
+#define NullDriverBench_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../Shared/NullDriverDevice.h"
+#include "../Shared/NullDriverProtocol.h"
+#include "../Shared/NullDriverStats.h"
+#include "NullDriverCoalescer.h"
+
+// The largest batch the dext accepts in one ExternalMethodType_CheckedStructBatch call, in bytes.
+#define kNullDriverBenchMaxBatchSize (kNullDriverMaxStructBatchCount * (uint32_t)sizeof(DataStruct))
+
+// Up to this many scalars can be passed each way in one call.
+#define kNullDriverBenchMaxScalarCount 16U
+
+// The most threads, and so connections, one bench runs.
+#define kNullDriverBenchMaxThreads 1024U
+
+typedef enum
+{
+    NullDriverBenchWorkload_Scalar = 0, // ExternalMethodType_Scalar, with payload / 8 scalars in and out.
+    NullDriverBenchWorkload_Struct = 1, // ExternalMethodType_CheckedStruct. The payload is always one DataStruct.
+    NullDriverBenchWorkload_StructBatch = 2, // ExternalMethodType_CheckedStructBatch, with payload / 16 DataStructs in and out.
+    NullDriverBenchWorkload_Async = 3, // ExternalMethodType_TaggedAsyncRequest with no delay, waiting for each completion before the next request.
+    NullDriverBenchWorkload_Mix = 4, // Each call is one of the above, picked at random with the weights in "mixWeights".
+    NumberOfNullDriverBenchWorkloads // Has to be last
+} NullDriverBenchWorkload;
+
+// The workloads a mix can be made of.
+#define kNullDriverBenchMixableWorkloadCount NullDriverBenchWorkload_Mix
+
+typedef enum
+{
+    NullDriverBenchFormat_JSON = 0,
+    NullDriverBenchFormat_CSV = 1,
+} NullDriverBenchFormat;
+
+typedef struct
+{
+    NullDriverBenchWorkload workload;
+    uint64_t iterations; // Measured calls on each thread.
+    uint32_t payloadSize; // In bytes. Zero picks the usual size for the workload. In a mix, only batch calls use it, and the rest use their usual size.
+    uint32_t threadCount;
+    uint64_t warmupMilliseconds; // Each thread calls for this long before it starts measuring.
+    NullDriverBenchFormat format;
+    const char* recordPath; // If set, every call is recorded to a trace at this path, which NullDriverReplay.h can replay.
+    uint32_t mixWeights[kNullDriverBenchMixableWorkloadCount]; // Relative share of each workload in a mix.
+    bool configureDevice; // If set, the caller configures the simulated device with "device" before the run, and puts back the configuration it replaced after.
+    NullDriverDeviceConfig device;
+    bool coalesce; // If set, the struct calls of every thread go through one NullDriverCoalescer, set up with "coalescer".
+    NullDriverCoalescerConfig coalescer;
+} NullDriverBenchOptions;
+
+// The throughput and tail latency of one part of a run: one thread, or one workload of a mix.
+typedef struct
+{
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t elapsedNanoseconds;
+    uint64_t p50Nanoseconds;
+    uint64_t p99Nanoseconds;
+    uint64_t p999Nanoseconds;
+} NullDriverBenchSummary;
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t errors; // Calls the transport failed.
+    uint64_t mismatches; // Calls that succeeded but returned the wrong data.
+    uint64_t bytes; // Payload bytes of the calls that succeeded, counted once.
+    uint64_t elapsedNanoseconds; // From the first measured call on any thread to the last one to finish.
+    uint64_t minNanoseconds;
+    uint64_t meanNanoseconds;
+    uint64_t p50Nanoseconds;
+    uint64_t p90Nanoseconds;
+    uint64_t p99Nanoseconds;
+    uint64_t p999Nanoseconds;
+    uint64_t maxNanoseconds;
+    uint64_t buckets[kNullDriverStatsBucketCount]; // The same buckets the dext uses for its own stats.
+    NullDriverBenchSummary threads[kNullDriverBenchMaxThreads]; // Each thread timed from its own first measured call to its last.
+    NullDriverBenchSummary workloads[kNullDriverBenchMixableWorkloadCount]; // Only filled in for a mix, timed over the whole run.
+    NullDriverCoalescerStats coalescer; // Only filled in with "coalesce" set, from the measured calls.
+} NullDriverBenchResult;
+
+// One connection to the dext, used by one thread at a time. Every call returns 0 (kIOReturnSuccess) or an error.
+// Scalars come back as input + 1, and each (foo, bar) pair of a DataStruct as (foo + 1, bar + 10).
+class NullDriverBenchTransport
+{
+public:
+    virtual ~NullDriverBenchTransport() {}
+
+    virtual int32_t CallScalar(const uint64_t* input, uint32_t inputCount, uint64_t* output, uint32_t* outputCount) = 0;
+    virtual int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) = 0;
+    virtual int32_t CallCheckedStructBatch(const uint64_t* input, size_t inputSize, uint64_t* output, size_t* outputSize) = 0;
+
+    // Sends one tagged request and returns once its result has arrived in "output".
+    virtual int32_t CallTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t* output) = 0;
+};
+
+// Sends struct calls through a NullDriverCoalescer that every thread shares, and everything else straight to the thread's own transport.
+// A batch is sent on the thread that opened it, through that thread's transport, so each transport is still only used by its own thread.
+class NullDriverBenchCoalescingTransport : public NullDriverBenchTransport
+{
+public:
+    // Takes ownership of "wrapped".
+    NullDriverBenchCoalescingTransport(NullDriverBenchTransport* wrapped, NullDriverCoalescer* shared) : transport(wrapped), coalescer(shared) {}
+
+    ~NullDriverBenchCoalescingTransport() override
+    {
+        delete transport;
+    }
+
+    int32_t CallScalar(const uint64_t* input, uint32_t inputCount, uint64_t* output, uint32_t* outputCount) override
+    {
+        return transport->CallScalar(input, inputCount, output, outputCount);
+    }
+
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        NullDriverCoalescerOutcome outcome = {};
+        int32_t ret = coalescer->Submit(CallBatch, transport, (const DataStruct*)input, (DataStruct*)output, &outcome);
+
+        NullDriverCoalescerStatsRecord(&stats, &outcome, ret);
+        return ret;
+    }
+
+    int32_t CallCheckedStructBatch(const uint64_t* input, size_t inputSize, uint64_t* output, size_t* outputSize) override
+    {
+        return transport->CallCheckedStructBatch(input, inputSize, output, outputSize);
+    }
+
+    int32_t CallTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t* output) override
+    {
+        return transport->CallTaggedAsync(tag, input, output);
+    }
+
+    // This thread's share of the coalescer's stats.
+    NullDriverCoalescerStats stats = {};
+
+private:
+    // A batch of one is a plain struct call, so coalescing with nobody else costs nothing extra in the dext.
+    static int32_t CallBatch(void* context, const DataStruct* input, DataStruct* output, uint32_t count)
+    {
+        NullDriverBenchTransport* transport = (NullDriverBenchTransport*)context;
+        size_t outputSize = count * sizeof(DataStruct);
+
+        if (count == 1)
+        {
+            return transport->CallCheckedStruct((const uint64_t*)input, (uint64_t*)output);
+        }
+
+        return transport->CallCheckedStructBatch((const uint64_t*)input, count * sizeof(DataStruct), (uint64_t*)output, &outputSize);
+    }
+
+    NullDriverBenchTransport* transport;
+    NullDriverCoalescer* coalescer;
+};
+
+// Called once on each worker thread, so a transport can attach anything thread-local, like a run loop source, to the thread that uses it.
+// Returns nullptr if the thread can't connect. The bench deletes the transport when the thread is done.
+typedef NullDriverBenchTransport* (*NullDriverBenchTransportFactory)(void* context);
+
+static const char* const kNullDriverBenchWorkloadNames[NumberOfNullDriverBenchWorkloads] = { "scalar", "struct", "batch", "async", "mix" };
+
+static inline uint64_t NullDriverBenchNowNanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void NullDriverBenchPrintUsage(const char* program)
+{
+    printf("Usage: %s [--workload scalar|struct|batch|async] [--mix WORKLOAD=WEIGHT,...] [--iterations N] [--payload BYTES] [--threads N] [--warmup-ms N] [--format json|csv] [--record TRACE] [--device MODEL,...] [--coalesce WINDOW[,COUNT]]\n", program);
+    printf("  --workload    The call to make. Defaults to struct.\n");
+    printf("  --mix         Picks each call at random from several workloads instead, for example struct=80,async=20.\n");
+    printf("  --iterations  Measured calls per thread. Defaults to 100000.\n");
+    printf("  --payload     Bytes in and out per call: 8 to 128 for scalar, 16 for struct and async, a multiple of 16 up to %u for batch.\n", kNullDriverBenchMaxBatchSize);
+    printf("                In a mix, only the batch calls use it.\n");
+    printf("  --threads     Threads, each with its own connection and notification port, up to %u. Defaults to 1.\n", kNullDriverBenchMaxThreads);
+    printf("  --warmup-ms   Unmeasured calls on each thread before measuring. Defaults to 500.\n");
+    printf("  --format      Report format. Defaults to json.\n");
+    printf("  --record      Records every call, warmup included, to a trace file that replay can play back.\n");
+    printf("  --device      Configures the simulated device that async calls wait on, for example exponential,service=200us,channels=4,depth=64.\n");
+    printf("                The model is requested, fixed, exponential, bimodal or trace, followed by any of channels=N, depth=N, service=TIME,\n");
+    printf("                slow=TIME, slow-ppm=N, seed=N and file=PATH. A trace model reads its service times from the file, one per line.\n");
+    printf("                Times are in ns unless they end in us, ms or s.\n");
+    printf("  --coalesce    Gathers the struct calls of every thread into batch calls. Each batch waits up to WINDOW for others to join, and is sent\n");
+    printf("                at once when it holds COUNT calls, which defaults to and can't exceed %u. For example 20us,32.\n", kNullDriverCoalescerMaxCount);
+}
+
+// Parses a time like "250us" into nanoseconds, and sets "end" to the first character after it.
+static inline bool NullDriverBenchParseTime(const char* text, const char** end, uint64_t* nanoseconds)
+{
+    char* numberEnd = nullptr;
+    const unsigned long long number = strtoull(text, &numberEnd, 10);
+    uint64_t scale = 1;
+
+    if (numberEnd == text)
+    {
+        return false;
+    }
+
+    if (strncmp(numberEnd, "ns", 2) == 0)
+    {
+        numberEnd += 2;
+    }
+    else if (strncmp(numberEnd, "us", 2) == 0)
+    {
+        scale = 1000;
+        numberEnd += 2;
+    }
+    else if (strncmp(numberEnd, "ms", 2) == 0)
+    {
+        scale = 1000000;
+        numberEnd += 2;
+    }
+    else if (*numberEnd == 's')
+    {
+        scale = 1000000000;
+        numberEnd += 1;
+    }
+
+    if (number > kNullDriverDeviceMaxServiceNanoseconds / scale)
+    {
+        return false;
+    }
+
+    *nanoseconds = number * scale;
+    *end = numberEnd;
+    return true;
+}
+
+// Reads the service times of a trace model from "path", separated by whitespace, each in the same form as NullDriverBenchParseTime.
+static inline bool NullDriverBenchReadDeviceTrace(const char* path, NullDriverDeviceConfig* config)
+{
+    FILE* file = fopen(path, "r");
+    char word[64];
+    bool valid = true;
+
+    if (file == nullptr)
+    {
+        printf("Couldn't open the device trace %s.\n", path);
+        return false;
+    }
+
+    config->traceCount = 0;
+    while (valid && (fscanf(file, "%63s", word) == 1))
+    {
+        const char* end = nullptr;
+
+        if (config->traceCount == kNullDriverDeviceMaxTraceCount)
+        {
+            printf("The device trace %s has more than %u service times.\n", path, kNullDriverDeviceMaxTraceCount);
+            valid = false;
+        }
+        else if (!NullDriverBenchParseTime(word, &end, &config->trace[config->traceCount]) || (*end != '\0'))
+        {
+            printf("%s in the device trace %s isn't a service time.\n", word, path);
+            valid = false;
+        }
+        else
+        {
+            ++config->traceCount;
+        }
+    }
+
+    fclose(file);
+    return valid;
+}
+
+// Parses a device like "bimodal,service=100us,slow=5ms,slow-ppm=1000,channels=4" into "config".
+static inline bool NullDriverBenchParseDevice(const char* device, NullDriverDeviceConfig* config)
+{
+    const char* comma = strchr(device, ',');
+    const size_t modelLength = (comma != nullptr) ? (size_t)(comma - device) : strlen(device);
+    int model = 0;
+
+    memset(config, 0, sizeof(*config));
+
+    for (; model < (int)NumberOfNullDriverDeviceModels; ++model)
+    {
+        if ((strlen(kNullDriverDeviceModelNames[model]) == modelLength) && (strncmp(device, kNullDriverDeviceModelNames[model], modelLength) == 0))
+        {
+            break;
+        }
+    }
+    if (model == (int)NumberOfNullDriverDeviceModels)
+    {
+        printf("Unknown device model %.*s.\n", (int)modelLength, device);
+        return false;
+    }
+    config->model = (uint32_t)model;
+
+    while (comma != nullptr)
+    {
+        const char* name = comma + 1;
+        const char* equals = strchr(name, '=');
+        char* end = nullptr;
+
+        comma = strchr(name, ',');
+        if ((equals == nullptr) || ((comma != nullptr) && (equals > comma)))
+        {
+            printf("Device setting %.*s needs a value.\n", (int)((comma != nullptr) ? comma - name : strlen(name)), name);
+            return false;
+        }
+
+        const size_t nameLength = (size_t)(equals - name);
+        const char* value = equals + 1;
+        bool valid = false;
+
+        if ((nameLength == 4) && (strncmp(name, "file", 4) == 0))
+        {
+            // The path runs to the end, so it can have commas in it.
+            return NullDriverBenchReadDeviceTrace(value, config) && NullDriverDeviceConfigIsValid(config);
+        }
+        else if (((nameLength == 7) && (strncmp(name, "service", 7) == 0)) || ((nameLength == 4) && (strncmp(name, "slow", 4) == 0)))
+        {
+            const char* timeEnd = nullptr;
+            valid = NullDriverBenchParseTime(value, &timeEnd, (nameLength == 4) ? &config->slowNanoseconds : &config->serviceNanoseconds) && ((*timeEnd == ',') || (*timeEnd == '\0'));
+        }
+        else
+        {
+            const unsigned long long number = strtoull(value, &end, 10);
+            valid = (end != value) && ((*end == ',') || (*end == '\0'));
+
+            if ((nameLength == 8) && (strncmp(name, "channels", 8) == 0))
+            {
+                config->channelCount = (number > kNullDriverDeviceMaxChannels) ? UINT32_MAX : (uint32_t)number;
+            }
+            else if ((nameLength == 5) && (strncmp(name, "depth", 5) == 0))
+            {
+                config->queueDepth = (number > kNullDriverDeviceMaxQueueDepth) ? UINT32_MAX : (uint32_t)number;
+            }
+            else if ((nameLength == 8) && (strncmp(name, "slow-ppm", 8) == 0))
+            {
+                config->slowPartsPerMillion = (number > kNullDriverDevicePartsPerMillion) ? UINT32_MAX : (uint32_t)number;
+            }
+            else if ((nameLength == 4) && (strncmp(name, "seed", 4) == 0))
+            {
+                config->seed = number;
+            }
+            else
+            {
+                printf("Unknown device setting %.*s.\n", (int)nameLength, name);
+                return false;
+            }
+        }
+
+        if (!valid)
+        {
+            printf("Device setting %.*s has an invalid value.\n", (int)nameLength, name);
+            return false;
+        }
+    }
+
+    if ((config->model == NullDriverDeviceModel_Trace) && (config->traceCount == 0))
+    {
+        printf("The trace device model needs file=PATH.\n");
+        return false;
+    }
+
+    if (!NullDriverDeviceConfigIsValid(config))
+    {
+        printf("The device allows up to %u channels, a queue depth up to %u, and service times up to %llu ns.\n", kNullDriverDeviceMaxChannels, kNullDriverDeviceMaxQueueDepth,
+               (unsigned long long)kNullDriverDeviceMaxServiceNanoseconds);
+        return false;
+    }
+
+    return true;
+}
+
+// Parses a coalescer setting like "20us,32" into "config".
+static inline bool NullDriverBenchParseCoalescer(const char* coalescer, NullDriverCoalescerConfig* config)
+{
+    const char* end = nullptr;
+
+    config->maxCount = kNullDriverCoalescerMaxCount;
+    if (!NullDriverBenchParseTime(coalescer, &end, &config->windowNanoseconds) || ((*end != ',') && (*end != '\0')))
+    {
+        printf("The coalescing window %s isn't a time.\n", coalescer);
+        return false;
+    }
+
+    if (*end == ',')
+    {
+        char* countEnd = nullptr;
+        const unsigned long long count = strtoull(end + 1, &countEnd, 10);
+
+        if ((countEnd == end + 1) || (*countEnd != '\0') || (count == 0) || (count > kNullDriverCoalescerMaxCount))
+        {
+            printf("The coalescing count has to be from 1 to %u.\n", kNullDriverCoalescerMaxCount);
+            return false;
+        }
+        config->maxCount = (uint32_t)count;
+    }
+
+    return true;
+}
+
+// Parses a mix like "struct=80,async=20" into "weights". Workloads left out get no share.
+static inline bool NullDriverBenchParseMix(const char* mix, uint32_t* weights)
+{
+    uint64_t total = 0;
+
+    memset(weights, 0, kNullDriverBenchMixableWorkloadCount * sizeof(uint32_t));
+
+    while (*mix != '\0')
+    {
+        const char* equals = strchr(mix, '=');
+        char* end = nullptr;
+        int workload = 0;
+
+        if (equals == nullptr)
+        {
+            printf("%s needs a weight, like struct=80.\n", mix);
+            return false;
+        }
+
+        for (; workload < (int)kNullDriverBenchMixableWorkloadCount; ++workload)
+        {
+            if ((strlen(kNullDriverBenchWorkloadNames[workload]) == (size_t)(equals - mix)) && (strncmp(mix, kNullDriverBenchWorkloadNames[workload], equals - mix) == 0))
+            {
+                break;
+            }
+        }
+        if (workload == (int)kNullDriverBenchMixableWorkloadCount)
+        {
+            printf("Unknown workload %.*s in the mix.\n", (int)(equals - mix), mix);
+            return false;
+        }
+
+        unsigned long long weight = strtoull(equals + 1, &end, 10);
+        if ((end == equals + 1) || ((*end != ',') && (*end != '\0')) || (weight > UINT32_MAX))
+        {
+            printf("The weight of %s in the mix has to be a number.\n", kNullDriverBenchWorkloadNames[workload]);
+            return false;
+        }
+
+        weights[workload] = (uint32_t)weight;
+        total += weight;
+        mix = (*end == ',') ? end + 1 : end;
+    }
+
+    if (total == 0)
+    {
+        printf("The mix needs at least one workload with a weight above 0.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Fills in "options" from "arguments", which shouldn't include the program name. Prints the problem and returns false for anything invalid.
+static inline bool NullDriverBenchParseArguments(int argumentCount, const char* arguments[], NullDriverBenchOptions* options)
+{
+    options->workload = NullDriverBenchWorkload_Struct;
+    options->iterations = 100000;
+    options->payloadSize = 0;
+    options->threadCount = 1;
+    options->warmupMilliseconds = 500;
+    options->format = NullDriverBenchFormat_JSON;
+    options->recordPath = nullptr;
+    memset(options->mixWeights, 0, sizeof(options->mixWeights));
+    options->configureDevice = false;
+    memset(&options->device, 0, sizeof(options->device));
+    options->coalesce = false;
+    memset(&options->coalescer, 0, sizeof(options->coalescer));
+
+    for (int index = 0; index < argumentCount; index += 2)
+    {
+        const char* name = arguments[index];
+        const char* value = (index + 1 < argumentCount) ? arguments[index + 1] : nullptr;
+        char* end = nullptr;
+
+        if (value == nullptr)
+        {
+            printf("Missing a value for %s.\n", name);
+            return false;
+        }
+
+        if (strcmp(name, "--workload") == 0)
+        {
+            int workload = 0;
+            for (; workload < (int)kNullDriverBenchMixableWorkloadCount; ++workload)
+            {
+                if (strcmp(value, kNullDriverBenchWorkloadNames[workload]) == 0)
+                {
+                    break;
+                }
+            }
+            if (workload == (int)kNullDriverBenchMixableWorkloadCount)
+            {
+                printf("Unknown workload %s.\n", value);
+                return false;
+            }
+            options->workload = (NullDriverBenchWorkload)workload;
+            continue;
+        }
+
+        if (strcmp(name, "--format") == 0)
+        {
+            if (strcmp(value, "json") == 0)
+            {
+                options->format = NullDriverBenchFormat_JSON;
+            }
+            else if (strcmp(value, "csv") == 0)
+            {
+                options->format = NullDriverBenchFormat_CSV;
+            }
+            else
+            {
+                printf("Unknown format %s.\n", value);
+                return false;
+            }
+            continue;
+        }
+
+        if (strcmp(name, "--mix") == 0)
+        {
+            if (!NullDriverBenchParseMix(value, options->mixWeights))
+            {
+                return false;
+            }
+            options->workload = NullDriverBenchWorkload_Mix;
+            continue;
+        }
+
+        if (strcmp(name, "--record") == 0)
+        {
+            options->recordPath = value;
+            continue;
+        }
+
+        if (strcmp(name, "--device") == 0)
+        {
+            if (!NullDriverBenchParseDevice(value, &options->device))
+            {
+                return false;
+            }
+            options->configureDevice = true;
+            continue;
+        }
+
+        if (strcmp(name, "--coalesce") == 0)
+        {
+            if (!NullDriverBenchParseCoalescer(value, &options->coalescer))
+            {
+                return false;
+            }
+            options->coalesce = true;
+            continue;
+        }
+
+        unsigned long long number = strtoull(value, &end, 10);
+        if ((end == value) || (*end != '\0'))
+        {
+            printf("%s needs a number, not %s.\n", name, value);
+            return false;
+        }
+
+        if (strcmp(name, "--iterations") == 0)
+        {
+            options->iterations = number;
+        }
+        else if (strcmp(name, "--payload") == 0)
+        {
+            options->payloadSize = (number > UINT32_MAX) ? UINT32_MAX : (uint32_t)number;
+        }
+        else if (strcmp(name, "--threads") == 0)
+        {
+            options->threadCount = (number > kNullDriverBenchMaxThreads) ? kNullDriverBenchMaxThreads : (uint32_t)number;
+        }
+        else if (strcmp(name, "--warmup-ms") == 0)
+        {
+            options->warmupMilliseconds = number;
+        }
+        else
+        {
+            printf("Unknown option %s.\n", name);
+            return false;
+        }
+    }
+
+    if (options->payloadSize == 0)
+    {
+        options->payloadSize = (options->workload == NullDriverBenchWorkload_Scalar) ? kNullDriverBenchMaxScalarCount * 8 : 16;
+    }
+
+    bool validPayload = false;
+    switch (options->workload)
+    {
+        case NullDriverBenchWorkload_Scalar:
+        {
+            validPayload = ((options->payloadSize % 8) == 0) && (options->payloadSize <= kNullDriverBenchMaxScalarCount * 8);
+        } break;
+
+        case NullDriverBenchWorkload_StructBatch:
+        case NullDriverBenchWorkload_Mix:
+        {
+            validPayload = ((options->payloadSize % 16) == 0) && (options->payloadSize <= kNullDriverBenchMaxBatchSize);
+        } break;
+
+        default:
+        {
+            validPayload = (options->payloadSize == 16);
+        } break;
+    }
+
+    if (!validPayload)
+    {
+        printf("A payload of %u bytes isn't valid for the %s workload.\n", options->payloadSize, kNullDriverBenchWorkloadNames[options->workload]);
+        return false;
+    }
+
+    if ((options->iterations == 0) || (options->threadCount == 0))
+    {
+        printf("Iterations and threads have to be at least 1.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// MARK: Workload
+// The calls and latencies of one worker thread. In a mix, "workloads" holds the workload of each latency.
+typedef struct
+{
+    std::vector<uint64_t> latencies;
+    std::vector<uint8_t> workloads;
+    uint64_t errors;
+    uint64_t workloadErrors[kNullDriverBenchMixableWorkloadCount];
+    uint64_t mismatches;
+    uint64_t bytes;
+    uint64_t startTime;
+    uint64_t endTime;
+    bool connected;
+    NullDriverCoalescerStats coalescer;
+} NullDriverBenchThreadResult;
+
+// The payload of one call of "workload". In a mix, only batch calls use the size from the options.
+static inline uint32_t NullDriverBenchPayloadSize(const NullDriverBenchOptions* options, NullDriverBenchWorkload workload)
+{
+    if (options->workload != NullDriverBenchWorkload_Mix)
+    {
+        return options->payloadSize;
+    }
+
+    switch (workload)
+    {
+        case NullDriverBenchWorkload_Scalar:
+        {
+            return kNullDriverBenchMaxScalarCount * 8;
+        }
+
+        case NullDriverBenchWorkload_StructBatch:
+        {
+            return options->payloadSize;
+        }
+
+        default:
+        {
+            return 16;
+        }
+    }
+}
+
+// Picks the workload of the next call. Each thread has its own "random" state, so threads don't share a cache line, or a sequence.
+static inline NullDriverBenchWorkload NullDriverBenchPickWorkload(const NullDriverBenchOptions* options, uint64_t* random)
+{
+    uint64_t total = 0;
+
+    if (options->workload != NullDriverBenchWorkload_Mix)
+    {
+        return options->workload;
+    }
+
+    for (uint32_t workload = 0; workload < kNullDriverBenchMixableWorkloadCount; ++workload)
+    {
+        total += options->mixWeights[workload];
+    }
+
+    // xorshift64* is plenty random for this, and costs a few cycles next to a call that costs microseconds.
+    *random ^= *random >> 12;
+    *random ^= *random << 25;
+    *random ^= *random >> 27;
+    uint64_t pick = (*random * 0x2545F4914F6CDD1DULL) % total;
+
+    for (uint32_t workload = 0; workload < kNullDriverBenchMixableWorkloadCount; ++workload)
+    {
+        if (pick < options->mixWeights[workload])
+        {
+            return (NullDriverBenchWorkload)workload;
+        }
+        pick -= options->mixWeights[workload];
+    }
+
+    return NullDriverBenchWorkload_Struct;
+}
+
+// Makes one call of "workload" and checks what came back. Returns false if the call failed.
+static inline bool NullDriverBenchCall(NullDriverBenchTransport* transport, NullDriverBenchWorkload workload, uint32_t payloadSize, uint64_t sequence, uint64_t* input, uint64_t* output, uint64_t* mismatches)
+{
+    const uint32_t wordCount = payloadSize / 8;
+    int32_t ret = 0;
+
+    // A new value each call, so a stale output can't pass the check.
+    input[0] = sequence;
+
+    switch (workload)
+    {
+        case NullDriverBenchWorkload_Scalar:
+        {
+            uint32_t outputCount = wordCount;
+            ret = transport->CallScalar(input, wordCount, output, &outputCount);
+            if ((ret == 0) && ((outputCount != wordCount) || ((wordCount != 0) && (output[0] != input[0] + 1))))
+            {
+                ++*mismatches;
+            }
+        } break;
+
+        case NullDriverBenchWorkload_Struct:
+        {
+            ret = transport->CallCheckedStruct(input, output);
+        } break;
+
+        case NullDriverBenchWorkload_StructBatch:
+        {
+            size_t outputSize = payloadSize;
+            ret = transport->CallCheckedStructBatch(input, payloadSize, output, &outputSize);
+            if ((ret == 0) && (outputSize != payloadSize))
+            {
+                ++*mismatches;
+            }
+        } break;
+
+        case NullDriverBenchWorkload_Async:
+        {
+            ret = transport->CallTaggedAsync(sequence, input, output);
+        } break;
+
+        default:
+        {
+            ret = -1;
+        } break;
+    }
+
+    if (ret != 0)
+    {
+        return false;
+    }
+
+    // Every DataStruct workload returns at least one (foo + 1, bar + 10) pair at the start.
+    if ((workload != NullDriverBenchWorkload_Scalar) && ((output[0] != input[0] + 1) || (output[1] != input[1] + 10)))
+    {
+        ++*mismatches;
+    }
+
+    return true;
+}
+
+// "coalescer" is nullptr unless "options->coalesce" is set.
+static inline void NullDriverBenchRunThread(const NullDriverBenchOptions* options, uint32_t thread, NullDriverBenchTransportFactory factory, void* context, NullDriverCoalescer* coalescer,
+                                            std::atomic<uint32_t>* ready, NullDriverBenchThreadResult* result)
+{
+    // Big enough for the largest payload of any workload in a mix.
+    const uint32_t largestPayload = (options->payloadSize > kNullDriverBenchMaxScalarCount * 8) ? options->payloadSize : kNullDriverBenchMaxScalarCount * 8;
+    const uint32_t wordCount = largestPayload / 8;
+    std::vector<uint64_t> input(wordCount);
+    std::vector<uint64_t> output(wordCount);
+    NullDriverBenchTransport* transport = factory(context);
+    uint64_t sequence = 0;
+    uint64_t ignored = 0;
+    uint64_t random = 0x9E3779B97F4A7C15ULL * (thread + 1);
+    NullDriverBenchCoalescingTransport* coalescing = nullptr;
+
+    if ((transport != nullptr) && (coalescer != nullptr))
+    {
+        coalescing = new NullDriverBenchCoalescingTransport(transport, coalescer);
+        transport = coalescing;
+    }
+
+    for (uint32_t index = 0; index < wordCount; index += 2)
+    {
+        input[index] = index / 2;
+        if (index + 1 < wordCount)
+        {
+            input[index + 1] = 70000;
+        }
+    }
+
+    result->connected = (transport != nullptr);
+    result->latencies.reserve(options->iterations);
+    if (options->workload == NullDriverBenchWorkload_Mix)
+    {
+        result->workloads.reserve(options->iterations);
+    }
+
+    // Every thread connects before any starts calling, so a slow connection doesn't leave the others measuring alone.
+    ready->fetch_add(1, std::memory_order_acq_rel);
+    while (ready->load(std::memory_order_acquire) < options->threadCount)
+    {
+        std::this_thread::yield();
+    }
+
+    if (transport == nullptr)
+    {
+        return;
+    }
+
+    const uint64_t warmupEnd = NullDriverBenchNowNanoseconds() + options->warmupMilliseconds * 1000000;
+    while (NullDriverBenchNowNanoseconds() < warmupEnd)
+    {
+        NullDriverBenchWorkload workload = NullDriverBenchPickWorkload(options, &random);
+        if (!NullDriverBenchCall(transport, workload, NullDriverBenchPayloadSize(options, workload), sequence++, input.data(), output.data(), &ignored))
+        {
+            break;
+        }
+    }
+
+    if (coalescing != nullptr)
+    {
+        coalescing->stats = {};
+    }
+
+    result->startTime = NullDriverBenchNowNanoseconds();
+    for (uint64_t iteration = 0; iteration < options->iterations; ++iteration)
+    {
+        NullDriverBenchWorkload workload = NullDriverBenchPickWorkload(options, &random);
+        uint32_t payloadSize = NullDriverBenchPayloadSize(options, workload);
+
+        uint64_t callStart = NullDriverBenchNowNanoseconds();
+        bool succeeded = NullDriverBenchCall(transport, workload, payloadSize, sequence++, input.data(), output.data(), &result->mismatches);
+        uint64_t callEnd = NullDriverBenchNowNanoseconds();
+
+        if (!succeeded)
+        {
+            ++result->errors;
+            ++result->workloadErrors[(workload < kNullDriverBenchMixableWorkloadCount) ? workload : 0];
+            continue;
+        }
+
+        result->latencies.push_back(callEnd - callStart);
+        result->bytes += payloadSize;
+        if (options->workload == NullDriverBenchWorkload_Mix)
+        {
+            result->workloads.push_back((uint8_t)workload);
+        }
+    }
+    result->endTime = NullDriverBenchNowNanoseconds();
+
+    if (coalescing != nullptr)
+    {
+        result->coalescer = coalescing->stats;
+    }
+
+    delete transport;
+}
+
+// The latency "fraction" (0 to 1) of the sorted "latencies" fall at or below.
+static inline uint64_t NullDriverBenchPercentile(const std::vector<uint64_t>& latencies, double fraction)
+{
+    if (latencies.empty())
+    {
+        return 0;
+    }
+
+    size_t rank = (size_t)(fraction * (double)latencies.size());
+    if ((double)rank < fraction * (double)latencies.size())
+    {
+        ++rank;
+    }
+
+    return latencies[(rank == 0) ? 0 : rank - 1];
+}
+
+// Sorts "latencies" and fills in "summary" from them.
+static inline void NullDriverBenchSummarize(std::vector<uint64_t>* latencies, uint64_t errors, uint64_t elapsedNanoseconds, NullDriverBenchSummary* summary)
+{
+    std::sort(latencies->begin(), latencies->end());
+
+    summary->calls = latencies->size() + errors;
+    summary->errors = errors;
+    summary->elapsedNanoseconds = elapsedNanoseconds;
+    summary->p50Nanoseconds = NullDriverBenchPercentile(*latencies, 0.5);
+    summary->p99Nanoseconds = NullDriverBenchPercentile(*latencies, 0.99);
+    summary->p999Nanoseconds = NullDriverBenchPercentile(*latencies, 0.999);
+}
+
+// Runs the bench on "options->threadCount" threads and fills in "result". Returns false if any thread couldn't connect.
+// Failed calls are counted in "errors" and left out of the latencies.
+static inline bool NullDriverBenchRun(const NullDriverBenchOptions* options, NullDriverBenchTransportFactory factory, void* context, NullDriverBenchResult* result)
+{
+    std::vector<NullDriverBenchThreadResult> threadResults(options->threadCount);
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> ready(0);
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> workloadLatencies[kNullDriverBenchMixableWorkloadCount];
+    uint64_t workloadErrors[kNullDriverBenchMixableWorkloadCount] = {};
+    uint64_t startTime = UINT64_MAX;
+    uint64_t endTime = 0;
+    uint64_t total = 0;
+    bool connected = true;
+    NullDriverCoalescer* coalescer = options->coalesce ? new NullDriverCoalescer(&options->coalescer) : nullptr;
+
+    memset(result, 0, sizeof(NullDriverBenchResult));
+
+    for (uint32_t thread = 0; thread < options->threadCount; ++thread)
+    {
+        NullDriverBenchThreadResult* threadResult = &threadResults[thread];
+        threadResult->errors = 0;
+        memset(threadResult->workloadErrors, 0, sizeof(threadResult->workloadErrors));
+        threadResult->mismatches = 0;
+        threadResult->bytes = 0;
+        threadResult->startTime = 0;
+        threadResult->endTime = 0;
+        threadResult->coalescer = {};
+        threads.emplace_back(NullDriverBenchRunThread, options, thread, factory, context, coalescer, &ready, threadResult);
+    }
+
+    for (uint32_t thread = 0; thread < options->threadCount; ++thread)
+    {
+        NullDriverBenchThreadResult* threadResult = &threadResults[thread];
+
+        threads[thread].join();
+        if (!threadResult->connected)
+        {
+            connected = false;
+            continue;
+        }
+
+        result->errors += threadResult->errors;
+        result->mismatches += threadResult->mismatches;
+        result->bytes += threadResult->bytes;
+        NullDriverCoalescerStatsAdd(&result->coalescer, &threadResult->coalescer);
+        startTime = (threadResult->startTime < startTime) ? threadResult->startTime : startTime;
+        endTime = (threadResult->endTime > endTime) ? threadResult->endTime : endTime;
+        latencies.insert(latencies.end(), threadResult->latencies.begin(), threadResult->latencies.end());
+
+        for (size_t index = 0; index < threadResult->workloads.size(); ++index)
+        {
+            workloadLatencies[threadResult->workloads[index]].push_back(threadResult->latencies[index]);
+        }
+        for (uint32_t workload = 0; workload < kNullDriverBenchMixableWorkloadCount; ++workload)
+        {
+            workloadErrors[workload] += threadResult->workloadErrors[workload];
+        }
+
+        NullDriverBenchSummarize(&threadResult->latencies, threadResult->errors, threadResult->endTime - threadResult->startTime, &result->threads[thread]);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    for (uint64_t latency : latencies)
+    {
+        total += latency;
+        ++result->buckets[NullDriverStatsBucketForNanoseconds(latency)];
+    }
+
+    result->calls = latencies.size() + result->errors;
+    result->elapsedNanoseconds = (endTime > startTime) ? endTime - startTime : 0;
+    if (!latencies.empty())
+    {
+        result->minNanoseconds = latencies.front();
+        result->meanNanoseconds = total / latencies.size();
+        result->p50Nanoseconds = NullDriverBenchPercentile(latencies, 0.5);
+        result->p90Nanoseconds = NullDriverBenchPercentile(latencies, 0.9);
+        result->p99Nanoseconds = NullDriverBenchPercentile(latencies, 0.99);
+        result->p999Nanoseconds = NullDriverBenchPercentile(latencies, 0.999);
+        result->maxNanoseconds = latencies.back();
+    }
+
+    if (options->workload == NullDriverBenchWorkload_Mix)
+    {
+        for (uint32_t workload = 0; workload < kNullDriverBenchMixableWorkloadCount; ++workload)
+        {
+            NullDriverBenchSummarize(&workloadLatencies[workload], workloadErrors[workload], result->elapsedNanoseconds, &result->workloads[workload]);
+        }
+    }
+
+    delete coalescer;
+    return connected;
+}
+
+// MARK: Report
+static inline double NullDriverBenchSummaryOpsPerSecond(const NullDriverBenchSummary* summary)
+{
+    return (summary->elapsedNanoseconds != 0) ? (double)(summary->calls - summary->errors) * 1000000000.0 / (double)summary->elapsedNanoseconds : 0.0;
+}
+
+// Lists each thread, or with "workloads" set each workload of the mix, as CSV rows or JSON array elements.
+static inline void NullDriverBenchReportSummaries(FILE* file, const NullDriverBenchOptions* options, const NullDriverBenchSummary* summaries, uint32_t count, bool workloads)
+{
+    // Workloads that aren't part of the mix are left out, so the last JSON element may come before "count".
+    uint32_t last = count - 1;
+    while (workloads && (last > 0) && (options->mixWeights[last] == 0))
+    {
+        --last;
+    }
+
+    for (uint32_t index = 0; index <= last; ++index)
+    {
+        const NullDriverBenchSummary* summary = &summaries[index];
+
+        if (workloads && (options->mixWeights[index] == 0))
+        {
+            continue;
+        }
+
+        if (options->format == NullDriverBenchFormat_CSV)
+        {
+            if (workloads)
+            {
+                fprintf(file, "%s,", kNullDriverBenchWorkloadNames[index]);
+            }
+            else
+            {
+                fprintf(file, "%u,", index);
+            }
+            fprintf(file, "%llu,%llu,%.0f,%llu,%llu,%llu\n", (unsigned long long)summary->calls, (unsigned long long)summary->errors, NullDriverBenchSummaryOpsPerSecond(summary),
+                    (unsigned long long)summary->p50Nanoseconds, (unsigned long long)summary->p99Nanoseconds, (unsigned long long)summary->p999Nanoseconds);
+            continue;
+        }
+
+        if (workloads)
+        {
+            fprintf(file, "    { \"workload\": \"%s\", \"weight\": %u, ", kNullDriverBenchWorkloadNames[index], options->mixWeights[index]);
+        }
+        else
+        {
+            fprintf(file, "    { \"thread\": %u, ", index);
+        }
+        fprintf(file, "\"calls\": %llu, \"errors\": %llu, \"ops_per_sec\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu }%s\n", (unsigned long long)summary->calls,
+                (unsigned long long)summary->errors, NullDriverBenchSummaryOpsPerSecond(summary), (unsigned long long)summary->p50Nanoseconds, (unsigned long long)summary->p99Nanoseconds,
+                (unsigned long long)summary->p999Nanoseconds, (index < last) ? "," : "");
+    }
+}
+
+// The coalescer's settings, and how much it batched and delayed the measured struct calls, as a CSV row or a JSON object.
+static inline void NullDriverBenchReportCoalescer(FILE* file, const NullDriverBenchOptions* options, const NullDriverCoalescerStats* stats)
+{
+    if (options->format == NullDriverBenchFormat_CSV)
+    {
+        fprintf(file, "%llu,%u,%llu,%llu,%llu,%llu,%.2f,%llu,%llu\n", (unsigned long long)options->coalescer.windowNanoseconds, options->coalescer.maxCount, (unsigned long long)stats->requests,
+                (unsigned long long)stats->batches, (unsigned long long)stats->fullBatches, (unsigned long long)stats->largestBatch, NullDriverCoalescerStatsBatchingFactor(stats),
+                (unsigned long long)NullDriverCoalescerStatsMeanAddedNanoseconds(stats), (unsigned long long)stats->maxAddedNanoseconds);
+        return;
+    }
+
+    fprintf(file, "{ \"window_ns\": %llu, \"max_count\": %u, \"requests\": %llu, \"batches\": %llu, \"full_batches\": %llu, \"largest_batch\": %llu, \"batching_factor\": %.2f, "
+            "\"added_latency_ns\": { \"mean\": %llu, \"max\": %llu } }\n", (unsigned long long)options->coalescer.windowNanoseconds, options->coalescer.maxCount,
+            (unsigned long long)stats->requests, (unsigned long long)stats->batches, (unsigned long long)stats->fullBatches, (unsigned long long)stats->largestBatch,
+            NullDriverCoalescerStatsBatchingFactor(stats), (unsigned long long)NullDriverCoalescerStatsMeanAddedNanoseconds(stats), (unsigned long long)stats->maxAddedNanoseconds);
+}
+
+// Writes one JSON object, or CSV tables, to "file". Bytes per second counts the payload once each way.
+// The first CSV table is the totals. With more than one thread a table of threads follows, for a mix a table of workloads, and with coalescing a row of
+// coalescer stats, each after a blank line.
+static inline void NullDriverBenchReport(FILE* file, const NullDriverBenchOptions* options, const NullDriverBenchResult* result)
+{
+    const uint64_t succeeded = result->calls - result->errors;
+    const double seconds = (double)result->elapsedNanoseconds / 1000000000.0;
+    const double opsPerSecond = (seconds > 0.0) ? (double)succeeded / seconds : 0.0;
+    const double bytesPerSecond = (seconds > 0.0) ? (double)result->bytes * 2 / seconds : 0.0;
+    const char* workloadName = kNullDriverBenchWorkloadNames[options->workload];
+    const bool mix = (options->workload == NullDriverBenchWorkload_Mix);
+
+    if (options->format == NullDriverBenchFormat_CSV)
+    {
+        fprintf(file, "workload,threads,iterations,payload_bytes,warmup_ms,calls,errors,mismatches,seconds,ops_per_sec,bytes_per_sec,min_ns,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+        fprintf(file, "%s,%u,%llu,%u,%llu,%llu,%llu,%llu,%.6f,%.0f,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", workloadName, options->threadCount, (unsigned long long)options->iterations, options->payloadSize,
+                (unsigned long long)options->warmupMilliseconds, (unsigned long long)result->calls, (unsigned long long)result->errors, (unsigned long long)result->mismatches, seconds, opsPerSecond, bytesPerSecond,
+                (unsigned long long)result->minNanoseconds, (unsigned long long)result->meanNanoseconds, (unsigned long long)result->p50Nanoseconds, (unsigned long long)result->p90Nanoseconds,
+                (unsigned long long)result->p99Nanoseconds, (unsigned long long)result->p999Nanoseconds, (unsigned long long)result->maxNanoseconds);
+
+        if (options->threadCount > 1)
+        {
+            fprintf(file, "\nthread,calls,errors,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+            NullDriverBenchReportSummaries(file, options, result->threads, options->threadCount, false);
+        }
+        if (mix)
+        {
+            fprintf(file, "\nworkload,calls,errors,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+            NullDriverBenchReportSummaries(file, options, result->workloads, kNullDriverBenchMixableWorkloadCount, true);
+        }
+        if (options->coalesce)
+        {
+            fprintf(file, "\nwindow_ns,max_count,requests,batches,full_batches,largest_batch,batching_factor,mean_added_ns,max_added_ns\n");
+            NullDriverBenchReportCoalescer(file, options, &result->coalescer);
+        }
+        return;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"workload\": \"%s\",\n", workloadName);
+    fprintf(file, "  \"threads\": %u,\n", options->threadCount);
+    fprintf(file, "  \"iterations\": %llu,\n", (unsigned long long)options->iterations);
+    fprintf(file, "  \"payload_bytes\": %u,\n", options->payloadSize);
+    fprintf(file, "  \"warmup_ms\": %llu,\n", (unsigned long long)options->warmupMilliseconds);
+    fprintf(file, "  \"calls\": %llu,\n", (unsigned long long)result->calls);
+    fprintf(file, "  \"errors\": %llu,\n", (unsigned long long)result->errors);
+    fprintf(file, "  \"mismatches\": %llu,\n", (unsigned long long)result->mismatches);
+    fprintf(file, "  \"seconds\": %.6f,\n", seconds);
+    fprintf(file, "  \"ops_per_sec\": %.0f,\n", opsPerSecond);
+    fprintf(file, "  \"bytes_per_sec\": %.0f,\n", bytesPerSecond);
+    fprintf(file, "  \"latency_ns\": { \"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu },\n", (unsigned long long)result->minNanoseconds,
+            (unsigned long long)result->meanNanoseconds, (unsigned long long)result->p50Nanoseconds, (unsigned long long)result->p90Nanoseconds, (unsigned long long)result->p99Nanoseconds,
+            (unsigned long long)result->p999Nanoseconds, (unsigned long long)result->maxNanoseconds);
+
+    // Only the buckets that were hit, as [lower bound, upper bound, count].
+    fprintf(file, "  \"histogram\": [");
+    bool first = true;
+    for (uint32_t bucket = 0; bucket < kNullDriverStatsBucketCount; ++bucket)
+    {
+        if (result->buckets[bucket] == 0)
+        {
+            continue;
+        }
+
+        fprintf(file, "%s\n    [%llu, %llu, %llu]", first ? "" : ",", (unsigned long long)NullDriverStatsBucketLowerBound(bucket), (unsigned long long)NullDriverStatsBucketUpperBound(bucket),
+                (unsigned long long)result->buckets[bucket]);
+        first = false;
+    }
+    fprintf(file, "%s],\n", first ? "" : "\n  ");
+
+    fprintf(file, "  \"per_thread\": [\n");
+    NullDriverBenchReportSummaries(file, options, result->threads, options->threadCount, false);
+    fprintf(file, "  ]%s\n", (mix || options->coalesce) ? "," : "");
+
+    if (mix)
+    {
+        fprintf(file, "  \"per_workload\": [\n");
+        NullDriverBenchReportSummaries(file, options, result->workloads, kNullDriverBenchMixableWorkloadCount, true);
+        fprintf(file, "  ]%s\n", options->coalesce ? "," : "");
+    }
+    if (options->coalesce)
+    {
+        fprintf(file, "  \"coalescer\": ");
+        NullDriverBenchReportCoalescer(file, options, &result->coalescer);
+    }
+    fprintf(file, "}\n");
+}
+
+#endif /* NullDriverBench_h */
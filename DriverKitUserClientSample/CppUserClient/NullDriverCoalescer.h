@@ -0,0 +1,250 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Gathers single DataStruct requests from many threads into batch calls, for callers that each make one synchronous CheckedStruct call at a time.
+The first request to arrive opens a batch and waits for up to the window, or until the batch holds the most requests allowed. Requests that
+arrive meanwhile join it. The first request then makes one batch call for all of them, and hands each waiting thread its own result.
+While one batch is in its call, the next request opens another, so batches don't wait on each other.
+Waiting for the window adds latency to every request, in return for fewer calls. The stats report both, so the window can be tuned.
+*/
+
+#ifndef NullDriverCoalescer_h
+#define NullDriverCoalescer_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "../Shared/NullDriverProtocol.h"
+
+// The most requests in one batch. A batch this size still fits in an inline structure, so the dext never maps it.
+#define kNullDriverCoalescerMaxCount (kNullDriverInlineStructureSize / (uint32_t)sizeof(DataStruct))
+
+typedef struct
+{
+    uint64_t windowNanoseconds; // How long the first request of a batch waits for others. 0 makes every request its own call.
+    uint32_t maxCount; // A batch is sent as soon as it holds this many requests. Limited to kNullDriverCoalescerMaxCount.
+} NullDriverCoalescerConfig;
+
+// What happened to one request.
+typedef struct
+{
+    uint32_t batchCount; // The requests in the batch it was sent in, itself included.
+    uint64_t addedNanoseconds; // From its arrival to the start of the batch call, which is the latency the coalescer added.
+    bool opened; // It opened the batch, and made the call.
+    bool full; // The batch was sent because it was full, not because the window ended.
+} NullDriverCoalescerOutcome;
+
+typedef struct
+{
+    uint64_t requests;
+    uint64_t errors; // Requests whose batch call failed.
+    uint64_t batches;
+    uint64_t fullBatches;
+    uint64_t largestBatch;
+    uint64_t addedNanoseconds; // The total over every request.
+    uint64_t maxAddedNanoseconds;
+} NullDriverCoalescerStats;
+
+// Makes one call for "count" DataStructs. "context" is whatever was passed to Submit with it.
+// Returns 0 (kIOReturnSuccess) or an error, which every request in the batch gets.
+typedef int32_t (*NullDriverCoalescerBatchCall)(void* context, const DataStruct* input, DataStruct* output, uint32_t count);
+
+static inline void NullDriverCoalescerStatsRecord(NullDriverCoalescerStats* stats, const NullDriverCoalescerOutcome* outcome, int32_t result)
+{
+    stats->requests += 1;
+    stats->errors += (result != 0) ? 1 : 0;
+    stats->addedNanoseconds += outcome->addedNanoseconds;
+    stats->maxAddedNanoseconds = (outcome->addedNanoseconds > stats->maxAddedNanoseconds) ? outcome->addedNanoseconds : stats->maxAddedNanoseconds;
+
+    if (outcome->opened)
+    {
+        stats->batches += 1;
+        stats->fullBatches += outcome->full ? 1 : 0;
+        stats->largestBatch = (outcome->batchCount > stats->largestBatch) ? outcome->batchCount : stats->largestBatch;
+    }
+}
+
+static inline void NullDriverCoalescerStatsAdd(NullDriverCoalescerStats* stats, const NullDriverCoalescerStats* other)
+{
+    stats->requests += other->requests;
+    stats->errors += other->errors;
+    stats->batches += other->batches;
+    stats->fullBatches += other->fullBatches;
+    stats->largestBatch = (other->largestBatch > stats->largestBatch) ? other->largestBatch : stats->largestBatch;
+    stats->addedNanoseconds += other->addedNanoseconds;
+    stats->maxAddedNanoseconds = (other->maxAddedNanoseconds > stats->maxAddedNanoseconds) ? other->maxAddedNanoseconds : stats->maxAddedNanoseconds;
+}
+
+// The average number of requests each call carried.
+static inline double NullDriverCoalescerStatsBatchingFactor(const NullDriverCoalescerStats* stats)
+{
+    return (stats->batches != 0) ? (double)stats->requests / (double)stats->batches : 0.0;
+}
+
+static inline uint64_t NullDriverCoalescerStatsMeanAddedNanoseconds(const NullDriverCoalescerStats* stats)
+{
+    return (stats->requests != 0) ? stats->addedNanoseconds / stats->requests : 0;
+}
+
+// Shared by every thread whose requests may be batched together. Each request's call is made on the thread that opened its batch,
+// with the "call" and "context" that thread passed, so a thread's own connection is only ever used from that thread.
+class NullDriverCoalescer
+{
+public:
+    explicit NullDriverCoalescer(const NullDriverCoalescerConfig* config)
+    {
+        Configure(config);
+    }
+
+    // Takes effect from the next batch that opens.
+    void Configure(const NullDriverCoalescerConfig* config)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        windowNanoseconds = config->windowNanoseconds;
+        maxCount = (config->maxCount == 0) ? 1 : config->maxCount;
+        maxCount = (maxCount > kNullDriverCoalescerMaxCount) ? kNullDriverCoalescerMaxCount : maxCount;
+    }
+
+    void CopyStats(NullDriverCoalescerStats* copy)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        *copy = stats;
+    }
+
+    // Transforms one DataStruct, as a CheckedStruct call would, and returns once its result is in "output".
+    // "outcome" may be nullptr.
+    int32_t Submit(NullDriverCoalescerBatchCall call, void* context, const DataStruct* input, DataStruct* output, NullDriverCoalescerOutcome* outcome)
+    {
+        const uint64_t arrival = NowNanoseconds();
+        Waiter self;
+        self.output = output;
+        std::unique_lock<std::mutex> guard(lock);
+
+        if (open != nullptr)
+        {
+            Batch* batch = open;
+
+            batch->inputs[batch->count] = *input;
+            batch->waiters[batch->count] = &self;
+            batch->count += 1;
+            if (batch->count >= batch->maxCount)
+            {
+                // Closing it here means no later request can join a batch that's already full.
+                open = nullptr;
+                batchFull.notify_one();
+            }
+
+            self.resultReady.wait(guard, [&self] { return self.done; });
+        }
+        else
+        {
+            Batch batch;
+            batch.inputs[0] = *input;
+            batch.waiters[0] = &self;
+            batch.count = 1;
+            batch.maxCount = maxCount;
+            if (batch.count < batch.maxCount)
+            {
+                open = &batch;
+            }
+
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(arrival + windowNanoseconds));
+            batchFull.wait_until(guard, deadline, [&batch] { return batch.count >= batch.maxCount; });
+            if (open == &batch)
+            {
+                open = nullptr;
+            }
+
+            Send(&batch, call, context, &guard);
+        }
+
+        NullDriverCoalescerOutcome result = {
+            .batchCount = self.batchCount,
+            .addedNanoseconds = (self.sendTime > arrival) ? self.sendTime - arrival : 0,
+            .opened = (self.opener == &self),
+            .full = self.full,
+        };
+        NullDriverCoalescerStatsRecord(&stats, &result, self.result);
+        if (outcome != nullptr)
+        {
+            *outcome = result;
+        }
+
+        return self.result;
+    }
+
+private:
+    // Each request waits on the stack of the thread that submitted it.
+    typedef struct Waiter
+    {
+        DataStruct* output = nullptr;
+        int32_t result = 0;
+        bool done = false;
+        bool full = false;
+        uint32_t batchCount = 0;
+        uint64_t sendTime = 0;
+        const struct Waiter* opener = nullptr;
+        std::condition_variable resultReady;
+    } Waiter;
+
+    // Lives on the stack of the thread that opened it, which doesn't return until every waiter has its result.
+    typedef struct
+    {
+        DataStruct inputs[kNullDriverCoalescerMaxCount];
+        Waiter* waiters[kNullDriverCoalescerMaxCount];
+        uint32_t count;
+        uint32_t maxCount;
+    } Batch;
+
+    static uint64_t NowNanoseconds(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Makes the call without the lock, so other threads can open and fill the next batch meanwhile. "batch" is closed, so nothing else changes it.
+    void Send(Batch* batch, NullDriverCoalescerBatchCall call, void* context, std::unique_lock<std::mutex>* guard)
+    {
+        DataStruct outputs[kNullDriverCoalescerMaxCount];
+        const bool full = (batch->count >= batch->maxCount);
+
+        guard->unlock();
+        const uint64_t sendTime = NowNanoseconds();
+        const int32_t result = call(context, batch->inputs, outputs, batch->count);
+        guard->lock();
+
+        for (uint32_t index = 0; index < batch->count; ++index)
+        {
+            Waiter* waiter = batch->waiters[index];
+
+            if (result == 0)
+            {
+                *waiter->output = outputs[index];
+            }
+            waiter->result = result;
+            waiter->full = full;
+            waiter->batchCount = batch->count;
+            waiter->sendTime = sendTime;
+            waiter->opener = batch->waiters[0];
+            waiter->done = true;
+            if (index != 0)
+            {
+                waiter->resultReady.notify_one();
+            }
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable batchFull;
+    Batch* open = nullptr; // The batch new requests join, or nullptr if the next request opens one.
+    uint64_t windowNanoseconds = 0;
+    uint32_t maxCount = 1;
+    NullDriverCoalescerStats stats = {};
+};
+
+#endif /* NullDriverCoalescer_h */
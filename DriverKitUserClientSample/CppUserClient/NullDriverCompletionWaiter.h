@@ -0,0 +1,168 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Waits for results in the async completion ring of a connection in NullDriverCompletionMode_SharedPage.
+The client can spin on the ring head, spin for a while and then park, or park right away on the existing notification.
+Spinning answers fastest but keeps a core busy, and parking costs a notification and a thread wakeup but no CPU while waiting.
+Parking itself is supplied by the caller.
+*/
+
+#ifndef NullDriverCompletionWaiter_h
+#define NullDriverCompletionWaiter_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <chrono>
+#include <thread>
+
+#include "../Shared/NullDriverDoorbell.h"
+#include "../Shared/NullDriverRing.h"
+
+typedef enum
+{
+    NullDriverWaitMode_Park = 0, // Sets the doorbell and waits for the notification.
+    NullDriverWaitMode_Spin = 1, // Polls the ring head and never asks for a notification.
+    NullDriverWaitMode_SpinThenPark = 2, // Polls for "spinNanoseconds", then parks.
+    NumberOfNullDriverWaitModes // Has to be last
+} NullDriverWaitMode;
+
+// Blocks until a notification arrives for the connection, or the wait times out. Returns false on timeout.
+// With IOKit this is CFRunLoopRunInMode on the run loop that has the connection's notification port.
+typedef bool (*NullDriverParkFunction)(void* context);
+
+// The clock is only read, and other threads only given a turn, this often while spinning.
+// Yielding keeps a spinning client from starving the thread that publishes its results when both share one core.
+#define kNullDriverWaiterSpinCheckInterval 64U
+
+// Call NullDriverCompletionWaiterInit before use.
+typedef struct
+{
+    const NullDriverRing* ring;
+    NullDriverDoorbell* doorbell;
+    NullDriverParkFunction park;
+    void* parkContext;
+
+    uint32_t mode;
+    uint64_t spinNanoseconds; // How long SpinThenPark polls before it parks.
+    uint64_t timeoutNanoseconds; // How long Spin polls before it gives up. Parking times out in "park" instead.
+
+    uint64_t spinHits; // Waits that found results while polling.
+    uint64_t parks; // Times the client parked.
+    uint64_t parkSkips; // Times results arrived between setting the doorbell and parking.
+    uint64_t spuriousWakeups; // Notifications that arrived with nothing new in the ring.
+    uint64_t timeouts;
+} NullDriverCompletionWaiter;
+
+static inline void NullDriverCompletionWaiterInit(NullDriverCompletionWaiter* waiter, const NullDriverRing* ring, NullDriverDoorbell* doorbell, NullDriverParkFunction park, void* parkContext)
+{
+    *waiter = {};
+    waiter->ring = ring;
+    waiter->doorbell = doorbell;
+    waiter->park = park;
+    waiter->parkContext = parkContext;
+    waiter->mode = NullDriverWaitMode_Park;
+    waiter->spinNanoseconds = 20000;
+    waiter->timeoutNanoseconds = 5000000000ULL;
+}
+
+static inline uint64_t NullDriverCompletionWaiterNow(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Tells the core this is a spin loop, so it doesn't speculate ahead and it lets a sibling hyperthread run.
+static inline void NullDriverCompletionWaiterPause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Polls the ring until it has results after "tail", or until "budget" nanoseconds have passed. Returns the number of results ready.
+static inline uint32_t NullDriverCompletionWaiterSpin(const NullDriverCompletionWaiter* waiter, uint32_t tail, uint64_t budget)
+{
+    const uint64_t start = NullDriverCompletionWaiterNow();
+
+    for (uint32_t iteration = 1; ; ++iteration)
+    {
+        uint32_t ready = NullDriverRingReadyCount(waiter->ring, tail);
+        if (ready != 0)
+        {
+            return ready;
+        }
+
+        if ((iteration % kNullDriverWaiterSpinCheckInterval) == 0)
+        {
+            if (NullDriverCompletionWaiterNow() - start >= budget)
+            {
+                return 0;
+            }
+            std::this_thread::yield();
+        }
+        else
+        {
+            NullDriverCompletionWaiterPause();
+        }
+    }
+}
+
+// Waits until the ring has results after "tail", which is the consumer's own copy of its index.
+// Returns the number of results ready, or 0 if the wait timed out. The caller consumes them from the ring.
+// Notifications that arrive while parked carry no results of their own, so "park" only has to wake the thread up.
+static inline uint32_t NullDriverCompletionWaiterWait(NullDriverCompletionWaiter* waiter, uint32_t tail)
+{
+    uint32_t ready = NullDriverRingReadyCount(waiter->ring, tail);
+    if (ready != 0)
+    {
+        return ready;
+    }
+
+    if ((waiter->mode == NullDriverWaitMode_Spin) || (waiter->mode == NullDriverWaitMode_SpinThenPark))
+    {
+        const uint64_t budget = (waiter->mode == NullDriverWaitMode_Spin) ? waiter->timeoutNanoseconds : waiter->spinNanoseconds;
+
+        ready = NullDriverCompletionWaiterSpin(waiter, tail, budget);
+        if (ready != 0)
+        {
+            ++waiter->spinHits;
+            return ready;
+        }
+
+        if (waiter->mode == NullDriverWaitMode_Spin)
+        {
+            ++waiter->timeouts;
+            return 0;
+        }
+    }
+
+    while (true)
+    {
+        if (NullDriverDoorbellPark(waiter->doorbell, waiter->ring, tail))
+        {
+            ++waiter->parkSkips;
+            return NullDriverRingReadyCount(waiter->ring, tail);
+        }
+
+        ++waiter->parks;
+        if (!waiter->park(waiter->parkContext))
+        {
+            NullDriverDoorbellUnpark(waiter->doorbell);
+            ++waiter->timeouts;
+            return 0;
+        }
+
+        // The dext cleared the doorbell when it sent the notification, so a wakeup with nothing new parks again.
+        ready = NullDriverRingReadyCount(waiter->ring, tail);
+        if (ready != 0)
+        {
+            return ready;
+        }
+        ++waiter->spuriousWakeups;
+    }
+}
+
+#endif /* NullDriverCompletionWaiter_h */
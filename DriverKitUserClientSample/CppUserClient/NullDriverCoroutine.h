@@ -0,0 +1,345 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A C++20 coroutine client for the dext, so many requests can be awaited at once over one connection and one notification port.
+Each async request gets a tag, and the coroutine that sent it is resumed when the result with that tag arrives, in whatever order results arrive.
+An optional NullDriverAdaptiveWindow limits how many requests are in flight. Requests beyond it wait in the client, in order, until a result frees a slot.
+Calls go through NullDriverCoroutineTransport, so the same scheduler runs against the dext through IOKit, or against a simulated completion
+source on any platform.
+*/
+
+#ifndef NullDriverCoroutine_h
+#define NullDriverCoroutine_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "../Shared/NullDriverStats.h"
+#include "NullDriverAdaptiveWindow.h"
+
+class NullDriverCoroutineClient;
+
+// "status" is 0 (kIOReturnSuccess) or an error. On success, foo and bar are the returned DataStruct.
+typedef struct
+{
+    int32_t status;
+    uint64_t foo;
+    uint64_t bar;
+    uint64_t latencyNanoseconds; // For async requests, from sending the request to its result arriving. Time spent waiting for the window isn't included.
+} NullDriverCoroutineResult;
+
+// One connection to the dext. Only the thread running NullDriverCoroutineClient::Run uses it.
+class NullDriverCoroutineTransport
+{
+public:
+    virtual ~NullDriverCoroutineTransport() {}
+
+    // A synchronous call, which returns once "output" holds the result.
+    virtual int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) = 0;
+
+    // Sends one tagged request without waiting for it. Its result is handed to NullDriverCoroutineClient::Complete from WaitForCompletions.
+    virtual int32_t SubmitTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t delayNanoseconds) = 0;
+
+    // Blocks until at least one result has been handed to "client", and returns 0.
+    // Returns an error instead if nothing arrives in time. Every outstanding request then fails with that error.
+    virtual int32_t WaitForCompletions(NullDriverCoroutineClient* client) = 0;
+
+    // The clock latencies are measured with. A simulated transport can substitute its own time.
+    virtual uint64_t NowNanoseconds(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// A coroutine that NullDriverCoroutineClient runs. It doesn't start until it's spawned, and the client destroys it once it finishes.
+class NullDriverTask
+{
+public:
+    struct promise_type
+    {
+        NullDriverTask get_return_object() { return NullDriverTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { abort(); }
+    };
+
+    NullDriverTask(NullDriverTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+    NullDriverTask(const NullDriverTask&) = delete;
+    NullDriverTask& operator=(const NullDriverTask&) = delete;
+
+    ~NullDriverTask()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> Release()
+    {
+        std::coroutine_handle<promise_type> released = handle;
+        handle = nullptr;
+        return released;
+    }
+
+private:
+    explicit NullDriverTask(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+class NullDriverCoroutineClient
+{
+public:
+    // Awaiting this makes a synchronous call. It never suspends, since the transport returns with the result.
+    class CheckedStructAwaiter
+    {
+    public:
+        CheckedStructAwaiter(NullDriverCoroutineClient* owner, uint64_t foo, uint64_t bar) : client(owner), input{ foo, bar } {}
+
+        bool await_ready() const noexcept { return true; }
+        void await_suspend(std::coroutine_handle<>) noexcept {}
+
+        NullDriverCoroutineResult await_resume()
+        {
+            uint64_t output[2] = {};
+            NullDriverCoroutineResult result = {};
+            uint64_t startTime = client->transport->NowNanoseconds();
+
+            result.status = client->transport->CallCheckedStruct(input, output);
+            result.foo = output[0];
+            result.bar = output[1];
+            result.latencyNanoseconds = client->transport->NowNanoseconds() - startTime;
+            return result;
+        }
+
+    private:
+        NullDriverCoroutineClient* client;
+        uint64_t input[2];
+    };
+
+    // Awaiting this sends a tagged request and suspends the coroutine until its result arrives.
+    // The awaiter lives in the coroutine's frame while it's suspended, so the pending table can point at it.
+    class AsyncRequestAwaiter
+    {
+    public:
+        AsyncRequestAwaiter(NullDriverCoroutineClient* owner, uint64_t foo, uint64_t bar, uint64_t delay) : client(owner), input{ foo, bar }, delayNanoseconds(delay) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        // Returns false to resume at once when the request couldn't be sent.
+        bool await_suspend(std::coroutine_handle<> coroutine)
+        {
+            handle = coroutine;
+
+            // Requests already waiting for the window go first, so a new one can't overtake them.
+            if (!client->parked.empty() || !client->HasWindowSlot())
+            {
+                client->parked.push_back(this);
+                return true;
+            }
+
+            return client->Submit(this);
+        }
+
+        NullDriverCoroutineResult await_resume() const noexcept { return result; }
+
+    private:
+        friend class NullDriverCoroutineClient;
+
+        NullDriverCoroutineClient* client;
+        uint64_t input[2];
+        uint64_t delayNanoseconds;
+        uint64_t submitNanoseconds = 0;
+        std::coroutine_handle<> handle;
+        NullDriverCoroutineResult result = {};
+    };
+
+    explicit NullDriverCoroutineClient(NullDriverCoroutineTransport* connection) : transport(connection) {}
+
+    NullDriverCoroutineClient(const NullDriverCoroutineClient&) = delete;
+    NullDriverCoroutineClient& operator=(const NullDriverCoroutineClient&) = delete;
+
+    ~NullDriverCoroutineClient()
+    {
+        for (std::coroutine_handle<> task : tasks)
+        {
+            task.destroy();
+        }
+    }
+
+    CheckedStructAwaiter CheckedStruct(uint64_t foo, uint64_t bar) { return CheckedStructAwaiter(this, foo, bar); }
+
+    // The dext sends the result after "delayNanoseconds", up to its own maximum.
+    AsyncRequestAwaiter AsyncRequest(uint64_t foo, uint64_t bar, uint64_t delayNanoseconds = 0) { return AsyncRequestAwaiter(this, foo, bar, delayNanoseconds); }
+
+    // Limits how many async requests are in flight, and is fed the latency of each one that completes. Pass nullptr for no limit.
+    // "window" has to outlive the client, or be replaced before it goes away.
+    void SetWindow(NullDriverAdaptiveWindow* newWindow) { window = newWindow; }
+
+    // The task starts running the next time Run resumes coroutines.
+    void Spawn(NullDriverTask task)
+    {
+        std::coroutine_handle<> handle = task.Release();
+
+        tasks.push_back(handle);
+        ready.push_back(handle);
+    }
+
+    // Resumes coroutines until every spawned task has finished, waiting on the transport whenever all of them are waiting for results.
+    // Returns 0, or the first error from WaitForCompletions. Requests that were outstanding then resume with that error, so every task still finishes.
+    int32_t Run(void)
+    {
+        int32_t status = 0;
+
+        for (;;)
+        {
+            while (!ready.empty())
+            {
+                std::coroutine_handle<> coroutine = ready.front();
+                ready.pop_front();
+                coroutine.resume();
+            }
+
+            // Results that arrived freed slots in the window. Refused requests resume at once, so the loop goes round again to run them.
+            while (!parked.empty() && HasWindowSlot())
+            {
+                AsyncRequestAwaiter* awaiter = parked.front();
+                parked.pop_front();
+                if (!Submit(awaiter))
+                {
+                    ready.push_back(awaiter->handle);
+                }
+            }
+
+            if (!ready.empty())
+            {
+                continue;
+            }
+
+            if (pending.empty())
+            {
+                break;
+            }
+
+            int32_t ret = transport->WaitForCompletions(this);
+            if (ret != 0)
+            {
+                if (status == 0)
+                {
+                    status = ret;
+                }
+
+                for (auto& entry : pending)
+                {
+                    entry.second->result.status = ret;
+                    ready.push_back(entry.second->handle);
+                }
+                pending.clear();
+            }
+        }
+
+        for (std::coroutine_handle<> task : tasks)
+        {
+            task.destroy();
+        }
+        tasks.clear();
+
+        return status;
+    }
+
+    // Called by the transport for each result it receives. The coroutine that sent "tag" resumes once the transport returns to Run.
+    // Results for tags that aren't outstanding, like the one that answers RegisterAsyncCallback, are only counted.
+    void Complete(uint64_t tag, int32_t status, uint64_t foo, uint64_t bar)
+    {
+        auto entry = pending.find(tag);
+
+        if (entry == pending.end())
+        {
+            ++strayCompletions;
+            return;
+        }
+
+        AsyncRequestAwaiter* awaiter = entry->second;
+        const uint64_t latency = transport->NowNanoseconds() - awaiter->submitNanoseconds;
+        pending.erase(entry);
+
+        awaiter->result.status = status;
+        awaiter->result.foo = foo;
+        awaiter->result.bar = bar;
+        awaiter->result.latencyNanoseconds = latency;
+        ready.push_back(awaiter->handle);
+
+        latencyStats.calls += 1;
+        latencyStats.errors += (status != 0) ? 1 : 0;
+        latencyStats.totalNanoseconds += latency;
+        latencyStats.maxNanoseconds = (latency > latencyStats.maxNanoseconds) ? latency : latencyStats.maxNanoseconds;
+        latencyStats.buckets[NullDriverStatsBucketForNanoseconds(latency)] += 1;
+
+        if (window != nullptr)
+        {
+            NullDriverAdaptiveWindowRecord(window, latency);
+        }
+    }
+
+    size_t InFlightCount(void) const { return pending.size(); }
+    size_t MaxInFlightCount(void) const { return maxInFlight; }
+    uint64_t StrayCompletionCount(void) const { return strayCompletions; }
+
+    // The latency of every async result since the last ResetCounters, in the same buckets the dext uses. Use NullDriverStatsPercentile to read it.
+    const NullDriverSelectorStats* LatencyStats(void) const { return &latencyStats; }
+
+    void ResetCounters(void)
+    {
+        maxInFlight = pending.size();
+        strayCompletions = 0;
+        latencyStats = {};
+    }
+
+private:
+    bool HasWindowSlot(void) const { return (window == nullptr) || (pending.size() < window->limit); }
+
+    // Returns true if the request was sent and its coroutine should stay suspended until the result arrives.
+    bool Submit(AsyncRequestAwaiter* awaiter)
+    {
+        const uint64_t tag = nextTag++;
+
+        awaiter->submitNanoseconds = transport->NowNanoseconds();
+        awaiter->result.status = transport->SubmitTaggedAsync(tag, awaiter->input, awaiter->delayNanoseconds);
+        if (awaiter->result.status != 0)
+        {
+            return false;
+        }
+
+        pending.emplace(tag, awaiter);
+        if (pending.size() > maxInFlight)
+        {
+            maxInFlight = pending.size();
+        }
+        return true;
+    }
+
+    NullDriverCoroutineTransport* transport;
+
+    // Tags are only unique per connection, so each client numbers its own. The dext refuses tags with the top bit set.
+    uint64_t nextTag = 1;
+    std::unordered_map<uint64_t, AsyncRequestAwaiter*> pending;
+    std::deque<AsyncRequestAwaiter*> parked; // Sent in order as the window allows.
+    std::deque<std::coroutine_handle<>> ready;
+    std::vector<std::coroutine_handle<>> tasks;
+    NullDriverAdaptiveWindow* window = nullptr;
+    size_t maxInFlight = 0;
+    uint64_t strayCompletions = 0;
+    NullDriverSelectorStats latencyStats = {};
+};
+
+#endif /* NullDriverCoroutine_h */
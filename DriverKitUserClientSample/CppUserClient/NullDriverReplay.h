@@ -0,0 +1,640 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Records the calls a client makes into a compact binary trace, and replays a trace against the dext at its original speed, faster, or flat out.
+Recording wraps any NullDriverBenchTransport, so every call the bench makes is captured with its selector, payload, timestamp and result.
+Replay spreads the recorded connections over any number of threads, each with its own transport, and reports how late calls went out as well as
+how long they took.
+*/
+
+#ifndef NullDriverReplay_h
+#define NullDriverReplay_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NullDriverBench.h"
+
+// A trace file is a NullDriverReplayFileHeader followed by "recordCount" records. Each record is a NullDriverReplayRecord followed by
+// "inputSize" bytes of payload. Everything is in the byte order of the machine that wrote it, which is little endian on every Mac.
+#define kNullDriverReplayMagic 0x5452444EU // "NDRT"
+#define kNullDriverReplayVersion 1U
+
+// No recorded call carries more than this, so a corrupt size can't make the reader allocate without bound.
+#define kNullDriverReplayMaxInputSize kNullDriverBenchMaxBatchSize
+
+// The dext's selectors for the calls a trace can hold. These match ExternalMethodType in NullDriver.cpp.
+typedef enum
+{
+    NullDriverReplaySelector_Scalar = 0, // The payload is the input scalars.
+    NullDriverReplaySelector_CheckedStruct = 3, // The payload is one DataStruct.
+    NullDriverReplaySelector_CheckedStructBatch = 7, // The payload is the DataStructs of the batch.
+    NullDriverReplaySelector_TaggedAsyncRequest = 8, // The payload is the tag, then one DataStruct.
+} NullDriverReplaySelector;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t recordCount;
+} NullDriverReplayFileHeader;
+
+typedef struct
+{
+    uint64_t timestamp; // When the call was made, in nanoseconds from the start of the recording.
+    uint32_t duration; // How long the call took, in nanoseconds, up to UINT32_MAX.
+    int32_t result; // What the call returned.
+    uint16_t selector;
+    uint16_t stream; // The connection that made the call. Calls on one stream were made one after another.
+    uint32_t inputSize; // Bytes of payload after the record, always a multiple of 8.
+    uint32_t outputSize; // Bytes (or, for scalars, 8 bytes per scalar) the call returned.
+    uint32_t reserved;
+} NullDriverReplayRecord;
+
+// A trace in memory. The payload of record N starts at payload[payloadOffsets[N]].
+typedef struct
+{
+    std::vector<NullDriverReplayRecord> records;
+    std::vector<uint64_t> payloadOffsets;
+    std::vector<uint64_t> payload;
+} NullDriverReplayTrace;
+
+static inline void NullDriverReplayTraceAdd(NullDriverReplayTrace* trace, const NullDriverReplayRecord* record, const uint64_t* input)
+{
+    trace->records.push_back(*record);
+    trace->payloadOffsets.push_back(trace->payload.size());
+    trace->payload.insert(trace->payload.end(), input, input + record->inputSize / 8);
+}
+
+// MARK: File Format
+// Writes "trace" to "path" in timestamp order. Calls with the same timestamp keep the order they were added in.
+static inline bool NullDriverReplayWrite(const char* path, const NullDriverReplayTrace* trace)
+{
+    std::vector<size_t> order(trace->records.size());
+    const NullDriverReplayFileHeader header = { kNullDriverReplayMagic, kNullDriverReplayVersion, trace->records.size() };
+    bool written = true;
+
+    for (size_t index = 0; index < order.size(); ++index)
+    {
+        order[index] = index;
+    }
+    std::stable_sort(order.begin(), order.end(), [trace](size_t first, size_t second) { return trace->records[first].timestamp < trace->records[second].timestamp; });
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Couldn't create trace file %s.\n", path);
+        return false;
+    }
+
+    written = (fwrite(&header, sizeof(header), 1, file) == 1);
+    for (size_t index = 0; (index < order.size()) && written; ++index)
+    {
+        const NullDriverReplayRecord* record = &trace->records[order[index]];
+
+        written = (fwrite(record, sizeof(NullDriverReplayRecord), 1, file) == 1);
+        if (written && (record->inputSize != 0))
+        {
+            written = (fwrite(&trace->payload[trace->payloadOffsets[order[index]]], record->inputSize, 1, file) == 1);
+        }
+    }
+
+    if ((fclose(file) != 0) || !written)
+    {
+        fprintf(stderr, "Couldn't write trace file %s.\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// Reads the trace at "path" into "trace". A file that is truncated, from another version, or out of timestamp order is rejected as a whole.
+static inline bool NullDriverReplayRead(const char* path, NullDriverReplayTrace* trace)
+{
+    NullDriverReplayFileHeader header = {};
+    NullDriverReplayRecord record = {};
+    uint64_t input[kNullDriverReplayMaxInputSize / 8];
+    uint64_t previousTimestamp = 0;
+    bool valid = true;
+
+    *trace = {};
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Couldn't open trace file %s.\n", path);
+        return false;
+    }
+
+    if ((fread(&header, sizeof(header), 1, file) != 1) || (header.magic != kNullDriverReplayMagic) || (header.version != kNullDriverReplayVersion))
+    {
+        fprintf(stderr, "%s isn't a version %u trace.\n", path, kNullDriverReplayVersion);
+        fclose(file);
+        return false;
+    }
+
+    for (uint64_t index = 0; (index < header.recordCount) && valid; ++index)
+    {
+        valid = (fread(&record, sizeof(record), 1, file) == 1);
+        valid = valid && ((record.inputSize % 8) == 0) && (record.inputSize <= kNullDriverReplayMaxInputSize) && (record.timestamp >= previousTimestamp);
+        valid = valid && ((record.inputSize == 0) || (fread(input, record.inputSize, 1, file) == 1));
+        if (!valid)
+        {
+            fprintf(stderr, "Record %llu of %s is truncated or corrupt.\n", (unsigned long long)index, path);
+            break;
+        }
+
+        NullDriverReplayTraceAdd(trace, &record, input);
+        previousTimestamp = record.timestamp;
+    }
+
+    fclose(file);
+    if (!valid)
+    {
+        *trace = {};
+    }
+
+    return valid;
+}
+
+// MARK: Recording
+// Collects the calls of every NullDriverReplayRecordingTransport made with it. Each transport keeps its calls to itself until it is deleted,
+// so recording takes no lock per call.
+class NullDriverReplayRecorder
+{
+public:
+    NullDriverReplayRecorder() : startTime(NullDriverBenchNowNanoseconds()) {}
+
+    uint64_t Timestamp(void) const { return NullDriverBenchNowNanoseconds() - startTime; }
+
+    uint16_t NextStream(void) { return (uint16_t)nextStream.fetch_add(1, std::memory_order_relaxed); }
+
+    void Append(const NullDriverReplayTrace* calls)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t index = 0; index < calls->records.size(); ++index)
+        {
+            NullDriverReplayTraceAdd(&trace, &calls->records[index], calls->payload.data() + calls->payloadOffsets[index]);
+        }
+    }
+
+    // Only call this once every recording transport has been deleted.
+    bool Save(const char* path)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return NullDriverReplayWrite(path, &trace);
+    }
+
+    size_t RecordCount(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return trace.records.size();
+    }
+
+private:
+    const uint64_t startTime;
+    std::atomic<uint32_t> nextStream{0};
+    std::mutex lock;
+    NullDriverReplayTrace trace;
+};
+
+// Passes every call on to "transport", which it owns, and records it.
+class NullDriverReplayRecordingTransport : public NullDriverBenchTransport
+{
+public:
+    NullDriverReplayRecordingTransport(NullDriverBenchTransport* recorded, NullDriverReplayRecorder* traceRecorder) : transport(recorded), recorder(traceRecorder), stream(traceRecorder->NextStream()) {}
+
+    ~NullDriverReplayRecordingTransport() override
+    {
+        recorder->Append(&calls);
+        delete transport;
+    }
+
+    int32_t CallScalar(const uint64_t* input, uint32_t inputCount, uint64_t* output, uint32_t* outputCount) override
+    {
+        const uint64_t start = recorder->Timestamp();
+        int32_t ret = transport->CallScalar(input, inputCount, output, outputCount);
+        Record(NullDriverReplaySelector_Scalar, start, ret, input, inputCount * 8, *outputCount * 8);
+        return ret;
+    }
+
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        const uint64_t start = recorder->Timestamp();
+        int32_t ret = transport->CallCheckedStruct(input, output);
+        Record(NullDriverReplaySelector_CheckedStruct, start, ret, input, 16, 16);
+        return ret;
+    }
+
+    int32_t CallCheckedStructBatch(const uint64_t* input, size_t inputSize, uint64_t* output, size_t* outputSize) override
+    {
+        const uint64_t start = recorder->Timestamp();
+        int32_t ret = transport->CallCheckedStructBatch(input, inputSize, output, outputSize);
+
+        // A batch too large for a trace is still made, it just isn't recorded.
+        if (((inputSize % 8) == 0) && (inputSize <= kNullDriverReplayMaxInputSize))
+        {
+            Record(NullDriverReplaySelector_CheckedStructBatch, start, ret, input, (uint32_t)inputSize, (uint32_t)*outputSize);
+        }
+        return ret;
+    }
+
+    int32_t CallTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t* output) override
+    {
+        const uint64_t start = recorder->Timestamp();
+        const uint64_t payload[3] = { tag, input[0], input[1] };
+        int32_t ret = transport->CallTaggedAsync(tag, input, output);
+        Record(NullDriverReplaySelector_TaggedAsyncRequest, start, ret, payload, 24, 16);
+        return ret;
+    }
+
+private:
+    void Record(uint16_t selector, uint64_t start, int32_t result, const uint64_t* input, uint32_t inputSize, uint32_t outputSize)
+    {
+        NullDriverReplayRecord record = {};
+        const uint64_t duration = recorder->Timestamp() - start;
+
+        record.timestamp = start;
+        record.duration = (duration > UINT32_MAX) ? UINT32_MAX : (uint32_t)duration;
+        record.result = result;
+        record.selector = selector;
+        record.stream = stream;
+        record.inputSize = inputSize;
+        record.outputSize = outputSize;
+        NullDriverReplayTraceAdd(&calls, &record, input);
+    }
+
+    NullDriverBenchTransport* const transport;
+    NullDriverReplayRecorder* const recorder;
+    const uint16_t stream;
+    NullDriverReplayTrace calls;
+};
+
+// Wraps "factory" so each transport it makes is recorded. Pass NullDriverReplayRecordingFactory and this context to NullDriverBenchRun.
+typedef struct
+{
+    NullDriverBenchTransportFactory factory;
+    void* context;
+    NullDriverReplayRecorder* recorder;
+} NullDriverReplayRecordingContext;
+
+static inline NullDriverBenchTransport* NullDriverReplayRecordingFactory(void* context)
+{
+    NullDriverReplayRecordingContext* recording = (NullDriverReplayRecordingContext*)context;
+    NullDriverBenchTransport* transport = recording->factory(recording->context);
+
+    if (transport == nullptr)
+    {
+        return nullptr;
+    }
+
+    return new NullDriverReplayRecordingTransport(transport, recording->recorder);
+}
+
+// MARK: Replay
+typedef struct
+{
+    double speed; // 1 replays at the recorded pace, 2 twice as fast, and so on. 0 replays flat out.
+    uint32_t threadCount; // Recorded stream N is replayed on thread N % threadCount.
+    NullDriverBenchFormat format;
+} NullDriverReplayOptions;
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t resultMismatches; // Calls that returned something other than the recorded result.
+    uint64_t sizeMismatches; // Calls that returned a different amount of output than recorded.
+    uint64_t elapsedNanoseconds;
+    uint64_t scheduledNanoseconds; // How long the trace should take at this speed.
+    uint64_t p50Nanoseconds;
+    uint64_t p99Nanoseconds;
+    uint64_t maxNanoseconds;
+    uint64_t p50LateNanoseconds; // How long after its scheduled time each call was made.
+    uint64_t p99LateNanoseconds;
+    uint64_t maxLateNanoseconds;
+} NullDriverReplayResult;
+
+static inline void NullDriverReplayPrintUsage(const char* program)
+{
+    printf("Usage: %s TRACE [--speed N|max] [--threads N] [--format json|csv]\n", program);
+    printf("  --speed    1 replays at the recorded pace, 2 twice as fast, max as fast as the calls complete. Defaults to 1.\n");
+    printf("  --threads  Threads, each with its own connection. Recorded connections are spread over them. Defaults to 1.\n");
+    printf("  --format   Report format. Defaults to json.\n");
+}
+
+// Fills in "options" and "path" from "arguments", which shouldn't include the program name. Prints the problem and returns false for anything invalid.
+static inline bool NullDriverReplayParseArguments(int argumentCount, const char* arguments[], const char** path, NullDriverReplayOptions* options)
+{
+    options->speed = 1.0;
+    options->threadCount = 1;
+    options->format = NullDriverBenchFormat_JSON;
+
+    if (argumentCount < 1)
+    {
+        printf("Missing the trace to replay.\n");
+        return false;
+    }
+    *path = arguments[0];
+
+    for (int index = 1; index < argumentCount; index += 2)
+    {
+        const char* name = arguments[index];
+        const char* value = (index + 1 < argumentCount) ? arguments[index + 1] : nullptr;
+        char* end = nullptr;
+
+        if (value == nullptr)
+        {
+            printf("Missing a value for %s.\n", name);
+            return false;
+        }
+
+        if (strcmp(name, "--speed") == 0)
+        {
+            options->speed = (strcmp(value, "max") == 0) ? 0.0 : strtod(value, &end);
+            if ((options->speed < 0.0) || ((end != nullptr) && ((end == value) || (*end != '\0'))))
+            {
+                printf("--speed needs a positive number or max, not %s.\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(name, "--threads") == 0)
+        {
+            unsigned long long number = strtoull(value, &end, 10);
+            if ((end == value) || (*end != '\0') || (number == 0))
+            {
+                printf("--threads needs a number of at least 1, not %s.\n", value);
+                return false;
+            }
+            options->threadCount = (number > 1024) ? 1024 : (uint32_t)number;
+        }
+        else if (strcmp(name, "--format") == 0)
+        {
+            if (strcmp(value, "json") == 0)
+            {
+                options->format = NullDriverBenchFormat_JSON;
+            }
+            else if (strcmp(value, "csv") == 0)
+            {
+                options->format = NullDriverBenchFormat_CSV;
+            }
+            else
+            {
+                printf("Unknown format %s.\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            printf("Unknown option %s.\n", name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The measurements of one replay thread.
+typedef struct
+{
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> lateness;
+    uint64_t resultMismatches;
+    uint64_t sizeMismatches;
+    uint64_t endTime;
+    bool connected;
+} NullDriverReplayThreadResult;
+
+// Makes the recorded call "index" on "transport". Returns the result, and the amount of output in "outputSize".
+static inline int32_t NullDriverReplayCall(NullDriverBenchTransport* transport, const NullDriverReplayTrace* trace, size_t index, uint64_t* output, uint32_t* outputSize)
+{
+    const NullDriverReplayRecord* record = &trace->records[index];
+    const uint64_t* input = &trace->payload[trace->payloadOffsets[index]];
+    int32_t ret = 0;
+
+    switch (record->selector)
+    {
+        case NullDriverReplaySelector_Scalar:
+        {
+            uint32_t outputCount = (record->outputSize / 8 > kNullDriverBenchMaxScalarCount) ? kNullDriverBenchMaxScalarCount : record->outputSize / 8;
+            ret = transport->CallScalar(input, record->inputSize / 8, output, &outputCount);
+            *outputSize = outputCount * 8;
+        } break;
+
+        case NullDriverReplaySelector_CheckedStruct:
+        {
+            ret = (record->inputSize >= 16) ? transport->CallCheckedStruct(input, output) : -1;
+            *outputSize = 16;
+        } break;
+
+        case NullDriverReplaySelector_CheckedStructBatch:
+        {
+            size_t batchOutputSize = record->outputSize;
+            ret = transport->CallCheckedStructBatch(input, record->inputSize, output, &batchOutputSize);
+            *outputSize = (uint32_t)batchOutputSize;
+        } break;
+
+        case NullDriverReplaySelector_TaggedAsyncRequest:
+        {
+            ret = (record->inputSize >= 24) ? transport->CallTaggedAsync(input[0], input + 1, output) : -1;
+            *outputSize = 16;
+        } break;
+
+        default:
+        {
+            ret = -1;
+            *outputSize = 0;
+        } break;
+    }
+
+    return ret;
+}
+
+// Waits until "deadline", sleeping while it's far off and yielding for the last stretch, so calls go out close to on time without spinning a core.
+static inline void NullDriverReplayWaitUntil(uint64_t deadline)
+{
+    while (true)
+    {
+        const uint64_t now = NullDriverBenchNowNanoseconds();
+        if (now >= deadline)
+        {
+            return;
+        }
+
+        if (deadline - now > 200000)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - 100000));
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+static inline void NullDriverReplayRunThread(const NullDriverReplayOptions* options, const NullDriverReplayTrace* trace, uint32_t thread, NullDriverBenchTransportFactory factory, void* context,
+                                             std::atomic<uint32_t>* ready, std::atomic<uint64_t>* startTime, NullDriverReplayThreadResult* result)
+{
+    std::vector<uint64_t> output(kNullDriverReplayMaxInputSize / 8);
+    NullDriverBenchTransport* transport = factory(context);
+    const uint64_t firstTimestamp = trace->records.empty() ? 0 : trace->records[0].timestamp;
+
+    result->connected = (transport != nullptr);
+
+    // Every thread connects before the clock starts. The last one to connect starts it.
+    if (ready->fetch_add(1, std::memory_order_acq_rel) + 1 == options->threadCount)
+    {
+        startTime->store(NullDriverBenchNowNanoseconds(), std::memory_order_release);
+    }
+    while (startTime->load(std::memory_order_acquire) == 0)
+    {
+        std::this_thread::yield();
+    }
+
+    if (transport == nullptr)
+    {
+        return;
+    }
+
+    const uint64_t start = startTime->load(std::memory_order_acquire);
+    for (size_t index = 0; index < trace->records.size(); ++index)
+    {
+        const NullDriverReplayRecord* record = &trace->records[index];
+        uint32_t outputSize = 0;
+
+        if ((record->stream % options->threadCount) != thread)
+        {
+            continue;
+        }
+
+        uint64_t deadline = start;
+        if (options->speed > 0.0)
+        {
+            deadline += (uint64_t)((double)(record->timestamp - firstTimestamp) / options->speed);
+            NullDriverReplayWaitUntil(deadline);
+        }
+
+        const uint64_t callStart = NullDriverBenchNowNanoseconds();
+        int32_t ret = NullDriverReplayCall(transport, trace, index, output.data(), &outputSize);
+        const uint64_t callEnd = NullDriverBenchNowNanoseconds();
+
+        result->latencies.push_back(callEnd - callStart);
+        result->lateness.push_back((options->speed > 0.0) ? callStart - deadline : 0);
+        if (ret != record->result)
+        {
+            ++result->resultMismatches;
+        }
+        else if ((ret == 0) && (outputSize != record->outputSize))
+        {
+            ++result->sizeMismatches;
+        }
+    }
+    result->endTime = NullDriverBenchNowNanoseconds();
+
+    delete transport;
+}
+
+// Replays "trace" on "options->threadCount" threads and fills in "result". Returns false if any thread couldn't connect.
+static inline bool NullDriverReplayRun(const NullDriverReplayOptions* options, const NullDriverReplayTrace* trace, NullDriverBenchTransportFactory factory, void* context, NullDriverReplayResult* result)
+{
+    std::vector<NullDriverReplayThreadResult> threadResults(options->threadCount);
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> ready(0);
+    std::atomic<uint64_t> startTime(0);
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> lateness;
+    uint64_t endTime = 0;
+    bool connected = true;
+
+    memset(result, 0, sizeof(NullDriverReplayResult));
+
+    for (uint32_t thread = 0; thread < options->threadCount; ++thread)
+    {
+        threadResults[thread].resultMismatches = 0;
+        threadResults[thread].sizeMismatches = 0;
+        threadResults[thread].endTime = 0;
+        threads.emplace_back(NullDriverReplayRunThread, options, trace, thread, factory, context, &ready, &startTime, &threadResults[thread]);
+    }
+
+    for (uint32_t thread = 0; thread < options->threadCount; ++thread)
+    {
+        NullDriverReplayThreadResult* threadResult = &threadResults[thread];
+
+        threads[thread].join();
+        if (!threadResult->connected)
+        {
+            connected = false;
+            continue;
+        }
+
+        result->resultMismatches += threadResult->resultMismatches;
+        result->sizeMismatches += threadResult->sizeMismatches;
+        endTime = (threadResult->endTime > endTime) ? threadResult->endTime : endTime;
+        latencies.insert(latencies.end(), threadResult->latencies.begin(), threadResult->latencies.end());
+        lateness.insert(lateness.end(), threadResult->lateness.begin(), threadResult->lateness.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(lateness.begin(), lateness.end());
+
+    result->calls = latencies.size();
+    result->elapsedNanoseconds = (endTime > startTime.load()) ? endTime - startTime.load() : 0;
+    if ((options->speed > 0.0) && !trace->records.empty())
+    {
+        result->scheduledNanoseconds = (uint64_t)((double)(trace->records.back().timestamp - trace->records.front().timestamp) / options->speed);
+    }
+    if (!latencies.empty())
+    {
+        result->p50Nanoseconds = NullDriverBenchPercentile(latencies, 0.5);
+        result->p99Nanoseconds = NullDriverBenchPercentile(latencies, 0.99);
+        result->maxNanoseconds = latencies.back();
+        result->p50LateNanoseconds = NullDriverBenchPercentile(lateness, 0.5);
+        result->p99LateNanoseconds = NullDriverBenchPercentile(lateness, 0.99);
+        result->maxLateNanoseconds = lateness.back();
+    }
+
+    return connected;
+}
+
+// MARK: Report
+// Writes one JSON object, or a CSV header and row, to "file".
+static inline void NullDriverReplayReport(FILE* file, const NullDriverReplayOptions* options, const NullDriverReplayResult* result)
+{
+    const double seconds = (double)result->elapsedNanoseconds / 1000000000.0;
+    const double opsPerSecond = (seconds > 0.0) ? (double)result->calls / seconds : 0.0;
+
+    if (options->format == NullDriverBenchFormat_CSV)
+    {
+        fprintf(file, "speed,threads,calls,result_mismatches,size_mismatches,seconds,scheduled_seconds,ops_per_sec,p50_ns,p99_ns,max_ns,p50_late_ns,p99_late_ns,max_late_ns\n");
+        fprintf(file, "%.3f,%u,%llu,%llu,%llu,%.6f,%.6f,%.0f,%llu,%llu,%llu,%llu,%llu,%llu\n", options->speed, options->threadCount, (unsigned long long)result->calls, (unsigned long long)result->resultMismatches,
+                (unsigned long long)result->sizeMismatches, seconds, (double)result->scheduledNanoseconds / 1000000000.0, opsPerSecond, (unsigned long long)result->p50Nanoseconds,
+                (unsigned long long)result->p99Nanoseconds, (unsigned long long)result->maxNanoseconds, (unsigned long long)result->p50LateNanoseconds, (unsigned long long)result->p99LateNanoseconds,
+                (unsigned long long)result->maxLateNanoseconds);
+        return;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"speed\": %.3f,\n", options->speed);
+    fprintf(file, "  \"threads\": %u,\n", options->threadCount);
+    fprintf(file, "  \"calls\": %llu,\n", (unsigned long long)result->calls);
+    fprintf(file, "  \"result_mismatches\": %llu,\n", (unsigned long long)result->resultMismatches);
+    fprintf(file, "  \"size_mismatches\": %llu,\n", (unsigned long long)result->sizeMismatches);
+    fprintf(file, "  \"seconds\": %.6f,\n", seconds);
+    fprintf(file, "  \"scheduled_seconds\": %.6f,\n", (double)result->scheduledNanoseconds / 1000000000.0);
+    fprintf(file, "  \"ops_per_sec\": %.0f,\n", opsPerSecond);
+    fprintf(file, "  \"latency_ns\": { \"p50\": %llu, \"p99\": %llu, \"max\": %llu },\n", (unsigned long long)result->p50Nanoseconds, (unsigned long long)result->p99Nanoseconds, (unsigned long long)result->maxNanoseconds);
+    fprintf(file, "  \"late_ns\": { \"p50\": %llu, \"p99\": %llu, \"max\": %llu }\n", (unsigned long long)result->p50LateNanoseconds, (unsigned long long)result->p99LateNanoseconds,
+            (unsigned long long)result->maxLateNanoseconds);
+    fprintf(file, "}\n");
+}
+
+#endif /* NullDriverReplay_h */
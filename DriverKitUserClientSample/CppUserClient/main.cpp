@@ -3,27 +3,52 @@ See LICENSE folder for this sample’s licensing information.
 
 Abstract:
 An interactive command-line client for calling the installed null driver.
+Run as "CppUserClient bench [options]" to run a single benchmark without the menu instead. See NullDriverBench.h for the options.
 */
 
 #include <iostream>
+#include <thread>
 #include <IOKit/usb/USB.h>
 #include <IOKit/IOReturn.h>
 #include <IOKit/IOKitLib.h>
 #include <IOKit/hidsystem/IOHIDShared.h>
 
-typedef struct {
-    uint64_t foo;
-    uint64_t bar;
-} DataStruct;
-
-typedef struct {
-    uint64_t foo;
-    uint64_t bar;
-    uint64_t largeArray[511];
-} OversizedDataStruct;
+#include "../Shared/NullDriverCompletion.h"
+#include "../Shared/NullDriverDevice.h"
+#include "../Shared/NullDriverDoorbell.h"
+#include "../Shared/NullDriverProtocol.h"
+#include "../Shared/NullDriverRegisteredBuffer.h"
+#include "../Shared/NullDriverRing.h"
+#include "../Shared/NullDriverSampleRing.h"
+#include "../Shared/NullDriverScatterGather.h"
+#include "../Shared/NullDriverStats.h"
+#include "../Shared/NullDriverStream.h"
+#include "NullDriverBench.h"
+#include "NullDriverCompletionWaiter.h"
+#include "NullDriverCoroutine.h"
+#include "NullDriverReplay.h"
 
 CFRunLoopRef globalRunLoop = nullptr;
 
+// Tagged async requests complete in any order, so the callback only counts them down and stops the run loop after the last one.
+uint32_t globalOutstandingTaggedRequests = 0;
+uint32_t globalTaggedMismatches = 0;
+
+// Every call into AsyncCallback counts as one notification, however many results it carries.
+uint64_t globalNotificationCount = 0;
+
+// In coalesced mode, large batches of tagged results arrive through this ring, mapped by option 13. Only AsyncCallback consumes from it.
+NullDriverRing* globalAsyncCompletionRing = nullptr;
+uint32_t globalAsyncCompletionTail = 0;
+
+// Progress of the current chunked stream. One queue in the dext processes its chunks, so they complete in order.
+uint64_t globalStreamCompletedChunks = 0;
+uint64_t globalStreamCompletedBytes = 0;
+uint32_t globalStreamErrors = 0;
+
+// Low-water mark notifications from the sample stream. Option 20 drains the ring itself, so the callback only counts them.
+uint64_t globalSampleNotifications = 0;
+
 inline void PrintArray(const uint64_t* ptr, const uint32_t length)
 {
     printf("{ ");
@@ -58,6 +83,72 @@ inline void PrintErrorDetails(kern_return_t ret)
     printf("\tCode: 0x%04x\n", err_get_code(ret));
 }
 
+inline double OpsPerSecond(uint64_t count, uint64_t elapsedNanoseconds)
+{
+    if (elapsedNanoseconds == 0)
+    {
+        return 0.0;
+    }
+
+    return (double)count * 1000000000.0 / (double)elapsedNanoseconds;
+}
+
+// The rings are created by the dext and mapped into this process with IOConnectMapMemory64.
+// The mapping stays valid until the connection is closed, so this only needs to happen once.
+static NullDriverRing* MapRing(io_connect_t connection, NullDriverMemoryType memoryType)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    mach_vm_address_t address = 0;
+    mach_vm_size_t size = 0;
+
+    ret = IOConnectMapMemory64(connection, memoryType, mach_task_self(), &address, &size, kIOMapAnywhere);
+    if (ret != kIOReturnSuccess)
+    {
+        printf("IOConnectMapMemory64 failed with error: 0x%08x.\n", ret);
+        PrintErrorDetails(ret);
+        return nullptr;
+    }
+
+    if (size < sizeof(NullDriverRing))
+    {
+        printf("Mapped ring of size %llu is smaller than the expected %lu.\n", size, sizeof(NullDriverRing));
+        IOConnectUnmapMemory64(connection, memoryType, mach_task_self(), address);
+        return nullptr;
+    }
+
+    return (NullDriverRing*)address;
+}
+
+// The shared rings of one connection. The client owns the submission ring's head and the completion ring's tail.
+typedef struct
+{
+    NullDriverRing* submissionRing;
+    NullDriverRing* completionRing;
+    uint32_t submissionHead;
+    uint32_t completionTail;
+} SharedRings;
+
+// Maps both rings the first time they're needed. Returns false if either can't be mapped.
+static bool MapSharedRings(io_connect_t connection, SharedRings* rings)
+{
+    if (rings->submissionRing != nullptr)
+    {
+        return true;
+    }
+
+    rings->submissionRing = MapRing(connection, NullDriverMemoryType_SubmissionRing);
+    rings->completionRing = MapRing(connection, NullDriverMemoryType_CompletionRing);
+    if ((rings->submissionRing == nullptr) || (rings->completionRing == nullptr))
+    {
+        printf("Failed to map the shared rings.\n");
+        rings->submissionRing = nullptr;
+        rings->completionRing = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
 // For more detail on this callback format, view the format of:
 // IOAsyncCallback, IOAsyncCallback0, IOAsyncCallback1, IOAsyncCallback2
 // Note that the variant of IOAsyncCallback called is based on the number of arguments being returned
@@ -67,41 +158,903 @@ inline void PrintErrorDetails(kern_return_t ret)
 // 3+ - IOAsyncCallback
 // This is an example of the "IOAsyncCallback" format.
 // refcon will be the value you placed in asyncRef[kIOAsyncCalloutRefconIndex]
+// The tag is what matches a result to its request. Every tagged request in this sample sends { .foo = tag, .bar = 70000 }.
+static void CompleteTaggedResult(IOReturn result, uint64_t tag, uint64_t foo, uint64_t bar)
+{
+    if ((result != kIOReturnSuccess) || (foo != tag + 1) || (bar != 70010))
+    {
+        ++globalTaggedMismatches;
+    }
+
+    if ((globalOutstandingTaggedRequests != 0) && (--globalOutstandingTaggedRequests == 0))
+    {
+        CFRunLoopStop(globalRunLoop);
+    }
+}
+
 static void AsyncCallback(void* refcon, IOReturn result, void** args, uint32_t numArgs)
 {
     const char* funcName = nullptr;
     uint64_t* arrArgs = (uint64_t*)args;
     DataStruct* output = (DataStruct*)(arrArgs + 1);
 
+    ++globalNotificationCount;
+
+    // Tagged completions are { 3, tag, foo, bar }.
+    if ((arrArgs[0] == AsyncCompletionType_TaggedAsyncRequest) && (numArgs >= 4))
+    {
+        CompleteTaggedResult(result, arrArgs[1], arrArgs[2], arrArgs[3]);
+        return;
+    }
+
+    // Coalesced completions are { 4, count, tag0, foo0, bar0, ... }, with up to kNullDriverCoalescedResultsMax results.
+    if (arrArgs[0] == AsyncCompletionType_CoalescedResults)
+    {
+        NullDriverCompletionResult results[kNullDriverCoalescedResultsMax];
+        uint32_t count = NullDriverCompletionUnpack(arrArgs, numArgs, results, kNullDriverCoalescedResultsMax);
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            CompleteTaggedResult(result, results[index].tag, results[index].foo, results[index].bar);
+        }
+        return;
+    }
+
+    // { 5, count } means the results are waiting in the async completion ring.
+    // Everything ready is taken, which may include results announced by a notification that hasn't been handled yet. That one then finds less, which is fine.
+    if (arrArgs[0] == AsyncCompletionType_AsyncCompletionRing)
+    {
+        NullDriverRingEntry entries[64];
+        uint32_t count = 0;
+
+        if (globalAsyncCompletionRing == nullptr)
+        {
+            return;
+        }
+
+        do
+        {
+            count = NullDriverRingConsume(globalAsyncCompletionRing, &globalAsyncCompletionTail, entries, 64);
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                CompleteTaggedResult((IOReturn)entries[index].status, entries[index].tag, entries[index].foo, entries[index].bar);
+            }
+        } while (count != 0);
+        return;
+    }
+
+    // Stream progress is { 6, sequence, completedBytes, totalLength }. The stream's own loop runs the run loop until the chunk it needs is done.
+    if ((arrArgs[0] == AsyncCompletionType_StreamProgress) && (numArgs >= 4))
+    {
+        globalStreamCompletedChunks = arrArgs[1] + 1;
+        globalStreamCompletedBytes = arrArgs[2];
+        if (result != kIOReturnSuccess)
+        {
+            ++globalStreamErrors;
+        }
+        return;
+    }
+
+    // Samples ready is { 7, ready, produced, dropped }. The samples are read from the ring, so this only wakes up the loop that reads them.
+    if ((arrArgs[0] == AsyncCompletionType_SamplesReady) && (numArgs >= 4))
+    {
+        ++globalSampleNotifications;
+        CFRunLoopStop(globalRunLoop);
+        return;
+    }
+
     switch (arrArgs[0])
     {
-        case 1:
+        case AsyncCompletionType_RegisterAsyncCallback:
+        {
+            funcName = "'Register Async Callback'";
+        } break;
+
+        case AsyncCompletionType_AsyncRequest:
+        {
+            funcName = "'Async Request'";
+        } break;
+
+        default:
+        {
+            funcName = "UNKNOWN";
+        } break;
+    }
+
+    printf("Got callback of %s from dext with returned data ", funcName);
+    PrintStruct(output);
+    printf("with return code: 0x%08x.\n", result);
+
+    // Stop the run loop so our program can return to normal processing.
+    CFRunLoopStop(globalRunLoop);
+}
+
+// MARK: Bench Mode
+// Each bench thread opens its own connection, so it gets its own user client in the dext, and its own notification port on its own run loop.
+// Nothing here touches the globals the menu uses.
+class IOKitBenchTransport : public NullDriverBenchTransport
+{
+public:
+    // "context" points to the io_service_t to open.
+    static NullDriverBenchTransport* Create(void* context)
+    {
+        IOKitBenchTransport* transport = new IOKitBenchTransport();
+        kern_return_t ret = kIOReturnSuccess;
+
+        ret = IOServiceOpen(*(io_service_t*)context, mach_task_self_, kIOHIDServerConnectType, &transport->connection);
+        if (ret != kIOReturnSuccess)
+        {
+            fprintf(stderr, "IOServiceOpen failed with error: 0x%08x.\n", ret);
+            delete transport;
+            return nullptr;
+        }
+
+        transport->notificationPort = IONotificationPortCreate(kIOMasterPortDefault);
+        if (transport->notificationPort == nullptr)
+        {
+            fprintf(stderr, "Failed to create notification port for bench thread.\n");
+            delete transport;
+            return nullptr;
+        }
+
+        transport->runLoop = CFRunLoopGetCurrent();
+        CFRetain(transport->runLoop);
+        CFRunLoopAddSource(transport->runLoop, IONotificationPortGetRunLoopSource(transport->notificationPort), kCFRunLoopDefaultMode);
+
+        transport->asyncRef[kIOAsyncCalloutFuncIndex] = (io_user_reference_t)AsyncCallback;
+        transport->asyncRef[kIOAsyncCalloutRefconIndex] = (io_user_reference_t)transport;
+
+        return transport;
+    }
+
+    ~IOKitBenchTransport() override
+    {
+        if (notificationPort != nullptr)
+        {
+            if (runLoop != nullptr)
+            {
+                CFRunLoopRemoveSource(runLoop, IONotificationPortGetRunLoopSource(notificationPort), kCFRunLoopDefaultMode);
+                CFRelease(runLoop);
+            }
+            IONotificationPortDestroy(notificationPort);
+        }
+
+        if (connection != IO_OBJECT_NULL)
+        {
+            IOServiceClose(connection);
+        }
+    }
+
+    int32_t CallScalar(const uint64_t* input, uint32_t inputCount, uint64_t* output, uint32_t* outputCount) override
+    {
+        return IOConnectCallScalarMethod(connection, ExternalMethodType_Scalar, input, inputCount, output, outputCount);
+    }
+
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        size_t outputSize = sizeof(DataStruct);
+        return IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStruct, input, sizeof(DataStruct), output, &outputSize);
+    }
+
+    int32_t CallCheckedStructBatch(const uint64_t* input, size_t inputSize, uint64_t* output, size_t* outputSize) override
+    {
+        return IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, input, inputSize, output, outputSize);
+    }
+
+    int32_t CallTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t* output) override
+    {
+        kern_return_t ret = kIOReturnSuccess;
+        const uint64_t scalars[2] = { tag, 0 };
+
+        // The dext needs a callback before it takes async requests. Registering one also sends a completion after a few seconds, which AsyncCallback ignores.
+        if (!callbackRegistered)
+        {
+            const DataStruct registerInput = { .foo = 0, .bar = 70000 };
+            DataStruct registerOutput = {};
+            size_t registerOutputSize = sizeof(DataStruct);
+
+            ret = IOConnectCallAsyncStructMethod(connection, ExternalMethodType_RegisterAsyncCallback, IONotificationPortGetMachPort(notificationPort), asyncRef, kIOAsyncCalloutCount, &registerInput, sizeof(DataStruct), &registerOutput, &registerOutputSize);
+            if (ret != kIOReturnSuccess)
+            {
+                return ret;
+            }
+            callbackRegistered = true;
+        }
+
+        completed = false;
+        ret = IOConnectCallAsyncMethod(connection, ExternalMethodType_TaggedAsyncRequest, IONotificationPortGetMachPort(notificationPort), asyncRef, kIOAsyncCalloutCount, scalars, 2, input, sizeof(DataStruct), nullptr, nullptr, nullptr, nullptr);
+        if (ret != kIOReturnSuccess)
+        {
+            return ret;
+        }
+
+        while (!completed)
+        {
+            if (CFRunLoopRunInMode(kCFRunLoopDefaultMode, kAsyncTimeoutSeconds, true) == kCFRunLoopRunTimedOut)
+            {
+                return kIOReturnTimeout;
+            }
+        }
+
+        if ((completionResult == kIOReturnSuccess) && (completionTag != tag))
+        {
+            return kIOReturnInvalid;
+        }
+
+        output[0] = completionData[0];
+        output[1] = completionData[1];
+        return completionResult;
+    }
+
+private:
+    static constexpr CFTimeInterval kAsyncTimeoutSeconds = 5.0;
+
+    // Only tagged completions, { 3, tag, foo, bar }, answer a bench request. The bench never turns on coalescing.
+    static void AsyncCallback(void* refcon, IOReturn result, void** args, uint32_t numArgs)
+    {
+        IOKitBenchTransport* transport = (IOKitBenchTransport*)refcon;
+        uint64_t* arrArgs = (uint64_t*)args;
+
+        if ((numArgs < 4) || (arrArgs[0] != AsyncCompletionType_TaggedAsyncRequest))
+        {
+            return;
+        }
+
+        transport->completionResult = result;
+        transport->completionTag = arrArgs[1];
+        transport->completionData[0] = arrArgs[2];
+        transport->completionData[1] = arrArgs[3];
+        transport->completed = true;
+    }
+
+    io_connect_t connection = IO_OBJECT_NULL;
+    IONotificationPortRef notificationPort = nullptr;
+    CFRunLoopRef runLoop = nullptr;
+    io_async_ref64_t asyncRef = {};
+    bool callbackRegistered = false;
+    bool completed = false;
+    IOReturn completionResult = kIOReturnSuccess;
+    uint64_t completionTag = 0;
+    uint64_t completionData[2] = {};
+};
+
+// The simulated device belongs to the service, so any connection can configure it. This one is only open for the call.
+// Configures the service's simulated device, and copies the configuration it replaced to "previous".
+static kern_return_t ConfigureDevice(io_service_t service, const NullDriverDeviceConfig* config, NullDriverDeviceConfig* previous)
+{
+    io_connect_t connection = IO_OBJECT_NULL;
+    kern_return_t ret = kIOReturnSuccess;
+    size_t outputSize = sizeof(NullDriverDeviceConfig);
+
+    ret = IOServiceOpen(service, mach_task_self_, kIOHIDServerConnectType, &connection);
+    if (ret != kIOReturnSuccess)
+    {
+        fprintf(stderr, "IOServiceOpen failed with error: 0x%08x.\n", ret);
+        return ret;
+    }
+
+    ret = IOConnectCallStructMethod(connection, ExternalMethodType_ConfigureDevice, config, sizeof(NullDriverDeviceConfig), previous, &outputSize);
+    if (ret != kIOReturnSuccess)
+    {
+        fprintf(stderr, "Configuring the simulated device failed with error: 0x%08x.\n", ret);
+    }
+
+    IOServiceClose(connection);
+    return ret;
+}
+
+// "CppUserClient bench [options]" runs one benchmark and prints only its report to stdout, so it can be scripted.
+static int RunBenchMode(io_service_t service, int argumentCount, const char* arguments[])
+{
+    NullDriverBenchOptions options = {};
+
+    if (!NullDriverBenchParseArguments(argumentCount, arguments, &options))
+    {
+        NullDriverBenchPrintUsage("CppUserClient bench");
+        return EXIT_FAILURE;
+    }
+
+    // The device stays configured for every client of the service, so the configuration it replaced is put back once the run is done.
+    NullDriverDeviceConfig previousDevice = {};
+    if (options.configureDevice && (ConfigureDevice(service, &options.device, &previousDevice) != kIOReturnSuccess))
+    {
+        return EXIT_FAILURE;
+    }
+
+    NullDriverBenchResult* result = new NullDriverBenchResult();
+    NullDriverReplayRecorder recorder;
+    NullDriverReplayRecordingContext recording = { IOKitBenchTransport::Create, &service, &recorder };
+    bool connected = false;
+    bool recorded = true;
+
+    if (options.recordPath != nullptr)
+    {
+        connected = NullDriverBenchRun(&options, NullDriverReplayRecordingFactory, &recording, result);
+        recorded = recorder.Save(options.recordPath);
+    }
+    else
+    {
+        connected = NullDriverBenchRun(&options, IOKitBenchTransport::Create, &service, result);
+    }
+
+    if (!connected)
+    {
+        fprintf(stderr, "Some bench threads couldn't connect to the dext, so they weren't measured.\n");
+    }
+
+    NullDriverBenchReport(stdout, &options, result);
+
+    if (options.configureDevice)
+    {
+        NullDriverDeviceConfig replacedDevice = {};
+        ConfigureDevice(service, &previousDevice, &replacedDevice);
+    }
+
+    bool passed = connected && recorded && (result->errors == 0) && (result->mismatches == 0);
+    delete result;
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// "CppUserClient replay TRACE [options]" plays back a trace recorded with "bench --record", and prints only its report to stdout.
+static int RunReplayMode(io_service_t service, int argumentCount, const char* arguments[])
+{
+    NullDriverReplayOptions options = {};
+    NullDriverReplayTrace trace = {};
+    NullDriverReplayResult result = {};
+    const char* path = nullptr;
+
+    if (!NullDriverReplayParseArguments(argumentCount, arguments, &path, &options))
+    {
+        NullDriverReplayPrintUsage("CppUserClient replay");
+        return EXIT_FAILURE;
+    }
+
+    if (!NullDriverReplayRead(path, &trace))
+    {
+        return EXIT_FAILURE;
+    }
+
+    bool connected = NullDriverReplayRun(&options, &trace, IOKitBenchTransport::Create, &service, &result);
+    if (!connected)
+    {
+        fprintf(stderr, "Some replay threads couldn't connect to the dext, so their calls weren't made.\n");
+    }
+
+    NullDriverReplayReport(stdout, &options, &result);
+
+    bool passed = connected && (result.resultMismatches == 0) && (result.sizeMismatches == 0);
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// MARK: Coroutine Client
+// Gives NullDriverCoroutineClient a connection of its own, so registering its callback doesn't take completions away from the menu's connection.
+// All of its coroutines share one notification port, and results are matched to them by tag as they arrive.
+class IOKitCoroutineTransport : public NullDriverCoroutineTransport
+{
+public:
+    static IOKitCoroutineTransport* Create(io_service_t service)
+    {
+        IOKitCoroutineTransport* transport = new IOKitCoroutineTransport();
+        kern_return_t ret = kIOReturnSuccess;
+        const DataStruct registerInput = { .foo = 0, .bar = 70000 };
+        DataStruct registerOutput = {};
+        size_t registerOutputSize = sizeof(DataStruct);
+
+        ret = IOServiceOpen(service, mach_task_self_, kIOHIDServerConnectType, &transport->connection);
+        if (ret != kIOReturnSuccess)
+        {
+            printf("IOServiceOpen failed with error: 0x%08x.\n", ret);
+            PrintErrorDetails(ret);
+            delete transport;
+            return nullptr;
+        }
+
+        transport->notificationPort = IONotificationPortCreate(kIOMasterPortDefault);
+        if (transport->notificationPort == nullptr)
+        {
+            printf("Failed to create notification port for coroutine client.\n");
+            delete transport;
+            return nullptr;
+        }
+
+        transport->runLoop = CFRunLoopGetCurrent();
+        CFRetain(transport->runLoop);
+        CFRunLoopAddSource(transport->runLoop, IONotificationPortGetRunLoopSource(transport->notificationPort), kCFRunLoopDefaultMode);
+
+        transport->asyncRef[kIOAsyncCalloutFuncIndex] = (io_user_reference_t)AsyncCallback;
+        transport->asyncRef[kIOAsyncCalloutRefconIndex] = (io_user_reference_t)transport;
+
+        // Every completion for this connection goes to the callback registered here. Its own result arrives after a few seconds and is counted as stray.
+        ret = IOConnectCallAsyncStructMethod(transport->connection, ExternalMethodType_RegisterAsyncCallback, IONotificationPortGetMachPort(transport->notificationPort), transport->asyncRef, kIOAsyncCalloutCount, &registerInput, sizeof(DataStruct), &registerOutput, &registerOutputSize);
+        if (ret != kIOReturnSuccess)
+        {
+            printf("IOConnectCallAsyncStructMethod failed with error: 0x%08x.\n", ret);
+            PrintErrorDetails(ret);
+            delete transport;
+            return nullptr;
+        }
+
+        return transport;
+    }
+
+    ~IOKitCoroutineTransport() override
+    {
+        if (doorbell != nullptr)
+        {
+            IOConnectUnmapMemory64(connection, NullDriverMemoryType_CompletionDoorbell, mach_task_self(), (mach_vm_address_t)doorbell);
+        }
+        if (asyncCompletionRing != nullptr)
+        {
+            IOConnectUnmapMemory64(connection, NullDriverMemoryType_AsyncCompletionRing, mach_task_self(), (mach_vm_address_t)asyncCompletionRing);
+        }
+
+        if (notificationPort != nullptr)
+        {
+            if (runLoop != nullptr)
+            {
+                CFRunLoopRemoveSource(runLoop, IONotificationPortGetRunLoopSource(notificationPort), kCFRunLoopDefaultMode);
+                CFRelease(runLoop);
+            }
+            IONotificationPortDestroy(notificationPort);
+        }
+
+        if (connection != IO_OBJECT_NULL)
+        {
+            IOServiceClose(connection);
+        }
+    }
+
+    int32_t CallCheckedStruct(const uint64_t* input, uint64_t* output) override
+    {
+        size_t outputSize = sizeof(DataStruct);
+        return IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStruct, input, sizeof(DataStruct), output, &outputSize);
+    }
+
+    int32_t SubmitTaggedAsync(uint64_t tag, const uint64_t* input, uint64_t delayNanoseconds) override
+    {
+        const uint64_t scalars[2] = { tag, delayNanoseconds };
+        return IOConnectCallAsyncMethod(connection, ExternalMethodType_TaggedAsyncRequest, IONotificationPortGetMachPort(notificationPort), asyncRef, kIOAsyncCalloutCount, scalars, 2, input, sizeof(DataStruct), nullptr, nullptr, nullptr, nullptr);
+    }
+
+    // Switches this connection to NullDriverCompletionMode_SharedPage, so results are read from the async completion ring as "mode" says.
+    // Calling it again only changes how the client waits.
+    kern_return_t EnableSharedPage(NullDriverWaitMode mode, uint64_t spinNanoseconds)
+    {
+        kern_return_t ret = kIOReturnSuccess;
+        const uint64_t completionMode = NullDriverCompletionMode_SharedPage;
+        NullDriverRing* ring = nullptr;
+        mach_vm_address_t address = 0;
+        mach_vm_size_t size = 0;
+
+        // Already in shared page mode, so only the wait changes.
+        if (asyncCompletionRing != nullptr)
+        {
+            waiter.mode = mode;
+            waiter.spinNanoseconds = spinNanoseconds;
+            return kIOReturnSuccess;
+        }
+
+        ring = MapRing(connection, NullDriverMemoryType_AsyncCompletionRing);
+        if (ring == nullptr)
+        {
+            ret = kIOReturnNoMemory;
+            goto Exit;
+        }
+
+        ret = IOConnectMapMemory64(connection, NullDriverMemoryType_CompletionDoorbell, mach_task_self(), &address, &size, kIOMapAnywhere);
+        if (ret != kIOReturnSuccess)
+        {
+            printf("IOConnectMapMemory64 failed with error: 0x%08x.\n", ret);
+            PrintErrorDetails(ret);
+            address = 0;
+            goto Exit;
+        }
+
+        if (size < sizeof(NullDriverDoorbell))
+        {
+            printf("Mapped doorbell of size %llu is smaller than the expected %lu.\n", size, sizeof(NullDriverDoorbell));
+            ret = kIOReturnNoSpace;
+            goto Exit;
+        }
+
+        ret = IOConnectCallScalarMethod(connection, ExternalMethodType_SetCompletionMode, &completionMode, 1, nullptr, nullptr);
+        if (ret != kIOReturnSuccess)
+        {
+            printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
+            PrintErrorDetails(ret);
+            goto Exit;
+        }
+
+        // The mappings only become the transport's once the dext has switched modes, so a failure above leaves it on notifications.
+        asyncCompletionRing = ring;
+        doorbell = (NullDriverDoorbell*)address;
+        ring = nullptr;
+        address = 0;
+
+        NullDriverCompletionWaiterInit(&waiter, asyncCompletionRing, doorbell, ParkOnRunLoop, nullptr);
+        waiter.mode = mode;
+        waiter.spinNanoseconds = spinNanoseconds;
+
+Exit:
+        if (address != 0)
+        {
+            IOConnectUnmapMemory64(connection, NullDriverMemoryType_CompletionDoorbell, mach_task_self(), address);
+        }
+        if (ring != nullptr)
+        {
+            IOConnectUnmapMemory64(connection, NullDriverMemoryType_AsyncCompletionRing, mach_task_self(), (mach_vm_address_t)ring);
+        }
+
+        return ret;
+    }
+
+    const NullDriverCompletionWaiter* Waiter(void) const { return &waiter; }
+
+    // Handles one notification at a time, so the client gets to resume its coroutines, and send their next requests, as soon as any result is in.
+    // In shared page mode the results are read from the async completion ring instead, once the waiter sees them.
+    int32_t WaitForCompletions(NullDriverCoroutineClient* client) override
+    {
+        bool timedOut = false;
+
+        waitingClient = client;
+        if (asyncCompletionRing == nullptr)
+        {
+            timedOut = (CFRunLoopRunInMode(kCFRunLoopDefaultMode, kAsyncTimeoutSeconds, true) == kCFRunLoopRunTimedOut);
+        }
+        else if (NullDriverCompletionWaiterWait(&waiter, asyncCompletionTail) == 0)
+        {
+            timedOut = true;
+        }
+        else
+        {
+            NullDriverRingEntry entries[64];
+            uint32_t count = 0;
+            do
+            {
+                count = NullDriverRingConsume(asyncCompletionRing, &asyncCompletionTail, entries, 64);
+                for (uint32_t index = 0; index < count; ++index)
+                {
+                    client->Complete(entries[index].tag, (int32_t)entries[index].status, entries[index].foo, entries[index].bar);
+                }
+            } while (count != 0);
+        }
+        waitingClient = nullptr;
+
+        return timedOut ? kIOReturnTimeout : kIOReturnSuccess;
+    }
+
+private:
+    static constexpr CFTimeInterval kAsyncTimeoutSeconds = 5.0;
+
+    // Any notification ends the wait, including the doorbell's { 5, count }, which carries nothing the ring doesn't already have.
+    static bool ParkOnRunLoop(void* context)
+    {
+        return (CFRunLoopRunInMode(kCFRunLoopDefaultMode, kAsyncTimeoutSeconds, true) != kCFRunLoopRunTimedOut);
+    }
+
+    // The coroutine client never turns on coalescing, but the connection may be left in that mode, so both single and packed results are accepted.
+    // Results announced by { 5, count } are read by WaitForCompletions, since only shared page mode maps the ring here.
+    // The in-flight table holds fewer requests than the ring has entries, so in that mode nothing spills over into packed results.
+    static void AsyncCallback(void* refcon, IOReturn result, void** args, uint32_t numArgs)
+    {
+        IOKitCoroutineTransport* transport = (IOKitCoroutineTransport*)refcon;
+        uint64_t* arrArgs = (uint64_t*)args;
+
+        if ((transport->waitingClient == nullptr) || (numArgs == 0))
+        {
+            return;
+        }
+
+        if ((arrArgs[0] == AsyncCompletionType_TaggedAsyncRequest) && (numArgs >= 4))
+        {
+            transport->waitingClient->Complete(arrArgs[1], result, arrArgs[2], arrArgs[3]);
+        }
+        else if (arrArgs[0] == AsyncCompletionType_CoalescedResults)
+        {
+            NullDriverCompletionResult results[kNullDriverCoalescedResultsMax];
+            uint32_t count = NullDriverCompletionUnpack(arrArgs, numArgs, results, kNullDriverCoalescedResultsMax);
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                transport->waitingClient->Complete(results[index].tag, result, results[index].foo, results[index].bar);
+            }
+        }
+    }
+
+    io_connect_t connection = IO_OBJECT_NULL;
+    IONotificationPortRef notificationPort = nullptr;
+    CFRunLoopRef runLoop = nullptr;
+    io_async_ref64_t asyncRef = {};
+    NullDriverCoroutineClient* waitingClient = nullptr;
+
+    NullDriverRing* asyncCompletionRing = nullptr;
+    uint32_t asyncCompletionTail = 0;
+    NullDriverDoorbell* doorbell = nullptr;
+    NullDriverCompletionWaiter waiter = {};
+};
+
+typedef struct
+{
+    uint64_t completed;
+    uint64_t mismatches;
+    uint64_t errors;
+} CoroutineCounts;
+
+// Each coroutine sends its own sequence of values, so a result handed to the wrong coroutine shows up as a mismatch.
+static NullDriverTask CoroutineRequestLoop(NullDriverCoroutineClient* client, uint64_t id, uint32_t requestCount, uint64_t delayNanoseconds, CoroutineCounts* counts)
+{
+    for (uint32_t request = 0; request < requestCount; ++request)
+    {
+        const uint64_t foo = (id << 32) | request;
+
+        NullDriverCoroutineResult result = co_await client->AsyncRequest(foo, 70000, delayNanoseconds);
+        if (result.status != kIOReturnSuccess)
+        {
+            ++counts->errors;
+            continue;
+        }
+
+        if ((result.foo != foo + 1) || (result.bar != 70010))
+        {
+            ++counts->mismatches;
+        }
+        ++counts->completed;
+    }
+}
+
+static NullDriverTask CoroutineCheckedStruct(NullDriverCoroutineClient* client)
+{
+    NullDriverCoroutineResult result = co_await client->CheckedStruct(300, 70000);
+    DataStruct output = { .foo = result.foo, .bar = result.bar };
+
+    printf("co_await CheckedStruct returned 0x%08x with ", result.status);
+    PrintStruct(&output);
+}
+
+// MARK: Transport Selection
+// Dexts from before ExternalMethodType_QueryCapabilities fail it as an unknown selector. "capabilities" is then filled in as for version 0,
+// so it can always be used, whatever this returns.
+static kern_return_t QueryCapabilities(io_connect_t connection, NullDriverCapabilities* capabilities)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    size_t outputSize = sizeof(NullDriverCapabilities);
+
+    ret = IOConnectCallStructMethod(connection, ExternalMethodType_QueryCapabilities, nullptr, 0, capabilities, &outputSize);
+    if ((ret != kIOReturnSuccess) || (outputSize != sizeof(NullDriverCapabilities)) || (capabilities->version == 0))
+    {
+        NullDriverCapabilitiesSetVersion0(capabilities);
+    }
+
+    return ret;
+}
+
+// Transforms "count" DataStructs through "transport", which is usually the one NullDriverCapabilitiesChooseTransport picks for "count".
+static kern_return_t TransformStructs(io_connect_t connection, const NullDriverCapabilities* capabilities, SharedRings* rings, NullDriverTransport transport, const DataStruct* input, DataStruct* output, uint32_t count)
+{
+    kern_return_t ret = kIOReturnSuccess;
+
+    switch (transport)
+    {
+        case NullDriverTransport_Batch:
+        {
+            const uint32_t maxBatchCount = (capabilities->maxBatchCount < kNullDriverMaxStructBatchCount) ? capabilities->maxBatchCount : kNullDriverMaxStructBatchCount;
+            for (uint32_t offset = 0; (offset < count) && (ret == kIOReturnSuccess); offset += maxBatchCount)
+            {
+                const uint32_t batchCount = (count - offset < maxBatchCount) ? count - offset : maxBatchCount;
+                size_t outputSize = batchCount * sizeof(DataStruct);
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, input + offset, batchCount * sizeof(DataStruct), output + offset, &outputSize);
+            }
+        } break;
+
+        case NullDriverTransport_SharedRing:
+        {
+            // The tag of each request is its index, so results can land in place in whatever order they come back.
+            // The high half of the tag is a number of its own for each call, so a result left over from an earlier call, or from option 8, is never taken for one of these.
+            static uint64_t generation = 0;
+            const uint64_t tagBase = (++generation) << 32;
+            const uint32_t batchSize = kNullDriverRingEntryCount / 4;
+            NullDriverRingEntry batch[batchSize];
+            uint32_t submitted = 0;
+            uint32_t completed = 0;
+            kern_return_t doorbellRet = kIOReturnSuccess;
+
+            if (!MapSharedRings(connection, rings))
+            {
+                return kIOReturnNoMemory;
+            }
+
+            // After a failed result nothing more is submitted, but every request already in the rings is still reaped, so none is left for the next call.
+            while ((completed < ((ret == kIOReturnSuccess) ? count : submitted)) && (doorbellRet == kIOReturnSuccess))
+            {
+                const uint32_t reaped = NullDriverRingConsume(rings->completionRing, &rings->completionTail, batch, batchSize);
+                for (uint32_t index = 0; index < reaped; ++index)
+                {
+                    const uint64_t tag = batch[index].tag - tagBase;
+
+                    if ((batch[index].tag < tagBase) || (tag >= submitted))
+                    {
+                        continue;
+                    }
+
+                    completed += 1;
+                    if (batch[index].status != kIOReturnSuccess)
+                    {
+                        ret = (ret == kIOReturnSuccess) ? (kern_return_t)batch[index].status : ret;
+                        continue;
+                    }
+                    output[tag].foo = batch[index].foo;
+                    output[tag].bar = batch[index].bar;
+                }
+
+                uint32_t produceCount = (ret != kIOReturnSuccess) ? 0 : ((count - submitted < batchSize) ? count - submitted : batchSize);
+                for (uint32_t index = 0; index < produceCount; ++index)
+                {
+                    batch[index].tag = tagBase + submitted + index;
+                    batch[index].status = 0;
+                    batch[index].foo = input[submitted + index].foo;
+                    batch[index].bar = input[submitted + index].bar;
+                }
+                produceCount = NullDriverRingProduce(rings->submissionRing, &rings->submissionHead, batch, produceCount);
+                submitted += produceCount;
+
+                // As in option 8, the doorbell only rings when there's something new for the dext: requests to drain, or room in the completion ring.
+                if ((produceCount != 0) || (reaped != 0))
+                {
+                    doorbellRet = IOConnectCallScalarMethod(connection, ExternalMethodType_RingDoorbell, nullptr, 0, nullptr, nullptr);
+                }
+            }
+
+            ret = (ret == kIOReturnSuccess) ? doorbellRet : ret;
+        } break;
+
+        default:
+        {
+            for (uint32_t index = 0; (index < count) && (ret == kIOReturnSuccess); ++index)
+            {
+                size_t outputSize = sizeof(DataStruct);
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStruct, &input[index], sizeof(DataStruct), &output[index], &outputSize);
+            }
+        } break;
+    }
+
+    return ret;
+}
+
+// MARK: Scatter-Gather
+// Transforms "segmentCount" segments of registered buffers in place with one call, and fills in "statuses" with a NullDriverSegmentStatus for each.
+static kern_return_t ScatterGather(io_connect_t connection, const NullDriverSegment* segments, uint32_t segmentCount, uint32_t* statuses)
+{
+    uint8_t request[sizeof(NullDriverScatterGatherHeader) + kNullDriverScatterGatherMaxSegments * sizeof(NullDriverSegment)];
+    NullDriverScatterGatherHeader* header = (NullDriverScatterGatherHeader*)request;
+    size_t outputSize = segmentCount * sizeof(uint32_t);
+
+    if ((segmentCount == 0) || (segmentCount > kNullDriverScatterGatherMaxSegments))
+    {
+        return kIOReturnBadArgument;
+    }
+
+    header->segmentCount = segmentCount;
+    header->reserved = 0;
+    memcpy(header + 1, segments, segmentCount * sizeof(NullDriverSegment));
+
+    return IOConnectCallStructMethod(connection, ExternalMethodType_ScatterGather, request, NullDriverScatterGatherRequestSize(segmentCount), statuses, &outputSize);
+}
+
+// MARK: Chunked Streams
+// Waits for the progress of chunk "sequence", then copies its result out of the stream region before the slot is reused.
+static kern_return_t CollectStreamChunk(const NullDriverStreamState* stream, mach_vm_address_t region, uint8_t* destination, uint64_t sequence)
+{
+    while (globalStreamCompletedChunks <= sequence)
+    {
+        bool timedOut = (CFRunLoopRunInMode(kCFRunLoopDefaultMode, 5.0, true) == kCFRunLoopRunTimedOut);
+        if (timedOut)
+        {
+            printf("Timed out waiting for stream chunk %llu.\n", sequence);
+            return kIOReturnTimeout;
+        }
+    }
+
+    memcpy(destination + sequence * stream->chunkSize, (const uint8_t*)region + NullDriverStreamSlotOffset(stream, NullDriverStreamSlotForSequence(sequence)), NullDriverStreamChunkLength(stream, sequence));
+    return kIOReturnSuccess;
+}
+
+// Sends "length" bytes from "source" through the dext as a chunked stream, and collects the result in "destination".
+// While the dext processes one chunk, the next is copied into the other slot, so copying and processing overlap.
+// Progress arrives through the callback from option 6, so that has to be assigned first.
+static kern_return_t StreamPayload(io_connect_t connection, const uint8_t* source, uint8_t* destination, uint64_t length, uint32_t chunkSize)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    const uint64_t beginScalars[2] = { length, chunkSize };
+    mach_vm_address_t region = 0;
+    mach_vm_size_t regionSize = 0;
+    NullDriverStreamState stream = {};
+    uint64_t chunkCount = 0;
+    uint64_t submitted = 0;
+
+    ret = IOConnectCallScalarMethod(connection, ExternalMethodType_StreamBegin, beginScalars, 2, nullptr, nullptr);
+    if (ret != kIOReturnSuccess)
+    {
+        printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
+        PrintErrorDetails(ret);
+        return ret;
+    }
+
+    // The region is replaced when the chunk size changes, so it's mapped again for every stream.
+    ret = IOConnectMapMemory64(connection, NullDriverMemoryType_StreamRegion, mach_task_self(), &region, &regionSize, kIOMapAnywhere);
+    if (ret != kIOReturnSuccess)
+    {
+        printf("IOConnectMapMemory64 failed with error: 0x%08x.\n", ret);
+        PrintErrorDetails(ret);
+        return ret;
+    }
+
+    // The client keeps the same state as the dext, only to work out each chunk's length and slot.
+    NullDriverStreamBegin(&stream, length, chunkSize);
+    chunkCount = NullDriverStreamChunkCount(&stream);
+
+    if (regionSize < NullDriverStreamRegionSize(chunkSize))
+    {
+        printf("Mapped stream region of size %llu is smaller than the expected %llu.\n", regionSize, NullDriverStreamRegionSize(chunkSize));
+        ret = kIOReturnNoSpace;
+        goto Exit;
+    }
+
+    globalStreamCompletedChunks = 0;
+    globalStreamCompletedBytes = 0;
+    globalStreamErrors = 0;
+
+    for (submitted = 0; submitted < chunkCount; ++submitted)
+    {
+        const uint64_t chunkScalars[2] = { submitted, NullDriverStreamChunkLength(&stream, submitted) };
+
+        // The slot still holds the chunk from two submissions ago. That one has to be done and copied out first.
+        if (submitted >= kNullDriverStreamSlotCount)
         {
-            funcName = "'Register Async Callback'";
-        } break;
+            ret = CollectStreamChunk(&stream, region, destination, submitted - kNullDriverStreamSlotCount);
+            if (ret != kIOReturnSuccess)
+            {
+                goto Exit;
+            }
+        }
+
+        memcpy((uint8_t*)region + NullDriverStreamSlotOffset(&stream, NullDriverStreamSlotForSequence(submitted)), source + submitted * chunkSize, chunkScalars[1]);
 
-        case 2:
+        ret = IOConnectCallScalarMethod(connection, ExternalMethodType_StreamChunk, chunkScalars, 2, nullptr, nullptr);
+        if (ret != kIOReturnSuccess)
         {
-            funcName = "'Async Request'";
-        } break;
+            printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
+            PrintErrorDetails(ret);
+            goto Exit;
+        }
+    }
 
-        default:
+    // The last chunks are still in their slots.
+    for (uint64_t sequence = (chunkCount > kNullDriverStreamSlotCount) ? chunkCount - kNullDriverStreamSlotCount : 0; sequence < chunkCount; ++sequence)
+    {
+        ret = CollectStreamChunk(&stream, region, destination, sequence);
+        if (ret != kIOReturnSuccess)
         {
-            funcName = "UNKNOWN";
-        } break;
+            goto Exit;
+        }
     }
 
-    printf("Got callback of %s from dext with returned data ", funcName);
-    PrintStruct(output);
-    printf("with return code: 0x%08x.\n", result);
+    if ((globalStreamCompletedBytes != length) || (globalStreamErrors != 0))
+    {
+        printf("Stream reported %llu of %llu bytes with %u errors.\n", globalStreamCompletedBytes, length, globalStreamErrors);
+        ret = kIOReturnError;
+    }
 
-    // Stop the run loop so our program can return to normal processing.
-    CFRunLoopStop(globalRunLoop);
+Exit:
+    IOConnectUnmapMemory64(connection, NullDriverMemoryType_StreamRegion, mach_task_self(), region);
+    return ret;
 }
 
 int main(int argc, const char* argv[])
 {
     bool runProgram = true;
+
+    // In bench and replay mode only the report goes to stdout, so the progress messages below are skipped.
+    const bool replayMode = (argc > 1) && (strcmp(argv[1], "replay") == 0);
+    const bool benchMode = replayMode || ((argc > 1) && (strcmp(argv[1], "bench") == 0));
     
     // If you don't know what value to use here, if should be identical to the IOUserClass value in your UserClientProperties.
     // You can double check by searching with the `ioreg` command in your terminal.
@@ -120,6 +1073,9 @@ int main(int argc, const char* argv[])
     CFRunLoopSourceRef runLoopSource = nullptr;
     io_async_ref64_t asyncRef = {};
 
+    // Shared ring variables.
+    SharedRings rings = {};
+
     /// - Tag: ClientApp_Connect
     ret = IOServiceGetMatchingServices(kIOMasterPortDefault, IOServiceNameMatching(dextIdentifier), &iterator);
     if (ret != kIOReturnSuccess)
@@ -128,7 +1084,10 @@ int main(int argc, const char* argv[])
         PrintErrorDetails(ret);
     }
 
-    printf("Searching for dext service...\n");
+    if (!benchMode)
+    {
+        printf("Searching for dext service...\n");
+    }
     while ((service = IOIteratorNext(iterator)) != IO_OBJECT_NULL)
     {
         // Open a connection to this user client as a server to that client, and store the instance in "service"
@@ -136,7 +1095,10 @@ int main(int argc, const char* argv[])
 
         if (ret == kIOReturnSuccess)
         {
-            printf("\tOpened service.\n");
+            if (!benchMode)
+            {
+                printf("\tOpened service.\n");
+            }
             break;
         }
         else
@@ -154,6 +1116,15 @@ int main(int argc, const char* argv[])
         return EXIT_FAILURE;
     }
 
+    // Every bench thread opens its own connection, so the one used to find the service isn't needed.
+    if (benchMode)
+    {
+        IOServiceClose(connection);
+        ret = replayMode ? RunReplayMode(service, argc - 2, argv + 2) : RunBenchMode(service, argc - 2, argv + 2);
+        IOObjectRelease(service);
+        return ret;
+    }
+
 
     // Async initialization
     globalRunLoop = CFRunLoopGetCurrent();
@@ -194,13 +1165,6 @@ int main(int argc, const char* argv[])
     // Main input loop of our program
     while (runProgram)
     {
-        constexpr uint32_t MessageType_Scalar = 0;
-        constexpr uint32_t MessageType_Struct = 1;
-        constexpr uint32_t MessageType_CheckedScalar = 2;
-        constexpr uint32_t MessageType_CheckedStruct = 3;
-        constexpr uint32_t MessageType_RegisterAsyncCallback = 4;
-        constexpr uint32_t MessageType_AsyncRequest = 5;
-
         uint64_t inputSelection = 0;
 
         printf("1. Scalar\n");
@@ -210,6 +1174,21 @@ int main(int argc, const char* argv[])
         printf("5. Checked Struct\n");
         printf("6. Assign Callback to Dext\n");
         printf("7. Async Action\n");
+        printf("8. Shared Ring Benchmark (compared with Checked Struct)\n");
+        printf("9. Checked Struct Batch\n");
+        printf("10. Checked Struct Batch Benchmark (batch sizes 1 to 4096)\n");
+        printf("11. Tagged Async Benchmark (queue depths 1 to 512)\n");
+        printf("12. Multi-Client Benchmark (1 to 8 connections)\n");
+        printf("13. Completion Coalescing Benchmark\n");
+        printf("14. Stats (calls, bytes and latency percentiles per selector)\n");
+        printf("15. Registered Buffer Benchmark (compared with Checked Struct Batch)\n");
+        printf("16. Coroutine Async Benchmark (1 to 256 coroutines over one notification port)\n");
+        printf("17. Pipelined Async Benchmark (fixed and adaptive in-flight windows)\n");
+        printf("18. Streaming Benchmark (chunked streams compared with Checked Struct Batch)\n");
+        printf("19. Completion Wait Benchmark (notification compared with shared page park, spin and spin-then-park)\n");
+        printf("20. Sample Stream Benchmark (10 thousand to 10 million samples per second)\n");
+        printf("21. Capabilities and Transport Selection Benchmark (the path picked for each batch size, compared with the others)\n");
+        printf("22. Scatter-Gather Benchmark (compared with staging through Checked Struct Batch)\n");
         printf("0. Exit\n");
         printf("Select a message type to send: ");
         scanf("%llu", &inputSelection);
@@ -233,7 +1212,7 @@ int main(int argc, const char* argv[])
                 uint32_t outputArraySize = arraySize;
                 uint64_t output[arraySize] = {};
 
-                ret = IOConnectCallScalarMethod(connection, MessageType_Scalar, input, arraySize, output, &outputArraySize);
+                ret = IOConnectCallScalarMethod(connection, ExternalMethodType_Scalar, input, arraySize, output, &outputArraySize);
                 if (ret != kIOReturnSuccess)
                 {
                     printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
@@ -256,7 +1235,7 @@ int main(int argc, const char* argv[])
                 size_t outputSize = sizeof(DataStruct);
                 DataStruct output = { .foo = 0, .bar = 0 };
 
-                ret = IOConnectCallStructMethod(connection, MessageType_Struct, &input, inputSize, &output, &outputSize);
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_Struct, &input, inputSize, &output, &outputSize);
                 if (ret != kIOReturnSuccess)
                 {
                     printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
@@ -279,7 +1258,7 @@ int main(int argc, const char* argv[])
                 size_t outputSize = sizeof(OversizedDataStruct);
                 OversizedDataStruct output = { };
 
-                ret = IOConnectCallStructMethod(connection, MessageType_Struct, &input, inputSize, &output, &outputSize);
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_Struct, &input, inputSize, &output, &outputSize);
                 if (ret != kIOReturnSuccess)
                 {
                     printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
@@ -304,7 +1283,7 @@ int main(int argc, const char* argv[])
                 uint32_t outputArraySize = arraySize;
                 uint64_t output[arraySize] = {};
 
-                ret = IOConnectCallScalarMethod(connection, MessageType_CheckedScalar, input, arraySize, output, &outputArraySize);
+                ret = IOConnectCallScalarMethod(connection, ExternalMethodType_CheckedScalar, input, arraySize, output, &outputArraySize);
                 if (ret != kIOReturnSuccess)
                 {
                     printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
@@ -327,7 +1306,7 @@ int main(int argc, const char* argv[])
                 size_t outputSize = sizeof(DataStruct);
                 DataStruct output = { .foo = 0, .bar = 0 };
 
-                ret = IOConnectCallStructMethod(connection, MessageType_CheckedStruct, &input, inputSize, &output, &outputSize);
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStruct, &input, inputSize, &output, &outputSize);
                 if (ret != kIOReturnSuccess)
                 {
                     printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
@@ -350,7 +1329,7 @@ int main(int argc, const char* argv[])
                 size_t outputSize = sizeof(DataStruct);
                 DataStruct output = { .foo = 0, .bar = 0 };
 
-                ret = IOConnectCallAsyncStructMethod(connection, MessageType_RegisterAsyncCallback, machNotificationPort, asyncRef, kIOAsyncCalloutCount, &input, inputSize, &output, &outputSize);
+                ret = IOConnectCallAsyncStructMethod(connection, ExternalMethodType_RegisterAsyncCallback, machNotificationPort, asyncRef, kIOAsyncCalloutCount, &input, inputSize, &output, &outputSize);
                 if (ret != kIOReturnSuccess)
                 {
                     printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
@@ -376,7 +1355,7 @@ int main(int argc, const char* argv[])
                 const size_t inputSize = sizeof(DataStruct);
                 const DataStruct input = { .foo = 300, .bar = 70000 };
 
-                ret = IOConnectCallAsyncStructMethod(connection, MessageType_AsyncRequest, machNotificationPort, asyncRef, kIOAsyncCalloutCount, &input, inputSize, nullptr, nullptr);
+                ret = IOConnectCallAsyncStructMethod(connection, ExternalMethodType_AsyncRequest, machNotificationPort, asyncRef, kIOAsyncCalloutCount, &input, inputSize, nullptr, nullptr);
                 if (ret == kIOReturnNotReady)
                 {
                     printf("No callback has been assigned to the dext, so it cannot respond to the async action.\n");
@@ -394,6 +1373,1146 @@ int main(int argc, const char* argv[])
                 printf("Run loop terminated, returning to standard program flow.\n");
             } break;
 
+            case 8: // "Shared Ring Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                const uint32_t ringRequestCount = 1000000;
+                const uint32_t checkedRequestCount = 100000;
+                const uint32_t batchSize = 256;
+
+                NullDriverRingEntry batch[batchSize] = {};
+                uint32_t submitted = 0;
+                uint32_t completed = 0;
+                uint32_t mismatches = 0;
+                uint64_t startTime = 0;
+                uint64_t ringElapsed = 0;
+                uint64_t checkedElapsed = 0;
+
+                if (!MapSharedRings(connection, &rings))
+                {
+                    break;
+                }
+
+                printf("Sending %u requests through the shared ring...\n", ringRequestCount);
+                startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                while ((completed < ringRequestCount) && (ret == kIOReturnSuccess))
+                {
+                    uint32_t reaped = NullDriverRingConsume(rings.completionRing, &rings.completionTail, batch, batchSize);
+                    for (uint32_t index = 0; index < reaped; ++index)
+                    {
+                        if ((batch[index].foo != batch[index].tag + 1) || (batch[index].bar != 70010))
+                        {
+                            ++mismatches;
+                        }
+                    }
+                    completed += reaped;
+
+                    // Queue as many requests as fit, then ring the doorbell once for all of them.
+                    uint32_t count = ringRequestCount - submitted;
+                    if (count > batchSize)
+                    {
+                        count = batchSize;
+                    }
+
+                    for (uint32_t index = 0; index < count; ++index)
+                    {
+                        batch[index].tag = submitted + index;
+                        batch[index].foo = submitted + index;
+                        batch[index].bar = 70000;
+                    }
+
+                    count = NullDriverRingProduce(rings.submissionRing, &rings.submissionHead, batch, count);
+                    submitted += count;
+
+                    // The dext stops draining when the completion ring is full, so ring again after reaping results too.
+                    if ((count != 0) || (reaped != 0))
+                    {
+                        ret = IOConnectCallScalarMethod(connection, ExternalMethodType_RingDoorbell, nullptr, 0, nullptr, nullptr);
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("Ring doorbell failed with error: 0x%08x.\n", ret);
+                            PrintErrorDetails(ret);
+                        }
+                    }
+                }
+                ringElapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                printf("Sending %u requests through Checked Struct...\n", checkedRequestCount);
+                startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                for (uint32_t index = 0; index < checkedRequestCount; ++index)
+                {
+                    const DataStruct input = { .foo = index, .bar = 70000 };
+                    DataStruct output = { .foo = 0, .bar = 0 };
+                    size_t outputSize = sizeof(DataStruct);
+
+                    ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStruct, &input, sizeof(DataStruct), &output, &outputSize);
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
+                        PrintErrorDetails(ret);
+                        break;
+                    }
+                }
+                checkedElapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                printf("Shared ring: %u results (%u mismatched) at %.0f ops/sec.\n", completed, mismatches, OpsPerSecond(completed, ringElapsed));
+                printf("Checked Struct: %.0f ops/sec.\n", OpsPerSecond(checkedRequestCount, checkedElapsed));
+            } break;
+
+            case 9: // "Checked Struct Batch"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                const uint32_t batchCount = 4;
+                const size_t inputSize = sizeof(DataStruct) * batchCount;
+                const DataStruct input[batchCount] = {
+                    { .foo = 300, .bar = 70000 },
+                    { .foo = 301, .bar = 70001 },
+                    { .foo = 302, .bar = 70002 },
+                    { .foo = 303, .bar = 70003 },
+                };
+
+                size_t outputSize = sizeof(DataStruct) * batchCount;
+                DataStruct output[batchCount] = {};
+
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, input, inputSize, output, &outputSize);
+                if (ret != kIOReturnSuccess)
+                {
+                    printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
+                    PrintErrorDetails(ret);
+                }
+
+                for (uint32_t index = 0; index < batchCount; ++index)
+                {
+                    printf("Input %u: \n", index);
+                    PrintStruct(&input[index]);
+                    printf("Output %u: \n", index);
+                    PrintStruct(&output[index]);
+                }
+            } break;
+
+            case 10: // "Checked Struct Batch Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Every batch size moves the same number of structs, so the rates are directly comparable.
+                const uint32_t maxBatchCount = 4096;
+                const uint32_t structsPerSize = 1 << 20;
+
+                DataStruct* input = new DataStruct[maxBatchCount];
+                DataStruct* output = new DataStruct[maxBatchCount];
+                for (uint32_t index = 0; index < maxBatchCount; ++index)
+                {
+                    input[index].foo = index;
+                    input[index].bar = 70000;
+                }
+
+                printf("%10s %12s %16s %14s\n", "batch", "calls", "structs/sec", "ns/call");
+                for (uint32_t batchCount = 1; (batchCount <= maxBatchCount) && (ret == kIOReturnSuccess); batchCount *= 2)
+                {
+                    const uint32_t callCount = structsPerSize / batchCount;
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+                    for (uint32_t call = 0; call < callCount; ++call)
+                    {
+                        size_t outputSize = sizeof(DataStruct) * batchCount;
+
+                        ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, input, sizeof(DataStruct) * batchCount, output, &outputSize);
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
+                            PrintErrorDetails(ret);
+                            break;
+                        }
+                    }
+
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+                    printf("%10u %12u %16.0f %14.0f\n", batchCount, callCount, OpsPerSecond(structsPerSize, elapsed), (double)elapsed / callCount);
+                }
+
+                if ((ret == kIOReturnSuccess) && ((output[maxBatchCount - 1].foo != maxBatchCount) || (output[maxBatchCount - 1].bar != 70010)))
+                {
+                    printf("Last batch returned unexpected data: ");
+                    PrintStruct(&output[maxBatchCount - 1]);
+                }
+
+                delete[] input;
+                delete[] output;
+            } break;
+
+            case 11: // "Tagged Async Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Every request takes the same simulated time, so throughput should grow with the number kept in flight.
+                const uint64_t delayNanoseconds = 10000000;
+                const uint32_t queueDepths[] = { 1, 8, 64, 256, 512 };
+                uint64_t nextTag = 0;
+
+                printf("Each request completes after %llu ms. The callback from option 6 must be assigned first.\n", delayNanoseconds / 1000000);
+                printf("%10s %16s %14s\n", "depth", "completions/sec", "mismatches");
+                for (uint32_t depth : queueDepths)
+                {
+                    uint32_t issued = 0;
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+                    globalTaggedMismatches = 0;
+                    globalOutstandingTaggedRequests = depth;
+
+                    for (issued = 0; issued < depth; ++issued)
+                    {
+                        const uint64_t scalars[2] = { nextTag, delayNanoseconds };
+                        const DataStruct input = { .foo = nextTag, .bar = 70000 };
+
+                        ret = IOConnectCallAsyncMethod(connection, ExternalMethodType_TaggedAsyncRequest, machNotificationPort, asyncRef, kIOAsyncCalloutCount, scalars, 2, &input, sizeof(DataStruct), nullptr, nullptr, nullptr, nullptr);
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("IOConnectCallAsyncMethod failed with error: 0x%08x.\n", ret);
+                            PrintErrorDetails(ret);
+                            break;
+                        }
+
+                        ++nextTag;
+                    }
+
+                    // Only wait for the requests that were actually issued.
+                    globalOutstandingTaggedRequests -= depth - issued;
+                    if (globalOutstandingTaggedRequests != 0)
+                    {
+                        CFRunLoopRun();
+                    }
+
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+                    printf("%10u %16.0f %14u\n", issued, OpsPerSecond(issued, elapsed), globalTaggedMismatches);
+
+                    if (ret != kIOReturnSuccess)
+                    {
+                        break;
+                    }
+                }
+            } break;
+
+            case 12: // "Multi-Client Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Each connection is its own user client in the dext, with its own queue, so clients shouldn't slow each other down.
+                static const uint32_t kMaxClients = 8;
+                const uint32_t clientCounts[] = { 1, 2, 4, 8 };
+                const uint64_t runNanoseconds = 2000000000;
+
+                printf("Each client sends Checked Struct calls from its own thread for %llu seconds.\n", runNanoseconds / 1000000000);
+                printf("%10s %16s %16s %16s %14s\n", "clients", "total ops/sec", "min client", "max client", "mismatches");
+                for (uint32_t clientCount : clientCounts)
+                {
+                    io_connect_t connections[kMaxClients] = {};
+                    uint64_t completed[kMaxClients] = {};
+                    uint32_t mismatches[kMaxClients] = {};
+                    std::thread threads[kMaxClients];
+                    uint32_t opened = 0;
+
+                    for (opened = 0; opened < clientCount; ++opened)
+                    {
+                        ret = IOServiceOpen(service, mach_task_self_, kIOHIDServerConnectType, &connections[opened]);
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("IOServiceOpen failed with error: 0x%08x.\n", ret);
+                            PrintErrorDetails(ret);
+                            break;
+                        }
+                    }
+
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                    for (uint32_t client = 0; client < opened; ++client)
+                    {
+                        threads[client] = std::thread([&, client] {
+                            DataStruct input = { .foo = 0, .bar = 70000 };
+                            DataStruct output = {};
+                            size_t outputSize = sizeof(DataStruct);
+
+                            while (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime < runNanoseconds)
+                            {
+                                outputSize = sizeof(DataStruct);
+                                if (IOConnectCallStructMethod(connections[client], ExternalMethodType_CheckedStruct, &input, sizeof(DataStruct), &output, &outputSize) != kIOReturnSuccess)
+                                {
+                                    ++mismatches[client];
+                                    break;
+                                }
+
+                                if ((output.foo != input.foo + 1) || (output.bar != 70010))
+                                {
+                                    ++mismatches[client];
+                                }
+
+                                ++input.foo;
+                                ++completed[client];
+                            }
+                        });
+                    }
+
+                    uint64_t total = 0;
+                    uint64_t minimum = UINT64_MAX;
+                    uint64_t maximum = 0;
+                    uint32_t totalMismatches = 0;
+                    for (uint32_t client = 0; client < opened; ++client)
+                    {
+                        threads[client].join();
+                        IOServiceClose(connections[client]);
+
+                        total += completed[client];
+                        minimum = (completed[client] < minimum) ? completed[client] : minimum;
+                        maximum = (completed[client] > maximum) ? completed[client] : maximum;
+                        totalMismatches += mismatches[client];
+                    }
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                    if (opened != 0)
+                    {
+                        printf("%10u %16.0f %16.0f %16.0f %14u\n", opened, OpsPerSecond(total, elapsed), OpsPerSecond(minimum, elapsed), OpsPerSecond(maximum, elapsed), totalMismatches);
+                    }
+
+                    if (ret != kIOReturnSuccess)
+                    {
+                        break;
+                    }
+                }
+            } break;
+
+            case 13: // "Completion Coalescing Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Enough requests with the same delay that many complete in each wakeup of the dext's timer.
+                const uint64_t delayNanoseconds = 10000000;
+                const uint32_t depth = 512;
+                const uint32_t rounds = 20;
+                // Shared page mode only notifies a client that has parked in the doorbell, so option 19 measures it instead.
+                const char* modeNames[] = { "single", "coalesced" };
+                uint64_t nextTag = 0;
+
+                if (globalAsyncCompletionRing == nullptr)
+                {
+                    globalAsyncCompletionRing = MapRing(connection, NullDriverMemoryType_AsyncCompletionRing);
+                    if (globalAsyncCompletionRing == nullptr)
+                    {
+                        printf("Failed to map the async completion ring. Coalesced results will only use the completion arguments.\n");
+                    }
+                }
+
+                printf("%u rounds of %u requests, each completing after %llu ms. The callback from option 6 must be assigned first.\n", rounds, depth, delayNanoseconds / 1000000);
+                printf("%10s %16s %16s %16s %12s\n", "mode", "notifications/s", "results/s", "results/notif", "mismatches");
+                for (uint32_t mode = 0; mode <= NullDriverCompletionMode_Coalesced; ++mode)
+                {
+                    const uint64_t modeScalar = mode;
+                    uint64_t results = 0;
+
+                    ret = IOConnectCallScalarMethod(connection, ExternalMethodType_SetCompletionMode, &modeScalar, 1, nullptr, nullptr);
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
+                        PrintErrorDetails(ret);
+                        break;
+                    }
+
+                    globalTaggedMismatches = 0;
+                    globalNotificationCount = 0;
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+                    for (uint32_t round = 0; (round < rounds) && (ret == kIOReturnSuccess); ++round)
+                    {
+                        uint32_t issued = 0;
+                        globalOutstandingTaggedRequests = depth;
+
+                        for (issued = 0; issued < depth; ++issued)
+                        {
+                            const uint64_t scalars[2] = { nextTag, delayNanoseconds };
+                            const DataStruct input = { .foo = nextTag, .bar = 70000 };
+
+                            ret = IOConnectCallAsyncMethod(connection, ExternalMethodType_TaggedAsyncRequest, machNotificationPort, asyncRef, kIOAsyncCalloutCount, scalars, 2, &input, sizeof(DataStruct), nullptr, nullptr, nullptr, nullptr);
+                            if (ret != kIOReturnSuccess)
+                            {
+                                printf("IOConnectCallAsyncMethod failed with error: 0x%08x.\n", ret);
+                                PrintErrorDetails(ret);
+                                break;
+                            }
+
+                            ++nextTag;
+                        }
+
+                        globalOutstandingTaggedRequests -= depth - issued;
+                        if (globalOutstandingTaggedRequests != 0)
+                        {
+                            CFRunLoopRun();
+                        }
+                        results += issued;
+                    }
+
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+                    printf("%10s %16.0f %16.0f %16.2f %12u\n", modeNames[mode], OpsPerSecond(globalNotificationCount, elapsed), OpsPerSecond(results, elapsed), (globalNotificationCount != 0) ? (double)results / globalNotificationCount : 0.0, globalTaggedMismatches);
+                }
+
+                // Leave the dext in the default mode, which the other options expect.
+                const uint64_t singleMode = NullDriverCompletionMode_Single;
+                IOConnectCallScalarMethod(connection, ExternalMethodType_SetCompletionMode, &singleMode, 1, nullptr, nullptr);
+            } break;
+
+            case 14: // "Stats"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Indexed by selector, with invalid selectors and SimulatedAsyncEvent in the last two slots.
+                const char* selectorNames[kNullDriverStatsSelectorCount] = {
+                    "Scalar", "Struct", "CheckedScalar", "CheckedStruct", "RegisterCallback", "AsyncRequest", "RingDoorbell", "StructBatch",
+                    "TaggedAsync", "SetCompletion", "CopyStats", "RegisterBuffer", "UnregisterBuf", "RegisteredBatch", "StreamBegin", "StreamChunk",
+                    "ConfigureDevice", "StartSamples", "StopSamples", "QueryCaps", "ScatterGather",
+                };
+                selectorNames[kNullDriverStatsSelector_Invalid] = "Invalid";
+                selectorNames[kNullDriverStatsSelector_SimulatedAsyncEvent] = "AsyncEvent";
+
+                // The snapshot is larger than a page, so the kernel passes this buffer to the dext as a memory descriptor.
+                NullDriverStats* stats = new NullDriverStats();
+                size_t statsSize = sizeof(NullDriverStats);
+
+                ret = IOConnectCallStructMethod(connection, ExternalMethodType_CopyStats, nullptr, 0, stats, &statsSize);
+                if (ret != kIOReturnSuccess)
+                {
+                    printf("IOConnectCallStructMethod failed with error: 0x%08x.\n", ret);
+                    PrintErrorDetails(ret);
+                    delete stats;
+                    break;
+                }
+
+                if ((stats->version != kNullDriverStatsVersion) || (stats->selectorCount != kNullDriverStatsSelectorCount) || (stats->bucketCount != kNullDriverStatsBucketCount))
+                {
+                    printf("Stats version %u from the dext doesn't match version %u of this client.\n", stats->version, kNullDriverStatsVersion);
+                    delete stats;
+                    break;
+                }
+
+                printf("Stats for client %llu. Latencies are in ns, and percentiles are accurate to within 25%%.\n", stats->clientID);
+                printf("%-16s %10s %8s %12s %12s %10s %10s %10s %10s %10s\n", "selector", "calls", "errors", "bytes in", "bytes out", "mean", "p50", "p99", "p999", "max");
+                for (uint32_t selector = 0; selector < kNullDriverStatsSelectorCount; ++selector)
+                {
+                    const NullDriverSelectorStats* selectorStats = &stats->selectors[selector];
+                    if (selectorStats->calls == 0)
+                    {
+                        continue;
+                    }
+
+                    printf("%-16s %10llu %8llu %12llu %12llu %10llu %10llu %10llu %10llu %10llu\n", selectorNames[selector], selectorStats->calls, selectorStats->errors, selectorStats->bytesIn, selectorStats->bytesOut,
+                           selectorStats->totalNanoseconds / selectorStats->calls, NullDriverStatsPercentile(selectorStats, 0.5), NullDriverStatsPercentile(selectorStats, 0.99), NullDriverStatsPercentile(selectorStats, 0.999), selectorStats->maxNanoseconds);
+                }
+
+                // Once a workload is steady, "allocated" should stop growing between two snapshots.
+                printf("Reply buffers: %llu allocated, %llu reused, %llu recycled, %llu discarded.\n", stats->outputPool.allocated, stats->outputPool.reused, stats->outputPool.recycled, stats->outputPool.discarded);
+
+                delete stats;
+            } break;
+
+            case 15: // "Registered Buffer Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Both paths move the same bytes. Above a page, Checked Struct Batch passes them in memory descriptors that the dext maps on every call.
+                // The registered path names regions of two buffers that were mapped once, and only passes scalars.
+                const uint32_t payloadSizes[] = { 4096, 8192, 16384, 32768, 65536 };
+                const uint64_t bytesPerSize = 256ULL * 1024 * 1024;
+                const uint64_t bufferSize = 65536;
+                uint64_t indices[2] = { UINT64_MAX, UINT64_MAX };
+                mach_vm_address_t addresses[2] = {};
+                mach_vm_size_t sizes[2] = {};
+
+                for (uint32_t buffer = 0; (buffer < 2) && (ret == kIOReturnSuccess); ++buffer)
+                {
+                    uint32_t outputCount = 1;
+
+                    ret = IOConnectCallScalarMethod(connection, ExternalMethodType_RegisterBuffer, &bufferSize, 1, &indices[buffer], &outputCount);
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
+                        PrintErrorDetails(ret);
+                        indices[buffer] = UINT64_MAX;
+                        break;
+                    }
+
+                    ret = IOConnectMapMemory64(connection, NullDriverMemoryType_RegisteredBuffer + (uint32_t)indices[buffer], mach_task_self(), &addresses[buffer], &sizes[buffer], kIOMapAnywhere);
+                    if ((ret == kIOReturnSuccess) && (sizes[buffer] < bufferSize))
+                    {
+                        printf("Mapped buffer of size %llu is smaller than the registered %llu.\n", sizes[buffer], bufferSize);
+                        ret = kIOReturnNoSpace;
+                    }
+                    else if (ret != kIOReturnSuccess)
+                    {
+                        printf("IOConnectMapMemory64 failed with error: 0x%08x.\n", ret);
+                        PrintErrorDetails(ret);
+                        addresses[buffer] = 0;
+                    }
+                }
+
+                if (ret == kIOReturnSuccess)
+                {
+                    DataStruct* input = (DataStruct*)addresses[0];
+                    DataStruct* output = (DataStruct*)addresses[1];
+
+                    for (uint32_t index = 0; index < bufferSize / sizeof(DataStruct); ++index)
+                    {
+                        input[index].foo = index;
+                        input[index].bar = 70000;
+                    }
+
+                    printf("%10s %12s %18s %18s %10s\n", "bytes", "calls", "mapped ns/call", "registered ns/call", "speedup");
+                    for (uint32_t payloadSize : payloadSizes)
+                    {
+                        const uint64_t callCount = bytesPerSize / payloadSize;
+                        const uint64_t scalars[5] = { indices[0], 0, indices[1], 0, payloadSize };
+                        uint64_t mappedElapsed = 0;
+                        uint64_t registeredElapsed = 0;
+                        uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+                        for (uint64_t call = 0; (call < callCount) && (ret == kIOReturnSuccess); ++call)
+                        {
+                            size_t outputSize = payloadSize;
+                            ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, input, payloadSize, output, &outputSize);
+                        }
+                        mappedElapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                        startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                        for (uint64_t call = 0; (call < callCount) && (ret == kIOReturnSuccess); ++call)
+                        {
+                            ret = IOConnectCallScalarMethod(connection, ExternalMethodType_RegisteredStructBatch, scalars, 5, nullptr, nullptr);
+                        }
+                        registeredElapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("Call failed with error: 0x%08x.\n", ret);
+                            PrintErrorDetails(ret);
+                            break;
+                        }
+
+                        printf("%10u %12llu %18.0f %18.0f %9.2fx\n", payloadSize, callCount, (double)mappedElapsed / callCount, (double)registeredElapsed / callCount, (double)mappedElapsed / registeredElapsed);
+                    }
+
+                    const uint32_t last = payloadSizes[sizeof(payloadSizes) / sizeof(payloadSizes[0]) - 1] / sizeof(DataStruct) - 1;
+                    if ((ret == kIOReturnSuccess) && ((output[last].foo != last + 1) || (output[last].bar != 70010)))
+                    {
+                        printf("Registered output returned unexpected data: ");
+                        PrintStruct(&output[last]);
+                    }
+                }
+
+                for (uint32_t buffer = 0; buffer < 2; ++buffer)
+                {
+                    if (addresses[buffer] != 0)
+                    {
+                        IOConnectUnmapMemory64(connection, NullDriverMemoryType_RegisteredBuffer + (uint32_t)indices[buffer], mach_task_self(), addresses[buffer]);
+                    }
+                    if (indices[buffer] != UINT64_MAX)
+                    {
+                        IOConnectCallScalarMethod(connection, ExternalMethodType_UnregisterBuffer, &indices[buffer], 1, nullptr, nullptr);
+                    }
+                }
+            } break;
+
+            case 16: // "Coroutine Async Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Each request takes a millisecond in the dext, so one coroutine, like options 6 and 7, completes about a thousand a second.
+                // More coroutines keep more requests in flight over the same connection, up to the dext's limit of 512.
+                const uint64_t delayNanoseconds = 1000000;
+                const uint32_t totalRequests = 8192;
+                const uint32_t coroutineCounts[] = { 1, 4, 16, 64, 256 };
+
+                IOKitCoroutineTransport* transport = IOKitCoroutineTransport::Create(service);
+                if (transport == nullptr)
+                {
+                    break;
+                }
+
+                NullDriverCoroutineClient* client = new NullDriverCoroutineClient(transport);
+
+                client->Spawn(CoroutineCheckedStruct(client));
+                client->Run();
+
+                printf("%10s %12s %16s %12s %8s\n", "coroutines", "requests", "completions/s", "max flight", "errors");
+                for (uint32_t coroutineCount : coroutineCounts)
+                {
+                    // A single coroutine gets fewer requests, so the run doesn't take seconds.
+                    const uint32_t requestsPerCoroutine = (coroutineCount == 1) ? 1000 : totalRequests / coroutineCount;
+                    CoroutineCounts counts = {};
+
+                    for (uint32_t id = 0; id < coroutineCount; ++id)
+                    {
+                        client->Spawn(CoroutineRequestLoop(client, id, requestsPerCoroutine, delayNanoseconds, &counts));
+                    }
+
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                    ret = client->Run();
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                    printf("%10u %12llu %16.0f %12zu %8llu\n", coroutineCount, counts.completed, OpsPerSecond(counts.completed, elapsed), client->MaxInFlightCount(), counts.errors);
+
+                    if (counts.mismatches != 0)
+                    {
+                        printf("%llu results reached the wrong coroutine.\n", counts.mismatches);
+                    }
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("Timed out waiting for completions with error: 0x%08x.\n", ret);
+                        break;
+                    }
+                }
+
+                delete client;
+                delete transport;
+            } break;
+
+            case 17: // "Pipelined Async Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Requests have no simulated delay, so latency is only the time the dext takes plus any queueing in front of it.
+                // There are always more coroutines than the window allows in flight, so the window alone sets the depth.
+                const uint32_t coroutineCount = kNullDriverAdaptiveWindowMax;
+                const uint32_t requestsPerCoroutine = 64;
+                const uint32_t windowSizes[] = { 1, 4, 16, 64, 256, kNullDriverAdaptiveWindowMax, 0 };
+
+                IOKitCoroutineTransport* transport = IOKitCoroutineTransport::Create(service);
+                if (transport == nullptr)
+                {
+                    break;
+                }
+
+                NullDriverCoroutineClient* client = new NullDriverCoroutineClient(transport);
+                NullDriverAdaptiveWindow window = {};
+
+                printf("%10s %16s %10s %10s %12s\n", "window", "completions/s", "p50 us", "p99 us", "max flight");
+                for (uint32_t windowSize : windowSizes)
+                {
+                    CoroutineCounts counts = {};
+
+                    // A size of 0 is the adaptive window, which starts at 1 and finds its own size.
+                    if (windowSize == 0)
+                    {
+                        NullDriverAdaptiveWindowInit(&window, 1, kNullDriverAdaptiveWindowMax, 25);
+                    }
+                    else
+                    {
+                        NullDriverAdaptiveWindowInit(&window, windowSize, windowSize, 25);
+                    }
+
+                    client->SetWindow(&window);
+                    client->ResetCounters();
+                    for (uint32_t id = 0; id < coroutineCount; ++id)
+                    {
+                        client->Spawn(CoroutineRequestLoop(client, id, requestsPerCoroutine, 0, &counts));
+                    }
+
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                    ret = client->Run();
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                    if (windowSize == 0)
+                    {
+                        printf("%10s ", "adaptive");
+                    }
+                    else
+                    {
+                        printf("%10u ", windowSize);
+                    }
+                    printf("%16.0f %10.1f %10.1f %12zu\n", OpsPerSecond(counts.completed, elapsed), NullDriverStatsPercentile(client->LatencyStats(), 0.50) / 1000.0, NullDriverStatsPercentile(client->LatencyStats(), 0.99) / 1000.0, client->MaxInFlightCount());
+
+                    if ((counts.mismatches != 0) || (counts.errors != 0))
+                    {
+                        printf("%llu results reached the wrong coroutine and %llu requests failed.\n", counts.mismatches, counts.errors);
+                    }
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("Timed out waiting for completions with error: 0x%08x.\n", ret);
+                        break;
+                    }
+                }
+
+                printf("The adaptive window ended at %u after %llu increases and %llu decreases.\n", window.limit, window.increases, window.decreases);
+
+                client->SetWindow(nullptr);
+                delete client;
+                delete transport;
+            } break;
+
+            case 18: // "Streaming Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // The same payload goes through Checked Struct Batch in its largest calls, which the kernel passes as memory descriptors,
+                // and through streams with chunks from 64 KB to 4 MB.
+                const uint64_t payloadSize = 256ULL * 1024 * 1024;
+                const uint64_t structCount = payloadSize / sizeof(DataStruct);
+                const uint32_t batchSize = 4096 * sizeof(DataStruct);
+                const uint32_t chunkSizes[] = { 65536, 262144, 1048576, 4194304 };
+
+                DataStruct* source = new DataStruct[structCount];
+                DataStruct* destination = new DataStruct[structCount];
+                for (uint64_t index = 0; index < structCount; ++index)
+                {
+                    source[index].foo = index;
+                    source[index].bar = 70000;
+                }
+
+                printf("Streams report progress through the callback from option 6, which must be assigned first.\n");
+                printf("%18s %12s %10s %12s\n", "path", "calls", "GB/s", "mismatches");
+
+                for (int32_t chunkIndex = -1; chunkIndex < (int32_t)(sizeof(chunkSizes) / sizeof(chunkSizes[0])); ++chunkIndex)
+                {
+                    char pathName[32] = {};
+                    uint64_t callCount = 0;
+                    uint64_t mismatches = 0;
+
+                    memset(destination, 0, payloadSize);
+                    uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+                    // The first pass is the single-shot path, one descriptor-backed call per batch.
+                    if (chunkIndex < 0)
+                    {
+                        snprintf(pathName, sizeof(pathName), "batch %u KB", batchSize / 1024);
+                        for (uint64_t offset = 0; (offset < payloadSize) && (ret == kIOReturnSuccess); offset += batchSize)
+                        {
+                            size_t outputSize = batchSize;
+                            ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, (const uint8_t*)source + offset, batchSize, (uint8_t*)destination + offset, &outputSize);
+                            ++callCount;
+                        }
+                    }
+                    else
+                    {
+                        snprintf(pathName, sizeof(pathName), "stream %u KB", chunkSizes[chunkIndex] / 1024);
+                        ret = StreamPayload(connection, (const uint8_t*)source, (uint8_t*)destination, payloadSize, chunkSizes[chunkIndex]);
+                        callCount = 1 + (payloadSize + chunkSizes[chunkIndex] - 1) / chunkSizes[chunkIndex];
+                    }
+
+                    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("%s failed with error: 0x%08x.\n", pathName, ret);
+                        PrintErrorDetails(ret);
+                        break;
+                    }
+
+                    for (uint64_t index = 0; index < structCount; ++index)
+                    {
+                        if ((destination[index].foo != index + 1) || (destination[index].bar != 70010))
+                        {
+                            ++mismatches;
+                        }
+                    }
+
+                    // Bytes per nanosecond is GB/s.
+                    printf("%18s %12llu %10.2f %12llu\n", pathName, callCount, (double)payloadSize / elapsed, mismatches);
+                }
+
+                delete[] source;
+                delete[] destination;
+            } break;
+
+            case 19: // "Completion Wait Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // One coroutine sends requests with no simulated delay one after another, so each latency is a full round trip including the client's wakeup.
+                // The first pass waits on notifications as options 16 and 17 do. The rest use the shared page, each with its own way of waiting.
+                const uint32_t requestCount = 20000;
+                const uint64_t spinNanoseconds = 20000;
+                const char* modeNames[] = { "park", "spin", "spin-then-park" };
+
+                IOKitCoroutineTransport* transport = IOKitCoroutineTransport::Create(service);
+                if (transport == nullptr)
+                {
+                    break;
+                }
+
+                NullDriverCoroutineClient* client = new NullDriverCoroutineClient(transport);
+
+                printf("%16s %10s %10s %14s %8s %10s\n", "wait", "p50 us", "p99 us", "cpu us/result", "parks", "spurious");
+                for (int32_t mode = -1; mode < NumberOfNullDriverWaitModes; ++mode)
+                {
+                    CoroutineCounts counts = {};
+
+                    if (mode >= 0)
+                    {
+                        ret = transport->EnableSharedPage((NullDriverWaitMode)mode, spinNanoseconds);
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("Failed to enable the shared page with error: 0x%08x.\n", ret);
+                            break;
+                        }
+                    }
+
+                    client->ResetCounters();
+                    client->Spawn(CoroutineRequestLoop(client, 0, requestCount, 0, &counts));
+
+                    const uint64_t parksBefore = transport->Waiter()->parks;
+                    const uint64_t spuriousBefore = transport->Waiter()->spuriousWakeups;
+                    uint64_t startCPU = clock_gettime_nsec_np(CLOCK_THREAD_CPUTIME_ID);
+                    ret = client->Run();
+                    uint64_t cpu = clock_gettime_nsec_np(CLOCK_THREAD_CPUTIME_ID) - startCPU;
+
+                    printf("%16s %10.1f %10.1f %14.2f %8llu %10llu\n", (mode < 0) ? "notification" : modeNames[mode], NullDriverStatsPercentile(client->LatencyStats(), 0.50) / 1000.0, NullDriverStatsPercentile(client->LatencyStats(), 0.99) / 1000.0, (counts.completed != 0) ? (double)cpu / counts.completed / 1000.0 : 0.0, transport->Waiter()->parks - parksBefore, transport->Waiter()->spuriousWakeups - spuriousBefore);
+
+                    if ((counts.mismatches != 0) || (counts.errors != 0))
+                    {
+                        printf("%llu results reached the wrong coroutine and %llu requests failed.\n", counts.mismatches, counts.errors);
+                    }
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("Timed out waiting for completions with error: 0x%08x.\n", ret);
+                        break;
+                    }
+                }
+
+                delete client;
+                delete transport;
+            } break;
+
+            case 20: // "Sample Stream Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // The dext writes samples into the ring at each rate for a second, and only notifies this client when the ring is half full.
+                // Samples are checked where they are in the ring. Sequence numbers that were skipped have to add up to what the dext says it dropped.
+                const uint64_t rates[] = { 10000, 100000, 1000000, 10000000 };
+                const uint64_t lowWaterMark = kNullDriverSampleRingEntryCount / 2;
+                const uint64_t runNanoseconds = 1000000000ULL;
+                NullDriverSampleRing* sampleRing = nullptr;
+                uint32_t sampleTail = 0;
+
+                printf("Samples are announced through the callback from option 6, which must be assigned first.\n");
+                printf("%12s %14s %12s %10s %14s %12s %10s\n", "rate", "samples/s", "read", "drop %", "notifications", "mismatches", "gaps");
+
+                for (uint32_t rateIndex = 0; rateIndex < sizeof(rates) / sizeof(rates[0]); ++rateIndex)
+                {
+                    const uint64_t startScalars[2] = { rates[rateIndex], lowWaterMark };
+                    uint64_t nextSequence = 0;
+                    uint64_t read = 0;
+                    uint64_t skipped = 0;
+                    uint64_t mismatches = 0;
+
+                    ret = IOConnectCallScalarMethod(connection, ExternalMethodType_StartSamples, startScalars, 2, nullptr, nullptr);
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("Failed to start the sample stream with error: 0x%08x.\n", ret);
+                        PrintErrorDetails(ret);
+                        break;
+                    }
+
+                    // The ring only exists once the first stream has started, and stays mapped for the rest of the run.
+                    if (sampleRing == nullptr)
+                    {
+                        mach_vm_address_t address = 0;
+                        mach_vm_size_t size = 0;
+
+                        ret = IOConnectMapMemory64(connection, NullDriverMemoryType_SampleRing, mach_task_self(), &address, &size, kIOMapAnywhere);
+                        if ((ret != kIOReturnSuccess) || (size < sizeof(NullDriverSampleRing)))
+                        {
+                            printf("IOConnectMapMemory64 failed with error: 0x%08x.\n", ret);
+                            IOConnectCallScalarMethod(connection, ExternalMethodType_StopSamples, nullptr, 0, nullptr, nullptr);
+                            break;
+                        }
+
+                        sampleRing = (NullDriverSampleRing*)address;
+                        sampleTail = __atomic_load_n(&sampleRing->tail, __ATOMIC_RELAXED);
+                    }
+
+                    const uint64_t notificationsBefore = globalSampleNotifications;
+                    const uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                    uint64_t now = startTime;
+                    bool stopped = false;
+
+                    // After the stream stops, the run loop is given one more short wait so the last samples the dext wrote can be read.
+                    while (true)
+                    {
+                        const NullDriverSample* samples = nullptr;
+                        uint32_t count = 0;
+
+                        while ((count = NullDriverSampleRingPeek(sampleRing, sampleTail, &samples)) != 0)
+                        {
+                            for (uint32_t index = 0; index < count; ++index)
+                            {
+                                if (samples[index].sequence > nextSequence)
+                                {
+                                    skipped += samples[index].sequence - nextSequence;
+                                }
+                                if ((samples[index].foo != samples[index].sequence + 1) || (samples[index].bar != kNullDriverSampleBar + 10))
+                                {
+                                    ++mismatches;
+                                }
+                                nextSequence = samples[index].sequence + 1;
+                            }
+
+                            read += count;
+                            NullDriverSampleRingRelease(sampleRing, &sampleTail, count);
+                        }
+
+                        if (stopped)
+                        {
+                            break;
+                        }
+
+                        now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                        if (now - startTime >= runNanoseconds)
+                        {
+                            IOConnectCallScalarMethod(connection, ExternalMethodType_StopSamples, nullptr, 0, nullptr, nullptr);
+                            CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.01, false);
+                            stopped = true;
+                            continue;
+                        }
+
+                        // Sleeps until the next notification, or the end of the run.
+                        CFRunLoopRunInMode(kCFRunLoopDefaultMode, (double)(runNanoseconds - (now - startTime)) / 1000000000.0, false);
+                    }
+
+                    const uint64_t produced = __atomic_load_n(&sampleRing->produced, __ATOMIC_RELAXED);
+                    const uint64_t dropped = __atomic_load_n(&sampleRing->dropped, __ATOMIC_RELAXED);
+
+                    printf("%12llu %14.0f %12llu %10.2f %14llu %12llu %10s\n", rates[rateIndex], OpsPerSecond(read, now - startTime), read, (produced != 0) ? 100.0 * dropped / produced : 0.0,
+                           globalSampleNotifications - notificationsBefore, mismatches, ((skipped + (produced - nextSequence)) == dropped) ? "ok" : "MISMATCH");
+                }
+
+                if (sampleRing != nullptr)
+                {
+                    IOConnectUnmapMemory64(connection, NullDriverMemoryType_SampleRing, mach_task_self(), (mach_vm_address_t)sampleRing);
+                }
+            } break;
+
+            case 21: // "Capabilities and Transport Selection Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // Each run of DataStructs goes through every path the dext supports, and the one NullDriverCapabilitiesChooseTransport picks is marked.
+                // Every size moves the same total, so the numbers are comparable down a column.
+                const uint32_t counts[] = { 1, 16, 256, 1024, 4096, 65536 };
+                const NullDriverTransport transports[] = { NullDriverTransport_Call, NullDriverTransport_Batch, NullDriverTransport_SharedRing };
+                const char* transportNames[] = { "call", "batch", "ring" };
+                const uint64_t structsPerRun = 1 << 20;
+                NullDriverCapabilities capabilities = {};
+
+                ret = QueryCapabilities(connection, &capabilities);
+                if (ret != kIOReturnSuccess)
+                {
+                    printf("The dext doesn't report capabilities (0x%08x), so it's treated as protocol version 0.\n", ret);
+                }
+
+                printf("Protocol version %u (this client has %u), %u selectors, transports 0x%x, batches up to %u, alignment %u, inline up to %u bytes, %u ring entries.\n",
+                       capabilities.version, kNullDriverProtocolVersion, capabilities.selectorCount, capabilities.transports, capabilities.maxBatchCount,
+                       capabilities.payloadAlignment, capabilities.inlineStructureSize, capabilities.ringEntryCount);
+
+                DataStruct* input = new DataStruct[counts[sizeof(counts) / sizeof(counts[0]) - 1]];
+                DataStruct* output = new DataStruct[counts[sizeof(counts) / sizeof(counts[0]) - 1]];
+
+                printf("%10s %8s %14s %12s\n", "count", "path", "structs/sec", "mismatches");
+                for (uint32_t countIndex = 0; countIndex < sizeof(counts) / sizeof(counts[0]); ++countIndex)
+                {
+                    const uint32_t count = counts[countIndex];
+                    const NullDriverTransport chosen = NullDriverCapabilitiesChooseTransport(&capabilities, count);
+
+                    for (uint32_t transportIndex = 0; transportIndex < sizeof(transports) / sizeof(transports[0]); ++transportIndex)
+                    {
+                        const NullDriverTransport transport = transports[transportIndex];
+                        uint64_t mismatches = 0;
+
+                        if ((capabilities.transports & transport) == 0)
+                        {
+                            continue;
+                        }
+
+                        const uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                        uint64_t moved = 0;
+                        for (; (moved < structsPerRun) && (ret == kIOReturnSuccess); moved += count)
+                        {
+                            for (uint32_t index = 0; index < count; ++index)
+                            {
+                                input[index].foo = moved + index;
+                                input[index].bar = 70000;
+                            }
+
+                            ret = TransformStructs(connection, &capabilities, &rings, transport, input, output, count);
+
+                            for (uint32_t index = 0; index < count; ++index)
+                            {
+                                if ((output[index].foo != moved + index + 1) || (output[index].bar != 70010))
+                                {
+                                    ++mismatches;
+                                }
+                            }
+                        }
+                        const uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                        if (ret != kIOReturnSuccess)
+                        {
+                            printf("The %s path failed with error: 0x%08x.\n", transportNames[transportIndex], ret);
+                            PrintErrorDetails(ret);
+                            break;
+                        }
+
+                        printf("%10u %7s%s %14.0f %12llu\n", count, transportNames[transportIndex], (transport == chosen) ? "*" : " ", OpsPerSecond(moved, elapsed), mismatches);
+                    }
+
+                    if (ret != kIOReturnSuccess)
+                    {
+                        break;
+                    }
+                }
+                printf("* is the path picked for that count.\n");
+
+                delete[] input;
+                delete[] output;
+            } break;
+
+            case 22: // "Scatter-Gather Benchmark"
+            {
+                kern_return_t ret = kIOReturnSuccess;
+
+                // The data is spread over one registered buffer, with a gap the size of a segment after each segment.
+                // The staged path gathers the segments into one array, transforms it with Checked Struct Batch, and scatters the results back.
+                // The scatter-gather path transforms the segments where they are, with one call that only carries the segment list.
+                const uint32_t segmentSizes[] = { 64, 256, 1024, 4096 };
+                const uint32_t segmentCount = 64;
+                const uint64_t bufferSize = 2ULL * segmentCount * 4096;
+                const uint64_t bytesPerSize = 256ULL * 1024 * 1024;
+                uint64_t index = UINT64_MAX;
+                mach_vm_address_t address = 0;
+                mach_vm_size_t size = 0;
+                uint32_t outputCount = 1;
+
+                ret = IOConnectCallScalarMethod(connection, ExternalMethodType_RegisterBuffer, &bufferSize, 1, &index, &outputCount);
+                if (ret != kIOReturnSuccess)
+                {
+                    printf("IOConnectCallScalarMethod failed with error: 0x%08x.\n", ret);
+                    PrintErrorDetails(ret);
+                    break;
+                }
+
+                ret = IOConnectMapMemory64(connection, NullDriverMemoryType_RegisteredBuffer + (uint32_t)index, mach_task_self(), &address, &size, kIOMapAnywhere);
+                if ((ret == kIOReturnSuccess) && (size < bufferSize))
+                {
+                    printf("Mapped buffer of size %llu is smaller than the registered %llu.\n", size, bufferSize);
+                    ret = kIOReturnNoSpace;
+                }
+                else if (ret != kIOReturnSuccess)
+                {
+                    printf("IOConnectMapMemory64 failed with error: 0x%08x.\n", ret);
+                    PrintErrorDetails(ret);
+                    address = 0;
+                }
+
+                DataStruct* staging = new DataStruct[bufferSize / 2 / sizeof(DataStruct)];
+
+                if (ret == kIOReturnSuccess)
+                {
+                    printf("%10s %10s %12s %16s %16s %10s\n", "seg bytes", "segments", "calls", "staged ns/call", "sg ns/call", "speedup");
+                }
+
+                for (uint32_t sizeIndex = 0; (ret == kIOReturnSuccess) && (sizeIndex < sizeof(segmentSizes) / sizeof(segmentSizes[0])); ++sizeIndex)
+                {
+                    const uint32_t segmentSize = segmentSizes[sizeIndex];
+                    const uint32_t segmentStructs = segmentSize / sizeof(DataStruct);
+                    const uint32_t totalStructs = segmentCount * segmentStructs;
+                    const uint64_t callCount = bytesPerSize / (segmentCount * segmentSize);
+                    NullDriverSegment segments[segmentCount];
+                    uint32_t statuses[segmentCount] = {};
+                    uint64_t elapsed[2] = {};
+                    uint64_t mismatches = 0;
+
+                    for (uint32_t segment = 0; segment < segmentCount; ++segment)
+                    {
+                        segments[segment] = { .buffer = index, .offset = 2ULL * segment * segmentSize, .length = segmentSize };
+                    }
+
+                    // Each path transforms the segments "callCount" times in place, so every DataStruct ends up callCount steps past where it started.
+                    for (uint32_t path = 0; (path < 2) && (ret == kIOReturnSuccess); ++path)
+                    {
+                        for (uint32_t segment = 0; segment < segmentCount; ++segment)
+                        {
+                            DataStruct* data = (DataStruct*)(address + segments[segment].offset);
+                            for (uint32_t item = 0; item < segmentStructs; ++item)
+                            {
+                                data[item].foo = segment * segmentStructs + item;
+                                data[item].bar = 70000;
+                            }
+                        }
+
+                        const uint64_t startTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+                        for (uint64_t call = 0; (call < callCount) && (ret == kIOReturnSuccess); ++call)
+                        {
+                            if (path == 0)
+                            {
+                                for (uint32_t segment = 0; segment < segmentCount; ++segment)
+                                {
+                                    memcpy(staging + segment * segmentStructs, (const void*)(address + segments[segment].offset), segmentSize);
+                                }
+                                for (uint32_t offset = 0; (offset < totalStructs) && (ret == kIOReturnSuccess); offset += kNullDriverMaxStructBatchCount)
+                                {
+                                    const uint32_t batchCount = (totalStructs - offset < kNullDriverMaxStructBatchCount) ? totalStructs - offset : kNullDriverMaxStructBatchCount;
+                                    size_t outputSize = batchCount * sizeof(DataStruct);
+                                    ret = IOConnectCallStructMethod(connection, ExternalMethodType_CheckedStructBatch, staging + offset, batchCount * sizeof(DataStruct), staging + offset, &outputSize);
+                                }
+                                for (uint32_t segment = 0; segment < segmentCount; ++segment)
+                                {
+                                    memcpy((void*)(address + segments[segment].offset), staging + segment * segmentStructs, segmentSize);
+                                }
+                            }
+                            else
+                            {
+                                ret = ScatterGather(connection, segments, segmentCount, statuses);
+                                for (uint32_t segment = 0; (segment < segmentCount) && (ret == kIOReturnSuccess); ++segment)
+                                {
+                                    if (statuses[segment] != NullDriverSegmentStatus_Done)
+                                    {
+                                        printf("Segment %u failed with status %u.\n", segment, statuses[segment]);
+                                        ret = kIOReturnError;
+                                    }
+                                }
+                            }
+                        }
+                        elapsed[path] = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startTime;
+
+                        for (uint32_t segment = 0; (segment < segmentCount) && (ret == kIOReturnSuccess); ++segment)
+                        {
+                            const DataStruct* data = (const DataStruct*)(address + segments[segment].offset);
+                            for (uint32_t item = 0; item < segmentStructs; ++item)
+                            {
+                                if ((data[item].foo != segment * segmentStructs + item + callCount) || (data[item].bar != 70000 + 10 * callCount))
+                                {
+                                    ++mismatches;
+                                }
+                            }
+                        }
+                    }
+
+                    if (ret != kIOReturnSuccess)
+                    {
+                        printf("Call failed with error: 0x%08x.\n", ret);
+                        PrintErrorDetails(ret);
+                        break;
+                    }
+
+                    printf("%10u %10u %12llu %16.0f %16.0f %9.2fx\n", segmentSize, segmentCount, callCount, (double)elapsed[0] / callCount, (double)elapsed[1] / callCount, (double)elapsed[0] / elapsed[1]);
+                    if (mismatches != 0)
+                    {
+                        printf("%llu DataStructs came back wrong.\n", mismatches);
+                    }
+                }
+
+                delete[] staging;
+
+                if (address != 0)
+                {
+                    IOConnectUnmapMemory64(connection, NullDriverMemoryType_RegisteredBuffer + (uint32_t)index, mach_task_self(), address);
+                }
+                IOConnectCallScalarMethod(connection, ExternalMethodType_UnregisterBuffer, &index, 1, nullptr, nullptr);
+            } break;
+
             default:
             {
                 printf("Invalid input, try again.\n");
@@ -7,102 +7,281 @@ A DriverKit null driver implementation that only logs interactions with its clie
 
 #include <os/log.h>
 
+#include <DriverKit/IOBufferMemoryDescriptor.h>
 #include <DriverKit/IOLib.h>
 #include <DriverKit/IOMemoryMap.h>
 #include <DriverKit/IOTimerDispatchSource.h>
 #include <DriverKit/IOUserClient.h>
+#include <DriverKit/OSBoolean.h>
 #include <DriverKit/OSData.h>
+#include <DriverKit/OSDictionary.h>
+#include <DriverKit/OSNumber.h>
 
 #include <time.h>
 
 #include "NullDriver.h"
+#include "../Shared/NullDriverBufferPool.h"
+#include "../Shared/NullDriverCompletion.h"
+#include "../Shared/NullDriverDevice.h"
+#include "../Shared/NullDriverDoorbell.h"
+#include "../Shared/NullDriverInFlightTable.h"
+#include "../Shared/NullDriverMethodTable.h"
+#include "../Shared/NullDriverProtocol.h"
+#include "../Shared/NullDriverRegisteredBuffer.h"
+#include "../Shared/NullDriverRing.h"
+#include "../Shared/NullDriverSampleRing.h"
+#include "../Shared/NullDriverScatterGather.h"
+#include "../Shared/NullDriverShard.h"
+#include "../Shared/NullDriverStats.h"
+#include "../Shared/NullDriverStream.h"
+#include "../Shared/NullDriverTrace.h"
+#include "../Shared/NullDriverTransform.h"
+
+// DriverKit logging has no logging levels, so the levels are applied at compile time instead.
+// "Log" is for lifecycle events and errors, "LogDebug" for once per request, and "LogTrace" for inside a request's loops.
+// Debug builds keep everything. Release builds compile away "LogDebug" and "LogTrace", so the per-request paths make no os_log calls at all.
+// Set NULLDRIVER_LOG_LEVEL in the build settings to override this.
+#define NULLDRIVER_LOG_LEVEL_INFO 1
+#define NULLDRIVER_LOG_LEVEL_DEBUG 2
+#define NULLDRIVER_LOG_LEVEL_TRACE 3
+
+#ifndef NULLDRIVER_LOG_LEVEL
+#if DEBUG
+#define NULLDRIVER_LOG_LEVEL NULLDRIVER_LOG_LEVEL_TRACE
+#else
+#define NULLDRIVER_LOG_LEVEL NULLDRIVER_LOG_LEVEL_INFO
+#endif
+#endif
 
 // This log to makes it easier to parse out individual logs from the driver, since all logs will be prefixed with the same word/phrase.
-// DriverKit logging has no logging levels; some developers might want to prefix errors differently than info messages.
-// Another option is to #define a "debug" case where some log messages only exist when doing a debug build.
 // To search for logs from this driver, use either: `sudo dmesg | grep NullDriver` or use Console.app search to find messages that start with "NullDriver -".
 #define Log(fmt, ...) os_log(OS_LOG_DEFAULT, "NullDriver - " fmt "\n", ##__VA_ARGS__)
 
-// This struct should ideally be shared across all applications using the driver, as the integer values need to be the same across all programs.
-typedef enum
-{
-    ExternalMethodType_Scalar = 0,
-    ExternalMethodType_Struct = 1,
-    ExternalMethodType_CheckedScalar = 2,
-    ExternalMethodType_CheckedStruct = 3,
-    ExternalMethodType_RegisterAsyncCallback = 4,
-    ExternalMethodType_AsyncRequest = 5,
-    NumberOfExternalMethods // Has to be last
-} ExternalMethodType;
-
-// These "DataStruct" structures are what used to discuss with our Dext.
-typedef struct
-{
-    uint64_t foo;
-    uint64_t bar;
-} DataStruct;
-
-typedef struct {
-    uint64_t foo;
-    uint64_t bar;
-    uint64_t largeArray[511];
-} OversizedDataStruct;
-
-
-const IOUserClientMethodDispatch externalMethodChecks[NumberOfExternalMethods] = {
-    // ExternalMethodType_Scalar and ExternalMethodType_Struct are intentionally omitted.
+#if NULLDRIVER_LOG_LEVEL >= NULLDRIVER_LOG_LEVEL_DEBUG
+#define LogDebug(fmt, ...) Log(fmt, ##__VA_ARGS__)
+#else
+#define LogDebug(fmt, ...) do { } while (0)
+#endif
+
+#if NULLDRIVER_LOG_LEVEL >= NULLDRIVER_LOG_LEVEL_TRACE
+#define LogTrace(fmt, ...) Log(fmt, ##__VA_ARGS__)
+#else
+#define LogTrace(fmt, ...) do { } while (0)
+#endif
+
+// The binary trace keeps a (timestamp, selector, status, size) record of every external method call in memory, and logs them when the client stops.
+// Recording one costs a few stores instead of an os_log, so it stays useful when the log level is too low to show individual calls.
+// It's on in debug builds. Set NULLDRIVER_TRACE to 1 in the build settings to use it in a release build.
+#ifndef NULLDRIVER_TRACE
+#if DEBUG
+#define NULLDRIVER_TRACE 1
+#else
+#define NULLDRIVER_TRACE 0
+#endif
+#endif
+
+
+// Each line describes one selector: its handler, then its scalar inputs, structure input, scalar outputs, structure output and completion.
+// The checks in its IOUserClientMethodDispatch are derived from those types, and so is the function the entry points to, which calls the handler.
+template <uint64_t Selector, auto Handler, typename ScalarInput, typename StructureInput, typename ScalarOutput, typename StructureOutput, uint32_t Completion = kNullDriverCompletionNone>
+using CheckedMethod = NullDriverMethod<IOUserClientMethodDispatch, Selector, Handler, ScalarInput, StructureInput, ScalarOutput, StructureOutput, Completion>;
+
+template <uint64_t Selector>
+using UncheckedMethod = NullDriverUncheckedMethod<IOUserClientMethodDispatch, Selector>;
+
+static_assert(kNullDriverVariableStructureSize == kIOUserClientVariableStructureSize, "NullDriverVariableStructure has the wrong size.");
+
+typedef NullDriverMethodTable<IOUserClientMethodDispatch,
+    // ExternalMethodType_Scalar and ExternalMethodType_Struct are intentionally left unchecked.
     // This is so they can be called directly, which is not recommended, but provided for ease of understanding.
     // Instead, prefer the "_Checked" methods, as they are safer and less prone to attacks.
-    //
-    // When possible choose exact sizes for all variables for security reasons, but if a size must be variable, use kIOUserClientVariableStructureSize.
+    UncheckedMethod<ExternalMethodType_Scalar>,
+    UncheckedMethod<ExternalMethodType_Struct>,
+
+    // When possible choose exact sizes for all variables for security reasons, but if a size must be variable, use NullDriverVariableStructure.
+    // Since this call doesn't use a callback, its completion is kNullDriverCompletionNone and IOUserClientMethodArguments.completion must be 0.
     /// - Tag: ClientMethodDispatch_CheckedScalar
-    [ExternalMethodType_CheckedScalar] =
-    {
-        .function = (IOUserClientMethodFunction) &NullDriver::StaticHandleExternalCheckedScalar,
-        .checkCompletionExists = false, // Since this call doesn't use a callback, this value is false and IOUserClientMethodArguments.completion must be 0.
-        .checkScalarInputCount = 16,
-        .checkStructureInputSize = 0,
-        .checkScalarOutputCount = 16,
-        .checkStructureOutputSize = 0,
-    },
-    [ExternalMethodType_CheckedStruct] =
-    {
-        .function = (IOUserClientMethodFunction) &NullDriver::StaticHandleExternalCheckedStruct,
-        .checkCompletionExists = false,
-        .checkScalarInputCount = 0, // No scalar inputs
-        .checkStructureInputSize = sizeof(DataStruct), // Avoid using variables unless absolutely required. Using the size of a structure is safer.
-        .checkScalarOutputCount = 0,
-        .checkStructureOutputSize = sizeof(DataStruct),
-    },
+    CheckedMethod<ExternalMethodType_CheckedScalar, &NullDriver::HandleExternalCheckedScalar, NullDriverScalars<16>, NullDriverNoStructure, NullDriverScalars<16>, NullDriverNoStructure>,
+    // Avoid using variables unless absolutely required. Using the size of a structure is safer.
+    CheckedMethod<ExternalMethodType_CheckedStruct, &NullDriver::HandleExternalCheckedStruct, NullDriverScalars<0>, NullDriverStructure<DataStruct>, NullDriverScalars<0>, NullDriverStructure<DataStruct>>,
+
     // The async methods follow the same flow as the checked methods, so the checks and function implementations are similar.
-    [ExternalMethodType_RegisterAsyncCallback] =
-    {
-        .function = (IOUserClientMethodFunction) &NullDriver::StaticRegisterAsyncCallback,
-        .checkCompletionExists = true,
-        .checkScalarInputCount = 0,
-        .checkStructureInputSize = sizeof(DataStruct),
-        .checkScalarOutputCount = 0,
-        .checkStructureOutputSize = sizeof(DataStruct),
-    },
-    [ExternalMethodType_AsyncRequest] =
-    {
-        .function = (IOUserClientMethodFunction) &NullDriver::StaticHandleAsyncRequest,
-        .checkCompletionExists = -1U, // Don't care about completion
-        .checkScalarInputCount = 0,
-        .checkStructureInputSize = sizeof(DataStruct),
-        .checkScalarOutputCount = 0,
-        .checkStructureOutputSize = 0,
-    },
-};
+    CheckedMethod<ExternalMethodType_RegisterAsyncCallback, &NullDriver::RegisterAsyncCallback, NullDriverScalars<0>, NullDriverStructure<DataStruct>, NullDriverScalars<0>, NullDriverStructure<DataStruct>, kNullDriverCompletionRequired>,
+    CheckedMethod<ExternalMethodType_AsyncRequest, &NullDriver::HandleAsyncRequest, NullDriverScalars<0>, NullDriverStructure<DataStruct>, NullDriverScalars<0>, NullDriverNoStructure, kNullDriverCompletionAny>,
+
+    // The doorbell carries no data of its own. Everything it needs is already in the shared submission ring.
+    CheckedMethod<ExternalMethodType_RingDoorbell, &NullDriver::HandleRingDoorbell, NullDriverScalars<0>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure>,
+
+    // The batch size is chosen by the caller, so the sizes are variable here.
+    // HandleExternalCheckedStructBatch applies the bounds itself: a whole number of DataStructs, between 1 and kNullDriverMaxStructBatchCount of them.
+    CheckedMethod<ExternalMethodType_CheckedStructBatch, &NullDriver::HandleExternalCheckedStructBatch, NullDriverScalars<0>, NullDriverVariableStructure, NullDriverScalars<0>, NullDriverVariableStructure>,
+
+    // The two scalar inputs are the client's tag and the simulated delay in nanoseconds.
+    // The completion isn't checked, since the one from RegisterAsyncCallback is used.
+    CheckedMethod<ExternalMethodType_TaggedAsyncRequest, &NullDriver::HandleTaggedAsyncRequest, NullDriverScalars<2>, NullDriverStructure<DataStruct>, NullDriverScalars<0>, NullDriverNoStructure, kNullDriverCompletionAny>,
+
+    // The one scalar input is a NullDriverCompletionMode.
+    CheckedMethod<ExternalMethodType_SetCompletionMode, &NullDriver::HandleSetCompletionMode, NullDriverScalars<1>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure>,
+
+    // A NullDriverStats is larger than a page, so it's always returned through the caller's memory descriptor.
+    // HandleCopyStats checks that the caller's buffer is large enough.
+    CheckedMethod<ExternalMethodType_CopyStats, &NullDriver::HandleCopyStats, NullDriverScalars<0>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverVariableStructure>,
+
+    // The scalar input is the size of the buffer to create, and the scalar output is its index.
+    CheckedMethod<ExternalMethodType_RegisterBuffer, &NullDriver::HandleRegisterBuffer, NullDriverScalars<1>, NullDriverNoStructure, NullDriverScalars<1>, NullDriverNoStructure>,
+
+    // The scalar input is the index of the buffer to release.
+    CheckedMethod<ExternalMethodType_UnregisterBuffer, &NullDriver::HandleUnregisterBuffer, NullDriverScalars<1>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure>,
+
+    // The five scalar inputs are the input buffer's index and offset, the output buffer's index and offset, and the length in bytes.
+    // The data itself never passes through the call.
+    CheckedMethod<ExternalMethodType_RegisteredStructBatch, &NullDriver::HandleRegisteredStructBatch, NullDriverScalars<5>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure>,
+
+    // The two scalar inputs are the stream's total length and its chunk size, both in bytes.
+    CheckedMethod<ExternalMethodType_StreamBegin, &NullDriver::HandleStreamBegin, NullDriverScalars<2>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure>,
+
+    // The two scalar inputs are the chunk's sequence number and length. The chunk itself is already in the stream region.
+    // Progress arrives through the completion from RegisterAsyncCallback, so the completion isn't checked.
+    CheckedMethod<ExternalMethodType_StreamChunk, &NullDriver::HandleStreamChunk, NullDriverScalars<2>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure, kNullDriverCompletionAny>,
+
+    // The structure input is a NullDriverDeviceConfig, which applies to the simulated device shared by every client of the service.
+    CheckedMethod<ExternalMethodType_ConfigureDevice, &NullDriver::HandleConfigureDevice, NullDriverScalars<0>, NullDriverStructure<NullDriverDeviceConfig>, NullDriverScalars<0>, NullDriverStructure<NullDriverDeviceConfig>>,
+
+    // The two scalar inputs are the rate in samples per second and the low-water mark in free slots.
+    // Notifications arrive through the completion from RegisterAsyncCallback, so the completion isn't checked.
+    CheckedMethod<ExternalMethodType_StartSamples, &NullDriver::HandleStartSamples, NullDriverScalars<2>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure, kNullDriverCompletionAny>,
+    CheckedMethod<ExternalMethodType_StopSamples, &NullDriver::HandleStopSamples, NullDriverScalars<0>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverNoStructure>,
+
+    // The structure output is a NullDriverCapabilities. Its size is fixed, so a client built against another version fails here rather than misreading it.
+    CheckedMethod<ExternalMethodType_QueryCapabilities, &NullDriver::HandleQueryCapabilities, NullDriverScalars<0>, NullDriverNoStructure, NullDriverScalars<0>, NullDriverStructure<NullDriverCapabilities>>,
+
+    // The structure input is a segment list and the output a status for each segment, so both sizes depend on the segment count.
+    // HandleScatterGather checks that they agree with each other.
+    CheckedMethod<ExternalMethodType_ScatterGather, &NullDriver::HandleScatterGather, NullDriverScalars<0>, NullDriverVariableStructure, NullDriverScalars<0>, NullDriverVariableStructure>
+> ExternalMethodTable;
+
+static_assert(ExternalMethodTable::count == NumberOfExternalMethods, "Every selector needs a line in ExternalMethodTable.");
+
+// Every selector needs its own slot in NullDriverStats, apart from the ones kept for invalid selectors and SimulatedAsyncEvent.
+static_assert(NumberOfExternalMethods <= kNullDriverStatsSelector_Invalid, "NullDriverStats has no room for every selector.");
+
+// Regions of registered buffers always hold whole DataStructs.
+static_assert((kNullDriverRegisteredBufferAlignment % sizeof(DataStruct)) == 0, "Registered buffer regions have to hold whole DataStructs.");
+
+// The untagged async requests get a tag from the dext. Those always have the top bit set, and clients aren't allowed to use such tags.
+static const uint64_t kInternalTagBit = 1ULL << 63;
+
+// Simulated completions for untagged requests arrive after five seconds. Tagged requests choose their own delay, up to the maximum.
+// Those delays are what NullDriverDeviceModel_Requested uses. The other device models choose the service time themselves.
+static const uint64_t kDefaultSimulatedDelay = 5000000000;
+static const uint64_t kMaxSimulatedDelay = 10000000000;
+static const uint64_t kSimulatedCompletionLeeway = 100000;
+
+// The most completions collected from the in-flight table while holding its lock.
+static const uint32_t kSimulatedCompletionBatchSize = 32;
+
+// The most ring entries processed between two index updates while draining the submission ring.
+static const uint32_t kRingDrainBatchSize = 64;
 
 /// - Tag: Struct_NullDriver_IVars
 struct NullDriver_IVars {
+    // Set on user clients only. This is the service instance that created the client in NewUserClient.
+    NullDriver* owner = nullptr;
+    uint64_t clientID = 0;
+
+    // Only used on the service instance, to number clients and count the open ones.
+    uint64_t nextClientID = 0;
+    uint32_t clientCount = 0;
+
+    // Only created on the service instance. Clients that don't ask for a dedicated queue are spread across these by client ID.
+    IODispatchQueue* shardQueues[kNullDriverMaxShardCount] = {};
+    uint32_t shardCount = 0;
+
+    // Only created on the service instance. Every client's simulated completions go through this one device, so they compete for its channels.
+    // Clients take "deviceLock" while holding their own "inFlightLock", never the other way around.
+    IOLock* deviceLock = nullptr;
+    NullDriverDevice* device = nullptr;
+
     OSAction* callbackAction = nullptr;
     IODispatchQueue* dispatchQueue = nullptr;
+    bool ownsDispatchQueue = false;
     IOTimerDispatchSource* dispatchSource = nullptr;
     OSAction* simulatedAsyncDeviceResponseAction = nullptr;
+
+    // Outstanding async requests. The lock is needed because requests arrive on the default queue, while completions run on "dispatchQueue".
+    IOLock* inFlightLock = nullptr;
+    NullDriverInFlightTable inFlight = {};
+    uint64_t nextInternalTag = 0;
+    uint64_t armedDeadline = 0; // Zero when the timer isn't armed.
+    uint32_t completionMode = NullDriverCompletionMode_Single;
+
+    // Only allocated when NULLDRIVER_TRACE is set.
+    NullDriverTraceRing* trace = nullptr;
+
+    // Counters and latency histograms for every call this client makes. Only allocated on user clients.
+    NullDriverStats* stats = nullptr;
+
+    // Shared-memory ring transport. The dext keeps its own copy of the index it owns, since the ring memory is writable by the client.
+    IOBufferMemoryDescriptor* submissionRingMemory = nullptr;
+    IOBufferMemoryDescriptor* completionRingMemory = nullptr;
+    IOBufferMemoryDescriptor* asyncCompletionRingMemory = nullptr;
+    IOMemoryMap* submissionRingMap = nullptr;
+    IOMemoryMap* completionRingMap = nullptr;
+    IOMemoryMap* asyncCompletionRingMap = nullptr;
+    NullDriverRing* submissionRing = nullptr;
+    NullDriverRing* completionRing = nullptr;
+    NullDriverRing* asyncCompletionRing = nullptr;
+    uint32_t submissionTail = 0;
+    uint32_t completionHead = 0;
+    uint32_t asyncCompletionHead = 0;
+    bool ringDrainScheduled = false;
+
+    // The doorbell page for NullDriverCompletionMode_SharedPage. It's created along with the rings.
+    IOBufferMemoryDescriptor* completionDoorbellMemory = nullptr;
+    IOMemoryMap* completionDoorbellMap = nullptr;
+    NullDriverDoorbell* completionDoorbell = nullptr;
+
+    // Buffers registered by the client, with the dext's mapping of each kept until the buffer is unregistered or the client goes away.
+    IOBufferMemoryDescriptor* registeredBufferMemory[kNullDriverRegisteredBufferCount] = {};
+    IOMemoryMap* registeredBufferMaps[kNullDriverRegisteredBufferCount] = {};
+    NullDriverRegisteredBufferTable registeredBuffers = {};
+
+    // The double-buffered region of the current chunked stream, mapped once when the stream begins. A later stream with the same chunk size reuses it.
+    IOBufferMemoryDescriptor* streamMemory = nullptr;
+    IOMemoryMap* streamMap = nullptr;
+    NullDriverStreamState stream = {};
+
+    // The ring of the device-to-client sample stream, created by the first ExternalMethodType_StartSamples and kept until the client goes away.
+    // The selectors only change the requested rate, under "inFlightLock". The producer itself only runs on the dispatch queue, in SimulatedAsyncEvent,
+    // which restarts it whenever "sampleGeneration" has moved on from the one it last saw.
+    IOBufferMemoryDescriptor* sampleRingMemory = nullptr;
+    IOMemoryMap* sampleRingMap = nullptr;
+    NullDriverSampleRing* sampleRing = nullptr;
+    uint64_t samplesPerSecond = 0;
+    uint32_t sampleLowWaterMark = 0;
+    uint64_t sampleGeneration = 0;
+    uint64_t sampleProducerGeneration = 0;
+    NullDriverSampleProducer sampleProducer = {};
+
+    // Reply OSDatas kept for reuse. "lentOutput" is the one given to the latest call, which goes back into the pool on the next call.
+    NullDriverBufferPool outputPool = {};
+    OSData* lentOutput = nullptr;
+    uint32_t lentOutputClass = 0;
 };
 
+// RegisterAsyncCallback swaps "callbackAction" under "inFlightLock", so checking for it takes the lock too.
+// Requests only check that there is one. Completions read it again under the lock, and retain it while they use it.
+static bool HasCallbackAction(NullDriver_IVars* ivars)
+{
+    bool result = false;
+
+    IOLockLock(ivars->inFlightLock);
+    result = (ivars->callbackAction != nullptr);
+    IOLockUnlock(ivars->inFlightLock);
+
+    return result;
+}
+
 
 // MARK: Dext Lifecycle Management
 bool NullDriver::init(void)
@@ -143,48 +322,178 @@ kern_return_t IMPL(NullDriver, Start)
         goto Exit;
     }
 
-    ret = IODispatchQueue::Create("NullDriverDispatchQueue", 0, 0, &ivars->dispatchQueue);
+    // Every user client is also a NullDriver (see "UserClientProperties" in Info.plist), started with the service as its provider.
+    // Only the service registers itself. Each user client sets up its own completion state instead.
+    ivars->owner = OSDynamicCast(NullDriver, provider);
+    if (ivars->owner != nullptr)
+    {
+        ivars->owner->retain();
+        ret = StartUserClient();
+        goto Exit;
+    }
+
+    // The simulated device starts out with an all-zero configuration, so every request takes its own delay until a client configures it.
+    ivars->deviceLock = IOLockAlloc();
+    ivars->device = IONewZero(NullDriverDevice, 1);
+    if ((ivars->deviceLock == nullptr) || (ivars->device == nullptr))
+    {
+        Log("Start() - Failed to allocate the simulated device.");
+        ret = kIOReturnNoMemory;
+        goto Exit;
+    }
+
+    // Clients that don't ask for a dedicated queue share these.
+    ret = CreateShardQueues();
+    if (ret != kIOReturnSuccess)
+    {
+        goto Exit;
+    }
+
+    ret = RegisterService();
     if (ret != kIOReturnSuccess)
     {
-        Log("Start() - Failed to create dispatch queue with error: 0x%08x.", ret);
+        Log("Start() - Failed to register service with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    Log("Start() - Finished.");
+    ret = kIOReturnSuccess;
+
+Exit:
+    return ret;
+}
+
+kern_return_t NullDriver::CreateShardQueues(void)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    OSDictionary* properties = nullptr;
+    uint64_t requestedCount = 0;
+
+    // "NullDriverDispatchQueueCount" in the personality sets how many queues shared clients are spread across.
+    // Each client stays on one queue, so more queues let more clients' completions run at once without reordering any one client's.
+    if (CopyProperties(&properties) == kIOReturnSuccess)
+    {
+        OSNumber* countProperty = OSDynamicCast(OSNumber, properties->getObject("NullDriverDispatchQueueCount"));
+        if (countProperty != nullptr)
+        {
+            requestedCount = countProperty->unsigned64BitValue();
+        }
+        OSSafeReleaseNULL(properties);
+    }
+
+    for (uint32_t shard = 0; shard < NullDriverShardCountFromProperty(requestedCount); ++shard)
+    {
+        ret = IODispatchQueue::Create("NullDriverDispatchQueue", 0, 0, &ivars->shardQueues[shard]);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("CreateShardQueues() - Failed to create dispatch queue %u with error: 0x%08x.", shard, ret);
+            goto Exit;
+        }
+        ++ivars->shardCount;
+    }
+
+    Log("CreateShardQueues() - Created %u shared queues.", ivars->shardCount);
+
+Exit:
+    return ret;
+}
+
+kern_return_t NullDriver::StartUserClient(void)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    OSDictionary* properties = nullptr;
+    bool dedicatedQueue = true;
+
+    ivars->clientID = __atomic_add_fetch(&ivars->owner->ivars->nextClientID, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ivars->owner->ivars->clientCount, 1, __ATOMIC_RELAXED);
+
+    ivars->inFlightLock = IOLockAlloc();
+    if (ivars->inFlightLock == nullptr)
+    {
+        Log("StartUserClient() - Failed to allocate in-flight lock.");
+        ret = kIOReturnNoMemory;
         goto Exit;
     }
 
+    // By default each client gets its own queue, so a slow client can't hold up the others' completions.
+    // Setting "NullDriverDedicatedDispatchQueue" to false in UserClientProperties makes clients share the service's queue instead.
+    if (CopyProperties(&properties) == kIOReturnSuccess)
+    {
+        OSBoolean* dedicatedQueueProperty = OSDynamicCast(OSBoolean, properties->getObject("NullDriverDedicatedDispatchQueue"));
+        if (dedicatedQueueProperty != nullptr)
+        {
+            dedicatedQueue = (dedicatedQueueProperty == kOSBooleanTrue);
+        }
+        OSSafeReleaseNULL(properties);
+    }
+
+    if (dedicatedQueue || (ivars->owner->ivars->shardCount == 0))
+    {
+        ret = IODispatchQueue::Create("NullDriverClientQueue", 0, 0, &ivars->dispatchQueue);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("StartUserClient() - Failed to create dispatch queue with error: 0x%08x.", ret);
+            goto Exit;
+        }
+        ivars->ownsDispatchQueue = true;
+    }
+    else
+    {
+        // The client keeps its own timer source below, so clients that share a queue still arm and cancel their timers independently.
+        ivars->dispatchQueue = ivars->owner->ivars->shardQueues[NullDriverShardForClient(ivars->clientID, ivars->owner->ivars->shardCount)];
+        ivars->dispatchQueue->retain();
+    }
+
     ret = IOTimerDispatchSource::Create(ivars->dispatchQueue, &ivars->dispatchSource);
     if (ret != kIOReturnSuccess)
     {
-        Log("Start() - Failed to create dispatch source with error: 0x%08x.", ret);
+        Log("StartUserClient() - Failed to create dispatch source with error: 0x%08x.", ret);
         goto Exit;
     }
 
     // This sample simulates async events using the IOTimerDispatchSource, which calls the "SimulatedAsyncEvent" method.
-    // The size is to store all of the necessary data for the responses.
+    // The requests waiting for their simulated response live in the in-flight table, so the action doesn't need any reference memory.
     // "CreateActionSimulatedAsyncEvent" was created automatically by the TYPE macro in the .iig file.
     /// - Tag: Start_InitializeSimulatedAsyncDeviceResponseAction
-    ret = CreateActionSimulatedAsyncEvent(sizeof(DataStruct), &ivars->simulatedAsyncDeviceResponseAction);
+    ret = CreateActionSimulatedAsyncEvent(0, &ivars->simulatedAsyncDeviceResponseAction);
     if (ret != kIOReturnSuccess)
     {
-        Log("Start() - Failed to create action for simulated async event with error: 0x%08x.", ret);
+        Log("StartUserClient() - Failed to create action for simulated async event with error: 0x%08x.", ret);
         goto Exit;
     }
-    
+
     // Set up our IOTimerDispatchSource to call our "SimulatedAsyncEvent" method through our OSAction
     ret = ivars->dispatchSource->SetHandler(ivars->simulatedAsyncDeviceResponseAction);
     if (ret != kIOReturnSuccess)
     {
-        Log("Start() - Failed to assign simulated action to handler with error: 0x%08x.", ret);
+        Log("StartUserClient() - Failed to assign simulated action to handler with error: 0x%08x.", ret);
         goto Exit;
     }
 
-    ret = RegisterService();
-    if (ret != kIOReturnSuccess)
+    ivars->stats = IONewZero(NullDriverStats, 1);
+    if (ivars->stats == nullptr)
     {
-        Log("Start() - Failed to register service with error: 0x%08x.", ret);
+        Log("StartUserClient() - Failed to allocate stats.");
+        ret = kIOReturnNoMemory;
         goto Exit;
     }
 
-    Log("Start() - Finished.");
-    ret = kIOReturnSuccess;
+#if NULLDRIVER_TRACE
+    ivars->trace = IONewZero(NullDriverTraceRing, 1);
+    if (ivars->trace == nullptr)
+    {
+        Log("StartUserClient() - Failed to allocate trace ring, calls won't be traced.");
+    }
+#endif
+
+    if (ivars->ownsDispatchQueue)
+    {
+        Log("StartUserClient() - Client %llu started with a dedicated queue.", ivars->clientID);
+    }
+    else
+    {
+        Log("StartUserClient() - Client %llu started on shared queue %u of %u.", ivars->clientID, NullDriverShardForClient(ivars->clientID, ivars->owner->ivars->shardCount), ivars->owner->ivars->shardCount);
+    }
 
 Exit:
     return ret;
@@ -197,6 +506,8 @@ kern_return_t IMPL(NullDriver, Stop)
 
     Log("Stop()");
 
+    DumpTrace();
+
     // Add a cancel count for each of these items that needs to be cancelled.
     if (ivars->simulatedAsyncDeviceResponseAction != nullptr)
     {
@@ -208,11 +519,14 @@ kern_return_t IMPL(NullDriver, Stop)
         ++cancelCount;
     }
 
-    if (ivars->dispatchQueue != nullptr)
+    // A shared queue belongs to the service, which cancels it when it stops.
+    if ((ivars->dispatchQueue != nullptr) && ivars->ownsDispatchQueue)
     {
         ++cancelCount;
     }
 
+    cancelCount += ivars->shardCount;
+
     if (ivars->callbackAction != nullptr)
     {
         ++cancelCount;
@@ -267,11 +581,16 @@ kern_return_t IMPL(NullDriver, Stop)
         ivars->dispatchSource->Cancel(finalize);
     }
 
-    if (ivars->dispatchQueue != nullptr)
+    if ((ivars->dispatchQueue != nullptr) && ivars->ownsDispatchQueue)
     {
         ivars->dispatchQueue->Cancel(finalize);
     }
 
+    for (uint32_t shard = 0; shard < ivars->shardCount; ++shard)
+    {
+        ivars->shardQueues[shard]->Cancel(finalize);
+    }
+
     if (ivars->callbackAction != nullptr)
     {
         ivars->callbackAction->Cancel(finalize);
@@ -289,7 +608,70 @@ void NullDriver::free(void)
     OSSafeReleaseNULL(ivars->simulatedAsyncDeviceResponseAction);
     OSSafeReleaseNULL(ivars->dispatchSource);
     OSSafeReleaseNULL(ivars->dispatchQueue);
+    for (uint32_t shard = 0; shard < kNullDriverMaxShardCount; ++shard)
+    {
+        OSSafeReleaseNULL(ivars->shardQueues[shard]);
+    }
     OSSafeReleaseNULL(ivars->callbackAction);
+    OSSafeReleaseNULL(ivars->submissionRingMap);
+    OSSafeReleaseNULL(ivars->completionRingMap);
+    OSSafeReleaseNULL(ivars->asyncCompletionRingMap);
+    OSSafeReleaseNULL(ivars->submissionRingMemory);
+    OSSafeReleaseNULL(ivars->completionRingMemory);
+    OSSafeReleaseNULL(ivars->asyncCompletionRingMemory);
+    OSSafeReleaseNULL(ivars->completionDoorbellMap);
+    OSSafeReleaseNULL(ivars->completionDoorbellMemory);
+
+    for (uint32_t index = 0; index < kNullDriverRegisteredBufferCount; ++index)
+    {
+        OSSafeReleaseNULL(ivars->registeredBufferMaps[index]);
+        OSSafeReleaseNULL(ivars->registeredBufferMemory[index]);
+    }
+
+    OSSafeReleaseNULL(ivars->streamMap);
+    OSSafeReleaseNULL(ivars->streamMemory);
+
+    OSSafeReleaseNULL(ivars->sampleRingMap);
+    OSSafeReleaseNULL(ivars->sampleRingMemory);
+
+    OSSafeReleaseNULL(ivars->lentOutput);
+    for (OSData* pooled = (OSData*)NullDriverBufferPoolDrain(&ivars->outputPool); pooled != nullptr; pooled = (OSData*)NullDriverBufferPoolDrain(&ivars->outputPool))
+    {
+        pooled->release();
+    }
+
+    if (ivars->inFlightLock != nullptr)
+    {
+        IOLockFree(ivars->inFlightLock);
+        ivars->inFlightLock = nullptr;
+    }
+
+    if (ivars->deviceLock != nullptr)
+    {
+        IOLockFree(ivars->deviceLock);
+        ivars->deviceLock = nullptr;
+    }
+
+    if (ivars->device != nullptr)
+    {
+        IOSafeDeleteNULL(ivars->device, NullDriverDevice, 1);
+    }
+
+    if (ivars->trace != nullptr)
+    {
+        IOSafeDeleteNULL(ivars->trace, NullDriverTraceRing, 1);
+    }
+
+    if (ivars->stats != nullptr)
+    {
+        IOSafeDeleteNULL(ivars->stats, NullDriverStats, 1);
+    }
+
+    if (ivars->owner != nullptr)
+    {
+        __atomic_sub_fetch(&ivars->owner->ivars->clientCount, 1, __ATOMIC_RELAXED);
+        OSSafeReleaseNULL(ivars->owner);
+    }
 
     IOSafeDeleteNULL(ivars, NullDriver_IVars, 1);
 
@@ -326,6 +708,113 @@ Exit:
     return ret;
 }
 
+// When an application maps memory via IOConnectMapMemory64, this method is called to provide the memory to map.
+kern_return_t IMPL(NullDriver, CopyClientMemoryForType)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    IOBufferMemoryDescriptor* ringMemory = nullptr;
+
+    LogDebug("CopyClientMemoryForType() - type %llu", type);
+
+    if (memory == nullptr)
+    {
+        Log("CopyClientMemoryForType() - Memory was null.");
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    // Registered buffers already exist, since they're created by ExternalMethodType_RegisterBuffer.
+    if ((type >= NullDriverMemoryType_RegisteredBuffer) && (type < NullDriverMemoryType_RegisteredBuffer + kNullDriverRegisteredBufferCount))
+    {
+        ringMemory = ivars->registeredBufferMemory[type - NullDriverMemoryType_RegisteredBuffer];
+        if (ringMemory == nullptr)
+        {
+            Log("CopyClientMemoryForType() - No buffer is registered at index %llu.", type - NullDriverMemoryType_RegisteredBuffer);
+            ret = kIOReturnNotFound;
+            goto Exit;
+        }
+
+        ringMemory->retain();
+        *memory = ringMemory;
+        goto Exit;
+    }
+
+    // The stream region only exists once ExternalMethodType_StreamBegin has created it.
+    if (type == NullDriverMemoryType_StreamRegion)
+    {
+        ringMemory = ivars->streamMemory;
+        if (ringMemory == nullptr)
+        {
+            Log("CopyClientMemoryForType() - No stream has begun.");
+            ret = kIOReturnNotReady;
+            goto Exit;
+        }
+
+        ringMemory->retain();
+        *memory = ringMemory;
+        goto Exit;
+    }
+
+    // Likewise, the sample ring only exists once ExternalMethodType_StartSamples has created it.
+    if (type == NullDriverMemoryType_SampleRing)
+    {
+        ringMemory = ivars->sampleRingMemory;
+        if (ringMemory == nullptr)
+        {
+            Log("CopyClientMemoryForType() - No sample stream has started.");
+            ret = kIOReturnNotReady;
+            goto Exit;
+        }
+
+        ringMemory->retain();
+        *memory = ringMemory;
+        goto Exit;
+    }
+
+    ret = CreateRings();
+    if (ret != kIOReturnSuccess)
+    {
+        goto Exit;
+    }
+
+    switch (type)
+    {
+        case NullDriverMemoryType_SubmissionRing:
+        {
+            ringMemory = ivars->submissionRingMemory;
+        } break;
+
+        case NullDriverMemoryType_CompletionRing:
+        {
+            ringMemory = ivars->completionRingMemory;
+        } break;
+
+        case NullDriverMemoryType_AsyncCompletionRing:
+        {
+            ringMemory = ivars->asyncCompletionRingMemory;
+        } break;
+
+        case NullDriverMemoryType_CompletionDoorbell:
+        {
+            ringMemory = ivars->completionDoorbellMemory;
+        } break;
+
+        default:
+        {
+            Log("CopyClientMemoryForType() - Unknown memory type %llu.", type);
+            ret = kIOReturnBadArgument;
+            goto Exit;
+        }
+    }
+
+    // The caller releases the returned descriptor, so it needs its own reference.
+    ringMemory->retain();
+    *memory = ringMemory;
+
+Exit:
+    return ret;
+}
+
 // MARK: ExternalMethod Handler
 // This method is called when an application calls IOConnectCall...Method.
 // All of the passed inputs and outputs are accessible through the "arguments" variable.
@@ -334,14 +823,16 @@ Exit:
 kern_return_t NullDriver::ExternalMethod(uint64_t selector, IOUserClientMethodArguments* arguments, const IOUserClientMethodDispatch* dispatch, OSObject* target, void* reference)
 {
     kern_return_t ret = kIOReturnSuccess;
+    const uint64_t startTime = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
 
     // Check to make sure that the call doesn't interfere with the minimum of the un-checked methods, for the sake of this example.
-    // Always check to make sure that the selector is not greater than the number of options in the IOUserClientMethodDispatch.
+    // ExternalMethodTable::Find checks the selector against the size of the table, so an out-of-range selector gets no dispatch and fails in super.
     if (selector >= ExternalMethodType_CheckedScalar)
     {
-        if (selector < NumberOfExternalMethods)
+        const IOUserClientMethodDispatch* checks = ExternalMethodTable::Find(selector);
+        if (checks != nullptr)
         {
-            dispatch = &externalMethodChecks[selector];
+            dispatch = checks;
             if (!target)
             {
                 target = this;
@@ -349,7 +840,8 @@ kern_return_t NullDriver::ExternalMethod(uint64_t selector, IOUserClientMethodAr
         }
 
         // This will call the functions as defined in the IOUserClientMethodDispatch.
-        return super::ExternalMethod(selector, arguments, dispatch, target, reference);
+        ret = super::ExternalMethod(selector, arguments, dispatch, target, reference);
+        goto Exit;
     }
 
     switch (selector)
@@ -370,9 +862,74 @@ kern_return_t NullDriver::ExternalMethod(uint64_t selector, IOUserClientMethodAr
         } break;
     }
 
+Exit:
+    if (arguments != nullptr)
+    {
+        const uint64_t endTime = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
+
+        // The struct input size, whichever way it arrived.
+        uint64_t structureInputSize = 0;
+        if (arguments->structureInput != nullptr)
+        {
+            structureInputSize = arguments->structureInput->getLength();
+        }
+        else if (arguments->structureInputDescriptor != nullptr)
+        {
+            arguments->structureInputDescriptor->GetLength(&structureInputSize);
+        }
+
+        if (ivars->stats != nullptr)
+        {
+            // A descriptor output is counted at the size the caller allowed, since the handlers fill it completely.
+            uint64_t bytesIn = arguments->scalarInputCount * sizeof(uint64_t) + structureInputSize;
+            uint64_t bytesOut = arguments->scalarOutputCount * sizeof(uint64_t);
+            if (arguments->structureOutput != nullptr)
+            {
+                bytesOut += arguments->structureOutput->getLength();
+            }
+            else if (arguments->structureOutputDescriptor != nullptr)
+            {
+                bytesOut += arguments->structureOutputMaximumSize;
+            }
+
+            // The selector is 64 bits, so it's range checked before it's used as a slot. Anything else the dext doesn't have shares one slot.
+            const uint32_t statsSelector = (selector < NumberOfExternalMethods) ? (uint32_t)selector : kNullDriverStatsSelector_Invalid;
+            NullDriverStatsRecord(ivars->stats, statsSelector, ret != kIOReturnSuccess, bytesIn, bytesOut, endTime - startTime);
+        }
+
+#if NULLDRIVER_TRACE
+        if (ivars->trace != nullptr)
+        {
+            NullDriverTraceRecordCall(ivars->trace, endTime, (uint32_t)selector, ret, structureInputSize);
+        }
+#endif
+    }
+
     return ret;
 }
 
+void NullDriver::DumpTrace(void)
+{
+#if NULLDRIVER_TRACE
+    // Only the most recent calls are logged. The rest are still counted, since every record carries its position in the trace.
+    static const uint32_t kDumpedRecordCount = 64;
+    NullDriverTraceRecord records[kDumpedRecordCount];
+    uint32_t count = 0;
+
+    if (ivars->trace == nullptr)
+    {
+        return;
+    }
+
+    count = NullDriverTraceSnapshot(ivars->trace, records, kDumpedRecordCount);
+    Log("DumpTrace() - Client %llu made %llu calls, the last %u are:", ivars->clientID, __atomic_load_n(&ivars->trace->next, __ATOMIC_RELAXED), count);
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        Log("\t#%llu at %llu: selector %u, status 0x%08x, size %llu", records[index].sequence, records[index].timestamp, records[index].selector, records[index].status, records[index].size);
+    }
+#endif
+}
+
 // MARK: Unsafe External Handlers
 kern_return_t NullDriver::HandleExternalScalar(IOUserClientMethodArguments* arguments)
 {
@@ -381,7 +938,7 @@ kern_return_t NullDriver::HandleExternalScalar(IOUserClientMethodArguments* argu
     uint8_t outputCount = 0;
     uint8_t iterCount = 0;
 
-    Log("Got action type scalar");
+    LogDebug("Got action type scalar");
 
     if (arguments == nullptr)
     {
@@ -426,7 +983,7 @@ kern_return_t NullDriver::HandleExternalScalar(IOUserClientMethodArguments* argu
     for (int16_t index = 0; index < iterCount; ++index)
     {
         arguments->scalarOutput[index] = arguments->scalarInput[index] + 1;
-        Log("%llu %llu", arguments->scalarInput[index], arguments->scalarOutput[index]);
+        LogTrace("%llu %llu", arguments->scalarInput[index], arguments->scalarOutput[index]);
     }
 
 Exit:
@@ -438,13 +995,14 @@ kern_return_t NullDriver::HandleExternalStruct(IOUserClientMethodArguments* argu
     kern_return_t ret = kIOReturnSuccess;
 
     DataStruct* input = nullptr;
+    uint64_t inputSize = 0;
     DataStruct output = {};
 
     IOMemoryMap* inputMap = nullptr;
     IOMemoryMap* outputMap = nullptr;
 
 
-    Log("Got action type struct");
+    LogDebug("Got action type struct");
 
     if (arguments == nullptr)
     {
@@ -456,6 +1014,7 @@ kern_return_t NullDriver::HandleExternalStruct(IOUserClientMethodArguments* argu
     if (arguments->structureInput != nullptr)
     {
         input = (DataStruct*)arguments->structureInput->getBytesNoCopy();
+        inputSize = arguments->structureInput->getLength();
     }
     else if (arguments->structureInputDescriptor != nullptr)
     {
@@ -469,6 +1028,7 @@ kern_return_t NullDriver::HandleExternalStruct(IOUserClientMethodArguments* argu
         }
 
         input = (DataStruct*)inputMap->GetAddress();
+        inputSize = inputMap->GetLength();
     }
     else
     {
@@ -483,11 +1043,18 @@ kern_return_t NullDriver::HandleExternalStruct(IOUserClientMethodArguments* argu
         ret = kIOReturnBadArgument;
         goto Exit;
     }
-    Log("Input - %llu, %llu", input->foo, input->bar);
 
-    output.foo = input->foo + 1;
-    output.bar = input->bar + 10;
-    Log("Output - %llu, %llu", output.foo, output.bar);
+    // Only the leading DataStruct is read, but the input still has to hold that much. Larger payloads belong in a stream instead.
+    if (inputSize < sizeof(DataStruct))
+    {
+        Log("Input of size %llu is smaller than a DataStruct.", inputSize);
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+    LogDebug("Input - %llu, %llu", input->foo, input->bar);
+
+    NullDriverTransformDataStructs(input, &output, 1);
+    LogDebug("Output - %llu, %llu", output.foo, output.bar);
 
     // Memory is not passed from the caller into the dext.
     // The dext needs to create its own OSData to hold this information in order to pass it back to the caller.
@@ -496,18 +1063,28 @@ kern_return_t NullDriver::HandleExternalStruct(IOUserClientMethodArguments* argu
         if (sizeof(OversizedDataStruct) > arguments->structureOutputMaximumSize)
         {
             Log("Required output size of %lu is larger than the given maximum size of %llu. Failing.", sizeof(OversizedDataStruct), arguments->structureOutputMaximumSize);
+            ret = kIOReturnNoSpace;
+            goto Exit;
         }
 
-        arguments->structureOutputDescriptor->CreateMapping(0, 0, 0, 0, 0, &outputMap);
-        uint8_t* outputPtr = (uint8_t*)outputMap->GetAddress();
-
-        // Copy the data from DataStruct over and then fill the rest with zeroes.
-        memcpy(outputPtr, &output, sizeof(DataStruct));
+        ret = arguments->structureOutputDescriptor->CreateMapping(0, 0, 0, 0, 0, &outputMap);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to create mapping for output descriptor with error: 0x%08x", ret);
+            PrintExtendedErrorInfo(ret);
+            ret = kIOReturnBadArgument;
+            goto Exit;
+        }
+
+        uint8_t* outputPtr = (uint8_t*)outputMap->GetAddress();
+
+        // Copy the data from DataStruct over and then fill the rest with zeroes.
+        memcpy(outputPtr, &output, sizeof(DataStruct));
         memset(outputPtr + sizeof(DataStruct), 0, sizeof(OversizedDataStruct) - sizeof(DataStruct));
     }
     else
     {
-        arguments->structureOutput = OSData::withBytes(&output, sizeof(DataStruct));
+        ret = SetStructureOutput(arguments, &output, sizeof(DataStruct));
     }
 
 Exit:
@@ -517,47 +1094,6 @@ Exit:
     return ret;
 }
 
-//MARK: Static External Handlers
-kern_return_t NullDriver::StaticHandleExternalCheckedScalar(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
-{
-    if (target == nullptr)
-    {
-        return kIOReturnError;
-    }
-
-    return ((NullDriver*)target)->HandleExternalCheckedScalar(reference, arguments);
-}
-
-kern_return_t NullDriver::StaticHandleExternalCheckedStruct(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
-{
-    if (target == nullptr)
-    {
-        return kIOReturnError;
-    }
-
-    return ((NullDriver*)target)->HandleExternalCheckedStruct(reference, arguments);
-}
-
-kern_return_t NullDriver::StaticRegisterAsyncCallback(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
-{
-    if (target == nullptr)
-    {
-        return kIOReturnError;
-    }
-
-    return ((NullDriver*)target)->RegisterAsyncCallback(reference, arguments);
-}
-
-kern_return_t NullDriver::StaticHandleAsyncRequest(OSObject* target, void* reference, IOUserClientMethodArguments* arguments)
-{
-    if (target == nullptr)
-    {
-        return kIOReturnError;
-    }
-
-    return ((NullDriver*)target)->HandleAsyncRequest(reference, arguments);
-}
-
 // MARK: Safer External Handlers
 kern_return_t NullDriver::HandleExternalCheckedScalar(void* reference, IOUserClientMethodArguments* arguments)
 {
@@ -565,12 +1101,12 @@ kern_return_t NullDriver::HandleExternalCheckedScalar(void* reference, IOUserCli
 
     kern_return_t ret = kIOReturnSuccess;
 
-    Log("Got action type checked scalar");
+    LogDebug("Got action type checked scalar");
 
     for (int16_t index = 0; index < arguments->scalarOutputCount; ++index)
     {
         arguments->scalarOutput[index] = arguments->scalarInput[index] + 1;
-        Log("%llu %llu", arguments->scalarInput[index], arguments->scalarOutput[index]);
+        LogTrace("%llu %llu", arguments->scalarInput[index], arguments->scalarOutput[index]);
     }
 
     return ret;
@@ -585,21 +1121,115 @@ kern_return_t NullDriver::HandleExternalCheckedStruct(void* reference, IOUserCli
     DataStruct* input = nullptr;
     DataStruct output = {};
 
-    Log("Got action type checked struct");
+    LogDebug("Got action type checked struct");
 
     input = (DataStruct*)arguments->structureInput->getBytesNoCopy();
 
-    output.foo = input->foo + 1;
-    output.bar = input->bar + 10;
+    NullDriverTransformDataStructs(input, &output, 1);
+
+    ret = SetStructureOutput(arguments, &output, sizeof(DataStruct));
+
+    return ret;
+}
+
+kern_return_t NullDriver::HandleExternalCheckedStructBatch(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch only checked the argument counts, since both sizes are variable.
+    // The sizes themselves still need to be validated here.
+
+    kern_return_t ret = kIOReturnSuccess;
+
+    const DataStruct* input = nullptr;
+    uint64_t inputSize = 0;
+    uint32_t count = 0;
+
+    IOMemoryMap* inputMap = nullptr;
+    IOMemoryMap* outputMap = nullptr;
+
+    // Inputs larger than a page arrive in a memory descriptor instead of an OSData.
+    if (arguments->structureInput != nullptr)
+    {
+        input = (const DataStruct*)arguments->structureInput->getBytesNoCopy();
+        inputSize = arguments->structureInput->getLength();
+    }
+    else if (arguments->structureInputDescriptor != nullptr)
+    {
+        ret = arguments->structureInputDescriptor->CreateMapping(0, 0, 0, 0, 0, &inputMap);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to create mapping for batch input descriptor with error: 0x%08x", ret);
+            PrintExtendedErrorInfo(ret);
+            ret = kIOReturnBadArgument;
+            goto Exit;
+        }
+
+        input = (const DataStruct*)inputMap->GetAddress();
+        inputSize = inputMap->GetLength();
+    }
+
+    if (input == nullptr)
+    {
+        Log("Batch input was null.");
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    if ((inputSize == 0) || ((inputSize % sizeof(DataStruct)) != 0) || (inputSize > kNullDriverMaxStructBatchCount * sizeof(DataStruct)))
+    {
+        Log("Batch input size of %llu is not between 1 and %u DataStructs.", inputSize, kNullDriverMaxStructBatchCount);
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    count = (uint32_t)(inputSize / sizeof(DataStruct));
+
+    // The reply is as large as the input, whether it goes into a descriptor or inline.
+    // A caller that sent its input in a descriptor but gave no output descriptor has no room for it.
+    if (inputSize > arguments->structureOutputMaximumSize)
+    {
+        Log("Batch output of size %llu is larger than the given maximum size of %llu.", inputSize, arguments->structureOutputMaximumSize);
+        ret = kIOReturnNoSpace;
+        goto Exit;
+    }
+
+    // Outputs larger than a page have to be written to the caller's memory descriptor.
+    // Smaller ones are returned in a new OSData, which is filled by copying the input and transforming it in place.
+    if (arguments->structureOutputDescriptor != nullptr)
+    {
+        ret = arguments->structureOutputDescriptor->CreateMapping(0, 0, 0, 0, 0, &outputMap);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to create mapping for batch output descriptor with error: 0x%08x", ret);
+            PrintExtendedErrorInfo(ret);
+            ret = kIOReturnBadArgument;
+            goto Exit;
+        }
+
+        NullDriverTransformDataStructs(input, (DataStruct*)outputMap->GetAddress(), count);
+    }
+    else
+    {
+        ret = SetStructureOutput(arguments, input, inputSize);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to allocate batch output.");
+            goto Exit;
+        }
+
+        DataStruct* output = (DataStruct*)arguments->structureOutput->getBytesNoCopy();
+        NullDriverTransformDataStructs(output, output, count);
+    }
 
-    arguments->structureOutput = OSData::withBytes(&output, sizeof(DataStruct));
+Exit:
+    OSSafeReleaseNULL(inputMap);
+    OSSafeReleaseNULL(outputMap);
 
     return ret;
 }
 
 kern_return_t NullDriver::RegisterAsyncCallback(void* reference, IOUserClientMethodArguments* arguments)
 {
-    Log("Got new async callback");
+    LogDebug("Got new async callback");
 
     DataStruct* input = nullptr;
     DataStruct output = {};
@@ -613,8 +1243,16 @@ kern_return_t NullDriver::RegisterAsyncCallback(void* reference, IOUserClientMet
 
     // Save the completion for later.
     // If not saved, then it might be freed before the asychronous return.
+    // A completion registered earlier is replaced, under the lock so SimulatedAsyncEvent never sees it half-released.
+    OSAction* previousAction = nullptr;
+    arguments->completion->retain();
+
+    IOLockLock(ivars->inFlightLock);
+    previousAction = ivars->callbackAction;
     ivars->callbackAction = arguments->completion;
-    ivars->callbackAction->retain();
+    IOLockUnlock(ivars->inFlightLock);
+
+    OSSafeReleaseNULL(previousAction);
 
     // All of this is returned synchronously.
     // This is provided for the sake of example.
@@ -622,75 +1260,1051 @@ kern_return_t NullDriver::RegisterAsyncCallback(void* reference, IOUserClientMet
     /// - Tag: RegisterAsyncCallback_CallCompletion
     input = (DataStruct*)arguments->structureInput->getBytesNoCopy();
 
-    // Retain action memory for later work.
-    void* osActionRetainedMemory = ivars->simulatedAsyncDeviceResponseAction->GetReference();
-    memcpy(osActionRetainedMemory, input, sizeof(DataStruct));
-
-    output.foo = input->foo + 1;
-    output.bar = input->bar + 10;
-
-    arguments->structureOutput = OSData::withBytes(&output, sizeof(DataStruct));
+    NullDriverTransformDataStructs(input, &output, 1);
 
-    // Dispatch action that waits five to seven seconds and then calls the callback.
-    const uint64_t fiveSecondsInNanoSeconds = 5000000000;
-    const uint64_t twoSecondsInNanoSeconds = 2000000000;
-    uint64_t currentTime = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
-
-    Log("Sleeping async...");
-    ivars->dispatchSource->WakeAtTime(kIOTimerClockMonotonicRaw, currentTime + fiveSecondsInNanoSeconds, twoSecondsInNanoSeconds);
+    kern_return_t ret = SetStructureOutput(arguments, &output, sizeof(DataStruct));
+    if (ret != kIOReturnSuccess)
+    {
+        return ret;
+    }
 
-    return kIOReturnSuccess;
+    // Queue a simulated response that calls the callback after five seconds.
+    LogDebug("Sleeping async...");
+    return QueueSimulatedCompletion(kInternalTagBit | ivars->nextInternalTag++, AsyncCompletionType_RegisterAsyncCallback, input->foo, input->bar, kDefaultSimulatedDelay);
 }
 
 kern_return_t NullDriver::HandleAsyncRequest(void* reference, IOUserClientMethodArguments* arguments)
 {
-    Log("Got action type async.");
+    LogDebug("Got action type async.");
 
     // This function executes synchronously and blocks the caller,
     // so it needs to check its inputs as fast as possible,
     // and then spawn a worker thread to take care of any nonblocking work.
     DataStruct* inputPtr = (DataStruct*)arguments->structureInput->getBytesNoCopy();
 
-    if (ivars->callbackAction == nullptr)
+    if (!HasCallbackAction(ivars))
     {
         Log("Callback action not available.");
         return kIOReturnError;
     }
 
-    // Retain action memory for later work.
-    void* osActionRetainedMemory = ivars->simulatedAsyncDeviceResponseAction->GetReference();
-    memcpy(osActionRetainedMemory, inputPtr, sizeof(DataStruct));
+    // Queue a simulated response that calls the callback after five seconds.
+    // Every request gets its own tag, so a second request no longer replaces the first.
+    LogDebug("Sleeping async...");
+    return QueueSimulatedCompletion(kInternalTagBit | ivars->nextInternalTag++, AsyncCompletionType_AsyncRequest, inputPtr->foo, inputPtr->bar, kDefaultSimulatedDelay);
+}
+
+kern_return_t NullDriver::HandleTaggedAsyncRequest(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // This function was checked by IOUserClientMethodDispatch, so it doesn't need to validate the argument counts.
+    // The values themselves still come from the client.
+
+    const uint64_t tag = arguments->scalarInput[0];
+    uint64_t delay = arguments->scalarInput[1];
+    const DataStruct* input = (const DataStruct*)arguments->structureInput->getBytesNoCopy();
+
+    if (!HasCallbackAction(ivars))
+    {
+        Log("Callback action not available.");
+        return kIOReturnNotReady;
+    }
+
+    if ((tag & kInternalTagBit) != 0)
+    {
+        Log("Tag 0x%llx uses the bit reserved for the dext's own tags.", tag);
+        return kIOReturnBadArgument;
+    }
+
+    if (delay > kMaxSimulatedDelay)
+    {
+        delay = kMaxSimulatedDelay;
+    }
+
+    return QueueSimulatedCompletion(tag, AsyncCompletionType_TaggedAsyncRequest, input->foo, input->bar, delay);
+}
+
+kern_return_t NullDriver::HandleSetCompletionMode(void* reference, IOUserClientMethodArguments* arguments)
+{
+    const uint64_t mode = arguments->scalarInput[0];
 
-    // Dispatch action that waits five to seven seconds and then calls the callback.
-    const uint64_t fiveSecondsInNanoSeconds = 5000000000;
-    const uint64_t twoSecondsInNanoSeconds = 2000000000;
-    uint64_t currentTime = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
+    if (mode >= NumberOfNullDriverCompletionModes)
+    {
+        Log("Unknown completion mode %llu.", mode);
+        return kIOReturnBadArgument;
+    }
 
-    Log("Sleeping async...");
-    ivars->dispatchSource->WakeAtTime(kIOTimerClockMonotonicRaw, currentTime + fiveSecondsInNanoSeconds, twoSecondsInNanoSeconds);
+    // SimulatedAsyncEvent reads this on the dispatch queue, so a change applies from its next wakeup.
+    __atomic_store_n(&ivars->completionMode, (uint32_t)mode, __ATOMIC_RELAXED);
 
     return kIOReturnSuccess;
 }
 
-// MARK: SimulatedAsyncEvent Callback
-void IMPL(NullDriver, SimulatedAsyncEvent)
+kern_return_t NullDriver::HandleConfigureDevice(void* reference, IOUserClientMethodArguments* arguments)
 {
-    Log("Woke async at time: %llu!", time);
+    // IOUserClientMethodDispatch checked the structure size. The values in it still come from the client.
 
-    // Get back our data previously stored in OSAction.
-    DataStruct* input = (DataStruct*)action->GetReference();
+    const NullDriverDeviceConfig* config = (const NullDriverDeviceConfig*)arguments->structureInput->getBytesNoCopy();
+    NullDriver_IVars* service = ivars->owner->ivars;
+    NullDriverDeviceConfig previous = {};
 
-    DataStruct output = {};
-    output.foo = input->foo + 1;
-    output.bar = input->bar + 10;
+    if (!NullDriverDeviceConfigIsValid(config))
+    {
+        Log("Simulated device configuration with model %u, %u channels and queue depth %u is not valid.", config->model, config->channelCount, config->queueDepth);
+        return kIOReturnBadArgument;
+    }
 
-    uint64_t asyncData[3] = { 2 };
-    memcpy(asyncData + 1, &output, sizeof(DataStruct));
+    // Requests already in flight keep their completion times. Only requests that arrive from now on see the new model.
+    // The replaced configuration is read under the same lock, so a client that puts it back afterwards restores exactly what it replaced.
+    IOLockLock(service->deviceLock);
+    previous = service->device->config;
+    NullDriverDeviceConfigure(service->device, config);
+    IOLockUnlock(service->deviceLock);
 
-    if (ivars->callbackAction != nullptr)
+    Log("Client %llu configured the simulated device with model %u, %u channels and queue depth %u.", ivars->clientID, config->model, config->channelCount, config->queueDepth);
+
+    return SetStructureOutput(arguments, &previous, sizeof(NullDriverDeviceConfig));
+}
+
+kern_return_t NullDriver::HandleQueryCapabilities(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch checked the output size, and there's no input.
+
+    NullDriverCapabilities capabilities = {};
+
+    capabilities.version = kNullDriverProtocolVersion;
+    capabilities.selectorCount = NumberOfExternalMethods;
+    capabilities.transports = NullDriverTransport_Call | NullDriverTransport_Batch | NullDriverTransport_SharedRing | NullDriverTransport_RegisteredBuffer |
+                              NullDriverTransport_Stream | NullDriverTransport_SharedPageCompletion | NullDriverTransport_SampleStream | NullDriverTransport_ScatterGather;
+    capabilities.maxBatchCount = kNullDriverMaxStructBatchCount;
+    capabilities.payloadAlignment = kNullDriverRegisteredBufferAlignment;
+    capabilities.inlineStructureSize = kNullDriverInlineStructureSize;
+    capabilities.ringEntryCount = kNullDriverRingEntryCount;
+
+    return SetStructureOutput(arguments, &capabilities, sizeof(NullDriverCapabilities));
+}
+
+kern_return_t NullDriver::HandleCopyStats(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch only checked the argument counts, since the output size is variable.
+
+    kern_return_t ret = kIOReturnSuccess;
+    IOMemoryMap* outputMap = nullptr;
+
+    if (ivars->stats == nullptr)
+    {
+        Log("Stats are only kept for user clients.");
+        ret = kIOReturnNotReady;
+        goto Exit;
+    }
+
+    if ((arguments->structureOutputDescriptor == nullptr) || (arguments->structureOutputMaximumSize < sizeof(NullDriverStats)))
+    {
+        Log("Stats output of size %llu is smaller than the required %lu.", arguments->structureOutputMaximumSize, sizeof(NullDriverStats));
+        ret = kIOReturnNoSpace;
+        goto Exit;
+    }
+
+    ret = arguments->structureOutputDescriptor->CreateMapping(0, 0, 0, 0, 0, &outputMap);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("Failed to create mapping for stats output descriptor with error: 0x%08x", ret);
+        PrintExtendedErrorInfo(ret);
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    NullDriverStatsSnapshot(ivars->stats, ivars->clientID, (NullDriverStats*)outputMap->GetAddress());
+    NullDriverBufferPoolCountersSnapshot(&ivars->outputPool, &((NullDriverStats*)outputMap->GetAddress())->outputPool);
+
+Exit:
+    OSSafeReleaseNULL(outputMap);
+
+    return ret;
+}
+
+void NullDriver::SendCoalescedCompletions(OSAction* action, const void* resultsBuffer, uint32_t count, bool sharedPage)
+{
+    const NullDriverCompletionResult* results = (const NullDriverCompletionResult*)resultsBuffer;
+    uint64_t asyncData[kNullDriverAsyncArgumentCountMax];
+    uint32_t sent = 0;
+
+    // A batch too large for one completion goes through the async completion ring, if the client has mapped it.
+    // In shared page mode every batch does, since the client polls that ring.
+    // This runs on the dispatch queue, which is the only producer of that ring.
+    if (((count > kNullDriverCoalescedResultsMax) || sharedPage) && (ivars->asyncCompletionRing != nullptr))
+    {
+        NullDriverRingEntry entries[kSimulatedCompletionBatchSize];
+        uint32_t ringCount = (count > kSimulatedCompletionBatchSize) ? kSimulatedCompletionBatchSize : count;
+
+        for (uint32_t index = 0; index < ringCount; ++index)
+        {
+            entries[index].tag = results[index].tag;
+            entries[index].status = kIOReturnSuccess;
+            entries[index].foo = results[index].foo;
+            entries[index].bar = results[index].bar;
+        }
+
+        sent = NullDriverRingProduce(ivars->asyncCompletionRing, &ivars->asyncCompletionHead, entries, ringCount);
+
+        // A client that is polling sees the new head by itself, so it only needs a notification if it has parked.
+        const bool notify = !sharedPage || (ivars->completionDoorbell == nullptr) || NullDriverDoorbellShouldNotify(ivars->completionDoorbell);
+        if ((sent != 0) && notify)
+        {
+            asyncData[0] = AsyncCompletionType_AsyncCompletionRing;
+            asyncData[1] = sent;
+            AsyncCompletion(action, kIOReturnSuccess, asyncData, 2);
+        }
+    }
+
+    // Whatever didn't go through the ring is packed into the completion arguments instead.
+    // In shared page mode that only happens if the ring is full or not mapped yet.
+    while (sent < count)
+    {
+        uint32_t chunk = count - sent;
+        if (chunk > kNullDriverCoalescedResultsMax)
+        {
+            chunk = kNullDriverCoalescedResultsMax;
+        }
+
+        uint32_t argumentCount = NullDriverCompletionPack(asyncData, AsyncCompletionType_CoalescedResults, results + sent, chunk);
+        AsyncCompletion(action, kIOReturnSuccess, asyncData, argumentCount);
+        sent += chunk;
+    }
+}
+
+kern_return_t NullDriver::QueueSimulatedCompletion(uint64_t tag, uint64_t type, uint64_t foo, uint64_t bar, uint64_t delay)
+{
+    kern_return_t ret = kIOReturnSuccess;
+    NullDriverInFlightEntry entry = {};
+    NullDriverInFlightResult result = NullDriverInFlightResult_Success;
+    NullDriver_IVars* service = ivars->owner->ivars;
+    bool admitted = true;
+
+    entry.tag = tag;
+    entry.type = type;
+    entry.foo = foo;
+    entry.bar = bar;
+
+    IOLockLock(ivars->inFlightLock);
+
+    // The table is checked before the device, so a request the table would refuse never takes up one of the device's channels.
+    if (NullDriverInFlightTableFind(&ivars->inFlight, tag) != kNullDriverInFlightSlotCount)
+    {
+        result = NullDriverInFlightResult_Duplicate;
+    }
+    else if (ivars->inFlight.count >= kNullDriverInFlightCapacity)
+    {
+        result = NullDriverInFlightResult_Full;
+    }
+    else
+    {
+        // The clock is read under the device lock, so requests from every client reach the device in the order they arrived.
+        IOLockLock(service->deviceLock);
+        admitted = NullDriverDeviceAdmit(service->device, clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW), delay, &entry.deadline);
+        IOLockUnlock(service->deviceLock);
+
+        if (admitted)
+        {
+            result = NullDriverInFlightTableInsert(&ivars->inFlight, &entry);
+        }
+    }
+
+    if (admitted && (result == NullDriverInFlightResult_Success))
+    {
+        // The single timer always targets the earliest deadline in the table. Only move it if this request is due sooner.
+        if ((ivars->armedDeadline == 0) || (entry.deadline < ivars->armedDeadline))
+        {
+            ivars->armedDeadline = entry.deadline;
+            ivars->dispatchSource->WakeAtTime(kIOTimerClockMonotonicRaw, entry.deadline, kSimulatedCompletionLeeway);
+        }
+    }
+
+    IOLockUnlock(ivars->inFlightLock);
+
+    if (!admitted)
+    {
+        // A real device with a full queue turns requests away too. The client is expected to back off and retry.
+        LogDebug("Simulated device queue is full, tag 0x%llx was turned away.", tag);
+        ret = kIOReturnBusy;
+    }
+    else if (result == NullDriverInFlightResult_Duplicate)
+    {
+        Log("Tag 0x%llx is already in flight.", tag);
+        ret = kIOReturnBadArgument;
+    }
+    else if (result == NullDriverInFlightResult_Full)
+    {
+        Log("In-flight table is full with %u requests.", kNullDriverInFlightCapacity);
+        ret = kIOReturnNoResources;
+    }
+
+    return ret;
+}
+
+// MARK: Output Buffer Pool
+// Replies up to a page are returned in an OSData. Instead of a new one for every call, each client keeps a pool of them.
+// External methods run one at a time on the default queue, and a call's reply has been sent by the time the next call starts.
+// So the reply lent out by one call can go back in the pool when the next call asks for a buffer.
+kern_return_t NullDriver::SetStructureOutput(IOUserClientMethodArguments* arguments, const void* bytes, size_t length)
+{
+    const uint32_t sizeClass = NullDriverBufferPoolClassForSize(length);
+    OSData* data = nullptr;
+
+    if ((length == 0) || (sizeClass == kNullDriverBufferPoolClassCount))
+    {
+        Log("Inline output of size %lu is not between 1 and %u bytes.", length, kNullDriverBufferPoolClassSizes[kNullDriverBufferPoolClassCount - 1]);
+        return kIOReturnBadArgument;
+    }
+
+    RecycleLentOutput();
+
+    // An OSData can't be resized, so a pooled one of the right class but the wrong length is replaced, and counted as a miss.
+    data = (OSData*)NullDriverBufferPoolAcquire(&ivars->outputPool, sizeClass);
+    if ((data != nullptr) && (data->getLength() != length))
+    {
+        OSSafeReleaseNULL(data);
+        NullDriverBufferPoolCountMismatch(&ivars->outputPool);
+    }
+
+    if (data == nullptr)
+    {
+        data = OSData::withBytes(bytes, length);
+        if (data == nullptr)
+        {
+            return kIOReturnNoMemory;
+        }
+        NullDriverBufferPoolCountAllocation(&ivars->outputPool);
+    }
+    else
+    {
+        memcpy((void*)data->getBytesNoCopy(), bytes, length);
+    }
+
+    // The reply's reference is released once it's sent. The extra one keeps the OSData alive for the pool.
+    data->retain();
+    arguments->structureOutput = data;
+    ivars->lentOutput = data;
+    ivars->lentOutputClass = sizeClass;
+
+    return kIOReturnSuccess;
+}
+
+void NullDriver::RecycleLentOutput(void)
+{
+    if (ivars->lentOutput == nullptr)
+    {
+        return;
+    }
+
+    if (!NullDriverBufferPoolRelease(&ivars->outputPool, ivars->lentOutputClass, ivars->lentOutput))
+    {
+        ivars->lentOutput->release();
+    }
+    ivars->lentOutput = nullptr;
+}
+
+// MARK: Registered Buffers
+kern_return_t NullDriver::HandleRegisterBuffer(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch checked the argument counts. The size still comes from the client.
+
+    kern_return_t ret = kIOReturnSuccess;
+    const uint64_t size = arguments->scalarInput[0];
+    uint32_t index = NullDriverRegisteredBufferFindFree(&ivars->registeredBuffers);
+    IOBufferMemoryDescriptor* bufferMemory = nullptr;
+    IOMemoryMap* bufferMap = nullptr;
+
+    if ((size == 0) || (size > kNullDriverRegisteredBufferMaxSize) || ((size % kNullDriverRegisteredBufferAlignment) != 0))
+    {
+        Log("Registered buffer size of %llu is not a multiple of %u up to %u.", size, kNullDriverRegisteredBufferAlignment, kNullDriverRegisteredBufferMaxSize);
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    if (index == kNullDriverRegisteredBufferCount)
+    {
+        Log("All %u registered buffers are in use.", kNullDriverRegisteredBufferCount);
+        ret = kIOReturnNoResources;
+        goto Exit;
+    }
+
+    ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, size, 0, &bufferMemory);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("Failed to create registered buffer of size %llu with error: 0x%08x.", size, ret);
+        goto Exit;
+    }
+
+    bufferMemory->SetLength(size);
+
+    // This is the mapping that every later request reuses.
+    ret = bufferMemory->CreateMapping(0, 0, 0, 0, 0, &bufferMap);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("Failed to map registered buffer with error: 0x%08x.", ret);
+        PrintExtendedErrorInfo(ret);
+        goto Exit;
+    }
+
+    memset((void*)bufferMap->GetAddress(), 0, size);
+
+    ivars->registeredBufferMemory[index] = bufferMemory;
+    ivars->registeredBufferMaps[index] = bufferMap;
+    ivars->registeredBuffers.addresses[index] = bufferMap->GetAddress();
+    ivars->registeredBuffers.lengths[index] = size;
+    bufferMemory = nullptr;
+    bufferMap = nullptr;
+
+    arguments->scalarOutput[0] = index;
+    LogDebug("Registered buffer %u of size %llu.", index, size);
+
+Exit:
+    OSSafeReleaseNULL(bufferMap);
+    OSSafeReleaseNULL(bufferMemory);
+
+    return ret;
+}
+
+kern_return_t NullDriver::HandleUnregisterBuffer(void* reference, IOUserClientMethodArguments* arguments)
+{
+    const uint64_t index = arguments->scalarInput[0];
+
+    if ((index >= kNullDriverRegisteredBufferCount) || (ivars->registeredBufferMemory[index] == nullptr))
+    {
+        Log("No buffer is registered at index %llu.", index);
+        return kIOReturnNotFound;
+    }
+
+    // A mapping the client still holds keeps its own reference to the memory, so releasing ours can't pull memory out from under it.
+    ivars->registeredBuffers.addresses[index] = 0;
+    ivars->registeredBuffers.lengths[index] = 0;
+    OSSafeReleaseNULL(ivars->registeredBufferMaps[index]);
+    OSSafeReleaseNULL(ivars->registeredBufferMemory[index]);
+
+    return kIOReturnSuccess;
+}
+
+kern_return_t NullDriver::HandleRegisteredStructBatch(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch checked the argument counts. The indices, offsets and length are checked against the registered buffers here.
+    // The client can write to its buffers while this runs, which only changes the result it gets back, since nothing here depends on the contents.
+
+    const uint64_t length = arguments->scalarInput[4];
+    const void* input = NullDriverRegisteredBufferResolve(&ivars->registeredBuffers, arguments->scalarInput[0], arguments->scalarInput[1], length);
+    void* output = NullDriverRegisteredBufferResolve(&ivars->registeredBuffers, arguments->scalarInput[2], arguments->scalarInput[3], length);
+
+    if ((input == nullptr) || (output == nullptr))
+    {
+        Log("Registered batch of %llu bytes is outside the registered buffers.", length);
+        return kIOReturnBadArgument;
+    }
+
+    if ((input != output) && NullDriverRegisteredBufferOverlaps(input, output, length))
+    {
+        Log("Registered batch input and output overlap.");
+        return kIOReturnBadArgument;
+    }
+
+    NullDriverTransformDataStructs(input, output, length / sizeof(DataStruct));
+
+    return kIOReturnSuccess;
+}
+
+kern_return_t NullDriver::HandleScatterGather(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch only checked the argument counts, since both sizes are variable.
+    // A bad segment only fails itself. The call only fails if the list as a whole is malformed.
+
+    const NullDriverScatterGatherHeader* header = nullptr;
+    uint64_t requestSize = 0;
+    uint32_t segmentCount = 0;
+    void* regions[kNullDriverScatterGatherMaxSegments];
+    uint32_t statuses[kNullDriverScatterGatherMaxSegments];
+
+    // The largest list is well under a page, so it always arrives inline. That also makes it the dext's own copy, which the client can't change.
+    if (arguments->structureInput == nullptr)
+    {
+        Log("Scatter-gather list was not passed inline.");
+        return kIOReturnBadArgument;
+    }
+
+    header = (const NullDriverScatterGatherHeader*)arguments->structureInput->getBytesNoCopy();
+    requestSize = arguments->structureInput->getLength();
+    segmentCount = NullDriverScatterGatherSegmentCount(header, requestSize);
+    if (segmentCount == 0)
+    {
+        Log("Scatter-gather list of %llu bytes does not hold between 1 and %u segments.", requestSize, kNullDriverScatterGatherMaxSegments);
+        return kIOReturnBadArgument;
+    }
+
+    if ((arguments->structureOutputDescriptor != nullptr) || (arguments->structureOutputMaximumSize < segmentCount * sizeof(uint32_t)))
+    {
+        Log("Scatter-gather output of %llu bytes can't hold %u statuses.", arguments->structureOutputMaximumSize, segmentCount);
+        return kIOReturnBadArgument;
+    }
+
+    const NullDriverSegment* segments = (const NullDriverSegment*)(header + 1);
+    NullDriverScatterGatherResolve(&ivars->registeredBuffers, segments, segmentCount, regions, statuses);
+
+    // Every segment is transformed where it is, so there's nothing to copy in or out.
+    for (uint32_t index = 0; index < segmentCount; ++index)
+    {
+        if (regions[index] != nullptr)
+        {
+            NullDriverTransformDataStructs(regions[index], regions[index], segments[index].length / sizeof(DataStruct));
+        }
+    }
+
+    return SetStructureOutput(arguments, statuses, segmentCount * sizeof(uint32_t));
+}
+
+// MARK: Chunked Streams
+kern_return_t NullDriver::HandleStreamBegin(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch checked the argument counts. The length and chunk size are checked by NullDriverStreamBegin.
+
+    kern_return_t ret = kIOReturnSuccess;
+    const uint64_t totalLength = arguments->scalarInput[0];
+    const uint64_t chunkSize = arguments->scalarInput[1];
+    NullDriverStreamState stream = {};
+    IOBufferMemoryDescriptor* regionMemory = nullptr;
+    IOMemoryMap* regionMap = nullptr;
+
+    // Progress is only ever reported through the completion, so a stream without one would never finish.
+    if (!HasCallbackAction(ivars))
+    {
+        Log("Callback action not available.");
+        ret = kIOReturnNotReady;
+        goto Exit;
+    }
+
+    // A chunk still being processed is writing to the current region.
+    if (!NullDriverStreamIsIdle(&ivars->stream))
+    {
+        Log("A stream is still processing a chunk.");
+        ret = kIOReturnBusy;
+        goto Exit;
+    }
+
+    if (NullDriverStreamBegin(&stream, totalLength, chunkSize) != NullDriverStreamResult_Success)
+    {
+        Log("Stream of %llu bytes in chunks of %llu is not a multiple of %u up to %llu, in page-sized chunks up to %u.", totalLength, chunkSize, kNullDriverStreamAlignment, kNullDriverStreamMaxLength, kNullDriverStreamMaxChunkSize);
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    // The region is the same size for every stream with the same chunk size, so it's only replaced when that changes.
+    if ((ivars->streamMap == nullptr) || (ivars->streamMap->GetLength() != NullDriverStreamRegionSize(stream.chunkSize)))
+    {
+        ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, NullDriverStreamRegionSize(stream.chunkSize), 0, &regionMemory);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to create stream region with error: 0x%08x.", ret);
+            goto Exit;
+        }
+
+        regionMemory->SetLength(NullDriverStreamRegionSize(stream.chunkSize));
+
+        ret = regionMemory->CreateMapping(0, 0, 0, 0, 0, &regionMap);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to map stream region with error: 0x%08x.", ret);
+            PrintExtendedErrorInfo(ret);
+            goto Exit;
+        }
+
+        memset((void*)regionMap->GetAddress(), 0, NullDriverStreamRegionSize(stream.chunkSize));
+
+        // As with registered buffers, a mapping the client still holds of the old region keeps its own reference.
+        OSSafeReleaseNULL(ivars->streamMap);
+        OSSafeReleaseNULL(ivars->streamMemory);
+        ivars->streamMemory = regionMemory;
+        ivars->streamMap = regionMap;
+        regionMemory = nullptr;
+        regionMap = nullptr;
+
+        LogDebug("Created stream region for chunks of %u bytes.", stream.chunkSize);
+    }
+
+    // Nothing is processing a chunk, so the old stream's state can be replaced as a whole.
+    ivars->stream = stream;
+
+Exit:
+    OSSafeReleaseNULL(regionMap);
+    OSSafeReleaseNULL(regionMemory);
+
+    return ret;
+}
+
+kern_return_t NullDriver::HandleStreamChunk(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch checked the argument counts. The sequence and length are checked by NullDriverStreamSubmit.
+
+    const uint64_t sequence = arguments->scalarInput[0];
+    const uint64_t length = arguments->scalarInput[1];
+    const uint64_t totalLength = ivars->stream.totalLength;
+    uint32_t slot = 0;
+
+    switch (NullDriverStreamSubmit(&ivars->stream, sequence, length, &slot))
+    {
+        case NullDriverStreamResult_Success:
+        {
+        } break;
+
+        case NullDriverStreamResult_Busy:
+        {
+            // The client reuses a slot only after the progress for the chunk before it, so this is a client that didn't wait.
+            Log("Stream chunk %llu arrived before its slot was free.", sequence);
+            return kIOReturnBusy;
+        }
+
+        case NullDriverStreamResult_OutOfOrder:
+        {
+            Log("Stream chunk %llu is not the next chunk of a stream.", sequence);
+            return kIOReturnBadArgument;
+        }
+
+        default:
+        {
+            Log("Stream chunk %llu has the wrong length of %llu.", sequence, length);
+            return kIOReturnBadArgument;
+        }
+    }
+
+    // Return to the caller right away, so it can fill the other slot while this one is processed on the dispatch queue.
+    ivars->dispatchQueue->DispatchAsync(^{
+        ProcessStreamChunk(sequence, slot, length, totalLength);
+    });
+
+    return kIOReturnSuccess;
+}
+
+void NullDriver::ProcessStreamChunk(uint64_t sequence, uint32_t slot, uint64_t length, uint64_t totalLength)
+{
+    // The region can't be replaced while its slot is busy, since HandleStreamBegin waits for every slot to be free.
+    // The client can write to the slot while this runs, which only changes the result it reads back.
+    DataStruct* chunk = (DataStruct*)(ivars->streamMap->GetAddress() + NullDriverStreamSlotOffset(&ivars->stream, slot));
+    OSAction* callbackAction = nullptr;
+    uint64_t completedBytes = 0;
+
+    NullDriverTransformDataStructs(chunk, chunk, length / sizeof(DataStruct));
+    LogTrace("Processed stream chunk %llu in slot %u.", sequence, slot);
+
+    completedBytes = NullDriverStreamComplete(&ivars->stream, slot, length);
+
+    IOLockLock(ivars->inFlightLock);
+    callbackAction = ivars->callbackAction;
+    if (callbackAction != nullptr)
+    {
+        callbackAction->retain();
+    }
+    IOLockUnlock(ivars->inFlightLock);
+
+    if (callbackAction != nullptr)
+    {
+        uint64_t asyncData[4] = { AsyncCompletionType_StreamProgress, sequence, completedBytes, totalLength };
+        AsyncCompletion(callbackAction, kIOReturnSuccess, asyncData, 4);
+    }
+
+    OSSafeReleaseNULL(callbackAction);
+}
+
+// MARK: Sample Stream
+kern_return_t NullDriver::HandleStartSamples(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // IOUserClientMethodDispatch checked the argument counts. The rate and low-water mark still come from the client.
+
+    kern_return_t ret = kIOReturnSuccess;
+    const uint64_t samplesPerSecond = arguments->scalarInput[0];
+    const uint64_t lowWaterMark = arguments->scalarInput[1];
+    IOBufferMemoryDescriptor* ringMemory = nullptr;
+    IOMemoryMap* ringMap = nullptr;
+    uint64_t now = 0;
+
+    if ((samplesPerSecond == 0) || (samplesPerSecond > kNullDriverSampleMaxRate) || (lowWaterMark >= kNullDriverSampleRingEntryCount))
+    {
+        Log("Sample stream of %llu samples per second with a low-water mark of %llu is not between 1 and %llu, below %u.", samplesPerSecond, lowWaterMark, kNullDriverSampleMaxRate, kNullDriverSampleRingEntryCount);
+        ret = kIOReturnBadArgument;
+        goto Exit;
+    }
+
+    // Notifications are the only way the client hears that samples are waiting, apart from polling the ring.
+    if (!HasCallbackAction(ivars))
+    {
+        Log("Callback action not available.");
+        ret = kIOReturnNotReady;
+        goto Exit;
+    }
+
+    // The ring is only created once, so a restarted stream carries on from the indices the client already has.
+    if (ivars->sampleRingMemory == nullptr)
+    {
+        ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(NullDriverSampleRing), 0, &ringMemory);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to create sample ring with error: 0x%08x.", ret);
+            goto Exit;
+        }
+
+        ringMemory->SetLength(sizeof(NullDriverSampleRing));
+
+        ret = ringMemory->CreateMapping(0, 0, 0, 0, 0, &ringMap);
+        if (ret != kIOReturnSuccess)
+        {
+            Log("Failed to map sample ring with error: 0x%08x.", ret);
+            PrintExtendedErrorInfo(ret);
+            goto Exit;
+        }
+
+        memset((void*)ringMap->GetAddress(), 0, sizeof(NullDriverSampleRing));
+
+        // SimulatedAsyncEvent reads the ring pointer under the lock, so it never sees it half set up.
+        IOLockLock(ivars->inFlightLock);
+        ivars->sampleRingMemory = ringMemory;
+        ivars->sampleRingMap = ringMap;
+        ivars->sampleRing = (NullDriverSampleRing*)ringMap->GetAddress();
+        IOLockUnlock(ivars->inFlightLock);
+        ringMemory = nullptr;
+        ringMap = nullptr;
+    }
+
+    // The first samples are written on the next wakeup, so the timer is pulled in to now if it's armed for later.
+    now = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
+
+    IOLockLock(ivars->inFlightLock);
+    ivars->samplesPerSecond = samplesPerSecond;
+    ivars->sampleLowWaterMark = (uint32_t)lowWaterMark;
+    ++ivars->sampleGeneration;
+    if ((ivars->armedDeadline == 0) || (now < ivars->armedDeadline))
+    {
+        ivars->armedDeadline = now;
+        ivars->dispatchSource->WakeAtTime(kIOTimerClockMonotonicRaw, now, kSimulatedCompletionLeeway);
+    }
+    IOLockUnlock(ivars->inFlightLock);
+
+    LogDebug("Started a sample stream of %llu samples per second.", samplesPerSecond);
+
+Exit:
+    OSSafeReleaseNULL(ringMap);
+    OSSafeReleaseNULL(ringMemory);
+
+    return ret;
+}
+
+kern_return_t NullDriver::HandleStopSamples(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // Samples already in the ring stay there for the client to read. The producer stops on its next wakeup.
+    IOLockLock(ivars->inFlightLock);
+    ivars->samplesPerSecond = 0;
+    ++ivars->sampleGeneration;
+    IOLockUnlock(ivars->inFlightLock);
+
+    return kIOReturnSuccess;
+}
+
+// Runs on the dispatch queue, from SimulatedAsyncEvent. Returns when the producer next needs a wakeup, or 0 if it's stopped.
+uint64_t NullDriver::ProduceSamples(OSAction* action, uint64_t now)
+{
+    NullDriverSampleRing* ring = nullptr;
+    uint64_t samplesPerSecond = 0;
+    uint32_t lowWaterMark = 0;
+    uint64_t generation = 0;
+
+    IOLockLock(ivars->inFlightLock);
+    ring = ivars->sampleRing;
+    samplesPerSecond = ivars->samplesPerSecond;
+    lowWaterMark = ivars->sampleLowWaterMark;
+    generation = ivars->sampleGeneration;
+    IOLockUnlock(ivars->inFlightLock);
+
+    if (ring == nullptr)
+    {
+        return 0;
+    }
+
+    if (generation != ivars->sampleProducerGeneration)
+    {
+        NullDriverSampleProducerStart(&ivars->sampleProducer, ring, samplesPerSecond, lowWaterMark, now);
+        ivars->sampleProducerGeneration = generation;
+    }
+
+    // One notification covers every sample in the ring, however many were written since the last one.
+    if (NullDriverSampleProducerRun(&ivars->sampleProducer, ring, now) && (action != nullptr))
+    {
+        uint64_t asyncData[4] = { AsyncCompletionType_SamplesReady, kNullDriverSampleRingEntryCount - NullDriverSampleRingFreeCount(ring, ivars->sampleProducer.head),
+                                  ivars->sampleProducer.generated, ivars->sampleProducer.dropped };
+        AsyncCompletion(action, kIOReturnSuccess, asyncData, 4);
+    }
+
+    return NullDriverSampleProducerNextDeadline(&ivars->sampleProducer, now);
+}
+
+// MARK: Shared Ring Transport
+kern_return_t NullDriver::CreateRings(void)
+{
+    kern_return_t ret = kIOReturnSuccess;
+
+    // All rings are created together the first time any one is mapped, and then live as long as the client.
+    if (ivars->submissionRing != nullptr)
+    {
+        return kIOReturnSuccess;
+    }
+
+    ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(NullDriverRing), 0, &ivars->submissionRingMemory);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to create submission ring memory with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(NullDriverRing), 0, &ivars->completionRingMemory);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to create completion ring memory with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(NullDriverRing), 0, &ivars->asyncCompletionRingMemory);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to create async completion ring memory with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ret = IOBufferMemoryDescriptor::Create(kIOMemoryDirectionInOut, sizeof(NullDriverDoorbell), 0, &ivars->completionDoorbellMemory);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to create completion doorbell memory with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ivars->submissionRingMemory->SetLength(sizeof(NullDriverRing));
+    ivars->completionRingMemory->SetLength(sizeof(NullDriverRing));
+    ivars->asyncCompletionRingMemory->SetLength(sizeof(NullDriverRing));
+    ivars->completionDoorbellMemory->SetLength(sizeof(NullDriverDoorbell));
+
+    ret = ivars->submissionRingMemory->CreateMapping(0, 0, 0, 0, 0, &ivars->submissionRingMap);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to map submission ring with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ret = ivars->completionRingMemory->CreateMapping(0, 0, 0, 0, 0, &ivars->completionRingMap);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to map completion ring with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ret = ivars->asyncCompletionRingMemory->CreateMapping(0, 0, 0, 0, 0, &ivars->asyncCompletionRingMap);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to map async completion ring with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    ret = ivars->completionDoorbellMemory->CreateMapping(0, 0, 0, 0, 0, &ivars->completionDoorbellMap);
+    if (ret != kIOReturnSuccess)
+    {
+        Log("CreateRings() - Failed to map completion doorbell with error: 0x%08x.", ret);
+        goto Exit;
+    }
+
+    memset((void*)ivars->submissionRingMap->GetAddress(), 0, sizeof(NullDriverRing));
+    memset((void*)ivars->completionRingMap->GetAddress(), 0, sizeof(NullDriverRing));
+    memset((void*)ivars->asyncCompletionRingMap->GetAddress(), 0, sizeof(NullDriverRing));
+    memset((void*)ivars->completionDoorbellMap->GetAddress(), 0, sizeof(NullDriverDoorbell));
+
+    ivars->submissionTail = 0;
+    ivars->completionHead = 0;
+    ivars->asyncCompletionHead = 0;
+
+    // Publish the rings last, since the doorbell uses them to decide if the transport is ready.
+    ivars->submissionRing = (NullDriverRing*)ivars->submissionRingMap->GetAddress();
+    ivars->completionRing = (NullDriverRing*)ivars->completionRingMap->GetAddress();
+    ivars->asyncCompletionRing = (NullDriverRing*)ivars->asyncCompletionRingMap->GetAddress();
+    ivars->completionDoorbell = (NullDriverDoorbell*)ivars->completionDoorbellMap->GetAddress();
+
+    Log("CreateRings() - Finished.");
+
+Exit:
+    if (ret != kIOReturnSuccess)
+    {
+        OSSafeReleaseNULL(ivars->submissionRingMap);
+        OSSafeReleaseNULL(ivars->completionRingMap);
+        OSSafeReleaseNULL(ivars->asyncCompletionRingMap);
+        OSSafeReleaseNULL(ivars->submissionRingMemory);
+        OSSafeReleaseNULL(ivars->completionRingMemory);
+        OSSafeReleaseNULL(ivars->asyncCompletionRingMemory);
+        OSSafeReleaseNULL(ivars->completionDoorbellMap);
+        OSSafeReleaseNULL(ivars->completionDoorbellMemory);
+    }
+
+    return ret;
+}
+
+kern_return_t NullDriver::HandleRingDoorbell(void* reference, IOUserClientMethodArguments* arguments)
+{
+    // This function was checked by IOUserClientMethodDispatch, so it doesn't need to validate the arguments.
+
+    if ((ivars->submissionRing == nullptr) || (ivars->completionRing == nullptr))
+    {
+        Log("Doorbell rung before the rings were mapped.");
+        return kIOReturnNotReady;
+    }
+
+    // Only one drain is queued at a time. A doorbell that arrives while a drain is already pending gets picked up by that drain.
+    if (__atomic_exchange_n(&ivars->ringDrainScheduled, true, __ATOMIC_ACQ_REL))
+    {
+        return kIOReturnSuccess;
+    }
+
+    // Return to the caller right away, and do the actual work on the dispatch queue.
+    ivars->dispatchQueue->DispatchAsync(^{
+        DrainSubmissionRing();
+    });
+
+    return kIOReturnSuccess;
+}
+
+void NullDriver::DrainSubmissionRing(void)
+{
+    NullDriverRingEntry entries[kRingDrainBatchSize];
+    uint32_t count = 0;
+
+    // Clear the flag before looking at the ring, so a doorbell that races with this drain schedules another pass instead of being lost.
+    __atomic_store_n(&ivars->ringDrainScheduled, false, __ATOMIC_RELEASE);
+
+    do
+    {
+        // Never take more submissions than there are free completion slots, so no result is ever dropped.
+        // If the completion ring is full, the client rings the doorbell again after it reaps some results.
+        uint32_t budget = NullDriverRingFreeCount(ivars->completionRing, ivars->completionHead);
+        if (budget > kRingDrainBatchSize)
+        {
+            budget = kRingDrainBatchSize;
+        }
+
+        count = NullDriverRingConsume(ivars->submissionRing, &ivars->submissionTail, entries, budget);
+
+        // Each ring entry carries its foo and bar at the same offset, so the whole batch is transformed in one strided pass.
+        NullDriverTransformStrided(&entries[0].foo, &entries[0].foo, count, sizeof(NullDriverRingEntry) / sizeof(uint64_t));
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            entries[index].status = kIOReturnSuccess;
+        }
+
+        NullDriverRingProduce(ivars->completionRing, &ivars->completionHead, entries, count);
+    } while (count != 0);
+}
+
+// MARK: SimulatedAsyncEvent Callback
+void IMPL(NullDriver, SimulatedAsyncEvent)
+{
+    LogDebug("Woke async at time: %llu!", time);
+
+    NullDriverInFlightEntry expired[kSimulatedCompletionBatchSize];
+    NullDriverCompletionResult coalesced[kSimulatedCompletionBatchSize];
+    uint32_t count = 0;
+    uint32_t coalescedCount = 0;
+    uint64_t delivered = 0;
+    const uint64_t startTime = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
+    uint64_t now = 0;
+    OSAction* callbackAction = nullptr;
+    const uint32_t completionMode = __atomic_load_n(&ivars->completionMode, __ATOMIC_RELAXED);
+    const bool coalesce = (completionMode != NullDriverCompletionMode_Single);
+
+    // Hold a reference to this client's completion for the whole wakeup, in case RegisterAsyncCallback replaces it meanwhile.
+    IOLockLock(ivars->inFlightLock);
+    callbackAction = ivars->callbackAction;
+    if (callbackAction != nullptr)
+    {
+        callbackAction->retain();
+    }
+    IOLockUnlock(ivars->inFlightLock);
+
+    // Complete every request that is due, earliest first, not just the one the timer was armed for.
+    // The lock is only held while collecting entries, and never across AsyncCompletion.
+    // The clock is read again for each batch, so requests that came due while the previous batch was sent go out in this wakeup too.
+    do
+    {
+        now = clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW);
+
+        IOLockLock(ivars->inFlightLock);
+        count = NullDriverInFlightTableTakeExpired(&ivars->inFlight, now, expired, kSimulatedCompletionBatchSize);
+        IOLockUnlock(ivars->inFlightLock);
+
+        delivered += count;
+
+        // Each in-flight entry carries its foo and bar at the same offset, so the whole batch is transformed in one strided pass.
+        NullDriverTransformStrided(&expired[0].foo, &expired[0].foo, count, sizeof(NullDriverInFlightEntry) / sizeof(uint64_t));
+
+        for (uint32_t index = 0; index < count; ++index)
+        {
+            if (callbackAction == nullptr)
+            {
+                continue;
+            }
+
+            if ((expired[index].type == AsyncCompletionType_TaggedAsyncRequest) && coalesce)
+            {
+                // Sent together once the whole batch has been transformed.
+                coalesced[coalescedCount].tag = expired[index].tag;
+                coalesced[coalescedCount].foo = expired[index].foo;
+                coalesced[coalescedCount].bar = expired[index].bar;
+                ++coalescedCount;
+            }
+            else if (expired[index].type == AsyncCompletionType_TaggedAsyncRequest)
+            {
+                // 4 is the leading "type" message, the tag, and the two elements of the DataStruct.
+                uint64_t asyncData[4] = { expired[index].type, expired[index].tag, expired[index].foo, expired[index].bar };
+                AsyncCompletion(callbackAction, kIOReturnSuccess, asyncData, 4);
+            }
+            else
+            {
+                // 3 is the 1 leading "type" message plus the two elements of the DataStruct.
+                uint64_t asyncData[3] = { expired[index].type, expired[index].foo, expired[index].bar };
+                AsyncCompletion(callbackAction, kIOReturnSuccess, asyncData, 3);
+            }
+        }
+
+        if (coalescedCount != 0)
+        {
+            SendCoalescedCompletions(callbackAction, coalesced, coalescedCount, completionMode == NullDriverCompletionMode_SharedPage);
+            coalescedCount = 0;
+        }
+    } while (count == kSimulatedCompletionBatchSize);
+
+    // The same timer feeds the sample stream, so a running stream keeps it armed even with nothing in flight.
+    const uint64_t nextSamples = ProduceSamples(callbackAction, now);
+
+    OSSafeReleaseNULL(callbackAction);
+
+    // Re-arm the timer for whatever is due next.
+    IOLockLock(ivars->inFlightLock);
+
+    uint64_t earliest = NullDriverInFlightTableEarliestDeadline(&ivars->inFlight);
+    if ((nextSamples != 0) && (nextSamples < earliest))
+    {
+        earliest = nextSamples;
+    }
+    if (earliest == kNullDriverInFlightNoDeadline)
+    {
+        ivars->armedDeadline = 0;
+    }
+    else
+    {
+        ivars->armedDeadline = earliest;
+        ivars->dispatchSource->WakeAtTime(kIOTimerClockMonotonicRaw, earliest, kSimulatedCompletionLeeway);
+    }
+
+    IOLockUnlock(ivars->inFlightLock);
+
+    // Each wakeup counts as one call, and every result it delivered as a DataStruct out.
+    if (ivars->stats != nullptr)
     {
-        // 3 is the 1 leading "type" message plus the two elements of the DataStruct.
-        AsyncCompletion(ivars->callbackAction, kIOReturnSuccess, asyncData, 3);
+        NullDriverStatsRecord(ivars->stats, kNullDriverStatsSelector_SimulatedAsyncEvent, false, 0, delivered * sizeof(DataStruct), clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW) - startTime);
     }
 }
 
@@ -0,0 +1,141 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A lock-free pool of reusable buffers, with counters that show whether a steady workload still allocates.
+The pool only stores pointers, so the dext can keep OSData objects in it while a test keeps plain memory.
+Buffers are filed by size class, but an OSData can't change its length, so the dext only reuses one whose length is exactly the reply's.
+A buffer of the right class and the wrong length is freed and counted with NullDriverBufferPoolCountMismatch, so replies whose lengths
+keep changing within a class miss the pool, and the counters show it.
+*/
+
+#ifndef NullDriverBufferPool_h
+#define NullDriverBufferPool_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Replies of up to a page are returned inline. Anything larger goes through the caller's memory descriptor, so it never needs a pooled buffer.
+#define kNullDriverBufferPoolClassCount 3U
+static const uint32_t kNullDriverBufferPoolClassSizes[kNullDriverBufferPoolClassCount] = { 16, 256, 4096 };
+
+// The most free buffers kept in each class. Releases beyond this are handed back to the owner to free.
+#define kNullDriverBufferPoolSlotCount 8U
+
+typedef struct
+{
+    uint64_t reused; // Acquires that were given a free buffer.
+    uint64_t allocated; // Buffers the owner had to create. Once a workload is steady, this should stop growing.
+    uint64_t recycled; // Releases that went back into the pool.
+    uint64_t discarded; // Releases the pool had no room for.
+} NullDriverBufferPoolCounters;
+
+// Each slot holds a free buffer or nullptr. An all-zero pool is valid and empty.
+typedef struct
+{
+    void* slots[kNullDriverBufferPoolClassCount][kNullDriverBufferPoolSlotCount];
+    NullDriverBufferPoolCounters counters;
+} NullDriverBufferPool;
+
+// Returns the smallest class that holds "size" bytes, or kNullDriverBufferPoolClassCount if none does.
+static inline uint32_t NullDriverBufferPoolClassForSize(uint64_t size)
+{
+    uint32_t sizeClass = 0;
+
+    while ((sizeClass < kNullDriverBufferPoolClassCount) && (size > kNullDriverBufferPoolClassSizes[sizeClass]))
+    {
+        ++sizeClass;
+    }
+
+    return sizeClass;
+}
+
+// Takes a free buffer of "sizeClass", or returns nullptr if there's none, in which case the owner creates one and calls NullDriverBufferPoolCountAllocation.
+// Any number of threads may acquire and release at once. Each slot is claimed with a single exchange, so a buffer can't be handed out twice.
+static inline void* NullDriverBufferPoolAcquire(NullDriverBufferPool* pool, uint32_t sizeClass)
+{
+    if (sizeClass >= kNullDriverBufferPoolClassCount)
+    {
+        return nullptr;
+    }
+
+    for (uint32_t slot = 0; slot < kNullDriverBufferPoolSlotCount; ++slot)
+    {
+        void** entry = &pool->slots[sizeClass][slot];
+
+        // A plain load first, so empty slots don't take their cache line exclusively.
+        if (__atomic_load_n(entry, __ATOMIC_RELAXED) == nullptr)
+        {
+            continue;
+        }
+
+        void* buffer = __atomic_exchange_n(entry, nullptr, __ATOMIC_ACQUIRE);
+        if (buffer != nullptr)
+        {
+            __atomic_fetch_add(&pool->counters.reused, 1, __ATOMIC_RELAXED);
+            return buffer;
+        }
+    }
+
+    return nullptr;
+}
+
+static inline void NullDriverBufferPoolCountAllocation(NullDriverBufferPool* pool)
+{
+    __atomic_fetch_add(&pool->counters.allocated, 1, __ATOMIC_RELAXED);
+}
+
+// The owner acquired a buffer it can't use, and frees it. The acquire becomes a miss, and the buffer is counted as discarded.
+static inline void NullDriverBufferPoolCountMismatch(NullDriverBufferPool* pool)
+{
+    __atomic_fetch_sub(&pool->counters.reused, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pool->counters.discarded, 1, __ATOMIC_RELAXED);
+}
+
+// Puts "buffer" back in "sizeClass". Returns false if the class is full, in which case the owner still owns the buffer and frees it.
+static inline bool NullDriverBufferPoolRelease(NullDriverBufferPool* pool, uint32_t sizeClass, void* buffer)
+{
+    if (sizeClass < kNullDriverBufferPoolClassCount)
+    {
+        for (uint32_t slot = 0; slot < kNullDriverBufferPoolSlotCount; ++slot)
+        {
+            void* expected = nullptr;
+            if (__atomic_compare_exchange_n(&pool->slots[sizeClass][slot], &expected, buffer, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            {
+                __atomic_fetch_add(&pool->counters.recycled, 1, __ATOMIC_RELAXED);
+                return true;
+            }
+        }
+    }
+
+    __atomic_fetch_add(&pool->counters.discarded, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+// Takes any free buffer, for freeing the pool's contents when its owner goes away. Returns nullptr once the pool is empty.
+static inline void* NullDriverBufferPoolDrain(NullDriverBufferPool* pool)
+{
+    for (uint32_t sizeClass = 0; sizeClass < kNullDriverBufferPoolClassCount; ++sizeClass)
+    {
+        for (uint32_t slot = 0; slot < kNullDriverBufferPoolSlotCount; ++slot)
+        {
+            void* buffer = __atomic_exchange_n(&pool->slots[sizeClass][slot], nullptr, __ATOMIC_ACQUIRE);
+            if (buffer != nullptr)
+            {
+                return buffer;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+static inline void NullDriverBufferPoolCountersSnapshot(const NullDriverBufferPool* pool, NullDriverBufferPoolCounters* counters)
+{
+    counters->reused = __atomic_load_n(&pool->counters.reused, __ATOMIC_RELAXED);
+    counters->allocated = __atomic_load_n(&pool->counters.allocated, __ATOMIC_RELAXED);
+    counters->recycled = __atomic_load_n(&pool->counters.recycled, __ATOMIC_RELAXED);
+    counters->discarded = __atomic_load_n(&pool->counters.discarded, __ATOMIC_RELAXED);
+}
+
+#endif /* NullDriverBufferPool_h */
@@ -0,0 +1,85 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The layout of coalesced async completions, which carry several tagged results in one AsyncCompletion.
+*/
+
+#ifndef NullDriverCompletion_h
+#define NullDriverCompletion_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The most arguments a single AsyncCompletion can carry. This matches kIOUserClientAsyncArgumentsCountMax.
+#define kNullDriverAsyncArgumentCountMax 16U
+
+// A coalesced completion is { type, count, tag0, foo0, bar0, tag1, foo1, bar1, ... }, so 4 results fit in the arguments.
+// Larger batches are written to the async completion ring instead, and the completion only says how many were written.
+#define kNullDriverCoalescedHeaderCount 2U
+#define kNullDriverCoalescedResultArgumentCount 3U
+#define kNullDriverCoalescedResultsMax ((kNullDriverAsyncArgumentCountMax - kNullDriverCoalescedHeaderCount) / kNullDriverCoalescedResultArgumentCount)
+
+// How the dext delivers tagged results, set with ExternalMethodType_SetCompletionMode.
+typedef enum
+{
+    NullDriverCompletionMode_Single = 0, // One AsyncCompletion per result, as { type, tag, foo, bar }.
+    NullDriverCompletionMode_Coalesced = 1, // Results that complete in the same wakeup share AsyncCompletions.
+    NullDriverCompletionMode_SharedPage = 2, // Results go to the async completion ring, with a notification only when the client is parked. See NullDriverDoorbell.h.
+    NumberOfNullDriverCompletionModes // Has to be last
+} NullDriverCompletionMode;
+
+typedef struct
+{
+    uint64_t tag;
+    uint64_t foo;
+    uint64_t bar;
+} NullDriverCompletionResult;
+
+// Packs up to kNullDriverCoalescedResultsMax results into "arguments", and returns the number of arguments to send.
+// The caller sends larger batches in chunks of kNullDriverCoalescedResultsMax.
+static inline uint32_t NullDriverCompletionPack(uint64_t* arguments, uint64_t type, const NullDriverCompletionResult* results, uint32_t count)
+{
+    if (count > kNullDriverCoalescedResultsMax)
+    {
+        count = kNullDriverCoalescedResultsMax;
+    }
+
+    arguments[0] = type;
+    arguments[1] = count;
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        arguments[kNullDriverCoalescedHeaderCount + index * kNullDriverCoalescedResultArgumentCount + 0] = results[index].tag;
+        arguments[kNullDriverCoalescedHeaderCount + index * kNullDriverCoalescedResultArgumentCount + 1] = results[index].foo;
+        arguments[kNullDriverCoalescedHeaderCount + index * kNullDriverCoalescedResultArgumentCount + 2] = results[index].bar;
+    }
+
+    return kNullDriverCoalescedHeaderCount + count * kNullDriverCoalescedResultArgumentCount;
+}
+
+// Unpacks a coalesced completion into "results", and returns how many there were.
+// The count is checked against the number of arguments actually received, so a short or corrupt message yields no results.
+static inline uint32_t NullDriverCompletionUnpack(const uint64_t* arguments, uint32_t argumentCount, NullDriverCompletionResult* results, uint32_t maxCount)
+{
+    if (argumentCount < kNullDriverCoalescedHeaderCount)
+    {
+        return 0;
+    }
+
+    uint64_t count = arguments[1];
+    if ((count > maxCount) || (count > kNullDriverCoalescedResultsMax) || (argumentCount < kNullDriverCoalescedHeaderCount + count * kNullDriverCoalescedResultArgumentCount))
+    {
+        return 0;
+    }
+
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        results[index].tag = arguments[kNullDriverCoalescedHeaderCount + index * kNullDriverCoalescedResultArgumentCount + 0];
+        results[index].foo = arguments[kNullDriverCoalescedHeaderCount + index * kNullDriverCoalescedResultArgumentCount + 1];
+        results[index].bar = arguments[kNullDriverCoalescedHeaderCount + index * kNullDriverCoalescedResultArgumentCount + 2];
+    }
+
+    return (uint32_t)count;
+}
+
+#endif /* NullDriverCompletion_h */
@@ -0,0 +1,120 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A binary min-heap of deadlines, used to find the next simulated completion without scanning every pending request.
+The caller owns the storage, so the same code runs over the dext's fixed-size table and over millions of timers in a benchmark.
+*/
+
+#ifndef NullDriverDeadlineHeap_h
+#define NullDriverDeadlineHeap_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct
+{
+    uint64_t deadline;
+    uint64_t tag;
+} NullDriverDeadline;
+
+// Deadlines that tie are ordered by tag, so the order entries come out in doesn't depend on the order they went in.
+static inline bool NullDriverDeadlineIsEarlier(const NullDriverDeadline* first, const NullDriverDeadline* second)
+{
+    return (first->deadline < second->deadline) || ((first->deadline == second->deadline) && (first->tag < second->tag));
+}
+
+static inline void NullDriverDeadlineHeapSiftUp(NullDriverDeadline* heap, uint32_t index)
+{
+    NullDriverDeadline entry = heap[index];
+
+    while (index != 0)
+    {
+        uint32_t parent = (index - 1) / 2;
+        if (!NullDriverDeadlineIsEarlier(&entry, &heap[parent]))
+        {
+            break;
+        }
+
+        heap[index] = heap[parent];
+        index = parent;
+    }
+
+    heap[index] = entry;
+}
+
+static inline void NullDriverDeadlineHeapSiftDown(NullDriverDeadline* heap, uint32_t count, uint32_t index)
+{
+    NullDriverDeadline entry = heap[index];
+
+    while (true)
+    {
+        uint32_t child = index * 2 + 1;
+        if (child >= count)
+        {
+            break;
+        }
+
+        if ((child + 1 < count) && NullDriverDeadlineIsEarlier(&heap[child + 1], &heap[child]))
+        {
+            ++child;
+        }
+
+        if (!NullDriverDeadlineIsEarlier(&heap[child], &entry))
+        {
+            break;
+        }
+
+        heap[index] = heap[child];
+        index = child;
+    }
+
+    heap[index] = entry;
+}
+
+// The caller checks there is room for one more entry before calling this.
+static inline void NullDriverDeadlineHeapPush(NullDriverDeadline* heap, uint32_t* count, uint64_t deadline, uint64_t tag)
+{
+    heap[*count].deadline = deadline;
+    heap[*count].tag = tag;
+    NullDriverDeadlineHeapSiftUp(heap, *count);
+    ++*count;
+}
+
+// Removes the entry at "index". Index 0 is always the earliest deadline.
+static inline NullDriverDeadline NullDriverDeadlineHeapRemoveAt(NullDriverDeadline* heap, uint32_t* count, uint32_t index)
+{
+    NullDriverDeadline removed = heap[index];
+
+    --*count;
+    if (index != *count)
+    {
+        // The last entry can belong either above or below the hole, depending on which subtree it came from.
+        heap[index] = heap[*count];
+        if ((index != 0) && NullDriverDeadlineIsEarlier(&heap[index], &heap[(index - 1) / 2]))
+        {
+            NullDriverDeadlineHeapSiftUp(heap, index);
+        }
+        else
+        {
+            NullDriverDeadlineHeapSiftDown(heap, *count, index);
+        }
+    }
+
+    return removed;
+}
+
+// Removes up to "maxCount" entries whose deadline is at or before "now", earliest first, and returns how many were copied to "expired".
+static inline uint32_t NullDriverDeadlineHeapPopExpired(NullDriverDeadline* heap, uint32_t* count, uint64_t now, NullDriverDeadline* expired, uint32_t maxCount)
+{
+    uint32_t popped = 0;
+
+    while ((popped < maxCount) && (*count != 0) && (heap[0].deadline <= now))
+    {
+        expired[popped++] = NullDriverDeadlineHeapRemoveAt(heap, count, 0);
+    }
+
+    return popped;
+}
+
+#endif /* NullDriverDeadlineHeap_h */
@@ -0,0 +1,267 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A model of the device behind NullDriver's simulated completions, which decides when each async request completes.
+The device has a number of parallel service channels, a limit on how many requests it holds at once, and a distribution of service times:
+each request's own delay, a fixed time, an exponential or bimodal distribution, or times replayed from a trace.
+Requests are served first come, first served, on whichever channel frees up first, so the model is an M/G/c queue when requests arrive at random.
+*/
+
+#ifndef NullDriverDevice_h
+#define NullDriverDevice_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NullDriverDeadlineHeap.h"
+
+// Limits on what ExternalMethodType_ConfigureDevice accepts.
+#define kNullDriverDeviceMaxChannels 64U
+#define kNullDriverDeviceMaxQueueDepth 4096U
+#define kNullDriverDeviceMaxTraceCount 256U
+#define kNullDriverDeviceMaxServiceNanoseconds 10000000000ULL
+
+#define kNullDriverDevicePartsPerMillion 1000000U
+
+typedef enum
+{
+    NullDriverDeviceModel_Requested = 0, // Each request takes the delay it asked for, or the dext's default for untagged requests.
+    NullDriverDeviceModel_Fixed = 1, // Every request takes "serviceNanoseconds".
+    NullDriverDeviceModel_Exponential = 2, // Service times are exponential, with a mean of "serviceNanoseconds".
+    NullDriverDeviceModel_Bimodal = 3, // "slowPartsPerMillion" of requests take "slowNanoseconds", and the rest take "serviceNanoseconds".
+    NullDriverDeviceModel_Trace = 4, // Service times are taken from "trace" in order, starting over at the end.
+    NumberOfNullDriverDeviceModels // Has to be last
+} NullDriverDeviceModel;
+
+static const char* const kNullDriverDeviceModelNames[NumberOfNullDriverDeviceModels] = { "requested", "fixed", "exponential", "bimodal", "trace" };
+
+// The structure input of ExternalMethodType_ConfigureDevice, and its structure output, which is the configuration the input replaced.
+// An all-zero configuration is the device as it was before it had a model:
+// every request takes its own delay, all of them at once, with no limit on how many are queued.
+typedef struct
+{
+    uint32_t model;
+    uint32_t channelCount; // Requests served at once. Zero means every request is served as soon as it arrives.
+    uint32_t queueDepth; // Requests held at once, whether being served or waiting for a channel. Zero means no limit.
+    uint32_t slowPartsPerMillion;
+    uint64_t serviceNanoseconds;
+    uint64_t slowNanoseconds;
+    uint64_t seed; // Zero uses a fixed default, so runs with the same configuration see the same service times.
+    uint32_t traceCount;
+    uint32_t reserved;
+    uint64_t trace[kNullDriverDeviceMaxTraceCount];
+} NullDriverDeviceConfig;
+
+// Call NullDriverDeviceConfigure before use. An all-zero device behaves the same as one configured with an all-zero configuration.
+typedef struct
+{
+    NullDriverDeviceConfig config;
+    uint64_t random;
+    uint32_t traceIndex;
+    uint32_t outstandingCount;
+    uint64_t channelFreeAt[kNullDriverDeviceMaxChannels];
+
+    // Completion times of the requests the device holds, so it knows when they leave. Only kept when "queueDepth" is set.
+    NullDriverDeadline outstanding[kNullDriverDeviceMaxQueueDepth];
+
+    uint64_t admitted;
+    uint64_t rejected; // Requests turned away because "queueDepth" requests were already held.
+    uint64_t serviceNanoseconds; // Total service time of every admitted request.
+    uint64_t waitNanoseconds; // Total time admitted requests spent waiting for a channel.
+} NullDriverDevice;
+
+static inline bool NullDriverDeviceConfigIsValid(const NullDriverDeviceConfig* config)
+{
+    if ((config->model >= NumberOfNullDriverDeviceModels) || (config->channelCount > kNullDriverDeviceMaxChannels) || (config->queueDepth > kNullDriverDeviceMaxQueueDepth))
+    {
+        return false;
+    }
+
+    switch (config->model)
+    {
+        case NullDriverDeviceModel_Fixed:
+        case NullDriverDeviceModel_Exponential:
+            return config->serviceNanoseconds <= kNullDriverDeviceMaxServiceNanoseconds;
+
+        case NullDriverDeviceModel_Bimodal:
+            return (config->serviceNanoseconds <= kNullDriverDeviceMaxServiceNanoseconds) && (config->slowNanoseconds <= kNullDriverDeviceMaxServiceNanoseconds) &&
+                   (config->slowPartsPerMillion <= kNullDriverDevicePartsPerMillion);
+
+        case NullDriverDeviceModel_Trace:
+            if ((config->traceCount == 0) || (config->traceCount > kNullDriverDeviceMaxTraceCount))
+            {
+                return false;
+            }
+            for (uint32_t index = 0; index < config->traceCount; ++index)
+            {
+                if (config->trace[index] > kNullDriverDeviceMaxServiceNanoseconds)
+                {
+                    return false;
+                }
+            }
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+// Starts the device over with "config", which the caller has checked with NullDriverDeviceConfigIsValid.
+// Requests admitted before this keep the completion times they were given, but no longer count against the new channels or queue depth.
+static inline void NullDriverDeviceConfigure(NullDriverDevice* device, const NullDriverDeviceConfig* config)
+{
+    device->config = *config;
+    device->random = (config->seed != 0) ? config->seed : 0x9E3779B97F4A7C15ULL;
+    device->traceIndex = 0;
+    device->outstandingCount = 0;
+    for (uint32_t channel = 0; channel < kNullDriverDeviceMaxChannels; ++channel)
+    {
+        device->channelFreeAt[channel] = 0;
+    }
+
+    device->admitted = 0;
+    device->rejected = 0;
+    device->serviceNanoseconds = 0;
+    device->waitNanoseconds = 0;
+}
+
+// xorshift64*, which is plenty for simulated service times and needs no library.
+static inline uint64_t NullDriverDeviceNextRandom(NullDriverDevice* device)
+{
+    if (device->random == 0)
+    {
+        device->random = 0x9E3779B97F4A7C15ULL;
+    }
+
+    device->random ^= device->random >> 12;
+    device->random ^= device->random << 25;
+    device->random ^= device->random >> 27;
+    return device->random * 0x2545F4914F6CDD1DULL;
+}
+
+// The natural log of "x", which has to be positive and finite. DriverKit has no libm, so this splits off the binary exponent
+// and uses the series for 2 * atanh((m - 1) / (m + 1)) on the rest, which is accurate to about 1e-12 once m is near 1.
+static inline double NullDriverDeviceLog(double x)
+{
+    const double ln2 = 0.69314718055994530942;
+    uint64_t bits = 0;
+
+    __builtin_memcpy(&bits, &x, sizeof(bits));
+    int64_t exponent = (int64_t)((bits >> 52) & 0x7ff) - 1023;
+    bits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+
+    double mantissa = 0.0;
+    __builtin_memcpy(&mantissa, &bits, sizeof(mantissa));
+
+    // Keeping the mantissa between 1/sqrt(2) and sqrt(2) makes the series converge quickly.
+    if (mantissa > 1.41421356237309504880)
+    {
+        mantissa *= 0.5;
+        ++exponent;
+    }
+
+    const double z = (mantissa - 1.0) / (mantissa + 1.0);
+    const double z2 = z * z;
+    double term = z;
+    double sum = 0.0;
+    for (uint32_t power = 1; power <= 15; power += 2)
+    {
+        sum += term / power;
+        term *= z2;
+    }
+
+    return 2.0 * sum + (double)exponent * ln2;
+}
+
+// Draws the service time of the next request. "requestedNanoseconds" is the delay the request itself asked for.
+static inline uint64_t NullDriverDeviceSample(NullDriverDevice* device, uint64_t requestedNanoseconds)
+{
+    const NullDriverDeviceConfig* config = &device->config;
+
+    switch (config->model)
+    {
+        case NullDriverDeviceModel_Fixed:
+            return config->serviceNanoseconds;
+
+        case NullDriverDeviceModel_Exponential:
+        {
+            // The top 53 bits make a uniform value in (0, 1], so the log is always finite.
+            const double uniform = (double)((NullDriverDeviceNextRandom(device) >> 11) + 1) * (1.0 / 9007199254740992.0);
+            const double sample = -NullDriverDeviceLog(uniform) * (double)config->serviceNanoseconds;
+            return (sample < (double)kNullDriverDeviceMaxServiceNanoseconds) ? (uint64_t)sample : kNullDriverDeviceMaxServiceNanoseconds;
+        }
+
+        case NullDriverDeviceModel_Bimodal:
+            return ((NullDriverDeviceNextRandom(device) % kNullDriverDevicePartsPerMillion) < config->slowPartsPerMillion) ? config->slowNanoseconds : config->serviceNanoseconds;
+
+        case NullDriverDeviceModel_Trace:
+        {
+            const uint64_t sample = config->trace[device->traceIndex];
+            device->traceIndex = (device->traceIndex + 1 < config->traceCount) ? device->traceIndex + 1 : 0;
+            return sample;
+        }
+
+        default:
+            return requestedNanoseconds;
+    }
+}
+
+// Admits a request arriving at "now", and sets "completion" to when it finishes.
+// Returns false, and leaves "completion" alone, if the device already holds "queueDepth" requests.
+// Arrivals have to be admitted in order of "now" for the channels to be first come, first served.
+static inline bool NullDriverDeviceAdmit(NullDriverDevice* device, uint64_t now, uint64_t requestedNanoseconds, uint64_t* completion)
+{
+    const NullDriverDeviceConfig* config = &device->config;
+
+    if (config->queueDepth != 0)
+    {
+        // Requests that have finished by now have left the device.
+        while ((device->outstandingCount != 0) && (device->outstanding[0].deadline <= now))
+        {
+            NullDriverDeadlineHeapRemoveAt(device->outstanding, &device->outstandingCount, 0);
+        }
+
+        if (device->outstandingCount >= config->queueDepth)
+        {
+            ++device->rejected;
+            return false;
+        }
+    }
+
+    const uint64_t service = NullDriverDeviceSample(device, requestedNanoseconds);
+    uint64_t start = now;
+
+    if (config->channelCount != 0)
+    {
+        uint32_t earliest = 0;
+        for (uint32_t channel = 1; channel < config->channelCount; ++channel)
+        {
+            if (device->channelFreeAt[channel] < device->channelFreeAt[earliest])
+            {
+                earliest = channel;
+            }
+        }
+
+        if (device->channelFreeAt[earliest] > start)
+        {
+            start = device->channelFreeAt[earliest];
+        }
+        device->channelFreeAt[earliest] = start + service;
+    }
+
+    *completion = start + service;
+
+    if (config->queueDepth != 0)
+    {
+        NullDriverDeadlineHeapPush(device->outstanding, &device->outstandingCount, *completion, device->admitted);
+    }
+
+    ++device->admitted;
+    device->serviceNanoseconds += service;
+    device->waitNanoseconds += start - now;
+
+    return true;
+}
+
+#endif /* NullDriverDevice_h */
@@ -0,0 +1,66 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The completion doorbell, a page shared by the client and the dext that decides when results need an AsyncCompletion at all.
+In NullDriverCompletionMode_SharedPage, the dext writes tagged results to the async completion ring, whose head doubles as the sequence counter
+the client polls. It only sends a notification when the client has marked itself parked in the doorbell, so a client that is polling never pays
+for a mach message.
+*/
+
+#ifndef NullDriverDoorbell_h
+#define NullDriverDoorbell_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NullDriverRing.h"
+
+// "parked" is set by the client before it waits for a notification, and cleared by whichever side sees it first.
+// It sits on its own cache line, away from the ring indices the client polls.
+typedef struct
+{
+    alignas(64) uint32_t parked;
+} NullDriverDoorbell;
+
+// Both sides follow the same order, so a result is never published without the parked client hearing of it:
+// the client sets "parked" and then checks the ring, and the dext publishes to the ring and then checks "parked".
+// The full fences keep each side's store from moving after its load.
+
+// Called by the client before it parks. Returns true if results arrived meanwhile, in which case the client is no longer parked and shouldn't wait.
+static inline bool NullDriverDoorbellPark(NullDriverDoorbell* doorbell, const NullDriverRing* ring, uint32_t tail)
+{
+    __atomic_store_n(&doorbell->parked, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (NullDriverRingReadyCount(ring, tail) != 0)
+    {
+        // The dext may have cleared the flag already and sent a notification, which then arrives with nothing new. The client ignores it.
+        __atomic_store_n(&doorbell->parked, 0, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    return false;
+}
+
+// Called by the client when it gives up waiting, so the dext doesn't send a notification nobody needs.
+static inline void NullDriverDoorbellUnpark(NullDriverDoorbell* doorbell)
+{
+    __atomic_store_n(&doorbell->parked, 0, __ATOMIC_RELAXED);
+}
+
+// Called by the dext after it publishes results to the ring. Returns true if the client is parked and needs a notification.
+// The flag is cleared at the same time, so results published while the client is waking up don't send a second one.
+static inline bool NullDriverDoorbellShouldNotify(NullDriverDoorbell* doorbell)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&doorbell->parked, __ATOMIC_RELAXED) == 0)
+    {
+        return false;
+    }
+
+    return __atomic_exchange_n(&doorbell->parked, 0, __ATOMIC_RELAXED) != 0;
+}
+
+#endif /* NullDriverDoorbell_h */
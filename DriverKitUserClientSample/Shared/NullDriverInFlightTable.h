@@ -0,0 +1,162 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A fixed-capacity table of outstanding asynchronous requests, keyed by a client-supplied tag.
+*/
+
+#ifndef NullDriverInFlightTable_h
+#define NullDriverInFlightTable_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NullDriverDeadlineHeap.h"
+
+// The most requests that can be outstanding at once.
+// The table has twice as many slots, which keeps probe sequences short even when it's full.
+#define kNullDriverInFlightCapacity 512U
+#define kNullDriverInFlightSlotCount (kNullDriverInFlightCapacity * 2)
+#define kNullDriverInFlightSlotMask (kNullDriverInFlightSlotCount - 1)
+
+// Returned by NullDriverInFlightTableEarliestDeadline when nothing is outstanding.
+#define kNullDriverInFlightNoDeadline UINT64_MAX
+
+typedef struct
+{
+    uint64_t tag;
+    uint64_t type; // Sent back as the first completion argument, so the client knows how to read the rest.
+    uint64_t foo;
+    uint64_t bar;
+    uint64_t deadline;
+    uint64_t occupied;
+} NullDriverInFlightEntry;
+
+// An all-zero table is a valid, empty table.
+// Every entry in "slots" has one matching entry in "deadlines", a min-heap that finds the next expiry without scanning the slots.
+typedef struct
+{
+    uint32_t count;
+    NullDriverInFlightEntry slots[kNullDriverInFlightSlotCount];
+    NullDriverDeadline deadlines[kNullDriverInFlightCapacity];
+} NullDriverInFlightTable;
+
+typedef enum
+{
+    NullDriverInFlightResult_Success = 0,
+    NullDriverInFlightResult_Duplicate = 1,
+    NullDriverInFlightResult_Full = 2,
+} NullDriverInFlightResult;
+
+// Tags come from the client, so they are mixed before use.
+// Sequential tags would otherwise all land next to each other and form one long probe sequence.
+static inline uint32_t NullDriverInFlightHomeSlot(uint64_t tag)
+{
+    return (uint32_t)((tag * 0x9E3779B97F4A7C15ULL) >> 40) & kNullDriverInFlightSlotMask;
+}
+
+// Returns the slot holding "tag", or kNullDriverInFlightSlotCount if it isn't in the table.
+static inline uint32_t NullDriverInFlightTableFind(const NullDriverInFlightTable* table, uint64_t tag)
+{
+    uint32_t slot = NullDriverInFlightHomeSlot(tag);
+
+    for (uint32_t probe = 0; probe < kNullDriverInFlightSlotCount; ++probe)
+    {
+        const NullDriverInFlightEntry* entry = &table->slots[slot];
+        if (entry->occupied == 0)
+        {
+            break;
+        }
+
+        if (entry->tag == tag)
+        {
+            return slot;
+        }
+
+        slot = (slot + 1) & kNullDriverInFlightSlotMask;
+    }
+
+    return kNullDriverInFlightSlotCount;
+}
+
+static inline NullDriverInFlightResult NullDriverInFlightTableInsert(NullDriverInFlightTable* table, const NullDriverInFlightEntry* entry)
+{
+    if (table->count >= kNullDriverInFlightCapacity)
+    {
+        return NullDriverInFlightResult_Full;
+    }
+
+    uint32_t slot = NullDriverInFlightHomeSlot(entry->tag);
+    while (table->slots[slot].occupied != 0)
+    {
+        if (table->slots[slot].tag == entry->tag)
+        {
+            return NullDriverInFlightResult_Duplicate;
+        }
+
+        slot = (slot + 1) & kNullDriverInFlightSlotMask;
+    }
+
+    table->slots[slot] = *entry;
+    table->slots[slot].occupied = 1;
+
+    // The heap always holds exactly "count" entries, so this push grows it along with the table.
+    uint32_t heapCount = table->count;
+    NullDriverDeadlineHeapPush(table->deadlines, &heapCount, entry->deadline, entry->tag);
+    ++table->count;
+
+    return NullDriverInFlightResult_Success;
+}
+
+// Empties "slot" and moves later members of its probe sequence back, so lookups never need tombstones.
+// This leaves the deadline heap alone, so callers must remove the matching heap entry themselves.
+static inline void NullDriverInFlightTableRemoveSlot(NullDriverInFlightTable* table, uint32_t slot)
+{
+    uint32_t next = slot;
+
+    while (true)
+    {
+        next = (next + 1) & kNullDriverInFlightSlotMask;
+        if (table->slots[next].occupied == 0)
+        {
+            break;
+        }
+
+        // An entry can only move back if that doesn't take it past its home slot.
+        uint32_t home = NullDriverInFlightHomeSlot(table->slots[next].tag);
+        bool canMove = (slot <= next) ? ((home <= slot) || (home > next)) : ((home <= slot) && (home > next));
+        if (canMove)
+        {
+            table->slots[slot] = table->slots[next];
+            slot = next;
+        }
+    }
+
+    table->slots[slot].occupied = 0;
+    --table->count;
+}
+
+// Removes up to "maxCount" entries whose deadline is at or before "now", earliest first, and returns how many were copied to "expired".
+static inline uint32_t NullDriverInFlightTableTakeExpired(NullDriverInFlightTable* table, uint64_t now, NullDriverInFlightEntry* expired, uint32_t maxCount)
+{
+    uint32_t count = 0;
+
+    while ((count < maxCount) && (table->count != 0) && (table->deadlines[0].deadline <= now))
+    {
+        uint32_t heapCount = table->count;
+        NullDriverDeadline deadline = NullDriverDeadlineHeapRemoveAt(table->deadlines, &heapCount, 0);
+
+        uint32_t slot = NullDriverInFlightTableFind(table, deadline.tag);
+        expired[count++] = table->slots[slot];
+        NullDriverInFlightTableRemoveSlot(table, slot);
+    }
+
+    return count;
+}
+
+static inline uint64_t NullDriverInFlightTableEarliestDeadline(const NullDriverInFlightTable* table)
+{
+    return (table->count != 0) ? table->deadlines[0].deadline : kNullDriverInFlightNoDeadline;
+}
+
+#endif /* NullDriverInFlightTable_h */
@@ -0,0 +1,143 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Builds the dext's table of IOUserClientMethodDispatch entries at compile time, from one line per selector that names the handler and the types of its
+arguments. The argument checks are derived from those types, and the function each entry points to is generated from the handler, so adding a
+selector means adding its enum value, its handler, and one line in the table.
+The dispatch structure is a template parameter, so the same table serves the dext and the benchmarks.
+*/
+
+#ifndef NullDriverMethodTable_h
+#define NullDriverMethodTable_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The same value as kIOUserClientVariableStructureSize, which tells IOUserClient not to check a structure's size.
+#define kNullDriverVariableStructureSize 0xFFFFFFFFU
+
+// Values for checkCompletionExists.
+#define kNullDriverCompletionNone 0U // The call must not pass a completion.
+#define kNullDriverCompletionRequired 1U // The call must pass a completion.
+#define kNullDriverCompletionAny 0xFFFFFFFFU // The completion isn't checked.
+
+// The argument types a selector is described with.
+template <uint32_t Count>
+struct NullDriverScalars
+{
+    static constexpr uint32_t count = Count;
+};
+
+// A structure of exactly sizeof(Type) bytes.
+template <typename Type>
+struct NullDriverStructure
+{
+    static constexpr uint32_t size = (uint32_t)sizeof(Type);
+};
+
+// No structure at all.
+struct NullDriverNoStructure
+{
+    static constexpr uint32_t size = 0;
+};
+
+// A structure whose size the handler checks itself.
+struct NullDriverVariableStructure
+{
+    static constexpr uint32_t size = kNullDriverVariableStructureSize;
+};
+
+// Takes a member function pointer apart, so the target and argument types come from the handler itself.
+template <typename Handler>
+struct NullDriverHandlerTraits;
+
+template <typename Result, typename Target, typename Arguments>
+struct NullDriverHandlerTraits<Result (Target::*)(void*, Arguments*)>
+{
+    typedef Result ResultType;
+    typedef Target TargetType;
+    typedef Arguments ArgumentsType;
+};
+
+// Takes the dispatch structure's function pointer apart, for the type of the object IOUserClient passes in.
+template <typename Function>
+struct NullDriverFunctionTraits;
+
+template <typename Result, typename Object, typename Arguments>
+struct NullDriverFunctionTraits<Result (*)(Object*, void*, Arguments*)>
+{
+    typedef Object ObjectType;
+};
+
+// One selector: its value, its handler, and what it takes and returns.
+// "Call" is the function the entry points to. It's the only indirect call, and the handler is called directly from it, so it's usually inlined there.
+template <typename Dispatch, uint64_t Selector, auto Handler, typename ScalarInput, typename StructureInput, typename ScalarOutput, typename StructureOutput, uint32_t Completion = kNullDriverCompletionNone>
+struct NullDriverMethod
+{
+    typedef NullDriverHandlerTraits<decltype(Handler)> HandlerTraits;
+    typedef typename NullDriverFunctionTraits<decltype(Dispatch::function)>::ObjectType ObjectType;
+
+    static constexpr uint64_t selector = Selector;
+
+    // The dext's ExternalMethod always passes a target, so there's no null check here.
+    static typename HandlerTraits::ResultType Call(ObjectType* target, void* reference, typename HandlerTraits::ArgumentsType* arguments)
+    {
+        return (static_cast<typename HandlerTraits::TargetType*>(target)->*Handler)(reference, arguments);
+    }
+
+    static constexpr Dispatch entry = {
+        .function = &Call,
+        .checkCompletionExists = Completion,
+        .checkScalarInputCount = ScalarInput::count,
+        .checkStructureInputSize = StructureInput::size,
+        .checkScalarOutputCount = ScalarOutput::count,
+        .checkStructureOutputSize = StructureOutput::size,
+    };
+};
+
+// A selector the table leaves empty, so IOUserClient isn't asked to dispatch it. The dext handles these itself, without checks.
+template <typename Dispatch, uint64_t Selector>
+struct NullDriverUncheckedMethod
+{
+    static constexpr uint64_t selector = Selector;
+    static constexpr Dispatch entry = {};
+};
+
+// The methods have to be listed in selector order, starting at 0, with no gaps. That's checked when the table is compiled.
+template <typename Dispatch, typename... Methods>
+struct NullDriverMethodTable
+{
+    static constexpr size_t count = sizeof...(Methods);
+    static constexpr Dispatch entries[count] = { Methods::entry... };
+
+    static constexpr bool IsInSelectorOrder(void)
+    {
+        const uint64_t selectors[count] = { Methods::selector... };
+
+        for (size_t index = 0; index < count; ++index)
+        {
+            if (selectors[index] != index)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static_assert(IsInSelectorOrder(), "The methods aren't listed in selector order.");
+
+    // Returns the entry for "selector", or nullptr if it's out of range or left unchecked.
+    static const Dispatch* Find(uint64_t selector)
+    {
+        if ((selector >= count) || (entries[selector].function == nullptr))
+        {
+            return nullptr;
+        }
+
+        return &entries[selector];
+    }
+};
+
+#endif /* NullDriverMethodTable_h */
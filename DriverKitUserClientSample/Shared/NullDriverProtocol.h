@@ -0,0 +1,139 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The protocol between the dext and its clients: the selectors, the layout of async completions, the structures passed to and from calls,
+and the capabilities the dext reports, so a client can pick the fastest path the running dext supports.
+*/
+
+#ifndef NullDriverProtocol_h
+#define NullDriverProtocol_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Goes up whenever a selector or structure changes in a way an older client or dext can't handle.
+// Adding a selector doesn't need a new version, since clients check the transports the dext reports instead.
+// Dexts from before ExternalMethodType_QueryCapabilities are version 0.
+// Version 2 made ExternalMethodType_ConfigureDevice return the configuration it replaced.
+#define kNullDriverProtocolVersion 2U
+
+// The selectors of IOConnectCall*Method. The values have to stay the same in every program that talks to the dext.
+typedef enum
+{
+    ExternalMethodType_Scalar = 0,
+    ExternalMethodType_Struct = 1,
+    ExternalMethodType_CheckedScalar = 2,
+    ExternalMethodType_CheckedStruct = 3,
+    ExternalMethodType_RegisterAsyncCallback = 4,
+    ExternalMethodType_AsyncRequest = 5,
+    ExternalMethodType_RingDoorbell = 6,
+    ExternalMethodType_CheckedStructBatch = 7,
+    ExternalMethodType_TaggedAsyncRequest = 8,
+    ExternalMethodType_SetCompletionMode = 9,
+    ExternalMethodType_CopyStats = 10,
+    ExternalMethodType_RegisterBuffer = 11,
+    ExternalMethodType_UnregisterBuffer = 12,
+    ExternalMethodType_RegisteredStructBatch = 13,
+    ExternalMethodType_StreamBegin = 14,
+    ExternalMethodType_StreamChunk = 15,
+    ExternalMethodType_ConfigureDevice = 16,
+    ExternalMethodType_StartSamples = 17,
+    ExternalMethodType_StopSamples = 18,
+    ExternalMethodType_QueryCapabilities = 19,
+    ExternalMethodType_ScatterGather = 20,
+    NumberOfExternalMethods // Has to be last
+} ExternalMethodType;
+
+// The first argument of every AsyncCompletion, which tells the client how to read the rest.
+typedef enum
+{
+    AsyncCompletionType_RegisterAsyncCallback = 1, // { type, foo, bar }
+    AsyncCompletionType_AsyncRequest = 2, // { type, foo, bar }
+    AsyncCompletionType_TaggedAsyncRequest = 3, // { type, tag, foo, bar }
+    AsyncCompletionType_CoalescedResults = 4, // { type, count, tag0, foo0, bar0, ... }, see NullDriverCompletion.h
+    AsyncCompletionType_AsyncCompletionRing = 5, // { type, count }, with the results in the async completion ring
+    AsyncCompletionType_StreamProgress = 6, // { type, sequence, completedBytes, totalLength }, once for every chunk of a stream
+    AsyncCompletionType_SamplesReady = 7, // { type, ready, produced, dropped }, when the sample ring falls to its low-water mark, see NullDriverSampleRing.h
+} AsyncCompletionType;
+
+// These "DataStruct" structures are what's used to talk with the dext. It returns every (foo, bar) as (foo + 1, bar + 10).
+typedef struct
+{
+    uint64_t foo;
+    uint64_t bar;
+} DataStruct;
+
+typedef struct
+{
+    uint64_t foo;
+    uint64_t bar;
+    uint64_t largeArray[511];
+} OversizedDataStruct;
+
+// The most DataStructs one ExternalMethodType_CheckedStructBatch call accepts.
+#define kNullDriverMaxStructBatchCount 4096U
+
+// Structures up to this size are copied with the call. Larger ones arrive in a memory descriptor, which the dext has to map.
+#define kNullDriverInlineStructureSize 4096U
+
+// MARK: Capabilities
+// The ways to move DataStructs, and the other features a dext may support. A dext reports the ones it has as a mask of these.
+typedef enum
+{
+    NullDriverTransport_Call = 1U << 0, // One DataStruct per ExternalMethodType_CheckedStruct call.
+    NullDriverTransport_Batch = 1U << 1, // Up to "maxBatchCount" DataStructs per ExternalMethodType_CheckedStructBatch call.
+    NullDriverTransport_SharedRing = 1U << 2, // The submission and completion rings, with ExternalMethodType_RingDoorbell. See NullDriverRing.h.
+    NullDriverTransport_RegisteredBuffer = 1U << 3, // See NullDriverRegisteredBuffer.h.
+    NullDriverTransport_Stream = 1U << 4, // See NullDriverStream.h.
+    NullDriverTransport_SharedPageCompletion = 1U << 5, // NullDriverCompletionMode_SharedPage, see NullDriverDoorbell.h.
+    NullDriverTransport_SampleStream = 1U << 6, // See NullDriverSampleRing.h.
+    NullDriverTransport_ScatterGather = 1U << 7, // Lists of segments of registered buffers, see NullDriverScatterGather.h.
+} NullDriverTransport;
+
+// The structure output of ExternalMethodType_QueryCapabilities.
+typedef struct
+{
+    uint32_t version; // kNullDriverProtocolVersion of the dext.
+    uint32_t selectorCount; // NumberOfExternalMethods of the dext.
+    uint32_t transports; // NullDriverTransport flags.
+    uint32_t maxBatchCount; // The most DataStructs in one batch call.
+    uint32_t payloadAlignment; // Payloads in shared memory should start on a multiple of this many bytes.
+    uint32_t inlineStructureSize; // Structures larger than this are passed in memory descriptors, which cost a mapping per call.
+    uint32_t ringEntryCount; // Entries in each of the shared rings, if the dext has them.
+    uint32_t reserved;
+    uint64_t reserved2[4];
+} NullDriverCapabilities;
+
+// What a client assumes of a dext that fails ExternalMethodType_QueryCapabilities as an unknown selector. Only plain calls are relied on.
+static inline void NullDriverCapabilitiesSetVersion0(NullDriverCapabilities* capabilities)
+{
+    __builtin_memset(capabilities, 0, sizeof(NullDriverCapabilities));
+    capabilities->transports = NullDriverTransport_Call;
+    capabilities->maxBatchCount = 1;
+    capabilities->payloadAlignment = sizeof(DataStruct);
+    capabilities->inlineStructureSize = kNullDriverInlineStructureSize;
+}
+
+// The fastest way to transform "count" DataStructs at once, out of Call, Batch and SharedRing.
+// One DataStruct is a plain call. Batches that are passed inline come next. Past that, a batch call would map its payload every time,
+// so the shared ring takes over, which moves the data through memory that was mapped once. Without the ring, large runs are split into batches.
+static inline NullDriverTransport NullDriverCapabilitiesChooseTransport(const NullDriverCapabilities* capabilities, uint64_t count)
+{
+    const bool batch = ((capabilities->transports & NullDriverTransport_Batch) != 0) && (capabilities->maxBatchCount > 1);
+    const bool ring = ((capabilities->transports & NullDriverTransport_SharedRing) != 0) && (capabilities->ringEntryCount != 0);
+
+    if ((count <= 1) || (!batch && !ring))
+    {
+        return NullDriverTransport_Call;
+    }
+
+    if (batch && ((count * sizeof(DataStruct) <= capabilities->inlineStructureSize) || !ring))
+    {
+        return NullDriverTransport_Batch;
+    }
+
+    return NullDriverTransport_SharedRing;
+}
+
+#endif /* NullDriverProtocol_h */
@@ -0,0 +1,80 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The table of buffers a client has registered with the dext, and the bounds checks for requests that refer to them by index and offset.
+A registered buffer is created and mapped by the dext once, and mapped by the client once, so requests that use it skip the per-call mapping of
+structureInputDescriptor and structureOutputDescriptor.
+*/
+
+#ifndef NullDriverRegisteredBuffer_h
+#define NullDriverRegisteredBuffer_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The most buffers one client can have registered at a time.
+#define kNullDriverRegisteredBufferCount 8U
+
+// The largest buffer a client can register, in bytes.
+#define kNullDriverRegisteredBufferMaxSize (16U * 1024U * 1024U)
+
+// Offsets and lengths in requests have to be multiples of this, so every region holds whole DataStructs.
+#define kNullDriverRegisteredBufferAlignment 16U
+
+// "addresses" are where the dext mapped each buffer, or 0 for a free slot.
+// The table is only changed and read from the dext's external method calls, which are serialized on its default queue, so it has no lock.
+typedef struct
+{
+    uint64_t addresses[kNullDriverRegisteredBufferCount];
+    uint64_t lengths[kNullDriverRegisteredBufferCount];
+} NullDriverRegisteredBufferTable;
+
+// Returns the first free slot, or kNullDriverRegisteredBufferCount if every slot is taken.
+static inline uint32_t NullDriverRegisteredBufferFindFree(const NullDriverRegisteredBufferTable* table)
+{
+    uint32_t index = 0;
+
+    for (; index < kNullDriverRegisteredBufferCount; ++index)
+    {
+        if (table->addresses[index] == 0)
+        {
+            break;
+        }
+    }
+
+    return index;
+}
+
+// Returns the address of "length" bytes at "offset" in buffer "index", or nullptr if the buffer isn't registered, or the region doesn't lie
+// entirely inside it. Every value comes from the client, so the checks are written so none of the arithmetic can overflow.
+static inline void* NullDriverRegisteredBufferResolve(const NullDriverRegisteredBufferTable* table, uint64_t index, uint64_t offset, uint64_t length)
+{
+    if ((index >= kNullDriverRegisteredBufferCount) || (table->addresses[index] == 0))
+    {
+        return nullptr;
+    }
+
+    if ((length == 0) || (((offset | length) % kNullDriverRegisteredBufferAlignment) != 0))
+    {
+        return nullptr;
+    }
+
+    if ((offset > table->lengths[index]) || (length > table->lengths[index] - offset))
+    {
+        return nullptr;
+    }
+
+    return (void*)(uintptr_t)(table->addresses[index] + offset);
+}
+
+// True if the two regions share any byte. A transform from one to the other is only safe if they don't, or are exactly the same region.
+static inline bool NullDriverRegisteredBufferOverlaps(const void* first, const void* second, uint64_t length)
+{
+    uintptr_t firstStart = (uintptr_t)first;
+    uintptr_t secondStart = (uintptr_t)second;
+
+    return (firstStart < secondStart + length) && (secondStart < firstStart + length);
+}
+
+#endif /* NullDriverRegisteredBuffer_h */
@@ -0,0 +1,128 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A single-producer, single-consumer ring that lives in memory shared between the client and the dext.
+*/
+
+#ifndef NullDriverRing_h
+#define NullDriverRing_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The memory types a client passes to IOConnectMapMemory64, which the dext receives in CopyClientMemoryForType.
+// The client produces into the submission ring and the dext consumes from it. The completion ring flows the other way.
+// The async completion ring also flows to the client, and holds coalesced results of tagged async requests.
+// Registered buffers are mapped as NullDriverMemoryType_RegisteredBuffer plus the buffer's index, see NullDriverRegisteredBuffer.h.
+// The stream region is the double buffer of the current chunked stream, see NullDriverStream.h.
+// The completion doorbell tells the dext whether the client is waiting for a notification, see NullDriverDoorbell.h.
+// The sample ring carries the continuous sample stream from the dext, see NullDriverSampleRing.h.
+typedef enum
+{
+    NullDriverMemoryType_SubmissionRing = 0,
+    NullDriverMemoryType_CompletionRing = 1,
+    NullDriverMemoryType_AsyncCompletionRing = 2,
+    NullDriverMemoryType_StreamRegion = 3,
+    NullDriverMemoryType_CompletionDoorbell = 4,
+    NullDriverMemoryType_SampleRing = 5,
+    NullDriverMemoryType_RegisteredBuffer = 16,
+} NullDriverMemoryType;
+
+// The number of entries in each ring. This has to be a power of two so indices can wrap with a mask.
+#define kNullDriverRingEntryCount 1024U
+#define kNullDriverRingIndexMask (kNullDriverRingEntryCount - 1)
+
+// One request or one result. The "tag" is chosen by the client and echoed back unchanged, so results can be matched to requests.
+typedef struct
+{
+    uint64_t tag;
+    uint64_t status;
+    uint64_t foo;
+    uint64_t bar;
+} NullDriverRingEntry;
+
+// "head" is only written by the producer and "tail" only by the consumer.
+// Each one sits on its own cache line, so the two sides don't invalidate each other's line on every update.
+typedef struct
+{
+    alignas(64) uint32_t head;
+    alignas(64) uint32_t tail;
+    alignas(64) NullDriverRingEntry entries[kNullDriverRingEntryCount];
+} NullDriverRing;
+
+// Both sides keep their own copy of the index they own ("head" for the producer, "tail" for the consumer) and only publish it to the ring.
+// The ring memory is writable by the other process, so its contents can never be trusted:
+// the published index of the other side is only ever read, and is rejected if it describes more entries than the ring can hold.
+
+// Returns how many entries the producer can write right now.
+static inline uint32_t NullDriverRingFreeCount(const NullDriverRing* ring, uint32_t head)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t used = head - tail;
+
+    if (used > kNullDriverRingEntryCount)
+    {
+        return 0;
+    }
+
+    return kNullDriverRingEntryCount - used;
+}
+
+// Returns how many entries the consumer can read right now.
+static inline uint32_t NullDriverRingReadyCount(const NullDriverRing* ring, uint32_t tail)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t ready = head - tail;
+
+    if (ready > kNullDriverRingEntryCount)
+    {
+        return 0;
+    }
+
+    return ready;
+}
+
+// Copies up to "count" entries into the ring and publishes them with a single index update.
+// Returns the number of entries written, which is less than "count" when the ring is full.
+static inline uint32_t NullDriverRingProduce(NullDriverRing* ring, uint32_t* head, const NullDriverRingEntry* entries, uint32_t count)
+{
+    uint32_t space = NullDriverRingFreeCount(ring, *head);
+    if (count > space)
+    {
+        count = space;
+    }
+
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        ring->entries[(*head + index) & kNullDriverRingIndexMask] = entries[index];
+    }
+
+    *head += count;
+    __atomic_store_n(&ring->head, *head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+// Copies up to "maxCount" entries out of the ring and releases their slots with a single index update.
+// Returns the number of entries read.
+static inline uint32_t NullDriverRingConsume(NullDriverRing* ring, uint32_t* tail, NullDriverRingEntry* entries, uint32_t maxCount)
+{
+    uint32_t count = NullDriverRingReadyCount(ring, *tail);
+    if (count > maxCount)
+    {
+        count = maxCount;
+    }
+
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        entries[index] = ring->entries[(*tail + index) & kNullDriverRingIndexMask];
+    }
+
+    *tail += count;
+    __atomic_store_n(&ring->tail, *tail, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+#endif /* NullDriverRing_h */
@@ -0,0 +1,185 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The sample ring, which carries a continuous stream of samples from the dext to the client without a request for each one.
+Once ExternalMethodType_StartSamples has started it, the dext generates samples at a fixed rate, and writes every one that is due into the ring
+each time SimulatedAsyncEvent runs. When the ring is full, new samples are dropped and counted, the way a device overruns a slow reader.
+The client reads samples in place, and only gets an AsyncCompletion when the free space in the ring falls to its low-water mark.
+*/
+
+#ifndef NullDriverSampleRing_h
+#define NullDriverSampleRing_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The number of samples the ring holds. This has to be a power of two so indices can wrap with a mask.
+#define kNullDriverSampleRingEntryCount 4096U
+#define kNullDriverSampleRingIndexMask (kNullDriverSampleRingEntryCount - 1)
+
+// The fastest rate ExternalMethodType_StartSamples accepts, in samples per second.
+#define kNullDriverSampleMaxRate 100000000ULL
+
+// How often the dext wakes up to write samples while the stream is running, unless the next sample is due later than that.
+#define kNullDriverSampleTickNanoseconds 1000000ULL
+
+// Every sample's (foo, bar) is what the dext returns for the DataStruct (sequence, kNullDriverSampleBar), so clients check it the usual way.
+#define kNullDriverSampleBar 70000ULL
+
+typedef struct
+{
+    uint64_t sequence; // Counts every sample generated since the stream started, dropped ones included, so a gap shows where samples were lost.
+    uint64_t timestamp; // When the dext wrote the sample, on its monotonic clock.
+    uint64_t foo;
+    uint64_t bar;
+} NullDriverSample;
+
+// "head", "produced" and "dropped" are only written by the dext, and "tail" only by the client.
+typedef struct
+{
+    alignas(64) uint32_t head;
+    alignas(64) uint32_t tail;
+    alignas(64) uint64_t produced; // Samples generated since the stream started, including the dropped ones.
+    uint64_t dropped; // Samples that found the ring full.
+    alignas(64) NullDriverSample samples[kNullDriverSampleRingEntryCount];
+} NullDriverSampleRing;
+
+// The dext's side of the stream. It's kept out of the shared memory, so the client can't change it.
+// An all-zero producer is stopped.
+typedef struct
+{
+    uint64_t samplesPerSecond;
+    uint64_t startTime;
+    uint64_t generated;
+    uint64_t dropped;
+    uint32_t head;
+    uint32_t lowWaterMark; // The client is notified when this many free slots or fewer remain.
+    bool notified; // Set once the client has been notified, until the ring has more than "lowWaterMark" free slots again.
+} NullDriverSampleProducer;
+
+// As with NullDriverRing, the other side's published index is only read, and is rejected if it describes more samples than the ring can hold.
+static inline uint32_t NullDriverSampleRingReadyCount(const NullDriverSampleRing* ring, uint32_t tail)
+{
+    uint32_t ready = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    return (ready > kNullDriverSampleRingEntryCount) ? 0 : ready;
+}
+
+static inline uint32_t NullDriverSampleRingFreeCount(const NullDriverSampleRing* ring, uint32_t head)
+{
+    uint32_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return (used > kNullDriverSampleRingEntryCount) ? 0 : kNullDriverSampleRingEntryCount - used;
+}
+
+// MARK: Producer
+// Starts the stream over at "samplesPerSecond", which stops it if zero. The ring's indices carry on, so samples still in it can be read.
+static inline void NullDriverSampleProducerStart(NullDriverSampleProducer* producer, NullDriverSampleRing* ring, uint64_t samplesPerSecond, uint32_t lowWaterMark, uint64_t now)
+{
+    // Stopping keeps the counts, so the client can still compare what it read with what was produced.
+    if (samplesPerSecond == 0)
+    {
+        producer->samplesPerSecond = 0;
+        return;
+    }
+
+    producer->samplesPerSecond = samplesPerSecond;
+    producer->startTime = now;
+    producer->generated = 0;
+    producer->dropped = 0;
+    producer->lowWaterMark = lowWaterMark;
+    producer->notified = false;
+
+    __atomic_store_n(&ring->produced, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+}
+
+// The number of samples generated from the start of the stream up to "now". The whole seconds and the rest are scaled apart, so this can't overflow.
+static inline uint64_t NullDriverSampleProducerDueBy(const NullDriverSampleProducer* producer, uint64_t now)
+{
+    const uint64_t elapsed = (now > producer->startTime) ? now - producer->startTime : 0;
+    return (elapsed / 1000000000ULL) * producer->samplesPerSecond + ((elapsed % 1000000000ULL) * producer->samplesPerSecond) / 1000000000ULL;
+}
+
+// Writes every sample due by "now" that fits in the ring, counts the rest as dropped, and publishes them all with one index update.
+// Returns true if the free space has just fallen to the low-water mark, so the client needs a notification.
+static inline bool NullDriverSampleProducerRun(NullDriverSampleProducer* producer, NullDriverSampleRing* ring, uint64_t now)
+{
+    if (producer->samplesPerSecond == 0)
+    {
+        return false;
+    }
+
+    const uint64_t due = NullDriverSampleProducerDueBy(producer, now) - producer->generated;
+    const uint32_t space = NullDriverSampleRingFreeCount(ring, producer->head);
+    const uint32_t count = (due < space) ? (uint32_t)due : space;
+
+    // The client has caught up since the last notification, so the next time the ring fills up it needs another one.
+    if (space > producer->lowWaterMark)
+    {
+        producer->notified = false;
+    }
+
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        NullDriverSample* sample = &ring->samples[(producer->head + index) & kNullDriverSampleRingIndexMask];
+        const uint64_t sequence = producer->generated + index;
+
+        sample->sequence = sequence;
+        sample->timestamp = now;
+        sample->foo = sequence + 1;
+        sample->bar = kNullDriverSampleBar + 10;
+    }
+
+    producer->generated += due;
+    producer->dropped += due - count;
+    producer->head += count;
+
+    __atomic_store_n(&ring->produced, producer->generated, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->dropped, producer->dropped, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, producer->head, __ATOMIC_RELEASE);
+
+    if ((space - count <= producer->lowWaterMark) && !producer->notified)
+    {
+        producer->notified = true;
+        return true;
+    }
+
+    return false;
+}
+
+// When the producer next has work to do: a tick from "now", or the next sample if that is later.
+// Returns 0 if the stream is stopped.
+static inline uint64_t NullDriverSampleProducerNextDeadline(const NullDriverSampleProducer* producer, uint64_t now)
+{
+    if (producer->samplesPerSecond == 0)
+    {
+        return 0;
+    }
+
+    // Sample N is due N / rate seconds after the start, split the same way as in NullDriverSampleProducerDueBy.
+    const uint64_t next = producer->generated + 1;
+    const uint64_t rate = producer->samplesPerSecond;
+    const uint64_t nextSample = producer->startTime + (next / rate) * 1000000000ULL + ((next % rate) * 1000000000ULL + rate - 1) / rate;
+    return (nextSample > now + kNullDriverSampleTickNanoseconds) ? nextSample : now + kNullDriverSampleTickNanoseconds;
+}
+
+// MARK: Consumer
+// Points "samples" at the samples ready after "tail", in place, and returns how many can be read from there before the ring wraps.
+// The caller reads them and then releases them with NullDriverSampleRingRelease. Calling again after that returns any samples past the wrap.
+static inline uint32_t NullDriverSampleRingPeek(const NullDriverSampleRing* ring, uint32_t tail, const NullDriverSample** samples)
+{
+    const uint32_t ready = NullDriverSampleRingReadyCount(ring, tail);
+    const uint32_t untilWrap = kNullDriverSampleRingEntryCount - (tail & kNullDriverSampleRingIndexMask);
+
+    *samples = &ring->samples[tail & kNullDriverSampleRingIndexMask];
+    return (ready < untilWrap) ? ready : untilWrap;
+}
+
+// Gives "count" samples back to the producer. Their slots can be overwritten as soon as this returns.
+static inline void NullDriverSampleRingRelease(NullDriverSampleRing* ring, uint32_t* tail, uint32_t count)
+{
+    *tail += count;
+    __atomic_store_n(&ring->tail, *tail, __ATOMIC_RELEASE);
+}
+
+#endif /* NullDriverSampleRing_h */
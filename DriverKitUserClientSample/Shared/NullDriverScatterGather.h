@@ -0,0 +1,118 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Scatter-gather requests over registered buffers. A request lists up to kNullDriverScatterGatherMaxSegments (buffer, offset, length) segments,
+and the dext transforms each one in place and returns a status for each, so data spread across many buffers doesn't have to be staged first.
+Segments are checked one by one, so a bad segment only fails itself, and the rest of the list is still processed.
+*/
+
+#ifndef NullDriverScatterGather_h
+#define NullDriverScatterGather_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NullDriverRegisteredBuffer.h"
+
+// The most segments in one request. The list and the statuses both stay well under a page, so neither needs a memory descriptor.
+#define kNullDriverScatterGatherMaxSegments 128U
+
+// One region of a registered buffer. Its offset and length follow the same rules as ExternalMethodType_RegisteredStructBatch.
+typedef struct
+{
+    uint64_t buffer; // The index ExternalMethodType_RegisterBuffer returned.
+    uint64_t offset;
+    uint64_t length;
+} NullDriverSegment;
+
+// The structure input of ExternalMethodType_ScatterGather is a header followed by "segmentCount" segments.
+// The structure output is one uint32_t NullDriverSegmentStatus per segment, in the same order.
+typedef struct
+{
+    uint32_t segmentCount;
+    uint32_t reserved; // Has to be 0.
+} NullDriverScatterGatherHeader;
+
+typedef enum
+{
+    NullDriverSegmentStatus_Done = 0,
+    NullDriverSegmentStatus_OutOfBounds = 1, // The buffer isn't registered, or the region isn't whole DataStructs inside it.
+    NullDriverSegmentStatus_Overlaps = 2, // The region shares bytes with an earlier segment, which would transform them twice.
+} NullDriverSegmentStatus;
+
+// The size of a request with "segmentCount" segments.
+static inline uint64_t NullDriverScatterGatherRequestSize(uint32_t segmentCount)
+{
+    return sizeof(NullDriverScatterGatherHeader) + (uint64_t)segmentCount * sizeof(NullDriverSegment);
+}
+
+// Checks a request of "requestSize" bytes, and returns its segment count, or 0 if it's malformed.
+static inline uint32_t NullDriverScatterGatherSegmentCount(const NullDriverScatterGatherHeader* header, uint64_t requestSize)
+{
+    if ((requestSize < sizeof(NullDriverScatterGatherHeader)) || (header->reserved != 0))
+    {
+        return 0;
+    }
+
+    if ((header->segmentCount == 0) || (header->segmentCount > kNullDriverScatterGatherMaxSegments) || (requestSize != NullDriverScatterGatherRequestSize(header->segmentCount)))
+    {
+        return 0;
+    }
+
+    return header->segmentCount;
+}
+
+// "segments" has to be memory the client can't change, like the dext's copy of the structure input.
+// Resolves every segment to its address in "regions", or nullptr, and sets its status. Returns the number of bytes in the segments that resolved.
+// A segment that overlaps an earlier one that resolved is refused, so each byte is transformed at most once.
+// While the resolved segments come in ascending address order, comparing with the end of the last one is enough. A segment out of order
+// is compared with every earlier one, and so is every segment after it, which is quadratic but stays cheap at kNullDriverScatterGatherMaxSegments.
+static inline uint64_t NullDriverScatterGatherResolve(const NullDriverRegisteredBufferTable* table, const NullDriverSegment* segments, uint32_t segmentCount,
+                                                      void** regions, uint32_t* statuses)
+{
+    uint64_t totalLength = 0;
+    uintptr_t ascendingEnd = 0;
+    bool ascending = true;
+
+    for (uint32_t index = 0; index < segmentCount; ++index)
+    {
+        const NullDriverSegment* segment = &segments[index];
+        void* region = NullDriverRegisteredBufferResolve(table, segment->buffer, segment->offset, segment->length);
+
+        regions[index] = nullptr;
+        statuses[index] = NullDriverSegmentStatus_OutOfBounds;
+        if (region == nullptr)
+        {
+            continue;
+        }
+
+        if (!ascending || ((uintptr_t)region < ascendingEnd))
+        {
+            statuses[index] = NullDriverSegmentStatus_Overlaps;
+            uint32_t earlier = 0;
+            for (; earlier < index; ++earlier)
+            {
+                if ((regions[earlier] != nullptr) && ((uintptr_t)region < (uintptr_t)regions[earlier] + segments[earlier].length) &&
+                    ((uintptr_t)regions[earlier] < (uintptr_t)region + segment->length))
+                {
+                    break;
+                }
+            }
+            if (earlier != index)
+            {
+                continue;
+            }
+            ascending = false;
+        }
+
+        ascendingEnd = (uintptr_t)region + segment->length;
+        regions[index] = region;
+        statuses[index] = NullDriverSegmentStatus_Done;
+        totalLength += segment->length;
+    }
+
+    return totalLength;
+}
+
+#endif /* NullDriverScatterGather_h */
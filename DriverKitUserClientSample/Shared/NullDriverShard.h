@@ -0,0 +1,41 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+How the dext spreads clients that don't have a dedicated queue across its pool of worker queues.
+A client is always placed on the same queue, so its completions and timer callbacks stay in the order they were scheduled.
+*/
+
+#ifndef NullDriverShard_h
+#define NullDriverShard_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The most worker queues the service creates, whatever "NullDriverDispatchQueueCount" asks for.
+#define kNullDriverMaxShardCount 16U
+
+// Turns the "NullDriverDispatchQueueCount" property into a usable queue count. A missing or zero property means one queue, as before.
+static inline uint32_t NullDriverShardCountFromProperty(uint64_t requested)
+{
+    if (requested == 0)
+    {
+        return 1;
+    }
+
+    return (requested > kNullDriverMaxShardCount) ? kNullDriverMaxShardCount : (uint32_t)requested;
+}
+
+// Client IDs are handed out in order from 1, so consecutive clients land on consecutive queues.
+// Sharding by request tag instead would spread one client's requests across queues, and its completions could then overtake each other.
+static inline uint32_t NullDriverShardForClient(uint64_t clientID, uint32_t shardCount)
+{
+    if (shardCount <= 1)
+    {
+        return 0;
+    }
+
+    return (uint32_t)((clientID - 1) % shardCount);
+}
+
+#endif /* NullDriverShard_h */
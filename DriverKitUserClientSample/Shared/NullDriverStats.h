@@ -0,0 +1,188 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Per-selector call counters and log-bucketed latency histograms, updated with relaxed atomics so any thread can record without a lock.
+The dext keeps one NullDriverStats per client, and returns a copy of it from ExternalMethodType_CopyStats.
+*/
+
+#ifndef NullDriverStats_h
+#define NullDriverStats_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "NullDriverBufferPool.h"
+
+// Bumped whenever the layout of NullDriverStats changes, so a client can tell if it's reading a snapshot it understands.
+#define kNullDriverStatsVersion 4U
+
+// Room for every ExternalMethodType. The last slot is used for SimulatedAsyncEvent wakeups, and the one before it for calls with a selector
+// the dext doesn't have.
+#define kNullDriverStatsSelectorCount 32U
+#define kNullDriverStatsSelector_SimulatedAsyncEvent (kNullDriverStatsSelectorCount - 1)
+#define kNullDriverStatsSelector_Invalid (kNullDriverStatsSelectorCount - 2)
+
+// Latencies below 4 ns get a bucket each. Above that, every power of two is split into 4 buckets, so a bucket is never wider than 25% of its value.
+// The last bucket also holds everything from about 7.5 seconds up.
+#define kNullDriverStatsSubBucketBits 2U
+#define kNullDriverStatsSubBucketCount (1U << kNullDriverStatsSubBucketBits)
+#define kNullDriverStatsBucketCount 128U
+
+typedef struct
+{
+    uint64_t calls;
+    uint64_t errors; // Calls that returned anything other than kIOReturnSuccess.
+    uint64_t bytesIn; // Scalar and structure inputs.
+    uint64_t bytesOut; // Scalar and structure outputs.
+    uint64_t totalNanoseconds;
+    uint64_t maxNanoseconds;
+    uint64_t buckets[kNullDriverStatsBucketCount];
+} NullDriverSelectorStats;
+
+// An all-zero NullDriverStats is valid and empty. "version" and the counts are filled in by NullDriverStatsSnapshot.
+typedef struct
+{
+    uint32_t version;
+    uint32_t selectorCount;
+    uint32_t bucketCount;
+    uint32_t reserved;
+    uint64_t clientID;
+    NullDriverSelectorStats selectors[kNullDriverStatsSelectorCount];
+    NullDriverBufferPoolCounters outputPool; // The client's pool of reply buffers. Filled in by the dext after NullDriverStatsSnapshot.
+} NullDriverStats;
+
+static inline uint32_t NullDriverStatsBucketForNanoseconds(uint64_t nanoseconds)
+{
+    if (nanoseconds < kNullDriverStatsSubBucketCount)
+    {
+        return (uint32_t)nanoseconds;
+    }
+
+    uint32_t octave = 63 - __builtin_clzll(nanoseconds);
+    uint32_t subBucket = (uint32_t)(nanoseconds >> (octave - kNullDriverStatsSubBucketBits)) & (kNullDriverStatsSubBucketCount - 1);
+    uint32_t bucket = (octave - kNullDriverStatsSubBucketBits + 1) * kNullDriverStatsSubBucketCount + subBucket;
+
+    return (bucket < kNullDriverStatsBucketCount) ? bucket : kNullDriverStatsBucketCount - 1;
+}
+
+// The smallest latency that lands in "bucket".
+static inline uint64_t NullDriverStatsBucketLowerBound(uint32_t bucket)
+{
+    if (bucket < kNullDriverStatsSubBucketCount)
+    {
+        return bucket;
+    }
+
+    uint32_t octave = bucket / kNullDriverStatsSubBucketCount + kNullDriverStatsSubBucketBits - 1;
+    uint64_t subBucket = bucket % kNullDriverStatsSubBucketCount;
+
+    return (kNullDriverStatsSubBucketCount + subBucket) << (octave - kNullDriverStatsSubBucketBits);
+}
+
+// The largest latency that lands in "bucket". The last bucket has no real upper bound, so this is UINT64_MAX.
+static inline uint64_t NullDriverStatsBucketUpperBound(uint32_t bucket)
+{
+    if (bucket + 1 >= kNullDriverStatsBucketCount)
+    {
+        return UINT64_MAX;
+    }
+
+    return NullDriverStatsBucketLowerBound(bucket + 1) - 1;
+}
+
+static inline void NullDriverStatsRecord(NullDriverStats* stats, uint32_t selector, bool failed, uint64_t bytesIn, uint64_t bytesOut, uint64_t nanoseconds)
+{
+    if (selector >= kNullDriverStatsSelectorCount)
+    {
+        return;
+    }
+
+    NullDriverSelectorStats* selectorStats = &stats->selectors[selector];
+
+    __atomic_fetch_add(&selectorStats->calls, 1, __ATOMIC_RELAXED);
+    if (failed)
+    {
+        __atomic_fetch_add(&selectorStats->errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&selectorStats->bytesIn, bytesIn, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&selectorStats->bytesOut, bytesOut, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&selectorStats->totalNanoseconds, nanoseconds, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&selectorStats->buckets[NullDriverStatsBucketForNanoseconds(nanoseconds)], 1, __ATOMIC_RELAXED);
+
+    uint64_t maximum = __atomic_load_n(&selectorStats->maxNanoseconds, __ATOMIC_RELAXED);
+    while ((nanoseconds > maximum) && !__atomic_compare_exchange_n(&selectorStats->maxNanoseconds, &maximum, nanoseconds, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+// Copies "stats" while other threads may still be recording into it.
+// Each counter is read atomically, but they aren't read at the same instant, so a call being recorded may be counted in some fields and not yet in others.
+static inline void NullDriverStatsSnapshot(const NullDriverStats* stats, uint64_t clientID, NullDriverStats* snapshot)
+{
+    snapshot->version = kNullDriverStatsVersion;
+    snapshot->selectorCount = kNullDriverStatsSelectorCount;
+    snapshot->bucketCount = kNullDriverStatsBucketCount;
+    snapshot->reserved = 0;
+    snapshot->clientID = clientID;
+    snapshot->outputPool = {};
+
+    for (uint32_t selector = 0; selector < kNullDriverStatsSelectorCount; ++selector)
+    {
+        const NullDriverSelectorStats* source = &stats->selectors[selector];
+        NullDriverSelectorStats* destination = &snapshot->selectors[selector];
+
+        destination->calls = __atomic_load_n(&source->calls, __ATOMIC_RELAXED);
+        destination->errors = __atomic_load_n(&source->errors, __ATOMIC_RELAXED);
+        destination->bytesIn = __atomic_load_n(&source->bytesIn, __ATOMIC_RELAXED);
+        destination->bytesOut = __atomic_load_n(&source->bytesOut, __ATOMIC_RELAXED);
+        destination->totalNanoseconds = __atomic_load_n(&source->totalNanoseconds, __ATOMIC_RELAXED);
+        destination->maxNanoseconds = __atomic_load_n(&source->maxNanoseconds, __ATOMIC_RELAXED);
+        for (uint32_t bucket = 0; bucket < kNullDriverStatsBucketCount; ++bucket)
+        {
+            destination->buckets[bucket] = __atomic_load_n(&source->buckets[bucket], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Returns an upper bound on the latency below which "fraction" (0 to 1) of the recorded calls fall, or 0 if nothing was recorded.
+// The true percentile is within the same bucket, so it's at most 25% lower. The maximum is used for the open-ended last bucket.
+static inline uint64_t NullDriverStatsPercentile(const NullDriverSelectorStats* selectorStats, double fraction)
+{
+    uint64_t total = 0;
+    for (uint32_t bucket = 0; bucket < kNullDriverStatsBucketCount; ++bucket)
+    {
+        total += selectorStats->buckets[bucket];
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the wanted call, counting from 1, rounded up so that p100 is the slowest call.
+    uint64_t rank = (uint64_t)(fraction * (double)total);
+    if ((double)rank < fraction * (double)total)
+    {
+        ++rank;
+    }
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < kNullDriverStatsBucketCount; ++bucket)
+    {
+        seen += selectorStats->buckets[bucket];
+        if (seen >= rank)
+        {
+            uint64_t upperBound = NullDriverStatsBucketUpperBound(bucket);
+            return (upperBound < selectorStats->maxNanoseconds) ? upperBound : selectorStats->maxNanoseconds;
+        }
+    }
+
+    return selectorStats->maxNanoseconds;
+}
+
+#endif /* NullDriverStats_h */
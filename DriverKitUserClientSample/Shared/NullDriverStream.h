@@ -0,0 +1,155 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The state of a chunked stream, which moves a payload of up to a gigabyte through a double-buffered region shared by the client and the dext.
+The client copies chunk N into one half of the region and submits it. The dext transforms it in place on its dispatch queue and reports progress
+with an AsyncCompletion, while the client copies chunk N + 1 into the other half. Each half is reused once the client has read its result back.
+*/
+
+#ifndef NullDriverStream_h
+#define NullDriverStream_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The region has one slot per chunk being worked on. Two let one chunk be filled while the other is processed.
+#define kNullDriverStreamSlotCount 2U
+
+// Chunks are whole pages, so each slot starts on its own page, and at most a few megabytes, so the region stays small.
+#define kNullDriverStreamMinChunkSize 4096U
+#define kNullDriverStreamMaxChunkSize (4U * 1024U * 1024U)
+
+// The largest payload one stream can carry, in bytes. Payloads are whole DataStructs.
+#define kNullDriverStreamMaxLength (1ULL << 30)
+#define kNullDriverStreamAlignment 16U
+
+typedef enum
+{
+    NullDriverStreamResult_Success = 0,
+    NullDriverStreamResult_BadArgument = 1, // A size or length the stream can't carry.
+    NullDriverStreamResult_OutOfOrder = 2, // Not the next chunk, or no stream has begun.
+    NullDriverStreamResult_Busy = 3, // The chunk's slot still holds a chunk the dext hasn't finished with.
+} NullDriverStreamResult;
+
+// "nextSequence" and "submittedBytes" are only used from the dext's external method calls, which are serialized on its default queue.
+// "completedBytes" is only written by the dispatch queue that processes chunks. "busy" is set by the one and cleared by the other.
+// None of it lives in the shared region, since the client can write there at any time.
+typedef struct
+{
+    uint64_t totalLength;
+    uint32_t chunkSize;
+    uint64_t nextSequence;
+    uint64_t submittedBytes;
+    uint64_t completedBytes;
+    uint32_t busy[kNullDriverStreamSlotCount];
+} NullDriverStreamState;
+
+static inline uint64_t NullDriverStreamRegionSize(uint32_t chunkSize)
+{
+    return (uint64_t)chunkSize * kNullDriverStreamSlotCount;
+}
+
+static inline uint64_t NullDriverStreamChunkCount(const NullDriverStreamState* state)
+{
+    return (state->totalLength + state->chunkSize - 1) / state->chunkSize;
+}
+
+// Every chunk is "chunkSize" long, apart from the last, which holds whatever is left.
+static inline uint64_t NullDriverStreamChunkLength(const NullDriverStreamState* state, uint64_t sequence)
+{
+    const uint64_t offset = sequence * state->chunkSize;
+
+    if (offset >= state->totalLength)
+    {
+        return 0;
+    }
+
+    return ((state->totalLength - offset) < state->chunkSize) ? (state->totalLength - offset) : state->chunkSize;
+}
+
+static inline uint32_t NullDriverStreamSlotForSequence(uint64_t sequence)
+{
+    return (uint32_t)(sequence % kNullDriverStreamSlotCount);
+}
+
+static inline uint64_t NullDriverStreamSlotOffset(const NullDriverStreamState* state, uint32_t slot)
+{
+    return (uint64_t)slot * state->chunkSize;
+}
+
+static inline bool NullDriverStreamIsIdle(const NullDriverStreamState* state)
+{
+    for (uint32_t slot = 0; slot < kNullDriverStreamSlotCount; ++slot)
+    {
+        if (__atomic_load_n(&state->busy[slot], __ATOMIC_ACQUIRE) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Starts a new stream, replacing any finished one. Every value comes from the client.
+// The caller has to check NullDriverStreamIsIdle first, since a chunk still being processed belongs to the old stream.
+static inline NullDriverStreamResult NullDriverStreamBegin(NullDriverStreamState* state, uint64_t totalLength, uint64_t chunkSize)
+{
+    if ((chunkSize < kNullDriverStreamMinChunkSize) || (chunkSize > kNullDriverStreamMaxChunkSize) || ((chunkSize % kNullDriverStreamMinChunkSize) != 0))
+    {
+        return NullDriverStreamResult_BadArgument;
+    }
+
+    if ((totalLength == 0) || (totalLength > kNullDriverStreamMaxLength) || ((totalLength % kNullDriverStreamAlignment) != 0))
+    {
+        return NullDriverStreamResult_BadArgument;
+    }
+
+    state->totalLength = totalLength;
+    state->chunkSize = (uint32_t)chunkSize;
+    state->nextSequence = 0;
+    state->submittedBytes = 0;
+    __atomic_store_n(&state->completedBytes, 0, __ATOMIC_RELAXED);
+
+    return NullDriverStreamResult_Success;
+}
+
+// Accepts chunk "sequence" of "length" bytes, and marks its slot busy until NullDriverStreamComplete.
+// Chunks have to arrive in order, each with exactly the length NullDriverStreamChunkLength gives for it.
+static inline NullDriverStreamResult NullDriverStreamSubmit(NullDriverStreamState* state, uint64_t sequence, uint64_t length, uint32_t* slot)
+{
+    if ((state->totalLength == 0) || (sequence != state->nextSequence) || (sequence >= NullDriverStreamChunkCount(state)))
+    {
+        return NullDriverStreamResult_OutOfOrder;
+    }
+
+    if (length != NullDriverStreamChunkLength(state, sequence))
+    {
+        return NullDriverStreamResult_BadArgument;
+    }
+
+    *slot = NullDriverStreamSlotForSequence(sequence);
+    if (__atomic_load_n(&state->busy[*slot], __ATOMIC_ACQUIRE) != 0)
+    {
+        return NullDriverStreamResult_Busy;
+    }
+
+    __atomic_store_n(&state->busy[*slot], 1, __ATOMIC_RELAXED);
+    state->nextSequence += 1;
+    state->submittedBytes += length;
+
+    return NullDriverStreamResult_Success;
+}
+
+// Called once a submitted chunk has been processed. Frees its slot and returns the bytes completed so far, which is the progress to report.
+static inline uint64_t NullDriverStreamComplete(NullDriverStreamState* state, uint32_t slot, uint64_t length)
+{
+    const uint64_t completed = __atomic_add_fetch(&state->completedBytes, length, __ATOMIC_RELAXED);
+
+    // Released last, so a chunk submitted into this slot can't start before this one's bytes are counted.
+    __atomic_store_n(&state->busy[slot], 0, __ATOMIC_RELEASE);
+
+    return completed;
+}
+
+#endif /* NullDriverStream_h */
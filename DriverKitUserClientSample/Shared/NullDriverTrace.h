@@ -0,0 +1,94 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+A lock-free ring of fixed-size binary trace records, cheap enough to write on every external method call.
+*/
+
+#ifndef NullDriverTrace_h
+#define NullDriverTrace_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The number of records kept. Older records are overwritten. This has to be a power of two so indices can wrap with a mask.
+#define kNullDriverTraceRecordCount 4096U
+#define kNullDriverTraceIndexMask (kNullDriverTraceRecordCount - 1)
+
+// "sequence" is one more than the record's position in the trace, and zero while the record is being written.
+// A reader that sees the same non-zero sequence before and after copying a record got a complete record.
+typedef struct
+{
+    uint64_t sequence;
+    uint64_t timestamp;
+    uint32_t selector;
+    int32_t status;
+    uint64_t size;
+} NullDriverTraceRecord;
+
+// An all-zero ring is a valid, empty ring.
+typedef struct
+{
+    alignas(64) uint64_t next;
+    alignas(64) NullDriverTraceRecord records[kNullDriverTraceRecordCount];
+} NullDriverTraceRing;
+
+// Any number of threads may record at once. Each one claims its own position, so writers never wait for each other.
+static inline void NullDriverTraceRecordCall(NullDriverTraceRing* ring, uint64_t timestamp, uint32_t selector, int32_t status, uint64_t size)
+{
+    uint64_t position = __atomic_fetch_add(&ring->next, 1, __ATOMIC_RELAXED);
+    NullDriverTraceRecord* record = &ring->records[position & kNullDriverTraceIndexMask];
+
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&record->timestamp, timestamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->selector, selector, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->status, status, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->size, size, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&record->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+// Copies up to "maxCount" of the most recent complete records to "records", oldest first, and returns how many were copied.
+// Records that are being written, or were overwritten while being copied, are skipped.
+static inline uint32_t NullDriverTraceSnapshot(const NullDriverTraceRing* ring, NullDriverTraceRecord* records, uint32_t maxCount)
+{
+    uint64_t end = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+    uint64_t available = (end < kNullDriverTraceRecordCount) ? end : kNullDriverTraceRecordCount;
+    uint32_t count = 0;
+
+    if (available > maxCount)
+    {
+        available = maxCount;
+    }
+
+    for (uint64_t position = end - available; position < end; ++position)
+    {
+        const NullDriverTraceRecord* record = &ring->records[position & kNullDriverTraceIndexMask];
+
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != position + 1)
+        {
+            continue;
+        }
+
+        NullDriverTraceRecord copy = {};
+        copy.sequence = position + 1;
+        copy.timestamp = __atomic_load_n(&record->timestamp, __ATOMIC_RELAXED);
+        copy.selector = __atomic_load_n(&record->selector, __ATOMIC_RELAXED);
+        copy.status = __atomic_load_n(&record->status, __ATOMIC_RELAXED);
+        copy.size = __atomic_load_n(&record->size, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&record->sequence, __ATOMIC_RELAXED) != position + 1)
+        {
+            continue;
+        }
+
+        records[count++] = copy;
+    }
+
+    return count;
+}
+
+#endif /* NullDriverTrace_h */
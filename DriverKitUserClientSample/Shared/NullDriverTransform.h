@@ -0,0 +1,249 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+The transform the dext applies to every DataStruct, with SSE2, AVX2 and NEON variants chosen at runtime.
+*/
+
+#ifndef NullDriverTransform_h
+#define NullDriverTransform_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define NULLDRIVER_TRANSFORM_X86 1
+#elif defined(__aarch64__) || defined(__arm64__)
+#include <arm_neon.h>
+#define NULLDRIVER_TRANSFORM_NEON 1
+#endif
+
+// Every DataStruct is a (foo, bar) pair of uint64_t, and the dext returns (foo + 1, bar + 10).
+#define kNullDriverTransformFooIncrement 1ULL
+#define kNullDriverTransformBarIncrement 10ULL
+
+// Below this many structs, the indirect call to a vector variant costs more than it saves.
+#define kNullDriverTransformVectorThreshold 4
+
+typedef enum
+{
+    NullDriverTransformVariant_Scalar = 0,
+    NullDriverTransformVariant_SSE2 = 1,
+    NullDriverTransformVariant_AVX2 = 2,
+    NullDriverTransformVariant_NEON = 3,
+    NumberOfNullDriverTransformVariants // Has to be last
+} NullDriverTransformVariant;
+
+// Transforms "count" (foo, bar) pairs. Pair N starts at word N * "stride" of each array, so the pairs can be embedded in larger records.
+// "input" and "output" may be the same array, but may not otherwise overlap.
+typedef void (*NullDriverTransformFunction)(const uint64_t* input, uint64_t* output, size_t count, size_t stride);
+
+static inline void NullDriverTransformScalar(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    for (size_t index = 0; index < count; ++index)
+    {
+        output[index * stride] = input[index * stride] + kNullDriverTransformFooIncrement;
+        output[index * stride + 1] = input[index * stride + 1] + kNullDriverTransformBarIncrement;
+    }
+}
+
+#if NULLDRIVER_TRANSFORM_X86
+// One pair fills one 128-bit register, so this variant handles any stride.
+static inline void NullDriverTransformSSE2(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    const __m128i increment = _mm_set_epi64x(kNullDriverTransformBarIncrement, kNullDriverTransformFooIncrement);
+
+    for (size_t index = 0; index < count; ++index)
+    {
+        __m128i pair = _mm_loadu_si128((const __m128i*)(input + index * stride));
+        _mm_storeu_si128((__m128i*)(output + index * stride), _mm_add_epi64(pair, increment));
+    }
+}
+
+// Two contiguous pairs fill one 256-bit register. Strided records fall back to SSE2.
+__attribute__((target("avx2")))
+static inline void NullDriverTransformAVX2(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    if (stride != 2)
+    {
+        NullDriverTransformSSE2(input, output, count, stride);
+        return;
+    }
+
+    const __m256i increment = _mm256_set_epi64x(kNullDriverTransformBarIncrement, kNullDriverTransformFooIncrement, kNullDriverTransformBarIncrement, kNullDriverTransformFooIncrement);
+    size_t index = 0;
+
+    // Four registers per iteration keeps enough loads in flight to saturate the cache on large payloads.
+    for (; index + 8 <= count; index += 8)
+    {
+        __m256i pairs0 = _mm256_loadu_si256((const __m256i*)(input + index * 2));
+        __m256i pairs1 = _mm256_loadu_si256((const __m256i*)(input + index * 2 + 4));
+        __m256i pairs2 = _mm256_loadu_si256((const __m256i*)(input + index * 2 + 8));
+        __m256i pairs3 = _mm256_loadu_si256((const __m256i*)(input + index * 2 + 12));
+        _mm256_storeu_si256((__m256i*)(output + index * 2), _mm256_add_epi64(pairs0, increment));
+        _mm256_storeu_si256((__m256i*)(output + index * 2 + 4), _mm256_add_epi64(pairs1, increment));
+        _mm256_storeu_si256((__m256i*)(output + index * 2 + 8), _mm256_add_epi64(pairs2, increment));
+        _mm256_storeu_si256((__m256i*)(output + index * 2 + 12), _mm256_add_epi64(pairs3, increment));
+    }
+
+    for (; index + 2 <= count; index += 2)
+    {
+        __m256i pairs = _mm256_loadu_si256((const __m256i*)(input + index * 2));
+        _mm256_storeu_si256((__m256i*)(output + index * 2), _mm256_add_epi64(pairs, increment));
+    }
+
+    NullDriverTransformSSE2(input + index * 2, output + index * 2, count - index, stride);
+}
+
+static inline bool NullDriverTransformCPUHasAVX2(void)
+{
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+
+    if ((__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) || ((ecx & bit_OSXSAVE) == 0) || ((ecx & bit_AVX) == 0))
+    {
+        return false;
+    }
+
+    // The CPU supporting AVX isn't enough. The OS also has to save the upper halves of the registers on a context switch.
+    unsigned int xcr0 = 0;
+    __asm__ volatile("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+    if ((xcr0 & 0x6) != 0x6)
+    {
+        return false;
+    }
+
+    if (__get_cpuid_max(0, nullptr) < 7)
+    {
+        return false;
+    }
+
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & bit_AVX2) != 0;
+}
+#endif
+
+#if NULLDRIVER_TRANSFORM_NEON
+static inline void NullDriverTransformNEON(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    const uint64_t incrementValues[2] = { kNullDriverTransformFooIncrement, kNullDriverTransformBarIncrement };
+    const uint64x2_t increment = vld1q_u64(incrementValues);
+    size_t index = 0;
+
+    if (stride == 2)
+    {
+        for (; index + 4 <= count; index += 4)
+        {
+            uint64x2_t pair0 = vld1q_u64(input + index * 2);
+            uint64x2_t pair1 = vld1q_u64(input + index * 2 + 2);
+            uint64x2_t pair2 = vld1q_u64(input + index * 2 + 4);
+            uint64x2_t pair3 = vld1q_u64(input + index * 2 + 6);
+            vst1q_u64(output + index * 2, vaddq_u64(pair0, increment));
+            vst1q_u64(output + index * 2 + 2, vaddq_u64(pair1, increment));
+            vst1q_u64(output + index * 2 + 4, vaddq_u64(pair2, increment));
+            vst1q_u64(output + index * 2 + 6, vaddq_u64(pair3, increment));
+        }
+    }
+
+    for (; index < count; ++index)
+    {
+        vst1q_u64(output + index * stride, vaddq_u64(vld1q_u64(input + index * stride), increment));
+    }
+}
+#endif
+
+// Returns the requested variant, or nullptr if this CPU can't run it.
+static inline NullDriverTransformFunction NullDriverTransformGetVariant(NullDriverTransformVariant variant)
+{
+    switch (variant)
+    {
+        case NullDriverTransformVariant_Scalar:
+        {
+            return NullDriverTransformScalar;
+        }
+
+#if NULLDRIVER_TRANSFORM_X86
+        case NullDriverTransformVariant_SSE2:
+        {
+            // SSE2 is part of the x86_64 baseline.
+            return NullDriverTransformSSE2;
+        }
+
+        case NullDriverTransformVariant_AVX2:
+        {
+            return NullDriverTransformCPUHasAVX2() ? NullDriverTransformAVX2 : nullptr;
+        }
+#endif
+
+#if NULLDRIVER_TRANSFORM_NEON
+        case NullDriverTransformVariant_NEON:
+        {
+            // NEON is part of the arm64 baseline.
+            return NullDriverTransformNEON;
+        }
+#endif
+
+        default:
+        {
+            return nullptr;
+        }
+    }
+}
+
+static inline const char* NullDriverTransformVariantName(NullDriverTransformVariant variant)
+{
+    static const char* const names[NumberOfNullDriverTransformVariants] = { "scalar", "sse2", "avx2", "neon" };
+
+    return (variant < NumberOfNullDriverTransformVariants) ? names[variant] : "unknown";
+}
+
+// Picks the fastest variant this CPU supports. The choice is made once and cached.
+// Two threads racing on the first call both store the same answer, so the cache needs no lock.
+static inline NullDriverTransformFunction NullDriverTransformBest(void)
+{
+    static NullDriverTransformFunction cachedFunction = nullptr;
+
+    NullDriverTransformFunction function = __atomic_load_n(&cachedFunction, __ATOMIC_RELAXED);
+    if (function == nullptr)
+    {
+        const NullDriverTransformVariant preferred[] = {
+            NullDriverTransformVariant_AVX2,
+            NullDriverTransformVariant_NEON,
+            NullDriverTransformVariant_SSE2,
+            NullDriverTransformVariant_Scalar,
+        };
+
+        for (size_t index = 0; (function == nullptr) && (index < sizeof(preferred) / sizeof(preferred[0])); ++index)
+        {
+            function = NullDriverTransformGetVariant(preferred[index]);
+        }
+
+        __atomic_store_n(&cachedFunction, function, __ATOMIC_RELAXED);
+    }
+
+    return function;
+}
+
+// Transforms pairs embedded every "stride" words, such as the foo and bar fields of an array of larger records.
+static inline void NullDriverTransformStrided(const uint64_t* input, uint64_t* output, size_t count, size_t stride)
+{
+    if (count < kNullDriverTransformVectorThreshold)
+    {
+        NullDriverTransformScalar(input, output, count, stride);
+        return;
+    }
+
+    NullDriverTransformBest()(input, output, count, stride);
+}
+
+// Transforms an array of "count" DataStructs. "input" and "output" may be the same array.
+static inline void NullDriverTransformDataStructs(const void* input, void* output, size_t count)
+{
+    NullDriverTransformStrided((const uint64_t*)input, (uint64_t*)output, count, 2);
+}
+
+#endif /* NullDriverTransform_h */